@@ -0,0 +1,17 @@
+# Runs clock_planner.py for the given sample rate and writes the plan to
+# OUT_DIR/audio_clock_config.h. Fails the configuration if the rate cannot
+# be generated by the nRF I2S and wm8904 clocks.
+function(generate_audio_clock_config SAMPLE_RATE OUT_DIR)
+  find_package(Python3 REQUIRED COMPONENTS Interpreter)
+  set(PLANNER ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/clock_planner.py)
+  file(MAKE_DIRECTORY ${OUT_DIR})
+  execute_process(
+    COMMAND ${Python3_EXECUTABLE} ${PLANNER} --rate ${SAMPLE_RATE} --output ${OUT_DIR}/audio_clock_config.h
+    RESULT_VARIABLE PLANNER_RESULT
+    ERROR_VARIABLE PLANNER_ERROR
+  )
+  if(NOT PLANNER_RESULT EQUAL 0)
+    message(FATAL_ERROR "No clock plan for AUDIO_SAMPLE_RATE=${SAMPLE_RATE}: ${PLANNER_ERROR}")
+  endif()
+  set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS ${PLANNER})
+endfunction()
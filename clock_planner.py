@@ -0,0 +1,181 @@
+#
+# Computes the nRF I2S and wm8904 clocking params for a target sample rate.
+# Prints the plan, or with --output, writes it to a C header. Exits with an
+# error if the rate cannot be generated within the tolerance or the clocks
+# would be out of range, which fails the build.
+#
+#   python3 clock_planner.py --rate 16000
+#   python3 clock_planner.py --rate 44100 --output audio_clock_config.h
+#
+
+import argparse
+import sys
+
+##########################
+# nRF clock config
+##########################
+NRF_I2S_MCK_SOURCE = 32_000_000
+# Dividers with an NRF_I2S_MCK_32MDIVn value
+NRF_I2S_MCK_32MDIVS = [2, 3, 4, 5, 6, 8, 10, 11, 15, 16, 21, 23, 30, 31, 32, 42, 63, 125]
+NRF_I2S_RATIOS = [32, 48, 64, 96, 128, 192, 256, 384, 512]
+n_channels = 2 # stereo
+bits_per_sample = 24 # NRF_I2S_SWIDTH_24BIT in i2s.c
+
+##########################
+# WM8904 clock config
+##########################
+# SAMPLE_RATE field of CLOCK_RATES_1, by nominal rate
+WM8904_SAMPLE_RATE_CODES = {8000: 0, 11025: 1, 12000: 1, 16000: 2, 22050: 3, 24000: 3, 32000: 4, 44100: 5, 48000: 5}
+# CLK_SYS_RATE field of CLOCK_RATES_1, by sysclk / fs ratio
+WM8904_CLK_SYS_RATE_CODES = {64: 0, 128: 1, 192: 2, 256: 3, 384: 4, 512: 5, 768: 6, 1024: 7, 1408: 8, 1536: 9}
+MIN_SYSCLK_FS_RATIO = 256 # 256fs is required if both ADC and DAC is enabled
+MIN_SYSCLK = 3_000_000
+MIN_F_VCO = 90_000_000
+MAX_F_VCO = 100_000_000
+MIN_FLL_OUT_DIV = 4
+MAX_FLL_OUT_DIV = 64
+MAX_FLL_F_REF = 13_500_000 # after FLL_CLK_REF_DIV
+
+
+def fail(message):
+    print("clock_planner.py: " + message, file=sys.stderr)
+    sys.exit(1)
+
+
+def plan_nrf(rate, tolerance):
+    candidates = []
+    for div in NRF_I2S_MCK_32MDIVS:
+        for ratio in NRF_I2S_RATIOS:
+            # LRCK is MCK / ratio and each frame needs 2 * SWIDTH bit clocks
+            if ratio % (n_channels * bits_per_sample) != 0:
+                continue
+            fs = NRF_I2S_MCK_SOURCE / (div * ratio)
+            candidates.append((abs(fs - rate) / rate, ratio, div, fs))
+    error, ratio, div, fs = min(candidates)
+    if error > tolerance:
+        fail("%d Hz is not possible with %d bit samples, the closest rate is %.3f Hz (%.2f%% off)"
+             % (rate, bits_per_sample, fs, 100 * error))
+    return div, ratio, fs, error
+
+
+def plan_wm8904(rate, fs):
+    if rate not in WM8904_SAMPLE_RATE_CODES:
+        fail("%d Hz is not a wm8904 sample rate, use one of %s" % (rate, sorted(WM8904_SAMPLE_RATE_CODES)))
+
+    # Smallest sysclk / fs ratio giving a valid sysclk
+    sysclk_ratio = next((r for r in sorted(WM8904_CLK_SYS_RATE_CODES)
+                         if r >= MIN_SYSCLK_FS_RATIO and r * fs >= MIN_SYSCLK), None)
+    if sysclk_ratio is None:
+        fail("no valid sysclk for %.3f Hz" % fs)
+    sysclk = sysclk_ratio * fs
+
+    # The FLL reference is the bit clock
+    f_ref = fs * n_channels * bits_per_sample
+    ref_div = next((d for d in [1, 2, 4, 8] if f_ref / d <= MAX_FLL_F_REF), None)
+    if ref_div is None:
+        fail("FLL reference %.0f Hz is too high" % f_ref)
+    f_ref /= ref_div
+    # FLL_FRATIO recommended for the reference frequency
+    fratio_code, fratio = next((code, ratio) for code, ratio, min_f_ref in
+                               [(0, 1, 1_000_000), (1, 2, 256_000), (2, 4, 128_000), (3, 8, 64_000), (4, 16, 0)]
+                               if f_ref >= min_f_ref)
+
+    # Smallest output divider putting the VCO in range
+    out_div = next((d for d in range(MIN_FLL_OUT_DIV, MAX_FLL_OUT_DIV + 1) if sysclk * d >= MIN_F_VCO), None)
+    if out_div is None or sysclk * out_div > MAX_F_VCO:
+        fail("no FLL_OUTDIV puts fVco in range for sysclk %.0f Hz" % sysclk)
+    f_vco = sysclk * out_div
+
+    nk = f_vco / (f_ref * fratio)
+    n = int(nk)
+    k = round((nk - n) * 65536)
+    if k == 65536:
+        n, k = n + 1, 0
+    f_out = f_ref * fratio * (n + k / 65536) / out_div
+
+    return {
+        "sysclk_ratio": sysclk_ratio,
+        "sysclk": sysclk,
+        "f_ref": f_ref,
+        "ref_div": ref_div,
+        "fratio": fratio,
+        "fratio_code": fratio_code,
+        "f_vco": f_vco,
+        "out_div": out_div,
+        "n": n,
+        "k": k,
+        "f_out": f_out,
+    }
+
+
+def print_plan(rate, div, ratio, fs, error, wm):
+    mclk = NRF_I2S_MCK_SOURCE / div
+    sclk = fs * n_channels * bits_per_sample
+    print("nRF clock config")
+    print("    NRF_I2S_MCK_32MDIV" + str(div))
+    print("    NRF_I2S_RATIO_" + str(ratio) + "X")
+    print("    MCLK " + str(mclk) + " Hz")
+    print("    SCLK " + str(sclk) + " Hz")
+    print("    fs   " + str(fs) + " Hz (%.2f%% from %d Hz)" % (100 * error, rate))
+    print("")
+    print("WM8904 FLL config")
+    print("    sysclk (%dfs) " % wm["sysclk_ratio"] + str(wm["sysclk"]) + " Hz")
+    print("    f_ref          " + str(wm["f_ref"]) + " Hz (FLL_CLK_REF_DIV " + str(wm["ref_div"]) + ")")
+    print("    f_vco          " + str(wm["f_vco"]) + " Hz")
+    print("    f_out          " + str(wm["f_out"]) + " Hz")
+    print("    N.K            %d + %d / 65536" % (wm["n"], wm["k"]))
+    print("    FLL_FRATIO     " + str(wm["fratio"]))
+    print("    FLL_OUT_DIV    " + str(wm["out_div"]))
+
+
+def write_header(path, rate, div, ratio, wm):
+    lines = [
+        "/* Generated by clock_planner.py --rate %d, do not edit */" % rate,
+        "#ifndef AUDIO_CLOCK_CONFIG_H",
+        "#define AUDIO_CLOCK_CONFIG_H",
+        "",
+        "#define AUDIO_SAMPLE_RATE_NOMINAL %d" % rate,
+        "",
+        "/* nRF I2S, fs = 32 MHz / (AUDIO_I2S_MCK_DIV * AUDIO_I2S_RATIO) */",
+        "#define AUDIO_I2S_MCK_DIV %d" % div,
+        "#define AUDIO_I2S_RATIO %d" % ratio,
+        "#define AUDIO_I2S_MCK_SETUP NRF_I2S_MCK_32MDIV%d" % div,
+        "#define AUDIO_I2S_RATIO_SETUP NRF_I2S_RATIO_%dX" % ratio,
+        "",
+        "/* The exact sample rate */",
+        "#define AUDIO_SAMPLE_RATE (%d.0f / (AUDIO_I2S_MCK_DIV * AUDIO_I2S_RATIO))" % NRF_I2S_MCK_SOURCE,
+        "",
+        "/* WM8904 FLL, fed by BCLK, and sysclk = WM8904_SYSCLK_RATIO * fs */",
+        "#define WM8904_SYSCLK_RATIO %d" % wm["sysclk_ratio"],
+        "#define WM8904_CLK_SYS_RATE_CODE %d" % WM8904_CLK_SYS_RATE_CODES[wm["sysclk_ratio"]],
+        "#define WM8904_SAMPLE_RATE_CODE %d" % WM8904_SAMPLE_RATE_CODES[rate],
+        "#define WM8904_FLL_CLK_REF_DIV_CODE %d" % [1, 2, 4, 8].index(wm["ref_div"]),
+        "#define WM8904_FLL_FRATIO_CODE %d" % wm["fratio_code"],
+        "#define WM8904_FLL_OUTDIV %d" % wm["out_div"],
+        "#define WM8904_FLL_N %d" % wm["n"],
+        "#define WM8904_FLL_K 0x%04x" % wm["k"],
+        "",
+        "#endif",
+        "",
+    ]
+    with open(path, "w") as f:
+        f.write("\n".join(lines))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--rate", type=int, default=44100, help="target sample rate in Hz")
+    parser.add_argument("--tolerance", type=float, default=0.01, help="max relative sample rate error")
+    parser.add_argument("--output", help="header to write the plan to")
+    args = parser.parse_args()
+
+    div, ratio, fs, error = plan_nrf(args.rate, args.tolerance)
+    wm = plan_wm8904(args.rate, fs)
+    if args.output:
+        write_header(args.output, args.rate, div, ratio, wm)
+    else:
+        print_plan(args.rate, div, ratio, fs, error, wm)
+
+
+if __name__ == "__main__":
+    main()
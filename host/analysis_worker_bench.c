@@ -0,0 +1,247 @@
+/*
+ * Host model of the deferred analysis tier in main.c, run on POSIX
+ * threads against the firmware's block queue (src/block_queue.c).
+ *
+ * A producer thread stands in for the audio thread. It wakes up once per
+ * period of the sample clock and pushes a block of a synthetic test signal
+ * (tone bursts in noise), like deferred_processing_cb does. A worker thread
+ * drains the queue through the demo app, like analysis_thread_entry_point.
+ * The worker can be slowed down with periodic stalls to model analysis
+ * hops that take longer than a period, and the clock can be sped up to
+ * model a slower CPU. The producer never waits for the worker.
+ *
+ * Checks that every block is either processed or counted as an overrun,
+ * that blocks arrive in order with gaps matching the dropped frames, and
+ * that the push cost of the audio thread does not depend on the analysis
+ * load. Also counts the blocks whose analysis took longer than a period,
+ * each of which would have been a dropout if the analysis ran on the
+ * audio thread.
+ *
+ *   analysis_worker_bench [-d seconds] [-s speed] [-t stall_ms] [-n stall_every_n_blocks]
+ */
+#include <microdsp_demos/microdsp_demos.h>
+
+#include <math.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audio_callbacks.h"
+#include "bench_util.h"
+#include "block_queue.h"
+
+#define SAMPLE_RATE 44444.444f
+#define BLOCK_N_FRAMES 256
+#define TONE_FREQUENCY 440.0f
+#define TONE_DURATION_S 0.5f
+#define SILENCE_DURATION_S 0.3f
+#define NOISE_AMPLITUDE 0.01f
+#define EVENT_BATCH_SIZE 8
+
+typedef struct {
+    /* Settings */
+    uint32_t block_count;
+    double speed;
+    uint64_t stall_ns;
+    uint32_t stall_interval;
+
+    void* app;
+    uint8_t rx_channel_mask;
+    block_queue_t queue;
+    sem_t ready;
+    volatile bool producer_done;
+
+    /* Producer results */
+    uint64_t max_push_ns;
+    uint64_t max_wakeup_late_ns;
+
+    /* Worker results */
+    uint32_t processed_count;
+    uint32_t out_of_order_count;
+    uint32_t gap_frame_count;
+    uint32_t event_count;
+    uint32_t slow_block_count;
+    uint64_t max_block_ns;
+} bench_t;
+
+static void busy_wait_ns(uint64_t duration)
+{
+    uint64_t end = now_ns() + duration;
+    while (now_ns() < end) {
+    }
+}
+
+static uint64_t period_ns(const bench_t* bench)
+{
+    return (uint64_t)(1e9 * BLOCK_N_FRAMES / SAMPLE_RATE / bench->speed);
+}
+
+static void* producer_thread(void* arg)
+{
+    bench_t* bench = arg;
+    float channel_buffers[AUDIO_MAX_CHANNELS][BLOCK_N_FRAMES];
+    const float* channels[AUDIO_MAX_CHANNELS];
+    for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+        channels[c] = channel_buffers[c];
+    }
+    uint32_t noise_state = 1;
+    uint32_t cycle_n_frames = (uint32_t)((TONE_DURATION_S + SILENCE_DURATION_S) * SAMPLE_RATE);
+    uint32_t tone_n_frames = (uint32_t)(TONE_DURATION_S * SAMPLE_RATE);
+
+    uint64_t start = now_ns();
+    for (uint32_t block = 0; block < bench->block_count; block++) {
+        /* Blocks are released once they have been received */
+        uint64_t release_time = start + (block + 1) * period_ns(bench);
+        sleep_until_ns(release_time);
+        uint64_t wakeup_time = now_ns();
+
+        uint32_t frame = block * BLOCK_N_FRAMES;
+        for (int i = 0; i < BLOCK_N_FRAMES; i++) {
+            uint32_t t = (frame + i) % cycle_n_frames;
+            float x = NOISE_AMPLITUDE * next_noise(&noise_state);
+            if (t < tone_n_frames) {
+                x += 0.5f * sinf(2.0f * (float)M_PI * TONE_FREQUENCY * t / SAMPLE_RATE);
+            }
+            for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+                channel_buffers[c][i] = x;
+            }
+        }
+
+        uint64_t push_start = now_ns();
+        if (block_queue_push(&bench->queue, channels, BLOCK_N_FRAMES, frame)) {
+            sem_post(&bench->ready);
+        }
+        uint64_t push_ns = now_ns() - push_start;
+        if (push_ns > bench->max_push_ns) {
+            bench->max_push_ns = push_ns;
+        }
+        if (wakeup_time - release_time > bench->max_wakeup_late_ns) {
+            bench->max_wakeup_late_ns = wakeup_time - release_time;
+        }
+    }
+    bench->producer_done = true;
+    sem_post(&bench->ready);
+    return NULL;
+}
+
+static void* worker_thread(void* arg)
+{
+    bench_t* bench = arg;
+    float* tx[AUDIO_MAX_CHANNELS] = { NULL };
+    uint32_t expected_timestamp = 0;
+    while (true) {
+        sem_wait(&bench->ready);
+        audio_block_t block;
+        while (block_queue_peek(&bench->queue, &block)) {
+            uint64_t start = now_ns();
+            demo_app_process_channels(bench->app, tx, block.channels, block.frame_count);
+            app_event_t events[EVENT_BATCH_SIZE];
+            uint32_t event_count;
+            while ((event_count = demo_app_take_events(bench->app, events, EVENT_BATCH_SIZE)) > 0) {
+                bench->event_count += event_count;
+            }
+            bench->processed_count++;
+            if (bench->stall_interval > 0 && bench->processed_count % bench->stall_interval == 0) {
+                busy_wait_ns(bench->stall_ns);
+            }
+            uint64_t block_ns = now_ns() - start;
+            if (block_ns > bench->max_block_ns) {
+                bench->max_block_ns = block_ns;
+            }
+            if (block_ns > period_ns(bench)) {
+                bench->slow_block_count++;
+            }
+
+            /* Blocks come in order, skipping only dropped ones */
+            int32_t gap = (int32_t)(block.timestamp - expected_timestamp);
+            if (gap < 0 || gap % BLOCK_N_FRAMES != 0) {
+                bench->out_of_order_count++;
+            } else {
+                bench->gap_frame_count += gap;
+            }
+            expected_timestamp = block.timestamp + block.frame_count;
+            block_queue_release(&bench->queue);
+        }
+        if (bench->producer_done && block_queue_depth(&bench->queue) == 0) {
+            return NULL;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench_t bench = {
+        .speed = 1.0,
+    };
+    double duration_s = 10.0;
+    double stall_ms = 0.0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:s:t:n:")) != -1) {
+        switch (opt) {
+        case 'd':
+            duration_s = atof(optarg);
+            break;
+        case 's':
+            bench.speed = atof(optarg);
+            break;
+        case 't':
+            stall_ms = atof(optarg);
+            break;
+        case 'n':
+            bench.stall_interval = (uint32_t)atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-d seconds] [-s speed] [-t stall_ms] [-n stall_every_n_blocks]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (stall_ms > 0 && bench.stall_interval == 0) {
+        bench.stall_interval = 100;
+    }
+    bench.stall_ns = (uint64_t)(1e6 * stall_ms);
+    bench.block_count = (uint32_t)(duration_s * SAMPLE_RATE / BLOCK_N_FRAMES);
+
+    bench.app = demo_app_create(SAMPLE_RATE);
+    if (demo_app_tx_channel_mask(bench.app) != 0) {
+        fprintf(stderr, "the demo app has tx channels, so it runs on the audio thread\n");
+        return 1;
+    }
+    bench.rx_channel_mask = demo_app_rx_channel_mask(bench.app);
+    if (!block_queue_init(&bench.queue, BLOCK_N_FRAMES, bench.rx_channel_mask)) {
+        fprintf(stderr, "blocks do not fit in the queue pool\n");
+        return 1;
+    }
+    sem_init(&bench.ready, 0, 0);
+
+    pthread_t producer, worker;
+    pthread_create(&worker, NULL, worker_thread, &bench);
+    pthread_create(&producer, NULL, producer_thread, &bench);
+    pthread_join(producer, NULL);
+    pthread_join(worker, NULL);
+
+    block_queue_stats_t stats;
+    block_queue_stats(&bench.queue, &stats);
+    printf("%u blocks of %u frames at %.1fx real time, %u slots, period %.3f ms\n",
+        bench.block_count, BLOCK_N_FRAMES, bench.speed, bench.queue.slot_count, period_ns(&bench) / 1e6);
+    printf("  audio thread: max push %.1f us, max wakeup lateness %.3f ms\n",
+        bench.max_push_ns / 1e3, bench.max_wakeup_late_ns / 1e6);
+    printf("  worker: %u blocks processed, max %.3f ms per block, %u longer than a period, %u events\n",
+        bench.processed_count, bench.max_block_ns / 1e6, bench.slow_block_count, bench.event_count);
+    printf("  queue: %u pushed, %u overruns (%u frames dropped), max depth %u\n",
+        stats.pushed_count, stats.overrun_count, stats.dropped_frame_count, stats.max_depth);
+
+    bool ok = true;
+    ok &= check(stats.pushed_count + stats.overrun_count == bench.block_count, "every block is pushed or counted as an overrun");
+    ok &= check(bench.processed_count == stats.pushed_count, "every pushed block is processed");
+    ok &= check(bench.out_of_order_count == 0, "blocks are processed in order");
+    ok &= check(bench.gap_frame_count == stats.dropped_frame_count, "timestamp gaps match the dropped frames");
+    ok &= check(stats.max_depth <= bench.queue.slot_count, "depth within capacity");
+    printf("\n%s\n", ok ? "all checks passed" : "some checks FAILED");
+    return ok ? 0 : 1;
+}
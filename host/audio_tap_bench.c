@@ -0,0 +1,212 @@
+/*
+ * Host model of the audio tap (src/audio_tap.c) and its UART drain thread
+ * (src/audio_tap_uart.c), on POSIX threads.
+ *
+ * A producer thread stands in for the audio thread. It wakes up once per
+ * period of the sample clock and pushes a block of each enabled source, like
+ * tap_block in main.c does. A drain thread writes the frames to a file or
+ * pipe, paced to the byte rate of a UART with the given baud rate (8N1, so
+ * 10 bits per byte). The producer never waits for the drain thread.
+ *
+ * The test signals are a 440 Hz tone in noise (rx left), a 1 kHz tone
+ * (tx left) and a slow sweep (app). Checks that every offered block is
+ * either sent or counted as dropped and reports the cost of a push. Pipe
+ * the output into host/audio_tap_receive.py to check the frames and
+ * write WAV files:
+ *
+ *   audio_tap_bench -o - | python3 host/audio_tap_receive.py -o tap -
+ *
+ *   audio_tap_bench [-d seconds] [-b baud] [-m source_mask] [-o file]
+ */
+#include <math.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* The frames may go to stdout */
+#define CHECK_OUTPUT stderr
+#include "bench_util.h"
+#include "audio_tap.h"
+
+#define SAMPLE_RATE 44444.444f
+#define BLOCK_N_FRAMES 256
+#define NOISE_AMPLITUDE 0.01f
+
+typedef struct {
+    /* Settings */
+    uint32_t block_count;
+    uint32_t baud_rate;
+    uint32_t source_mask;
+    FILE* output;
+
+    audio_tap_t tap;
+    sem_t ready;
+    volatile bool producer_done;
+
+    /* Producer results */
+    uint32_t offered_count;
+    uint64_t total_push_ns;
+    uint64_t max_push_ns;
+
+    /* Drain results */
+    uint64_t write_start_ns;
+    uint64_t written_byte_count;
+} bench_t;
+
+static uint64_t period_ns(void)
+{
+    return (uint64_t)(1e9 * BLOCK_N_FRAMES / SAMPLE_RATE);
+}
+
+static void* producer_thread(void* arg)
+{
+    bench_t* bench = arg;
+    float signals[AUDIO_TAP_SOURCE_COUNT][BLOCK_N_FRAMES] = { { 0 } };
+    uint32_t noise_state = 1;
+    float sweep_phase = 0.0f;
+
+    uint64_t start = now_ns();
+    for (uint32_t block = 0; block < bench->block_count; block++) {
+        sleep_until_ns(start + (block + 1) * period_ns());
+
+        uint32_t frame = block * BLOCK_N_FRAMES;
+        for (int i = 0; i < BLOCK_N_FRAMES; i++) {
+            float t = (frame + i) / SAMPLE_RATE;
+            signals[AUDIO_TAP_RX_LEFT][i] = 0.5f * sinf(2.0f * (float)M_PI * 440.0f * t) + NOISE_AMPLITUDE * next_noise(&noise_state);
+            signals[AUDIO_TAP_TX_LEFT][i] = 0.25f * sinf(2.0f * (float)M_PI * 1000.0f * t);
+            /* 100 Hz to 5 kHz and back every 4 s */
+            float sweep_frequency = 100.0f + 4900.0f * (0.5f - 0.5f * cosf(2.0f * (float)M_PI * t / 4.0f));
+            sweep_phase = fmodf(sweep_phase + 2.0f * (float)M_PI * sweep_frequency / SAMPLE_RATE, 2.0f * (float)M_PI);
+            signals[AUDIO_TAP_APP][i] = 0.5f * sinf(sweep_phase);
+        }
+
+        uint64_t push_start = now_ns();
+        bool pushed = false;
+        for (int source = 0; source < AUDIO_TAP_SOURCE_COUNT; source++) {
+            if (bench->source_mask & AUDIO_TAP_SOURCE_BIT(source)) {
+                pushed |= audio_tap_push(&bench->tap, (audio_tap_source_t)source, signals[source], BLOCK_N_FRAMES, frame);
+                bench->offered_count++;
+            }
+        }
+        if (pushed) {
+            sem_post(&bench->ready);
+        }
+        uint64_t push_ns = now_ns() - push_start;
+        bench->total_push_ns += push_ns;
+        if (push_ns > bench->max_push_ns) {
+            bench->max_push_ns = push_ns;
+        }
+    }
+    bench->producer_done = true;
+    sem_post(&bench->ready);
+    return NULL;
+}
+
+static void* drain_thread(void* arg)
+{
+    bench_t* bench = arg;
+    bench->write_start_ns = now_ns();
+    while (true) {
+        sem_wait(&bench->ready);
+        const uint8_t* frame;
+        size_t size;
+        while ((size = audio_tap_peek(&bench->tap, &frame)) > 0) {
+            fwrite(frame, 1, size, bench->output);
+            fflush(bench->output);
+            bench->written_byte_count += size;
+            /* Hold on to the slot for as long as the UART would take to send it */
+            if (bench->baud_rate > 0) {
+                sleep_until_ns(bench->write_start_ns + bench->written_byte_count * 10 * 1000000000ull / bench->baud_rate);
+            }
+            audio_tap_release(&bench->tap);
+        }
+        if (bench->producer_done) {
+            return NULL;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench_t bench = {
+        .baud_rate = 1000000,
+        .source_mask = AUDIO_TAP_SOURCE_BIT(AUDIO_TAP_RX_LEFT),
+    };
+    double duration_s = 5.0;
+    const char* output_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:b:m:o:")) != -1) {
+        switch (opt) {
+        case 'd':
+            duration_s = atof(optarg);
+            break;
+        case 'b':
+            bench.baud_rate = (uint32_t)atoi(optarg);
+            break;
+        case 'm':
+            bench.source_mask = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            output_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-d seconds] [-b baud] [-m source_mask] [-o file]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (output_path == NULL || strcmp(output_path, "-") == 0) {
+        bench.output = output_path ? stdout : fopen("/dev/null", "wb");
+    } else {
+        bench.output = fopen(output_path, "wb");
+    }
+    if (bench.output == NULL) {
+        fprintf(stderr, "could not open %s\n", output_path);
+        return 1;
+    }
+    bench.block_count = (uint32_t)(duration_s * SAMPLE_RATE / BLOCK_N_FRAMES);
+
+    if (!audio_tap_init(&bench.tap, BLOCK_N_FRAMES, (uint32_t)(SAMPLE_RATE + 0.5f))) {
+        fprintf(stderr, "frames do not fit in the tap pool\n");
+        return 1;
+    }
+    audio_tap_set_sources(&bench.tap, bench.source_mask);
+    sem_init(&bench.ready, 0, 0);
+
+    pthread_t producer, drain;
+    pthread_create(&drain, NULL, drain_thread, &bench);
+    pthread_create(&producer, NULL, producer_thread, &bench);
+    pthread_join(producer, NULL);
+    pthread_join(drain, NULL);
+    uint64_t elapsed_ns = now_ns() - bench.write_start_ns;
+    if (bench.output != stdout) {
+        fclose(bench.output);
+    }
+
+    audio_tap_stats_t stats;
+    audio_tap_stats(&bench.tap, &stats);
+    /* The report goes to stderr, since the frames may go to stdout */
+    fprintf(stderr, "%u blocks of %u frames, sources 0x%02x, %u baud, %u slots of %u bytes\n",
+        bench.block_count, BLOCK_N_FRAMES, bench.source_mask, bench.baud_rate,
+        bench.tap.slot_count, bench.tap.slot_size);
+    fprintf(stderr, "  producer: %u blocks offered, mean %.1f us and max %.1f us per period to push\n",
+        bench.offered_count, bench.total_push_ns / 1e3 / bench.block_count, bench.max_push_ns / 1e3);
+    fprintf(stderr, "  tap: %u pushed, %u dropped (%u frames), max depth %u\n",
+        stats.pushed_count, stats.dropped_count, stats.dropped_frame_count, stats.max_depth);
+    fprintf(stderr, "  transport: %u frames, %u bytes, %.1f KB/s\n",
+        stats.sent_count, stats.sent_byte_count, stats.sent_byte_count / (elapsed_ns / 1e9) / 1e3);
+
+    bool ok = true;
+    ok &= check(stats.pushed_count + stats.dropped_count == bench.offered_count, "every block is pushed or counted as dropped");
+    ok &= check(stats.sent_count == stats.pushed_count, "every pushed frame is sent");
+    ok &= check(stats.sent_byte_count == bench.written_byte_count, "sent bytes are counted");
+    ok &= check(stats.max_depth <= bench.tap.slot_count, "depth within capacity");
+    fprintf(stderr, "\n%s\n", ok ? "all checks passed" : "some checks FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+#
+# Receives the audio tap stream (see src/audio_tap.h) and writes a WAV file
+# per source. Reads from a file, a pipe ("-" for stdin), the pty of a
+# native_posix UART or a serial port. Frames with a bad CRC are skipped,
+# as is anything between frames, e.g console output on a shared UART.
+# Gaps in the sequence numbers are reported as lost frames, and lost audio
+# is filled with silence, using the frame timestamps.
+#
+#   python3 host/audio_tap_receive.py -o tap /dev/ttyUSB0 -b 1000000
+#   audio_tap_bench -o - | python3 host/audio_tap_receive.py -o tap -
+#
+
+import argparse
+import struct
+import sys
+import wave
+
+SYNC = b'\x5a\xa5' # AUDIO_TAP_SYNC, little endian
+HEADER_FORMAT = '<HBBHHII'
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+CRC_SIZE = 2
+FORMAT_S16 = 1
+SOURCE_NAMES = ['rx_left', 'rx_right', 'tx_left', 'tx_right', 'app']
+# Longest frame the receiver accepts, to resync quickly after garbage
+MAX_FRAME_COUNT = 4096
+
+
+def crc16(data):
+    # CRC-16/CCITT-FALSE
+    crc = 0xffff
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xffff
+    return crc
+
+
+class SourceWriter:
+    def __init__(self, path, sample_rate):
+        self.path = path
+        self.wav = wave.open(path, 'wb')
+        self.wav.setnchannels(1)
+        self.wav.setsampwidth(2)
+        self.wav.setframerate(sample_rate)
+        self.next_timestamp = None
+        self.frame_count = 0
+        self.silence_frame_count = 0
+
+    def write(self, timestamp, payload, frame_count):
+        if self.next_timestamp is not None:
+            gap = (timestamp - self.next_timestamp) & 0xffffffff
+            # Fill lost blocks with silence. Anything else, e.g a timestamp
+            # going backwards after a reset, just continues the file.
+            if 0 < gap < 0x80000000:
+                self.wav.writeframes(b'\x00\x00' * gap)
+                self.silence_frame_count += gap
+        self.wav.writeframes(payload)
+        self.frame_count += frame_count
+        self.next_timestamp = (timestamp + frame_count) & 0xffffffff
+
+    def close(self):
+        self.wav.close()
+
+
+class Receiver:
+    def __init__(self, output_prefix, verbose):
+        self.output_prefix = output_prefix
+        self.verbose = verbose
+        self.buffer = bytearray()
+        self.writers = {}
+        self.next_sequence = None
+        self.frame_count = 0
+        self.lost_frame_count = 0
+        self.crc_error_count = 0
+        self.skipped_byte_count = 0
+
+    def feed(self, data):
+        self.buffer += data
+        while True:
+            start = self.buffer.find(SYNC)
+            if start < 0:
+                # Keep a possible first sync byte
+                keep = 1 if self.buffer[-1:] == SYNC[:1] else 0
+                self.skipped_byte_count += len(self.buffer) - keep
+                del self.buffer[:len(self.buffer) - keep]
+                return
+            if start > 0:
+                self.skipped_byte_count += start
+                del self.buffer[:start]
+            if len(self.buffer) < HEADER_SIZE:
+                return
+            _, source, sample_format, sequence, frame_count, timestamp, sample_rate = struct.unpack_from(HEADER_FORMAT, self.buffer)
+            if frame_count > MAX_FRAME_COUNT or sample_format != FORMAT_S16:
+                self.resync()
+                continue
+            size = HEADER_SIZE + 2 * frame_count + CRC_SIZE
+            if len(self.buffer) < size:
+                return
+            frame = bytes(self.buffer[:size])
+            (crc,) = struct.unpack_from('<H', frame, size - CRC_SIZE)
+            if crc16(frame[2:size - CRC_SIZE]) != crc:
+                self.crc_error_count += 1
+                self.resync()
+                continue
+            del self.buffer[:size]
+            self.handle_frame(source, sequence, frame_count, timestamp, sample_rate, frame[HEADER_SIZE:size - CRC_SIZE])
+
+    def resync(self):
+        # Not a frame after all, look for the next sync word
+        self.skipped_byte_count += 1
+        del self.buffer[:1]
+
+    def handle_frame(self, source, sequence, frame_count, timestamp, sample_rate, payload):
+        if self.next_sequence is not None and sequence != self.next_sequence:
+            lost = (sequence - self.next_sequence) & 0xffff
+            self.lost_frame_count += lost
+            if self.verbose:
+                print(f'lost {lost} frames before sequence number {sequence}')
+        self.next_sequence = (sequence + 1) & 0xffff
+        self.frame_count += 1
+
+        writer = self.writers.get(source)
+        if writer is None:
+            name = SOURCE_NAMES[source] if source < len(SOURCE_NAMES) else f'source{source}'
+            writer = SourceWriter(f'{self.output_prefix}_{name}.wav', sample_rate)
+            self.writers[source] = writer
+        writer.write(timestamp, payload, frame_count)
+
+    def close(self):
+        for writer in self.writers.values():
+            writer.close()
+
+    def print_summary(self):
+        print(f'{self.frame_count} frames received, {self.lost_frame_count} lost, '
+              f'{self.crc_error_count} CRC errors, {self.skipped_byte_count} bytes skipped')
+        for source, writer in sorted(self.writers.items()):
+            print(f'  {writer.path}: {writer.frame_count} frames, '
+                  f'{writer.silence_frame_count} frames of silence for lost audio')
+
+
+def open_input(path, baud_rate):
+    if path == '-':
+        return sys.stdin.buffer
+    if baud_rate:
+        import serial # pyserial
+        return serial.Serial(path, baud_rate, timeout=0.1)
+    return open(path, 'rb', buffering=0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Writes the audio tap stream to WAV files')
+    parser.add_argument('input', help='File, pipe, pty or serial port to read from, - for stdin')
+    parser.add_argument('-o', '--output', default='tap', help='Prefix of the WAV files, e.g tap gives tap_rx_left.wav')
+    parser.add_argument('-b', '--baud', type=int, help='Open input as a serial port with this baud rate (needs pyserial)')
+    parser.add_argument('-d', '--duration', type=float, help='Stop after this many seconds of audio of any source')
+    parser.add_argument('-v', '--verbose', action='store_true', help='Print every gap in the sequence numbers')
+    args = parser.parse_args()
+
+    receiver = Receiver(args.output, args.verbose)
+    stream = open_input(args.input, args.baud)
+    try:
+        while True:
+            data = stream.read(4096)
+            if data is None:
+                continue
+            if not data:
+                if args.baud:
+                    continue
+                break
+            receiver.feed(data)
+            if args.duration and any(w.frame_count + w.silence_frame_count >= args.duration * w.wav.getframerate()
+                                     for w in receiver.writers.values()):
+                break
+    except KeyboardInterrupt:
+        pass
+    receiver.close()
+    receiver.print_summary()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,59 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Helpers shared by the host benches. Failed checks are reported on
+   CHECK_OUTPUT, which a bench that writes data to stdout can define as
+   stderr before including this. */
+
+#ifndef CHECK_OUTPUT
+#define CHECK_OUTPUT stdout
+#endif
+
+/* The clock sleep_until_ns sleeps on, so that deadlines can be computed
+   from now_ns */
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline void sleep_until_ns(uint64_t t)
+{
+    struct timespec ts = { .tv_sec = t / 1000000000ull, .tv_nsec = t % 1000000000ull };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+    }
+}
+
+static inline bool check(bool condition, const char* description)
+{
+    if (!condition) {
+        fprintf(CHECK_OUTPUT, "FAILED: %s\n", description);
+    }
+    return condition;
+}
+
+/* check for benches that run the same checks on several subjects, e.g
+   filters or codecs */
+static inline bool check_for(bool condition, const char* subject, const char* description)
+{
+    if (!condition) {
+        fprintf(CHECK_OUTPUT, "FAILED: %s: %s\n", subject, description);
+    }
+    return condition;
+}
+
+/* Uniform noise in [-1, 1) from a linear congruential generator, the same
+   sequence for the same seed on every host */
+static inline float next_noise(uint32_t* state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return (float)(*state >> 8) / (float)(1u << 23) - 1.0f;
+}
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * Startup time and bus traffic of the WM8904 initialisation, measured on
+ * the mock bus in wm8904_mock.c.
+ *
+ * Runs wm8904_init and checks that every register ends up with the last
+ * value the init sequence writes to it, then checks that runtime
+ * read-modify-write updates go through the register cache without bus
+ * reads, and that gain changes ramp one code at a time with left and right
+ * written together. For comparison, also prints the cost of the same sequence sent
+ * the way the driver used to send it: one write and two byte read back per
+ * register and fixed sleeps instead of polls.
+ *
+ *   codec_init_bench [-v] [-f fll_lock_ms] [-d dc_servo_ms] [-k bus_khz]
+ */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "codecs/wm8904.h"
+#include "wm8904_mock.h"
+
+int main(int argc, char** argv)
+{
+    wm8904_mock_t mock;
+    wm8904_bus_t bus;
+    wm8904_mock_init(&mock, &bus);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "vf:d:k:")) != -1) {
+        switch (opt) {
+        case 'v':
+            mock.log = stdout;
+            break;
+        case 'f':
+            mock.fll_lock_delay_us = (int32_t)(1000 * atof(optarg));
+            break;
+        case 'd':
+            mock.dcs_startup_delay_us = (int32_t)(1000 * atof(optarg));
+            break;
+        case 'k':
+            mock.bus_frequency_hz = (uint32_t)(1000 * atof(optarg));
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-v] [-f fll_lock_ms] [-d dc_servo_ms] [-k bus_khz]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    bool ok = true;
+    ok &= check(wm8904_init(&bus) == 0, "wm8904_init returned 0");
+
+    /* Every register written by the sequence should have its last value */
+    uint16_t expected[WM8904_REG_COUNT];
+    bool expected_written[WM8904_REG_COUNT] = { false };
+    uint32_t sequence_write_count = 0;
+    uint64_t sequence_sleep_us = 0;
+    for (size_t i = 0; i < wm8904_init_sequence_len; i++) {
+        const wm8904_op_t* op = &wm8904_init_sequence[i];
+        if (op->type == WM8904_OP_WRITE) {
+            expected[op->reg] = op->value;
+            expected_written[op->reg] = true;
+            sequence_write_count++;
+        } else {
+            sequence_sleep_us += 1000u * op->time_ms;
+        }
+    }
+    for (int reg = 0; reg < WM8904_REG_COUNT; reg++) {
+        if (expected_written[reg] != mock.written[reg]
+            || (expected_written[reg] && expected[reg] != mock.regs[reg])) {
+            printf("R%d 0x%02x is 0x%04x, expected 0x%04x\n", reg, reg, mock.regs[reg], expected[reg]);
+            ok &= check(false, "register state after init");
+        }
+    }
+
+    /* The legacy driver wrote every register in its own transaction with a
+       two byte read back, and read the device id once */
+    uint32_t legacy_write_count = 1 + sequence_write_count;
+    uint32_t legacy_transaction_count = legacy_write_count + 1;
+    uint64_t legacy_bus_time_us
+        = legacy_write_count * (wm8904_mock_transfer_time_us(&mock, 3) + wm8904_mock_transfer_time_us(&mock, 2))
+        + wm8904_mock_transfer_time_us(&mock, 1) + wm8904_mock_transfer_time_us(&mock, 2);
+
+    printf("%-22s %12s %12s\n", "", "legacy", "current");
+    printf("%-22s %12u %12u\n", "transactions", legacy_transaction_count, mock.write_count + mock.read_count);
+    printf("%-22s %12u %12u\n", "  writes", legacy_write_count, mock.write_count);
+    printf("%-22s %12u %12u\n", "  reads", 1, mock.read_count);
+    printf("%-22s %12u %12u\n", "register writes", legacy_write_count, mock.register_write_count);
+    printf("%-22s %12.2f %12.2f\n", "bus time (ms)", legacy_bus_time_us / 1000.0, mock.bus_time_us / 1000.0);
+    printf("%-22s %12.2f %12.2f\n", "sleep time (ms)", sequence_sleep_us / 1000.0, mock.sleep_time_us / 1000.0);
+    printf("%-22s %12.2f %12.2f\n", "startup time (ms)",
+        (legacy_bus_time_us + sequence_sleep_us) / 1000.0, mock.time_us / 1000.0);
+    /* Reads are polls of status registers, apart from the device id */
+    ok &= check(mock.write_count < legacy_write_count, "fewer write transactions than legacy");
+    ok &= check(mock.time_us <= legacy_bus_time_us + sequence_sleep_us, "no slower than legacy");
+
+    /* Runtime gain changes cost one write and no reads, and writing the
+       current value again costs nothing */
+    wm8904_mock_reset_stats(&mock);
+    ok &= check(wm8904_update_bits(WM8904_ADC_DIGITAL_VOLUME_LEFT, 0xff, 0xa0) == 0, "update_bits returned 0");
+    ok &= check(mock.read_count == 0 && mock.write_count == 1, "update_bits is a single write");
+    ok &= check(mock.regs[WM8904_ADC_DIGITAL_VOLUME_LEFT] == 0xa0, "update_bits value");
+    wm8904_mock_reset_stats(&mock);
+    ok &= check(wm8904_update_bits(WM8904_ADC_DIGITAL_VOLUME_LEFT, 0xff, 0xa0) == 0, "update_bits returned 0");
+    ok &= check(mock.read_count == 0 && mock.write_count == 0, "redundant update_bits is skipped");
+
+    /* The init sequence leaves the headphone output at 0 dB, code 57 */
+    const wm8904_gain_t* headphone = &wm8904_gains[WM8904_GAIN_HEADPHONE];
+    wm8904_mock_reset_stats(&mock);
+    uint64_t ramp_start_us = mock.time_us;
+    ok &= check(wm8904_set_gain(WM8904_GAIN_HEADPHONE, 40) == 0, "set_gain returned 0");
+    uint64_t ramp_us = mock.time_us - ramp_start_us;
+    ok &= check(mock.read_count == 0 && mock.write_count == 17 && mock.register_write_count == 34,
+                "one two register write per ramp step");
+    ok &= check(ramp_us >= 17u * WM8904_GAIN_RAMP_STEP_US, "ramp paced");
+    ok &= check((mock.regs[headphone->left_reg] & headphone->code_mask) == 40
+                && mock.regs[headphone->right_reg] == (40 | headphone->update_bit), "gain after the ramp");
+    uint16_t code = 0;
+    ok &= check(wm8904_get_gain(WM8904_GAIN_HEADPHONE, &code) == 0 && code == 40, "get_gain");
+    ok &= check(wm8904_set_gain(WM8904_GAIN_HEADPHONE, headphone->max_code + 1) == -EINVAL, "out of range gain rejected");
+    ok &= check(wm8904_find_gain("line") == WM8904_GAIN_LINE_OUT && wm8904_find_gain("volume") == -1, "find_gain");
+    /* The update_bits above left the ADC sides apart */
+    const wm8904_gain_t* adc = &wm8904_gains[WM8904_GAIN_ADC];
+    ok &= check(wm8904_set_gain(WM8904_GAIN_ADC, 0xa0) == 0
+                && (mock.regs[adc->right_reg] & adc->code_mask) == 0xa0, "set_gain brings both sides to the code");
+    printf("%-22s %12s %12.2f\n", "gain ramp 57 to 40 (ms)", "", ramp_us / 1000.0);
+
+    printf("\n%s\n", ok ? "all checks passed" : "some checks FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+/*
+ * Cost of calling a demo app through its registry vtable, compared with
+ * the demo_app_* functions of a single demo build, which C calls
+ * directly.
+ *
+ * Both paths drive the same app, alternating in rounds of blocks so that
+ * they see similar app state and caches, and the best round of each is
+ * reported. The per call overhead is measured separately on
+ * take_events with no events pending, which does next to no work. The
+ * app is created through the registry, which firmware images do in any
+ * case. Also checks that the vtable describes the same app as the direct
+ * functions, and that the app stays within its arena budget.
+ *
+ *   demo_dispatch_bench [-r rounds] [-b blocks_per_round]
+ */
+#include <microdsp_demos/microdsp_demos.h>
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audio_callbacks.h"
+#include "bench_util.h"
+
+#define SAMPLE_RATE 44444.444f
+#define BLOCK_N_FRAMES 256
+#define CALL_COUNT 100000
+
+typedef enum {
+    PATH_DIRECT,
+    PATH_VTABLE,
+    PATH_COUNT,
+} path_t;
+
+static const char* path_names[PATH_COUNT] = { "direct", "vtable" };
+
+int main(int argc, char** argv)
+{
+    int round_count = 50;
+    int blocks_per_round = 20;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:b:")) != -1) {
+        switch (opt) {
+        case 'r':
+            round_count = atoi(optarg);
+            break;
+        case 'b':
+            blocks_per_round = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r rounds] [-b blocks_per_round]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (round_count < 1 || blocks_per_round < 1) {
+        fprintf(stderr, "needs at least one round of one block\n");
+        return 1;
+    }
+
+    bool ok = true;
+    ok &= check(demo_registry_abi_version() == DEMO_APP_ABI_VERSION, "ABI version");
+    ok &= check(demo_registry_count() == 1, "a single demo build registers one demo");
+    const demo_app_vtable_t* vtable = demo_registry_get(0);
+    if (vtable == NULL) {
+        return 1;
+    }
+    ok &= check(vtable->abi_version == DEMO_APP_ABI_VERSION && vtable->size == sizeof(demo_app_vtable_t), "vtable version and size");
+    ok &= check(demo_registry_find(vtable->name) == vtable, "demo found by name");
+
+    void* app = demo_registry_create(vtable, SAMPLE_RATE);
+    if (!check(app != NULL, "app created")) {
+        return 1;
+    }
+    allocator_stats_t allocator_stats;
+    demo_app_allocator_stats(&allocator_stats);
+    ok &= check(allocator_stats.used <= vtable->arena_budget, "arena use within budget");
+    uint8_t rx_channel_mask = demo_app_rx_channel_mask(app);
+    uint8_t tx_channel_mask = demo_app_tx_channel_mask(app);
+    ok &= check(vtable->rx_channel_mask == rx_channel_mask && vtable->tx_channel_mask == tx_channel_mask, "vtable channel masks");
+
+    float rx_buffers[AUDIO_MAX_CHANNELS][BLOCK_N_FRAMES];
+    float tx_buffers[AUDIO_MAX_CHANNELS][BLOCK_N_FRAMES];
+    const float* rx[AUDIO_MAX_CHANNELS];
+    float* tx[AUDIO_MAX_CHANNELS];
+    for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+        rx[c] = rx_channel_mask & (1 << c) ? rx_buffers[c] : NULL;
+        tx[c] = tx_channel_mask & (1 << c) ? tx_buffers[c] : NULL;
+    }
+
+    /* Blocks of a 440 Hz tone, alternating between the paths in rounds */
+    uint64_t best_round_ns[PATH_COUNT] = { UINT64_MAX, UINT64_MAX };
+    uint32_t frame = 0;
+    uint32_t event_count = 0;
+    for (int round = 0; round < round_count; round++) {
+        for (int path = 0; path < PATH_COUNT; path++) {
+            uint64_t round_ns = 0;
+            for (int block = 0; block < blocks_per_round; block++) {
+                for (int i = 0; i < BLOCK_N_FRAMES; i++) {
+                    float x = 0.5f * sinf(2.0f * (float)M_PI * 440.0f * (frame + i) / SAMPLE_RATE);
+                    for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+                        rx_buffers[c][i] = x;
+                    }
+                }
+                frame += BLOCK_N_FRAMES;
+                memset(tx_buffers, 0, sizeof(tx_buffers));
+
+                app_event_t events[8];
+                uint64_t start = now_ns();
+                if (path == PATH_DIRECT) {
+                    demo_app_process_channels(app, tx, rx, BLOCK_N_FRAMES);
+                    event_count += demo_app_take_events(app, events, 8);
+                } else {
+                    vtable->process_channels(app, tx, rx, BLOCK_N_FRAMES);
+                    event_count += vtable->take_events(app, events, 8);
+                }
+                round_ns += now_ns() - start;
+            }
+            if (round_ns < best_round_ns[path]) {
+                best_round_ns[path] = round_ns;
+            }
+        }
+    }
+
+    /* Calls that return right away, so that the call itself dominates */
+    uint64_t best_call_ns[PATH_COUNT] = { UINT64_MAX, UINT64_MAX };
+    app_event_t event;
+    for (int round = 0; round < 10; round++) {
+        uint64_t start = now_ns();
+        for (int i = 0; i < CALL_COUNT; i++) {
+            event_count += demo_app_take_events(app, &event, 1);
+        }
+        uint64_t mid = now_ns();
+        for (int i = 0; i < CALL_COUNT; i++) {
+            event_count += vtable->take_events(app, &event, 1);
+        }
+        uint64_t end = now_ns();
+        if (mid - start < best_call_ns[PATH_DIRECT]) {
+            best_call_ns[PATH_DIRECT] = mid - start;
+        }
+        if (end - mid < best_call_ns[PATH_VTABLE]) {
+            best_call_ns[PATH_VTABLE] = end - mid;
+        }
+    }
+
+    printf("%s: %d rounds of %d blocks of %d frames per path, %u events, %u of %u arena bytes budgeted used\n",
+        vtable->name, round_count, blocks_per_round, BLOCK_N_FRAMES, (unsigned int)event_count,
+        (unsigned int)allocator_stats.used, (unsigned int)vtable->arena_budget);
+    for (int path = 0; path < PATH_COUNT; path++) {
+        printf("  %-7s %8.3f us per block, %6.2f ns per empty take_events call\n", path_names[path],
+            best_round_ns[path] / 1e3 / blocks_per_round, (double)best_call_ns[path] / CALL_COUNT);
+    }
+    double block_overhead_ns = ((double)best_round_ns[PATH_VTABLE] - (double)best_round_ns[PATH_DIRECT]) / blocks_per_round;
+    printf("  vtable overhead %+.1f ns per block (%+.3f%%), %+.2f ns per call\n",
+        block_overhead_ns, 100.0 * block_overhead_ns * blocks_per_round / best_round_ns[PATH_DIRECT],
+        ((double)best_call_ns[PATH_VTABLE] - (double)best_call_ns[PATH_DIRECT]) / CALL_COUNT);
+
+    printf("\n%s\n", ok ? "all checks passed" : "some checks FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,289 @@
+/*
+ * Host-native offline renderer and benchmark for the demo apps.
+ *
+ * Feeds a WAV file through demo_app_process_channels in blocks of the same
+ * size, and with the same message sequencing, as processing_cb in src/main.c:
+ * pending incoming messages are passed to the app, the tx channels are
+ * zeroed, the block is processed and outgoing messages are drained. Only the
+ * channels in the app's channel masks are passed, like in src/i2s.c. A mono
+ * input file feeds both input channels.
+ */
+#include <microdsp_demos/microdsp_demos.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audio_callbacks.h"
+#include "bench_util.h"
+#include "wav.h"
+
+/* Default period size, see i2s_buffer_cfg_t in src/main.c */
+#define DEFAULT_BLOCK_N_FRAMES 256
+/* Must match I2S_MAX_PERIOD_N_FRAMES in src/i2s.h */
+#define MAX_BLOCK_N_FRAMES 1024
+/* Determined by NRF_I2S_MCK_32MDIV... and NRF_I2S_RATIO_... */
+#define DEFAULT_SAMPLE_RATE 44444.444f
+#define MAX_SCRIPT_ENTRIES 1024
+
+typedef struct {
+    const char* name;
+    int value;
+} message_name_t;
+
+static const message_name_t message_names[] = {
+    { "Button0Down", 1 }, { "Button1Down", 2 }, { "Button2Down", 3 }, { "Button3Down", 4 },
+    { "Button0Up", 5 }, { "Button1Up", 6 }, { "Button2Up", 7 }, { "Button3Up", 8 },
+    { "Led0On", 9 }, { "Led1On", 10 }, { "Led2On", 11 }, { "Led3On", 12 },
+    { "Led0Off", 13 }, { "Led1Off", 14 }, { "Led2Off", 15 }, { "Led3Off", 16 },
+    { "PitchDetected", 17 }, { "NoveltyDetected", 18 }, { "FilterModeChanged", 19 }, { "DelayEstimated", 20 },
+    { "AdaptationSkipped", 21 },
+};
+
+static const char* message_name(int value)
+{
+    for (size_t i = 0; i < sizeof(message_names) / sizeof(message_names[0]); i++) {
+        if (message_names[i].value == value) {
+            return message_names[i].name;
+        }
+    }
+    return "Unknown";
+}
+
+static int message_value(const char* name)
+{
+    for (size_t i = 0; i < sizeof(message_names) / sizeof(message_names[0]); i++) {
+        if (strcasecmp(message_names[i].name, name) == 0) {
+            return message_names[i].value;
+        }
+    }
+    return atoi(name);
+}
+
+/* An incoming message delivered at the start of the first block
+   beginning at or after frame. */
+typedef struct {
+    uint64_t frame;
+    int message;
+} script_entry_t;
+
+static int read_script(const char* path, float sample_rate, script_entry_t* entries, int max_count)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "failed to open %s\n", path);
+        return -1;
+    }
+    int count = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f) && count < max_count) {
+        double time_s = 0;
+        char name[64];
+        if (line[0] == '#' || sscanf(line, "%lf %63s", &time_s, name) != 2) {
+            continue;
+        }
+        entries[count].frame = (uint64_t)(time_s * sample_rate);
+        entries[count].message = message_value(name);
+        count++;
+    }
+    fclose(f);
+    return count;
+}
+
+static int compare_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void print_usage(const char* program)
+{
+    fprintf(stderr,
+        "usage: %s [options] input.wav\n"
+        "  -o path   write the rendered tx signal to a 32 bit float WAV file\n"
+        "  -m path   write outgoing app messages to a text file\n"
+        "  -s path   read incoming messages from a text file with lines\n"
+        "            '<time in seconds> <message name>', e.g '0.5 Button2Down'\n"
+        "  -r count  number of passes over the input, for more stable timing (default 1)\n"
+        "  -f rate   sample rate passed to demo_app_create (default %.3f)\n"
+        "  -b frames block (I2S period) size, at most %d (default %d)\n",
+        program, DEFAULT_SAMPLE_RATE, MAX_BLOCK_N_FRAMES, DEFAULT_BLOCK_N_FRAMES);
+}
+
+int main(int argc, char** argv)
+{
+    const char* output_path = NULL;
+    const char* messages_path = NULL;
+    const char* script_path = NULL;
+    int pass_count = 1;
+    float sample_rate = DEFAULT_SAMPLE_RATE;
+    int block_n_frames = DEFAULT_BLOCK_N_FRAMES;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:m:s:r:f:b:h")) != -1) {
+        switch (opt) {
+            case 'o': output_path = optarg; break;
+            case 'm': messages_path = optarg; break;
+            case 's': script_path = optarg; break;
+            case 'r': pass_count = atoi(optarg); break;
+            case 'f': sample_rate = atof(optarg); break;
+            case 'b': block_n_frames = atoi(optarg); break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1 || pass_count < 1 || block_n_frames < 1 || block_n_frames > MAX_BLOCK_N_FRAMES) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    wav_data_t input;
+    if (wav_read(argv[optind], &input) != 0) {
+        return 1;
+    }
+    if (input.sample_rate != (uint32_t)(sample_rate + 0.5f)) {
+        fprintf(stderr, "note: input sample rate is %u Hz, processing at %.3f Hz\n", input.sample_rate, sample_rate);
+    }
+
+    static script_entry_t script[MAX_SCRIPT_ENTRIES];
+    int script_length = 0;
+    if (script_path) {
+        script_length = read_script(script_path, sample_rate, script, MAX_SCRIPT_ENTRIES);
+        if (script_length < 0) {
+            return 1;
+        }
+    }
+
+    FILE* messages_file = NULL;
+    if (messages_path) {
+        messages_file = fopen(messages_path, "w");
+        if (!messages_file) {
+            fprintf(stderr, "failed to open %s for writing\n", messages_path);
+            return 1;
+        }
+        fprintf(messages_file, "# block timestamp time_s message value\n");
+    }
+
+    void* app = demo_app_create(sample_rate);
+    uint8_t rx_channel_mask = demo_app_rx_channel_mask(app);
+    uint8_t tx_channel_mask = demo_app_tx_channel_mask(app);
+    /* A single tx channel is played on both outputs */
+    int output_channel_count = tx_channel_mask == (AUDIO_CHANNEL_LEFT | AUDIO_CHANNEL_RIGHT) ? 2 : 1;
+
+    uint32_t block_count = (input.frame_count + block_n_frames - 1) / block_n_frames;
+    float* output = calloc((size_t)block_count * block_n_frames * output_channel_count, sizeof(float));
+    uint64_t* block_times = malloc(sizeof(uint64_t) * block_count * pass_count);
+    if (!output || !block_times) {
+        return 1;
+    }
+
+    static float rx[AUDIO_MAX_CHANNELS][MAX_BLOCK_N_FRAMES];
+    static float tx[AUDIO_MAX_CHANNELS][MAX_BLOCK_N_FRAMES];
+    const float* rx_channels[AUDIO_MAX_CHANNELS] = { NULL };
+    float* tx_channels[AUDIO_MAX_CHANNELS] = { NULL };
+    for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+        rx_channels[c] = rx_channel_mask & (1 << c) ? rx[c] : NULL;
+        tx_channels[c] = tx_channel_mask & (1 << c) ? tx[c] : NULL;
+    }
+    uint64_t frame = 0;
+    int next_script_entry = 0;
+    for (int pass = 0; pass < pass_count; pass++) {
+        for (uint32_t block = 0; block < block_count; block++) {
+            for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+                uint32_t input_channel = c < input.channel_count ? c : 0;
+                for (int i = 0; rx_channels[c] && i < block_n_frames; i++) {
+                    uint32_t input_frame = block * block_n_frames + i;
+                    rx[c][i] = input_frame < input.frame_count ? input.samples[input_frame * input.channel_count + input_channel] : 0;
+                }
+            }
+
+            uint64_t start = now_ns();
+
+            /* Pass incoming messages to the demo app */
+            while (pass == 0 && next_script_entry < script_length && script[next_script_entry].frame <= frame) {
+                demo_app_handle_message(app, script[next_script_entry].message);
+                next_script_entry++;
+            }
+
+            /* Process audio */
+            for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+                if (tx_channels[c]) {
+                    memset(tx_channels[c], 0, block_n_frames * sizeof(float));
+                }
+            }
+            demo_app_process_channels(app, tx_channels, rx_channels, block_n_frames);
+
+            /* Drain outgoing events */
+            app_event_t events[64];
+            uint32_t event_count = 0;
+            uint32_t batch_count;
+            while ((batch_count = demo_app_take_events(app, &events[event_count], 64 - event_count)) > 0) {
+                event_count += batch_count;
+            }
+
+            block_times[pass * block_count + block] = now_ns() - start;
+
+            if (pass == 0) {
+                for (int c = 0; c < output_channel_count && tx_channel_mask; c++) {
+                    const float* channel = tx_channels[c] ? tx_channels[c] : tx_channels[1 - c];
+                    for (int i = 0; i < block_n_frames; i++) {
+                        output[(block * block_n_frames + i) * output_channel_count + c] = channel[i];
+                    }
+                }
+                for (uint32_t i = 0; messages_file && i < event_count; i++) {
+                    fprintf(messages_file, "%u %u %.6f %s %g\n",
+                        block, events[i].timestamp, events[i].timestamp / sample_rate,
+                        message_name(events[i].message), events[i].value);
+                }
+            }
+            frame += block_n_frames;
+        }
+    }
+
+    if (messages_file) {
+        fclose(messages_file);
+    }
+    if (output_path && wav_write_float(output_path, output, block_count * block_n_frames, output_channel_count, (uint32_t)(sample_rate + 0.5f)) != 0) {
+        return 1;
+    }
+
+    /* Report timing */
+    uint32_t timed_block_count = block_count * pass_count;
+    uint64_t total_ns = 0;
+    for (uint32_t i = 0; i < timed_block_count; i++) {
+        total_ns += block_times[i];
+    }
+    qsort(block_times, timed_block_count, sizeof(uint64_t), compare_u64);
+    double budget_ns = 1e9 * block_n_frames / sample_rate;
+    double mean_ns = (double)total_ns / timed_block_count;
+    uint64_t worst_ns = block_times[timed_block_count - 1];
+
+    printf("blocks          %u x %d frames (%d passes)\n", timed_block_count, block_n_frames, pass_count);
+    printf("block budget    %.0f ns at %.3f Hz\n", budget_ns, sample_rate);
+    printf("mean            %.0f ns/block\n", mean_ns);
+    printf("median          %llu ns/block\n", (unsigned long long)block_times[timed_block_count / 2]);
+    printf("p99             %llu ns/block\n", (unsigned long long)block_times[(uint32_t)(0.99 * (timed_block_count - 1))]);
+    printf("worst           %llu ns/block (%.2f%% of budget)\n", (unsigned long long)worst_ns, 100.0 * worst_ns / budget_ns);
+    printf("real-time factor %.5f (processing time / audio time)\n", mean_ns / budget_ns);
+
+    allocator_stats_t allocator_stats;
+    demo_app_allocator_stats(&allocator_stats);
+    printf("arena           %u of %u bytes used, high water mark %u\n",
+        allocator_stats.used, allocator_stats.arena_size, allocator_stats.high_water_mark);
+    printf("                %u allocations, %u bytes padding, %u bytes unreclaimed\n",
+        allocator_stats.allocation_count, allocator_stats.alignment_padding, allocator_stats.unreclaimed);
+    printf("                %u failed, %u after create\n",
+        allocator_stats.failed_allocation_count, allocator_stats.locked_allocation_count);
+
+    free(block_times);
+    free(output);
+    wav_free(&input);
+    return 0;
+}
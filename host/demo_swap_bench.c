@@ -0,0 +1,367 @@
+/*
+ * Host model of runtime demo switching in main.c, run on POSIX threads
+ * against an all_demos build of the crate and the firmware's demo switch
+ * (src/demo_switch.c) and block queue (src/block_queue.c).
+ *
+ * First creates and destroys every demo in the registry at a few sample
+ * rates, and reports the arena use and creation time of each, checked
+ * against its arena budget.
+ *
+ * Then an audio thread wakes up once per period of the sample clock and
+ * runs the current app on a test signal, or queues the block for an
+ * analysis thread if the app has no tx channels, like processing_cb and
+ * analysis_thread_entry_point do. Meanwhile the main thread swaps to a
+ * random other demo every few blocks, like the demo select shell command.
+ *
+ * Checks that no app is used once it has been retired, that two apps
+ * never run at the same time, that no block of the audio thread took
+ * longer than a period, and that after every swap the arena holds only
+ * the new app, within its budget.
+ *
+ *   demo_swap_bench [-n swaps] [-s speed] [-b max_blocks_between_swaps]
+ */
+#include <microdsp_demos/microdsp_demos.h>
+
+#include <math.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audio_callbacks.h"
+#include "bench_util.h"
+#include "block_queue.h"
+#include "demo_switch.h"
+
+#define SAMPLE_RATE 44444.444f
+#define BLOCK_N_FRAMES 256
+#define EVENT_BATCH_SIZE 8
+
+static const float rates[] = { 16000.0f, SAMPLE_RATE, 48000.0f };
+
+typedef struct {
+    /* Settings */
+    uint32_t swap_count;
+    double speed;
+    uint32_t max_blocks_between_swaps;
+
+    demo_switch_t demo_switch;
+    block_queue_t queue;
+    sem_t ready;
+    volatile bool done;
+
+    /* Apps running right now, at most one */
+    int running_count;
+
+    /* Audio thread results */
+    uint32_t block_count;
+    uint32_t inline_block_count;
+    uint32_t queued_block_count;
+    uint32_t empty_block_count;
+    uint64_t max_audio_block_ns;
+
+    /* Analysis thread results */
+    uint32_t analysed_block_count;
+    uint32_t discarded_block_count;
+
+    /* Both threads */
+    uint32_t retired_use_count;
+    uint32_t concurrent_run_count;
+    uint32_t event_count;
+} bench_t;
+
+/* Kernel functions used by demo_switch.c */
+int32_t k_msleep(int32_t ms)
+{
+    usleep(1000 * ms);
+    return 0;
+}
+
+int k_mutex_init(struct k_mutex* mutex)
+{
+    return pthread_mutex_init(&mutex->mutex, NULL);
+}
+
+int k_mutex_lock(struct k_mutex* mutex, k_timeout_t timeout)
+{
+    (void)timeout;
+    return pthread_mutex_lock(&mutex->mutex);
+}
+
+int k_mutex_unlock(struct k_mutex* mutex)
+{
+    return pthread_mutex_unlock(&mutex->mutex);
+}
+
+static uint64_t period_ns(const bench_t* bench)
+{
+    return (uint64_t)(1e9 * BLOCK_N_FRAMES / SAMPLE_RATE / bench->speed);
+}
+
+/* Like run_demo_app in main.c, minus the event queues */
+static void run_app(bench_t* bench, demo_instance_t* instance, float* const* tx, const float* const* rx)
+{
+    const demo_app_vtable_t* vtable = instance->vtable;
+    /* Retired instances are cleared */
+    if (vtable == NULL || instance->app == NULL) {
+        __atomic_add_fetch(&bench->retired_use_count, 1, __ATOMIC_SEQ_CST);
+        return;
+    }
+    if (__atomic_fetch_add(&bench->running_count, 1, __ATOMIC_SEQ_CST) != 0) {
+        __atomic_add_fetch(&bench->concurrent_run_count, 1, __ATOMIC_SEQ_CST);
+    }
+    float* app_tx[AUDIO_MAX_CHANNELS];
+    const float* app_rx[AUDIO_MAX_CHANNELS];
+    for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+        app_tx[c] = vtable->tx_channel_mask & (1 << c) ? tx[c] : NULL;
+        app_rx[c] = vtable->rx_channel_mask & (1 << c) ? rx[c] : NULL;
+    }
+    vtable->process_channels(instance->app, app_tx, app_rx, BLOCK_N_FRAMES);
+    app_event_t events[EVENT_BATCH_SIZE];
+    uint32_t event_count;
+    while ((event_count = vtable->take_events(instance->app, events, EVENT_BATCH_SIZE)) > 0) {
+        __atomic_add_fetch(&bench->event_count, event_count, __ATOMIC_SEQ_CST);
+    }
+    __atomic_sub_fetch(&bench->running_count, 1, __ATOMIC_SEQ_CST);
+}
+
+static void* audio_thread(void* arg)
+{
+    bench_t* bench = arg;
+    float rx_buffers[AUDIO_MAX_CHANNELS][BLOCK_N_FRAMES];
+    float tx_buffers[AUDIO_MAX_CHANNELS][BLOCK_N_FRAMES];
+    const float* rx[AUDIO_MAX_CHANNELS];
+    float* tx[AUDIO_MAX_CHANNELS];
+    for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+        rx[c] = rx_buffers[c];
+        tx[c] = tx_buffers[c];
+    }
+    uint32_t noise_state = 1;
+
+    uint64_t start = now_ns();
+    for (uint32_t block = 0; !bench->done; block++) {
+        sleep_until_ns(start + (block + 1) * period_ns(bench));
+        uint32_t frame = block * BLOCK_N_FRAMES;
+        for (int i = 0; i < BLOCK_N_FRAMES; i++) {
+            /* A 440 Hz tone that is on half of the time, in noise */
+            float t = (frame + i) / SAMPLE_RATE;
+            float x = 0.01f * next_noise(&noise_state);
+            if (fmodf(t, 1.0f) < 0.5f) {
+                x += 0.5f * sinf(2.0f * (float)M_PI * 440.0f * t);
+            }
+            for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+                rx_buffers[c][i] = x;
+            }
+        }
+        memset(tx_buffers, 0, sizeof(tx_buffers));
+
+        uint64_t block_start = now_ns();
+        demo_instance_t* instance = demo_switch_acquire(&bench->demo_switch, DEMO_SWITCH_AUDIO_THREAD);
+        if (instance != NULL && instance->deferred) {
+            if (block_queue_push(&bench->queue, rx, BLOCK_N_FRAMES, frame)) {
+                sem_post(&bench->ready);
+            }
+            bench->queued_block_count++;
+        } else if (instance != NULL) {
+            run_app(bench, instance, tx, rx);
+            bench->inline_block_count++;
+        } else {
+            bench->empty_block_count++;
+        }
+        demo_switch_release(&bench->demo_switch, DEMO_SWITCH_AUDIO_THREAD);
+        uint64_t block_ns = now_ns() - block_start;
+        if (block_ns > bench->max_audio_block_ns) {
+            bench->max_audio_block_ns = block_ns;
+        }
+        bench->block_count++;
+    }
+    sem_post(&bench->ready);
+    return NULL;
+}
+
+static void* analysis_thread(void* arg)
+{
+    bench_t* bench = arg;
+    float* tx[AUDIO_MAX_CHANNELS] = { NULL };
+    while (true) {
+        sem_wait(&bench->ready);
+        audio_block_t block;
+        while (block_queue_peek(&bench->queue, &block)) {
+            demo_instance_t* instance = demo_switch_acquire(&bench->demo_switch, DEMO_SWITCH_ANALYSIS_THREAD);
+            if (instance != NULL && instance->deferred) {
+                run_app(bench, instance, tx, block.channels);
+                bench->analysed_block_count++;
+            } else {
+                bench->discarded_block_count++;
+            }
+            demo_switch_release(&bench->demo_switch, DEMO_SWITCH_ANALYSIS_THREAD);
+            block_queue_release(&bench->queue);
+        }
+        if (bench->done && block_queue_depth(&bench->queue) == 0) {
+            return NULL;
+        }
+    }
+}
+
+/* Creates and destroys every demo at a few rates */
+static bool check_budgets(void)
+{
+    bool ok = true;
+    printf("demo       budget    used at");
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        printf("  %6.0f Hz", rates[r]);
+    }
+    printf("   create time\n");
+    for (uint32_t i = 0; i < demo_registry_count(); i++) {
+        const demo_app_vtable_t* vtable = demo_registry_get(i);
+        printf("%-10s %6u          ", vtable->name, (unsigned int)vtable->arena_budget);
+        uint64_t create_ns = 0;
+        for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+            uint64_t start = now_ns();
+            void* app = demo_registry_create(vtable, rates[r]);
+            uint64_t end = now_ns();
+            allocator_stats_t stats;
+            demo_app_allocator_stats(&stats);
+            if (!check(app != NULL, vtable->name)) {
+                ok = false;
+                continue;
+            }
+            printf("  %9u", (unsigned int)stats.used);
+            ok &= check(stats.used <= vtable->arena_budget, "arena use within budget");
+            if (rates[r] == SAMPLE_RATE) {
+                create_ns = end - start;
+            }
+            demo_registry_destroy(vtable, app);
+            demo_app_allocator_stats(&stats);
+            ok &= check(stats.used == 0, "destroying the only app empties the arena");
+        }
+        printf("  %8.3f ms\n", create_ns / 1e6);
+    }
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    bench_t bench = {
+        .swap_count = 100,
+        .speed = 4.0,
+        .max_blocks_between_swaps = 20,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:b:")) != -1) {
+        switch (opt) {
+        case 'n':
+            bench.swap_count = (uint32_t)atoi(optarg);
+            break;
+        case 's':
+            bench.speed = atof(optarg);
+            break;
+        case 'b':
+            bench.max_blocks_between_swaps = (uint32_t)atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n swaps] [-s speed] [-b max_blocks_between_swaps]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (demo_registry_abi_version() != DEMO_APP_ABI_VERSION || demo_registry_count() < 2) {
+        fprintf(stderr, "needs a build of the crate with several demos and ABI version %u\n", DEMO_APP_ABI_VERSION);
+        return 1;
+    }
+
+    allocator_stats_t stats;
+    demo_app_allocator_stats(&stats);
+    printf("%u demos, arena %u bytes\n\n", (unsigned int)demo_registry_count(), (unsigned int)stats.arena_size);
+    bool ok = check_budgets();
+
+    /* Channels of all demos, like main.c */
+    uint8_t deferred_rx_channel_mask = 0;
+    for (uint32_t i = 0; i < demo_registry_count(); i++) {
+        const demo_app_vtable_t* vtable = demo_registry_get(i);
+        if (vtable->tx_channel_mask == 0) {
+            deferred_rx_channel_mask |= vtable->rx_channel_mask;
+        }
+    }
+    bool deferred_analysis = deferred_rx_channel_mask != 0
+        && block_queue_init(&bench.queue, BLOCK_N_FRAMES, deferred_rx_channel_mask);
+    demo_switch_init(&bench.demo_switch, SAMPLE_RATE, deferred_analysis);
+    sem_init(&bench.ready, 0, 0);
+    if (demo_switch_select(&bench.demo_switch, demo_registry_get(0)) != 0) {
+        fprintf(stderr, "could not create %s\n", demo_registry_get(0)->name);
+        return 1;
+    }
+
+    pthread_t audio, analysis;
+    pthread_create(&analysis, NULL, analysis_thread, &bench);
+    pthread_create(&audio, NULL, audio_thread, &bench);
+
+    uint32_t seed = 1;
+    uint64_t total_select_ns = 0;
+    uint64_t max_select_ns = 0;
+    uint32_t failed_select_count = 0;
+    uint32_t over_budget_count = 0;
+    for (uint32_t swap = 0; swap < bench.swap_count; swap++) {
+        seed = seed * 1664525u + 1013904223u;
+        uint32_t blocks = 1 + (seed >> 8) % bench.max_blocks_between_swaps;
+        usleep((useconds_t)(blocks * period_ns(&bench) / 1000));
+
+        /* Any demo but the current one */
+        const demo_app_vtable_t* current = demo_switch_current(&bench.demo_switch);
+        const demo_app_vtable_t* vtable;
+        do {
+            seed = seed * 1664525u + 1013904223u;
+            vtable = demo_registry_get((seed >> 8) % demo_registry_count());
+        } while (vtable == current);
+
+        uint64_t start = now_ns();
+        int rc = demo_switch_select(&bench.demo_switch, vtable);
+        uint64_t select_ns = now_ns() - start;
+        total_select_ns += select_ns;
+        if (select_ns > max_select_ns) {
+            max_select_ns = select_ns;
+        }
+        if (rc != 0) {
+            failed_select_count++;
+            continue;
+        }
+        /* Only the new app is left */
+        demo_app_allocator_stats(&stats);
+        if (stats.used > vtable->arena_budget) {
+            over_budget_count++;
+        }
+    }
+    bench.done = true;
+    pthread_join(audio, NULL);
+    pthread_join(analysis, NULL);
+
+    demo_app_allocator_stats(&stats);
+    printf("\n%u swaps at %.1fx real time, %u seamless, %u with no app in between\n",
+        bench.swap_count, bench.speed, bench.demo_switch.seamless_swap_count, bench.demo_switch.gap_swap_count);
+    printf("  select: mean %.3f ms, max %.3f ms, including the wait for the threads to let go of the old app\n",
+        total_select_ns / 1e6 / bench.swap_count, max_select_ns / 1e6);
+    printf("  audio thread: %u blocks, %u inline, %u queued, %u with no app, max %.3f ms per block of %.3f ms\n",
+        bench.block_count, bench.inline_block_count, bench.queued_block_count, bench.empty_block_count,
+        bench.max_audio_block_ns / 1e6, period_ns(&bench) / 1e6);
+    printf("  analysis thread: %u blocks analysed, %u left over from swapped apps\n",
+        bench.analysed_block_count, bench.discarded_block_count);
+    printf("  %u events, arena %u bytes used, high water mark %u, %u allocations failed, %u after create\n",
+        bench.event_count, (unsigned int)stats.used, (unsigned int)stats.high_water_mark,
+        (unsigned int)stats.failed_allocation_count, (unsigned int)stats.locked_allocation_count);
+
+    ok &= check(failed_select_count == 0, "every swap succeeds");
+    ok &= check(bench.demo_switch.seamless_swap_count + bench.demo_switch.gap_swap_count == bench.swap_count, "every swap is counted");
+    ok &= check(bench.retired_use_count == 0, "no app is used after it has been retired");
+    ok &= check(bench.concurrent_run_count == 0, "apps never run at the same time");
+    ok &= check(over_budget_count == 0, "the arena only holds the new app after a swap");
+    ok &= check(bench.max_audio_block_ns < period_ns(&bench), "no audio block takes longer than a period");
+    ok &= check(stats.failed_allocation_count == 0, "no failed allocations");
+    ok &= check(stats.locked_allocation_count == 0, "no allocations while running");
+    printf("\n%s\n", ok ? "all checks passed" : "some checks FAILED");
+    return ok ? 0 : 1;
+}
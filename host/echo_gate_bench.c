@@ -0,0 +1,354 @@
+/*
+ * Activity gating of the NLMS demo's filter adaptation
+ * (microdsp_demos/src/activity_gate.rs), on a simulated echo path, against
+ * an all_demos build of the crate.
+ *
+ * The demo plays its tone in bursts, a quarter of the time, and tx is
+ * looped back through a short echo path into rx along with near end
+ * noise. In the double-talk run, bursts of louder near end noise stand in
+ * for speech, half of them during the tone. While recording through each
+ * filter, reports the time per block while the far end is silent, during
+ * double-talk and while the far end alone is active, the echo return loss
+ * enhancement (ERLE) of the recorded residual while the far end alone is
+ * active and during double-talk, and the share of skipped blocks that the
+ * demo reports. During double-talk, the known near end speech is
+ * subtracted from the residual to leave the echo that got through.
+ *
+ * The time of each block is the best of a few rounds. Checks that the
+ * reported share matches the script, that skipped blocks are cheaper than
+ * adapting ones, that near end speech costs no more than
+ * ERLE_TOLERANCE_DB of ERLE, and that the echo is still cancelled during
+ * double-talk, while adaptation is paused.
+ *
+ *   echo_gate_bench [-r rounds] [-d seconds]
+ */
+#include <microdsp_demos/microdsp_demos.h>
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audio_callbacks.h"
+#include "bench_util.h"
+
+#define SAMPLE_RATE 44444.444f
+#define BLOCK_N_FRAMES 256
+/* 6 s, which fits in the recording buffer with IMA ADPCM */
+#define MAX_BLOCK_COUNT 1041
+#define MAX_DURATION_S (MAX_BLOCK_COUNT * BLOCK_N_FRAMES / SAMPLE_RATE)
+#define EVENT_BATCH_SIZE 8
+
+/* The script, in blocks of about 5.8 ms. The far end is active for the
+   first FAR_END_BLOCKS of every PERIOD_BLOCKS. Every other period has near
+   end speech in the two given ranges, the first during the far end. */
+#define PERIOD_BLOCKS 348
+#define FAR_END_BLOCKS 87
+#define DOUBLE_TALK_START 30
+#define NEAR_END_ONLY_START 150
+#define SPEECH_BLOCKS 30
+/* Blocks after the far end starts or speech ends before ERLE is measured,
+   longer than the hangovers of the gate */
+#define SETTLE_BLOCKS 17
+
+/* Echo of the tx sample played this many frames earlier, i.e one block,
+   which is where the demo looks before it has estimated the delay */
+#define ECHO_DELAY BLOCK_N_FRAMES
+static const float echo_path[] = { 0.0f, 0.3f, 0.5f, -0.2f, 0.1f };
+#define ECHO_PATH_LENGTH (sizeof(echo_path) / sizeof(echo_path[0]))
+#define NOISE_AMPLITUDE 0.001f
+#define SPEECH_AMPLITUDE 0.05f
+/* The frames by which the PBFDAF residual lags rx, the partition size of
+   the demo's filter */
+#define PBFDAF_PARTITION_SIZE 128
+#define ERLE_TOLERANCE_DB 3.0f
+#define MIN_ERLE_DB 10.0f
+
+typedef enum {
+    BLOCK_FAR_END_SILENT,
+    BLOCK_DOUBLE_TALK,
+    BLOCK_FAR_END_ONLY,
+    BLOCK_CLASS_COUNT,
+} block_class_t;
+
+static const char* block_class_names[BLOCK_CLASS_COUNT] = { "far end silent", "double-talk", "far end only" };
+
+typedef struct {
+    uint64_t ns[BLOCK_CLASS_COUNT];
+    uint32_t block_counts[BLOCK_CLASS_COUNT];
+    double erle_db;
+    double double_talk_erle_db;
+    float reported_skipped;
+    float expected_skipped;
+    uint32_t delay_estimate_count;
+} run_result_t;
+
+static bool far_end_active(int block)
+{
+    return block % PERIOD_BLOCKS < FAR_END_BLOCKS;
+}
+
+static bool near_end_active(int block, bool double_talk)
+{
+    int period_block = block % PERIOD_BLOCKS;
+    bool speech_period = (block / PERIOD_BLOCKS) % 2 == 1;
+    return double_talk && speech_period
+           && ((period_block >= DOUBLE_TALK_START && period_block < DOUBLE_TALK_START + SPEECH_BLOCKS)
+               || (period_block >= NEAR_END_ONLY_START && period_block < NEAR_END_ONLY_START + SPEECH_BLOCKS));
+}
+
+static block_class_t block_class(int block, bool double_talk)
+{
+    if (!far_end_active(block)) {
+        return BLOCK_FAR_END_SILENT;
+    }
+    return near_end_active(block, double_talk) ? BLOCK_DOUBLE_TALK : BLOCK_FAR_END_ONLY;
+}
+
+/* Whether the far end alone has been active long enough for the block to
+   count towards the ERLE */
+static bool settled_far_end_only(int block, bool double_talk)
+{
+    if (block % PERIOD_BLOCKS < SETTLE_BLOCKS) {
+        return false;
+    }
+    for (int i = 0; i <= SETTLE_BLOCKS && i <= block; i++) {
+        if (!far_end_active(block - i) || near_end_active(block - i, double_talk)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void take_events(const demo_app_vtable_t* vtable, void* app, run_result_t* result)
+{
+    app_event_t events[EVENT_BATCH_SIZE];
+    uint32_t event_count;
+    while ((event_count = vtable->take_events(app, events, EVENT_BATCH_SIZE)) > 0) {
+        for (uint32_t i = 0; i < event_count; i++) {
+            if (events[i].message == AdaptationSkipped) {
+                result->reported_skipped = events[i].value;
+            } else if (events[i].message == DelayEstimated) {
+                result->delay_estimate_count++;
+            }
+        }
+    }
+}
+
+/* NaN without any echo, which fails the checks */
+static double erle_db(double echo_energy, double residual_energy)
+{
+    if (echo_energy <= 0.0) {
+        return NAN;
+    }
+    return residual_energy > 0.0 ? 10.0 * log10(echo_energy / residual_energy) : INFINITY;
+}
+
+/* filter_presses is the number of Button1Down messages that select the
+   filter, 1 for NLMS and 2 for PBFDAF, and residual_lag the number of
+   frames by which its residual lags rx */
+static void run(const demo_app_vtable_t* vtable, int filter_presses, int residual_lag, bool double_talk,
+                int block_count, uint64_t* best_block_ns, run_result_t* result)
+{
+    static float tx_history[MAX_BLOCK_COUNT * BLOCK_N_FRAMES];
+    static float speech_history[MAX_BLOCK_COUNT * BLOCK_N_FRAMES];
+    memset(result, 0, sizeof(*result));
+    result->reported_skipped = -1.0f;
+    memset(tx_history, 0, sizeof(tx_history));
+    memset(speech_history, 0, sizeof(speech_history));
+    void* app = demo_registry_create(vtable, SAMPLE_RATE);
+    for (int i = 0; i < filter_presses; i++) {
+        vtable->handle_message(app, Button1Down);
+    }
+    vtable->handle_message(app, Button2Down);
+
+    uint32_t noise_state = 1;
+    bool oscillator_enabled = false;
+    double echo_energy = 0.0;
+    double residual_energy = 0.0;
+    double double_talk_echo_energy = 0.0;
+    double double_talk_residual_energy = 0.0;
+    uint32_t skipped_block_count = 0;
+    for (int block = 0; block < block_count; block++) {
+        if (far_end_active(block) != oscillator_enabled) {
+            vtable->handle_message(app, Button0Down);
+            oscillator_enabled = !oscillator_enabled;
+        }
+        bool near_end = near_end_active(block, double_talk);
+        float rx[BLOCK_N_FRAMES];
+        for (int i = 0; i < BLOCK_N_FRAMES; i++) {
+            int frame = block * BLOCK_N_FRAMES + i;
+            float echo = 0.0f;
+            for (size_t j = 0; j < ECHO_PATH_LENGTH; j++) {
+                int tx_frame = frame - ECHO_DELAY - (int)j;
+                echo += tx_frame >= 0 ? echo_path[j] * tx_history[tx_frame] : 0.0f;
+            }
+            rx[i] = echo + NOISE_AMPLITUDE * next_noise(&noise_state);
+            if (near_end) {
+                speech_history[frame] = SPEECH_AMPLITUDE * next_noise(&noise_state);
+                rx[i] += speech_history[frame];
+            }
+        }
+
+        /* The demo plays its tx channel on both outputs and filters the
+           left rx channel */
+        float* tx[AUDIO_MAX_CHANNELS] = { &tx_history[block * BLOCK_N_FRAMES] };
+        const float* rx_channels[AUDIO_MAX_CHANNELS] = { rx };
+        uint64_t start = now_ns();
+        vtable->process_channels(app, tx, rx_channels, BLOCK_N_FRAMES);
+        uint64_t ns = now_ns() - start;
+        if (ns < best_block_ns[block]) {
+            best_block_ns[block] = ns;
+        }
+        take_events(vtable, app, result);
+
+        block_class_t class = block_class(block, double_talk);
+        result->block_counts[class]++;
+        skipped_block_count += class != BLOCK_FAR_END_ONLY;
+
+        /* The ERLE of the second half, after the filter has converged */
+        const float* residual;
+        uint32_t residual_len = vtable->tap_signal(app, &residual);
+        if (block >= block_count / 2 && settled_far_end_only(block, double_talk) && residual_len == BLOCK_N_FRAMES) {
+            for (int i = 0; i < BLOCK_N_FRAMES; i++) {
+                echo_energy += rx[i] * rx[i];
+                residual_energy += residual[i] * residual[i];
+            }
+        }
+        /* The echo left in the residual during double-talk, i.e without
+           the speech that was recorded along with it, after the filter
+           has converged in the first period */
+        if (block >= PERIOD_BLOCKS && class == BLOCK_DOUBLE_TALK && residual_len == BLOCK_N_FRAMES) {
+            for (int i = 0; i < BLOCK_N_FRAMES; i++) {
+                int frame = block * BLOCK_N_FRAMES + i;
+                float speech = frame >= residual_lag ? speech_history[frame - residual_lag] : 0.0f;
+                float echo = rx[i] - speech_history[frame];
+                float residual_echo = residual[i] - speech;
+                double_talk_echo_energy += echo * echo;
+                double_talk_residual_energy += residual_echo * residual_echo;
+            }
+        }
+    }
+    vtable->handle_message(app, Button2Down);
+    take_events(vtable, app, result);
+    demo_registry_destroy(vtable, app);
+    result->expected_skipped = (float)skipped_block_count / block_count;
+    result->erle_db = erle_db(echo_energy, residual_energy);
+    result->double_talk_erle_db = erle_db(double_talk_echo_energy, double_talk_residual_energy);
+}
+
+static void print_result(const char* label, const run_result_t* result)
+{
+    printf("    %-12s ERLE %5.1f dB, skipped %5.1f%% of blocks (%5.1f%% in the script), %u delay estimates\n",
+           label, result->erle_db, 100.0f * result->reported_skipped, 100.0f * result->expected_skipped,
+           (unsigned int)result->delay_estimate_count);
+    if (result->block_counts[BLOCK_DOUBLE_TALK] > 0) {
+        printf("    %-12s ERLE %5.1f dB during double-talk\n", "", result->double_talk_erle_db);
+    }
+    for (int class = 0; class < BLOCK_CLASS_COUNT; class++) {
+        if (result->block_counts[class] > 0) {
+            printf("      %-15s %5u blocks, %7.3f us per block\n", block_class_names[class],
+                   (unsigned int)result->block_counts[class],
+                   result->ns[class] / 1e3 / result->block_counts[class]);
+        }
+    }
+}
+
+/* Runs the script round_count times and sums the best time of each block
+   by class */
+static void run_rounds(const demo_app_vtable_t* vtable, int filter_presses, int residual_lag, bool double_talk,
+                       int block_count, int round_count, run_result_t* result)
+{
+    static uint64_t best_block_ns[MAX_BLOCK_COUNT];
+    for (int block = 0; block < block_count; block++) {
+        best_block_ns[block] = UINT64_MAX;
+    }
+    for (int round = 0; round < round_count; round++) {
+        run(vtable, filter_presses, residual_lag, double_talk, block_count, best_block_ns, result);
+    }
+    for (int block = 0; block < block_count; block++) {
+        result->ns[block_class(block, double_talk)] += best_block_ns[block];
+    }
+}
+
+static double mean_ns(const run_result_t* result, block_class_t class)
+{
+    return (double)result->ns[class] / result->block_counts[class];
+}
+
+int main(int argc, char** argv)
+{
+    int round_count = 5;
+    float duration = MAX_DURATION_S;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:d:")) != -1) {
+        switch (opt) {
+        case 'r':
+            round_count = atoi(optarg);
+            break;
+        case 'd':
+            duration = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r rounds] [-d seconds]\n", argv[0]);
+            return 1;
+        }
+    }
+    int block_count = (int)(duration * SAMPLE_RATE) / BLOCK_N_FRAMES;
+    if (round_count < 1) {
+        fprintf(stderr, "needs at least one round\n");
+        return 1;
+    }
+    if (block_count < 2 * PERIOD_BLOCKS || block_count > MAX_BLOCK_COUNT) {
+        fprintf(stderr, "duration must be between %.1f and %.1f s\n",
+                2 * PERIOD_BLOCKS * BLOCK_N_FRAMES / SAMPLE_RATE, MAX_DURATION_S);
+        return 1;
+    }
+
+    const demo_app_vtable_t* vtable = demo_registry_find("nlms");
+    if (vtable == NULL) {
+        fprintf(stderr, "no nlms demo in the registry\n");
+        return 1;
+    }
+    static const struct {
+        const char* name;
+        int presses;
+        int residual_lag;
+    } filters[] = { { "nlms", 1, 0 }, { "pbfdaf", 2, PBFDAF_PARTITION_SIZE } };
+    bool ok = true;
+    printf("%d blocks of %d frames, far end active %d%% of the time, best of %d rounds per block\n", block_count,
+           BLOCK_N_FRAMES, 100 * FAR_END_BLOCKS / PERIOD_BLOCKS, round_count);
+    for (size_t f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+        const char* name = filters[f].name;
+        run_result_t single_talk;
+        run_result_t double_talk;
+        run_rounds(vtable, filters[f].presses, filters[f].residual_lag, false, block_count, round_count,
+                   &single_talk);
+        run_rounds(vtable, filters[f].presses, filters[f].residual_lag, true, block_count, round_count,
+                   &double_talk);
+        printf("  %s\n", name);
+        print_result("single-talk", &single_talk);
+        print_result("double-talk", &double_talk);
+
+        for (int i = 0; i < 2; i++) {
+            const run_result_t* result = i ? &double_talk : &single_talk;
+            ok &= check_for(fabsf(result->reported_skipped - result->expected_skipped) < 0.03f, name,
+                        "reported skipped share matches the script");
+            ok &= check_for(mean_ns(result, BLOCK_FAR_END_SILENT) < mean_ns(result, BLOCK_FAR_END_ONLY), name,
+                        "cheaper while the far end is silent");
+        }
+        ok &= check_for(mean_ns(&double_talk, BLOCK_DOUBLE_TALK) < mean_ns(&double_talk, BLOCK_FAR_END_ONLY), name,
+                    "cheaper during double-talk");
+        ok &= check_for(single_talk.erle_db >= MIN_ERLE_DB, name, "converges");
+        ok &= check_for(double_talk.erle_db >= single_talk.erle_db - ERLE_TOLERANCE_DB, name,
+                    "no divergence from near end speech");
+        ok &= check_for(double_talk.double_talk_erle_db >= MIN_ERLE_DB, name, "cancels the echo during double-talk");
+    }
+
+    printf("\n%s\n", ok ? "all checks passed" : "some checks FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,252 @@
+/*
+ * Cost of building a demo app from stages (see graph.rs), compared with
+ * the same app written by hand. Links a build of the crate with the
+ * graph_reference feature, which registers the MPM demo twice: mpm,
+ * chained from a decimation and a pitch detection stage, and
+ * mpm_reference, the hand written version it replaced.
+ *
+ * Both apps process the same tone sequence, taking turns block by block,
+ * and must produce exactly the same events. The time of each app is
+ * summed over rounds of blocks, and the median ratio of the rounds is
+ * reported, which is robust against rounds disturbed by other work on the
+ * host. Without a cycle counter, the stages only count blocks, and the
+ * composed app must be no slower than the hand written one, within the
+ * tolerance given by -t. The rounds are then repeated
+ * with a cycle counter set, which reports the time spent in each stage
+ * and what the counting costs.
+ *
+ *   graph_bench [-r rounds] [-b blocks_per_round] [-t tolerance_percent]
+ */
+#include <microdsp_demos/microdsp_demos.h>
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audio_callbacks.h"
+#include "bench_util.h"
+
+#define SAMPLE_RATE 44444.444f
+#define BLOCK_N_FRAMES 256
+#define MAX_STAGE_COUNT 8
+#define MAX_BLOCK_EVENTS 32
+#define MAX_ROUND_COUNT 10000
+
+typedef enum {
+    APP_COMPOSED,
+    APP_HAND_WRITTEN,
+    APP_COUNT,
+} app_index_t;
+
+static const char* app_names[APP_COUNT] = { "mpm", "mpm_reference" };
+
+typedef struct {
+    const demo_app_vtable_t* vtable;
+    void* app;
+} bench_app_t;
+
+typedef struct {
+    uint64_t best_round_ns[APP_COUNT];
+    /* Median over the rounds of the composed app's time relative to the
+       hand written app's */
+    double median_ratio;
+    uint32_t event_count;
+    bool events_match;
+} rounds_result_t;
+
+static uint32_t ns_counter(void)
+{
+    return (uint32_t)now_ns();
+}
+
+/* The targets of the tuner demos and tones between them, 0.3 s each with
+   a harmonic and some noise, with 0.1 s of silence in between */
+static void make_block(float* block, uint32_t frame, uint32_t* noise_state)
+{
+    static const float frequencies[] = { 440.0f, 330.0f, 262.0f, 392.0f, 300.0f, 415.0f };
+    const uint32_t tone_frames = (uint32_t)(0.3f * SAMPLE_RATE);
+    const uint32_t case_frames = (uint32_t)(0.4f * SAMPLE_RATE);
+    for (int i = 0; i < BLOCK_N_FRAMES; i++) {
+        uint32_t case_index = (frame + i) / case_frames;
+        uint32_t case_frame = (frame + i) % case_frames;
+        float f = frequencies[case_index % (sizeof(frequencies) / sizeof(frequencies[0]))];
+        float t = case_frame / SAMPLE_RATE;
+        float x = 0.01f * next_noise(noise_state);
+        if (case_frame < tone_frames) {
+            x += 0.3f * sinf(2.0f * (float)M_PI * f * t) + 0.1f * sinf(4.0f * (float)M_PI * f * t);
+        }
+        block[i] = x;
+    }
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void run_rounds(bench_app_t* apps, int round_count, int blocks_per_round, uint32_t* frame,
+                       rounds_result_t* result)
+{
+    static float blocks[1024][BLOCK_N_FRAMES];
+    static app_event_t events[APP_COUNT][1024 * MAX_BLOCK_EVENTS];
+    static double ratios[MAX_ROUND_COUNT];
+    uint32_t noise_state = *frame;
+    float tx_buffers[AUDIO_MAX_CHANNELS][BLOCK_N_FRAMES];
+    float* tx[APP_COUNT][AUDIO_MAX_CHANNELS];
+    for (int app = 0; app < APP_COUNT; app++) {
+        result->best_round_ns[app] = UINT64_MAX;
+        for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+            tx[app][c] = apps[app].vtable->tx_channel_mask & (1 << c) ? tx_buffers[c] : NULL;
+        }
+    }
+    result->event_count = 0;
+    result->events_match = true;
+
+    for (int round = 0; round < round_count; round++) {
+        for (int block = 0; block < blocks_per_round; block++) {
+            make_block(blocks[block], *frame + block * BLOCK_N_FRAMES, &noise_state);
+        }
+        *frame += blocks_per_round * BLOCK_N_FRAMES;
+
+        uint64_t round_ns[APP_COUNT] = { 0 };
+        uint32_t counts[APP_COUNT] = { 0 };
+        for (int block = 0; block < blocks_per_round; block++) {
+            /* Alternate which app goes first, so that neither gets the
+               warmer caches */
+            for (int i = 0; i < APP_COUNT; i++) {
+                int app = (block + i) % APP_COUNT;
+                const float* rx[AUDIO_MAX_CHANNELS];
+                for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+                    rx[c] = apps[app].vtable->rx_channel_mask & (1 << c) ? blocks[block] : NULL;
+                }
+                uint64_t start = now_ns();
+                apps[app].vtable->process_channels(apps[app].app, tx[app], rx, BLOCK_N_FRAMES);
+                counts[app] += apps[app].vtable->take_events(apps[app].app, &events[app][counts[app]], MAX_BLOCK_EVENTS);
+                round_ns[app] += now_ns() - start;
+            }
+        }
+        for (int app = 0; app < APP_COUNT; app++) {
+            if (round_ns[app] < result->best_round_ns[app]) {
+                result->best_round_ns[app] = round_ns[app];
+            }
+        }
+        ratios[round] = (double)round_ns[APP_COMPOSED] / round_ns[APP_HAND_WRITTEN];
+
+        if (counts[APP_COMPOSED] != counts[APP_HAND_WRITTEN]) {
+            result->events_match = false;
+            continue;
+        }
+        for (uint32_t i = 0; i < counts[APP_COMPOSED]; i++) {
+            const app_event_t* a = &events[APP_COMPOSED][i];
+            const app_event_t* b = &events[APP_HAND_WRITTEN][i];
+            if (a->timestamp != b->timestamp || a->message != b->message || memcmp(&a->value, &b->value, sizeof(float))) {
+                result->events_match = false;
+            }
+        }
+        result->event_count += counts[APP_COMPOSED];
+    }
+    qsort(ratios, round_count, sizeof(double), compare_doubles);
+    result->median_ratio = ratios[round_count / 2];
+}
+
+int main(int argc, char** argv)
+{
+    int round_count = 100;
+    int blocks_per_round = 20;
+    double tolerance_percent = 2.0;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:b:t:")) != -1) {
+        switch (opt) {
+        case 'r':
+            round_count = atoi(optarg);
+            break;
+        case 'b':
+            blocks_per_round = atoi(optarg);
+            break;
+        case 't':
+            tolerance_percent = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r rounds] [-b blocks_per_round] [-t tolerance_percent]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (round_count < 1 || round_count > MAX_ROUND_COUNT || blocks_per_round < 1 || blocks_per_round > 1024) {
+        fprintf(stderr, "needs 1 to %d rounds of 1 to 1024 blocks\n", MAX_ROUND_COUNT);
+        return 1;
+    }
+
+    bool ok = true;
+    ok &= check(demo_registry_abi_version() == DEMO_APP_ABI_VERSION, "ABI version");
+    bench_app_t apps[APP_COUNT];
+    for (int app = 0; app < APP_COUNT; app++) {
+        apps[app].vtable = demo_registry_find(app_names[app]);
+        if (!check(apps[app].vtable != NULL, "composed and hand written demos registered")) {
+            return 1;
+        }
+        apps[app].app = demo_registry_create(apps[app].vtable, SAMPLE_RATE);
+        if (!check(apps[app].app != NULL, "apps created")) {
+            return 1;
+        }
+    }
+    allocator_stats_t allocator_stats;
+    demo_app_allocator_stats(&allocator_stats);
+    ok &= check(allocator_stats.locked_allocation_count == 0, "no allocations after create");
+
+    /* Without cycle counting */
+    uint32_t frame = 0;
+    rounds_result_t result;
+    run_rounds(apps, round_count, blocks_per_round, &frame, &result);
+    ok &= check(result.events_match, "same events from both apps");
+    ok &= check(result.event_count > 0, "events detected");
+    printf("%d rounds of %d blocks of %d frames per app, %u events each\n",
+           round_count, blocks_per_round, BLOCK_N_FRAMES, (unsigned int)result.event_count);
+    for (int app = 0; app < APP_COUNT; app++) {
+        printf("  %-14s %8.3f us per block in the best round\n", app_names[app],
+               result.best_round_ns[app] / 1e3 / blocks_per_round);
+    }
+    double overhead_percent = 100.0 * (result.median_ratio - 1.0);
+    printf("  composed %+.3f%% in the median round (tolerance %.1f%%)\n", overhead_percent, tolerance_percent);
+    ok &= check(overhead_percent <= tolerance_percent, "composed app no slower than the hand written one");
+
+    /* With cycle counting. The stage counts so far are subtracted. */
+    demo_stage_stats_t before[MAX_STAGE_COUNT];
+    demo_stage_stats_t after[MAX_STAGE_COUNT];
+    const demo_app_vtable_t* composed = apps[APP_COMPOSED].vtable;
+    uint32_t stage_count = composed->stage_stats(apps[APP_COMPOSED].app, before, MAX_STAGE_COUNT);
+    ok &= check(stage_count > 1, "composed app has stages");
+    ok &= check(apps[APP_HAND_WRITTEN].vtable->stage_stats(apps[APP_HAND_WRITTEN].app, after, MAX_STAGE_COUNT) == 0,
+                "hand written app has no stages");
+    demo_stage_set_cycle_counter(ns_counter);
+    run_rounds(apps, round_count, blocks_per_round, &frame, &result);
+    demo_stage_set_cycle_counter(NULL);
+    ok &= check(result.events_match, "same events from both apps with cycle counting");
+    composed->stage_stats(apps[APP_COMPOSED].app, after, MAX_STAGE_COUNT);
+
+    printf("\nwith a clock_gettime cycle counter, composed %+.3f%% in the median round\n",
+           100.0 * (result.median_ratio - 1.0));
+    uint64_t stage_sum_ns = 0;
+    for (uint32_t i = 0; i < stage_count; i++) {
+        uint32_t blocks = after[i].block_count - before[i].block_count;
+        ok &= check(blocks == (uint32_t)(round_count * blocks_per_round), "every block counted by every stage");
+        ok &= check(before[i].total_cycles == 0, "no cycles counted without a counter");
+        double mean_ns = blocks ? (double)(after[i].total_cycles - before[i].total_cycles) / blocks : 0.0;
+        stage_sum_ns += after[i].total_cycles - before[i].total_cycles;
+        printf("  %-10s %8.3f us mean, %8.3f us max per block\n", after[i].name, mean_ns / 1e3,
+               after[i].max_cycles / 1e3);
+    }
+    printf("  all stages %8.3f us mean per block\n", (double)stage_sum_ns / (round_count * blocks_per_round) / 1e3);
+
+    for (int app = 0; app < APP_COUNT; app++) {
+        demo_registry_destroy(apps[app].vtable, apps[app].app);
+    }
+    printf("\n%s\n", ok ? "all checks passed" : "some checks FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,545 @@
+#include "i2s_mock.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nrfx_i2s.h>
+#include <zephyr/zephyr.h>
+
+/* Stamps of captured periods wrap around after this many periods */
+#define STAMP_PERIOD_COUNT 8192
+#define STAMP_FRAME_BITS 10
+
+static i2s_mock_cfg_t cfg;
+static i2s_mock_stats_t stats;
+static uint64_t now_ns;
+static uint32_t random_state;
+
+/***********************************************************
+ * Scheduler
+ *
+ * There is a single thread besides the simulation itself,
+ * the processing thread created by i2s_start. It runs on a
+ * POSIX thread that only proceeds while it holds the CPU,
+ * which is handed back and forth under handoff_mutex.
+ ***********************************************************/
+typedef enum {
+    THREAD_UNUSED,
+    THREAD_READY,
+    THREAD_BUSY,
+    THREAD_PENDING,
+} thread_state_t;
+
+typedef enum {
+    CONTEXT_MAIN,
+    CONTEXT_THREAD,
+    CONTEXT_ISR,
+} context_t;
+
+static struct {
+    pthread_t pthread;
+    thread_state_t state;
+    uint64_t busy_until_ns;
+    struct k_sem* pending_sem;
+    k_thread_entry_t entry;
+    void* p1;
+    void* p2;
+    void* p3;
+} thread;
+
+static pthread_mutex_t handoff_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t handoff_cond = PTHREAD_COND_INITIALIZER;
+static bool thread_has_cpu = false;
+static context_t context = CONTEXT_MAIN;
+static bool irq_locked = false;
+
+static int (*connected_isr)(void) = NULL;
+static bool isr_pending = false;
+static uint64_t isr_time_ns;
+
+static void log_event(const char* format, const char* what)
+{
+    if (cfg.log) {
+        fprintf(cfg.log, "%12.3f ms  ", now_ns / 1e6);
+        fprintf(cfg.log, format, what);
+        fprintf(cfg.log, "\n");
+    }
+}
+
+uint32_t i2s_mock_random(void)
+{
+    /* xorshift32 */
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static uint64_t random_below(uint64_t limit)
+{
+    return limit > 0 ? ((uint64_t)i2s_mock_random() << 32 | i2s_mock_random()) % limit : 0;
+}
+
+/* Called by the scheduler. Returns once the thread has given the CPU back. */
+static void run_thread(void)
+{
+    context = CONTEXT_THREAD;
+    pthread_mutex_lock(&handoff_mutex);
+    thread_has_cpu = true;
+    pthread_cond_broadcast(&handoff_cond);
+    while (thread_has_cpu) {
+        pthread_cond_wait(&handoff_cond, &handoff_mutex);
+    }
+    pthread_mutex_unlock(&handoff_mutex);
+    context = CONTEXT_MAIN;
+}
+
+static void wait_for_cpu(void)
+{
+    while (!thread_has_cpu) {
+        pthread_cond_wait(&handoff_cond, &handoff_mutex);
+    }
+}
+
+/* Called by the thread after setting its state. Returns once the
+   scheduler runs it again. */
+static void yield_to_scheduler(void)
+{
+    pthread_mutex_lock(&handoff_mutex);
+    thread_has_cpu = false;
+    pthread_cond_broadcast(&handoff_cond);
+    wait_for_cpu();
+    pthread_mutex_unlock(&handoff_mutex);
+}
+
+static void* thread_main(void* arg)
+{
+    pthread_mutex_lock(&handoff_mutex);
+    wait_for_cpu();
+    pthread_mutex_unlock(&handoff_mutex);
+    thread.entry(thread.p1, thread.p2, thread.p3);
+    /* Threads are not expected to return */
+    thread.state = THREAD_UNUSED;
+    pthread_mutex_lock(&handoff_mutex);
+    thread_has_cpu = false;
+    pthread_cond_broadcast(&handoff_cond);
+    pthread_mutex_unlock(&handoff_mutex);
+    return NULL;
+}
+
+void i2s_mock_busy(uint64_t ns)
+{
+    if (context != CONTEXT_THREAD || ns == 0) {
+        return;
+    }
+    thread.state = THREAD_BUSY;
+    thread.busy_until_ns = now_ns + ns;
+    yield_to_scheduler();
+}
+
+static void preemption_point(void)
+{
+    if (context != CONTEXT_THREAD || irq_locked || cfg.preemption_probability <= 0.0) {
+        return;
+    }
+    if (i2s_mock_random() < cfg.preemption_probability * UINT32_MAX) {
+        stats.preemption_count++;
+        i2s_mock_busy(1 + random_below(cfg.max_preemption_ns));
+    }
+}
+
+/***********************************************************
+ * Zephyr kernel
+ ***********************************************************/
+void zephyr_shim_atomic_hook(void)
+{
+    preemption_point();
+}
+
+void zephyr_shim_assert_failed(const char* file, int line, const char* condition)
+{
+    stats.assert_count++;
+    if (cfg.log) {
+        fprintf(cfg.log, "%12.3f ms  assertion failed at %s:%d: %s\n", now_ns / 1e6, file, line, condition);
+    }
+}
+
+int k_sem_take(struct k_sem* sem, k_timeout_t timeout)
+{
+    if (sem->count > 0) {
+        sem->count--;
+        return 0;
+    }
+    if (timeout.ticks == K_NO_WAIT.ticks) {
+        return -EBUSY;
+    }
+    if (context != CONTEXT_THREAD || timeout.ticks != K_FOREVER.ticks) {
+        fprintf(stderr, "k_sem_take: only K_FOREVER waits on the processing thread are simulated\n");
+        abort();
+    }
+    thread.state = THREAD_PENDING;
+    thread.pending_sem = sem;
+    yield_to_scheduler();
+    return 0;
+}
+
+void k_sem_give(struct k_sem* sem)
+{
+    if (thread.state == THREAD_PENDING && thread.pending_sem == sem) {
+        thread.state = THREAD_READY;
+        thread.pending_sem = NULL;
+    } else if (sem->count < sem->limit) {
+        sem->count++;
+    }
+}
+
+k_tid_t k_thread_create(
+    struct k_thread* new_thread,
+    k_thread_stack_t* stack,
+    size_t stack_size,
+    k_thread_entry_t entry,
+    void* p1, void* p2, void* p3,
+    int priority, uint32_t options, k_timeout_t delay
+)
+{
+    if (thread.state != THREAD_UNUSED) {
+        fprintf(stderr, "k_thread_create: only one thread is simulated\n");
+        abort();
+    }
+    thread.entry = entry;
+    thread.p1 = p1;
+    thread.p2 = p2;
+    thread.p3 = p3;
+    thread.state = THREAD_READY;
+    pthread_create(&thread.pthread, NULL, thread_main, NULL);
+    return new_thread;
+}
+
+void k_yield(void)
+{
+}
+
+uint32_t sys_clock_hw_cycles_per_sec(void)
+{
+    return cfg.cycles_per_sec;
+}
+
+uint32_t k_cycle_get_32(void)
+{
+    preemption_point();
+    return (uint32_t)(uint64_t)((double)now_ns * cfg.cycles_per_sec / 1e9);
+}
+
+unsigned int irq_lock(void)
+{
+    unsigned int key = irq_locked;
+    irq_locked = true;
+    return key;
+}
+
+void irq_unlock(unsigned int key)
+{
+    irq_locked = key;
+    preemption_point();
+}
+
+void zephyr_shim_irq_connect(int irq, int (*isr)(void))
+{
+    connected_isr = isr;
+}
+
+/***********************************************************
+ * I2S peripheral and nrfx driver
+ ***********************************************************/
+static const nrfx_i2s_buffers_t no_buffers = { NULL, NULL };
+
+static struct {
+    bool started;
+    uint32_t frames_per_period;
+    /* Index of the next period to start */
+    uint32_t period_index;
+    uint64_t next_period_ns;
+    /* Pointer registers, and the buffers latched for the current period */
+    nrfx_i2s_buffers_t ptr_registers;
+    nrfx_i2s_buffers_t dma;
+    bool ptr_update_event;
+} hw;
+
+static struct {
+    nrfx_i2s_data_handler_t handler;
+    nrfx_i2s_buffers_t current;
+    nrfx_i2s_buffers_t next;
+    bool buffers_needed;
+} driver;
+
+/* State of the output check */
+static struct {
+    bool audio_started;
+    bool in_glitch;
+    uint32_t previous_stamp;
+} output;
+
+static bool same_buffers(const nrfx_i2s_buffers_t* a, const nrfx_i2s_buffers_t* b)
+{
+    return a->p_rx_buffer == b->p_rx_buffer && a->p_tx_buffer == b->p_tx_buffer;
+}
+
+static int32_t stamp_sample(uint32_t period, uint32_t frame)
+{
+    return (int32_t)(((period % STAMP_PERIOD_COUNT) << STAMP_FRAME_BITS) | (frame & ((1 << STAMP_FRAME_BITS) - 1)));
+}
+
+static void capture_period(int32_t* rx, uint32_t period)
+{
+    for (uint32_t i = 0; i < hw.frames_per_period; i++) {
+        rx[2 * i] = stamp_sample(period, i);
+        rx[2 * i + 1] = stamp_sample(period, i);
+    }
+}
+
+static void check_transmitted_period(const int32_t* tx, uint32_t period)
+{
+    bool silent = true;
+    for (uint32_t i = 0; i < 2 * hw.frames_per_period && silent; i++) {
+        silent = tx[i] == 0;
+    }
+    if (silent) {
+        if (output.audio_started && !output.in_glitch) {
+            stats.glitch_count++;
+            output.in_glitch = true;
+            log_event("%s", "glitch: silent period");
+        }
+        return;
+    }
+
+    uint32_t stamp = (uint32_t)tx[0] >> STAMP_FRAME_BITS;
+    for (uint32_t i = 0; i < hw.frames_per_period; i++) {
+        if (tx[2 * i] != stamp_sample(stamp, i) || tx[2 * i + 1] != stamp_sample(stamp, i)) {
+            stats.torn_block_count++;
+            log_event("%s", "glitch: transmitted period mixes captured periods");
+            break;
+        }
+    }
+    if (!output.audio_started) {
+        output.audio_started = true;
+    } else if (stamp != (output.previous_stamp + 1) % STAMP_PERIOD_COUNT && !output.in_glitch) {
+        stats.glitch_count++;
+        log_event("%s", "glitch: transmitted period is not the next captured period");
+    }
+    int32_t latency = (int32_t)((period - stamp) % STAMP_PERIOD_COUNT);
+    if (stats.latency_periods >= 0 && latency != stats.latency_periods) {
+        log_event("%s", "latency changed");
+    }
+    stats.latency_periods = latency;
+    output.previous_stamp = stamp;
+    output.in_glitch = false;
+}
+
+static bool owned_by_hardware(const void* buffer, bool rx)
+{
+    if (!hw.started || buffer == NULL) {
+        return false;
+    }
+    const void* dma = rx ? (const void*)hw.dma.p_rx_buffer : (const void*)hw.dma.p_tx_buffer;
+    const void* next = rx ? (const void*)hw.ptr_registers.p_rx_buffer : (const void*)hw.ptr_registers.p_tx_buffer;
+    return buffer == dma || buffer == next;
+}
+
+void i2s_mock_check_rx_access(const int32_t* rx)
+{
+    preemption_point();
+    if (owned_by_hardware(rx, true)) {
+        stats.rx_hazard_count++;
+        log_event("%s", "hazard: rx buffer read while in use by the hardware");
+    }
+}
+
+void i2s_mock_check_tx_access(const int32_t* tx)
+{
+    preemption_point();
+    if (owned_by_hardware(tx, false)) {
+        stats.tx_hazard_count++;
+        log_event("%s", "hazard: tx buffer written while in use by the hardware");
+    }
+}
+
+nrfx_err_t nrfx_i2s_init(nrfx_i2s_config_t const* p_config, nrfx_i2s_data_handler_t handler)
+{
+    driver.handler = handler;
+    return NRFX_SUCCESS;
+}
+
+nrfx_err_t nrfx_i2s_start(nrfx_i2s_buffers_t const* p_initial_buffers, uint16_t buffer_size, uint8_t flags)
+{
+    if (hw.started) {
+        return NRFX_ERROR_INVALID_STATE;
+    }
+    /* The first buffers are released on the second pointer update */
+    driver.current = no_buffers;
+    driver.next = *p_initial_buffers;
+    driver.buffers_needed = false;
+
+    hw.frames_per_period = buffer_size / 2;
+    hw.ptr_registers = *p_initial_buffers;
+    hw.dma = no_buffers;
+    hw.period_index = 0;
+    hw.next_period_ns = now_ns;
+    hw.started = true;
+    return NRFX_SUCCESS;
+}
+
+nrfx_err_t nrfx_i2s_next_buffers_set(nrfx_i2s_buffers_t const* p_buffers)
+{
+    if (!driver.buffers_needed) {
+        stats.swap_error_count++;
+        log_event("%s", "swap error: next buffers set while none were requested");
+        return NRFX_ERROR_INVALID_STATE;
+    }
+    if (p_buffers->p_rx_buffer == hw.dma.p_rx_buffer || p_buffers->p_tx_buffer == hw.dma.p_tx_buffer) {
+        stats.swap_error_count++;
+        log_event("%s", "swap error: next buffers are in use by the hardware");
+    }
+    hw.ptr_registers = *p_buffers;
+    driver.next = *p_buffers;
+    driver.buffers_needed = false;
+    return NRFX_SUCCESS;
+}
+
+void nrfx_i2s_stop(void)
+{
+    hw.started = false;
+}
+
+/* Both pointer update events are set at the start of each period, and
+   cleared by the interrupt handler */
+bool nrf_i2s_event_check(NRF_I2S_Type const* p_reg, nrf_i2s_event_t event)
+{
+    preemption_point();
+    return event != NRF_I2S_EVENT_STOPPED && hw.ptr_update_event;
+}
+
+/* Mirrors the buffer handling of nrfx_i2s_irq_handler */
+void nrfx_i2s_irq_handler(void)
+{
+    if (!hw.ptr_update_event) {
+        return;
+    }
+    hw.ptr_update_event = false;
+    if (driver.buffers_needed) {
+        /* The buffers were not provided in time, so the hardware is
+           reusing the current ones and nothing is released */
+        driver.handler(NULL, NRFX_I2S_STATUS_NEXT_BUFFERS_NEEDED);
+    } else {
+        nrfx_i2s_buffers_t released = driver.current;
+        driver.current = driver.next;
+        driver.next = no_buffers;
+        driver.buffers_needed = true;
+        if (!same_buffers(&driver.current, &hw.dma)) {
+            stats.desync_count++;
+            log_event("%s", "swap error: the driver and the hardware disagree on the current buffers");
+        }
+        driver.handler(&released, NRFX_I2S_STATUS_NEXT_BUFFERS_NEEDED);
+    }
+}
+
+/* End of a period: the transfer of the latched buffers completes and the
+   pointer registers are latched for the next period */
+static void start_next_period(void)
+{
+    if (hw.period_index > 0) {
+        uint32_t period = hw.period_index - 1;
+        capture_period((int32_t*)hw.dma.p_rx_buffer, period);
+        check_transmitted_period((const int32_t*)hw.dma.p_tx_buffer, period);
+        stats.period_count++;
+        if (same_buffers(&hw.ptr_registers, &hw.dma)) {
+            stats.buffer_reuse_count++;
+            log_event("%s", "buffer reuse: no new buffers, repeating the current ones");
+        }
+    }
+    hw.dma = hw.ptr_registers;
+    hw.ptr_update_event = true;
+    hw.period_index++;
+    hw.next_period_ns = (uint64_t)(hw.period_index * (double)hw.frames_per_period * 1e9 / cfg.sample_rate + 0.5);
+    isr_pending = true;
+    isr_time_ns = now_ns + random_below(cfg.max_isr_latency_ns + 1);
+}
+
+static void dispatch_isr(void)
+{
+    isr_pending = false;
+    stats.isr_count++;
+    context = CONTEXT_ISR;
+    if (connected_isr) {
+        connected_isr();
+    }
+    context = CONTEXT_MAIN;
+}
+
+/***********************************************************
+ * Simulation
+ ***********************************************************/
+void i2s_mock_init(const i2s_mock_cfg_t* new_cfg)
+{
+    cfg = *new_cfg;
+    memset(&stats, 0, sizeof(stats));
+    stats.latency_periods = -1;
+    random_state = cfg.seed ? cfg.seed : 1;
+    now_ns = 0;
+}
+
+void i2s_mock_run(void)
+{
+    while (true) {
+        if (irq_locked) {
+            fprintf(stderr, "the processing thread gave up the CPU with interrupts locked\n");
+            abort();
+        }
+        if (isr_pending && isr_time_ns <= now_ns) {
+            dispatch_isr();
+            continue;
+        }
+        if (hw.started && hw.next_period_ns <= now_ns) {
+            start_next_period();
+            continue;
+        }
+        if (thread.state == THREAD_READY) {
+            run_thread();
+            continue;
+        }
+
+        uint64_t next_ns = UINT64_MAX;
+        if (hw.started) {
+            next_ns = hw.next_period_ns;
+        }
+        if (isr_pending && isr_time_ns < next_ns) {
+            next_ns = isr_time_ns;
+        }
+        if (thread.state == THREAD_BUSY && thread.busy_until_ns < next_ns) {
+            next_ns = thread.busy_until_ns;
+        }
+        if (next_ns >= cfg.duration_ns) {
+            break;
+        }
+        now_ns = next_ns;
+        if (thread.state == THREAD_BUSY && thread.busy_until_ns <= now_ns) {
+            thread.state = THREAD_READY;
+        }
+    }
+}
+
+const i2s_mock_stats_t* i2s_mock_stats(void)
+{
+    return &stats;
+}
+
+uint64_t i2s_mock_time_ns(void)
+{
+    return now_ns;
+}
+
+uint64_t i2s_mock_period_ns(void)
+{
+    return (uint64_t)(hw.frames_per_period * 1e9 / cfg.sample_rate);
+}
@@ -0,0 +1,98 @@
+/*
+ * Deterministic host-side model of the nRF I2S peripheral, the nrfx I2S
+ * driver and the parts of the Zephyr kernel used by src/i2s.c, so that the
+ * real driver code can be run against a virtual sample clock.
+ *
+ * Time only advances when the scheduler says so. The processing thread
+ * created by i2s_start runs on its own POSIX thread, but only while the
+ * scheduler has handed it the CPU, so every run with the same settings
+ * and seed takes the same path. Code runs in zero virtual time, except
+ * for i2s_mock_busy, which models CPU time spent on the calling thread,
+ * and preemptions injected at preemption points (atomic operations,
+ * cycle counter reads, irq_unlock and buffer accesses). Interrupts are
+ * delivered whenever the thread is busy or preempted and interrupts are
+ * not locked.
+ *
+ * The hardware double buffers the buffer pointers like the peripheral
+ * does: at the start of each period it latches the pointers set last,
+ * whether or not the driver has provided new ones. Every period of rx
+ * data is stamped with its period index and frame offset, and every
+ * transmitted period is checked for the stamps of consecutive captured
+ * periods, so with a loopback processing callback any audible glitch is
+ * detected.
+ */
+#ifndef I2S_MOCK_H
+#define I2S_MOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct {
+    double sample_rate;
+    uint64_t duration_ns;
+    uint32_t seed;
+    /* Rate of k_cycle_get_32. The nRF52 system timer runs at 32768 Hz. */
+    uint32_t cycles_per_sec;
+    /* Probability that the processing thread is preempted at each
+       preemption point, and the longest preemption */
+    double preemption_probability;
+    uint64_t max_preemption_ns;
+    /* Longest delay from the pointer update at the start of a period to
+       the interrupt handler running. Must be shorter than a period. */
+    uint64_t max_isr_latency_ns;
+    /* If not NULL, every anomaly is logged here */
+    FILE* log;
+} i2s_mock_cfg_t;
+
+typedef struct {
+    uint32_t period_count;
+    uint32_t isr_count;
+    uint32_t preemption_count;
+    /* Periods for which the hardware latched the buffers it had just used,
+       because the driver did not provide new ones in time */
+    uint32_t buffer_reuse_count;
+    /* Rejected or unsafe calls to nrfx_i2s_next_buffers_set, and periods
+       in which the driver's idea of the current buffers differs from the
+       buffers the hardware is actually using */
+    uint32_t swap_error_count;
+    uint32_t desync_count;
+    /* Reads of rx buffers and writes of tx buffers that the hardware is
+       using or has been given for the next period */
+    uint32_t rx_hazard_count;
+    uint32_t tx_hazard_count;
+    uint32_t assert_count;
+    /* Transmitted periods that were not the continuation of the previous
+       one, i.e silence after the first captured audio or a jump, and
+       periods mixing data from different captured periods */
+    uint32_t glitch_count;
+    uint32_t torn_block_count;
+    /* Periods from capture to transmission, -1 until audio comes out */
+    int32_t latency_periods;
+} i2s_mock_stats_t;
+
+void i2s_mock_init(const i2s_mock_cfg_t* cfg);
+
+/* Runs the simulation for cfg.duration_ns. i2s_start must have been
+   called before. */
+void i2s_mock_run(void);
+
+const i2s_mock_stats_t* i2s_mock_stats(void);
+uint64_t i2s_mock_time_ns(void);
+
+/* Length of a period once the hardware has been started */
+uint64_t i2s_mock_period_ns(void);
+
+/* Spends ns of CPU time on the calling thread. Interrupts may be
+   delivered meanwhile. Only valid on the processing thread. */
+void i2s_mock_busy(uint64_t ns);
+
+/* Deterministic pseudo random numbers */
+uint32_t i2s_mock_random(void);
+
+/* Check that a period's buffers may be accessed by the processing thread,
+   counting a hazard if not. Also preemption points. */
+void i2s_mock_check_rx_access(const int32_t* rx);
+void i2s_mock_check_tx_access(const int32_t* tx);
+
+#endif
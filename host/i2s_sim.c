@@ -0,0 +1,398 @@
+/*
+ * Runs the I2S driver in src/i2s.c against the virtual clock model in
+ * i2s_mock.c, with a loopback processing callback of configurable cost.
+ *
+ * Reports every dropout detected by the driver, every period in which the
+ * hardware had to reuse buffers, buffer swap errors, accesses to buffers
+ * owned by the hardware and glitches in the transmitted audio. Runs are
+ * deterministic for a given seed. Exits with an error if anything other
+ * than dropouts caused by overload was found, i.e hazards, swap errors,
+ * failed assertions, or glitches or buffer reuses without a dropout.
+ *
+ *   i2s_sim [options]
+ *     -n frames    period size (256)
+ *     -r depth     ring depth (2)
+ *     -d seconds   simulated time (10)
+ *     -c us        callback cost per period (0)
+ *     -j us        extra callback cost, uniformly distributed in [0, us] (0)
+ *     -p prob      probability of a preemption at each preemption point (0)
+ *     -P us        longest preemption (100)
+ *     -l us        longest interrupt latency (0)
+ *     -x seed      random seed (1)
+ *     -i           use the in place int32 processing callback
+ *     -g           run the load governor, which scales the callback cost
+ *                  down to the share an app keeps at each load level
+ *     -v           log every anomaly
+ *     -S a:b:step  sweep the callback cost from a to b us, printing CSV
+ *     -F           find the lowest callback cost that causes dropouts
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "audio_clock_config.h"
+#include "audio_stats.h"
+#include "i2s.h"
+#include "i2s_mock.h"
+#include "load_governor.h"
+#include "pcm_convert.h"
+
+typedef struct {
+    uint16_t period_n_frames;
+    uint8_t ring_depth;
+    double duration_s;
+    double cost_us;
+    double jitter_us;
+    double preemption_probability;
+    double max_preemption_us;
+    double max_isr_latency_us;
+    uint32_t seed;
+    bool int32_path;
+    bool governor;
+    bool verbose;
+} sim_settings_t;
+
+typedef struct {
+    i2s_mock_stats_t mock;
+    audio_stats_t audio;
+    uint32_t dropout_cb_count;
+    load_governor_stats_t governor;
+    nrfx_err_t start_result;
+} sim_result_t;
+
+static const sim_settings_t* settings;
+static uint32_t dropout_cb_count;
+
+/* i2s.c is built with its PCM conversion calls renamed to these, so that
+   every DMA buffer access is checked against the hardware state */
+void sim_pcm_deinterleave_to_float(const int32_t* pcm, unsigned int frame_count, float* left, float* right)
+{
+    i2s_mock_check_rx_access(pcm);
+    pcm_deinterleave_to_float(pcm, frame_count, left, right);
+}
+
+void sim_pcm_interleave_from_float(int32_t* pcm, unsigned int frame_count, const float* left, const float* right)
+{
+    i2s_mock_check_tx_access(pcm);
+    pcm_interleave_from_float(pcm, frame_count, left, right);
+}
+
+/* Share of the callback cost left at each load level with -g, roughly
+   that of the MPM demo searching 64 and 48 of its 128 lags */
+static const double governed_cost_share[LOAD_GOVERNOR_LEVEL_COUNT] = { 1.0, 0.55, 0.45 };
+
+static void spend_callback_cost(void)
+{
+    double share = settings->governor ? governed_cost_share[load_governor_level()] : 1.0;
+    uint64_t jitter_ns = (uint64_t)(1000 * share * settings->jitter_us);
+    uint64_t cost_ns = (uint64_t)(1000 * share * settings->cost_us);
+    if (jitter_ns > 0) {
+        cost_ns += i2s_mock_random() % (jitter_ns + 1);
+    }
+    i2s_mock_busy(cost_ns);
+}
+
+static void processing_cb(void* cb_data, unsigned int frame_count, float* const* tx, const float* const* rx)
+{
+    memcpy(tx[0], rx[0], frame_count * sizeof(float));
+    spend_callback_cost();
+}
+
+static void processing_i32_cb(void* cb_data, unsigned int frame_count, int32_t* tx, const int32_t* rx)
+{
+    i2s_mock_check_rx_access(rx);
+    i2s_mock_check_tx_access(tx);
+    memcpy(tx, rx, 2 * frame_count * sizeof(int32_t));
+    spend_callback_cost();
+}
+
+static void dropout_cb(void* cb_data)
+{
+    dropout_cb_count++;
+}
+
+static void load_cb(void* cb_data, uint32_t busy_cycles, uint32_t deadline_cycles)
+{
+    load_governor_update((uint32_t)((uint64_t)busy_cycles * 1000 / deadline_cycles));
+}
+
+static void run(const sim_settings_t* sim_settings, sim_result_t* result)
+{
+    settings = sim_settings;
+    i2s_mock_cfg_t cfg = {
+        .sample_rate = AUDIO_SAMPLE_RATE,
+        .duration_ns = (uint64_t)(1e9 * settings->duration_s),
+        .seed = settings->seed,
+        .cycles_per_sec = 32768,
+        .preemption_probability = settings->preemption_probability,
+        .max_preemption_ns = (uint64_t)(1000 * settings->max_preemption_us),
+        .max_isr_latency_ns = (uint64_t)(1000 * settings->max_isr_latency_us),
+        .log = settings->verbose ? stdout : NULL,
+    };
+    i2s_mock_init(&cfg);
+
+    i2s_pin_cfg_t pin_cfg = { 0 };
+    i2s_buffer_cfg_t buffer_cfg = {
+        .period_n_frames = settings->period_n_frames,
+        .ring_depth = settings->ring_depth,
+    };
+    static audio_callbacks_t audio_callbacks;
+    audio_callbacks = (audio_callbacks_t) {
+        .dropout_cb = dropout_cb,
+        .rx_channel_mask = AUDIO_CHANNEL_LEFT,
+        .tx_channel_mask = AUDIO_CHANNEL_LEFT,
+    };
+    if (settings->int32_path) {
+        audio_callbacks.processing_i32_cb = processing_i32_cb;
+    } else {
+        audio_callbacks.processing_cb = processing_cb;
+    }
+    if (settings->governor) {
+        load_governor_config_t governor_config = LOAD_GOVERNOR_DEFAULT_CONFIG;
+        load_governor_init(&governor_config);
+        audio_callbacks.load_cb = load_cb;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->start_result = i2s_start(&pin_cfg, &buffer_cfg, &audio_callbacks);
+    if (result->start_result == NRFX_SUCCESS) {
+        i2s_mock_run();
+    }
+    result->mock = *i2s_mock_stats();
+    audio_stats_snapshot(&result->audio);
+    load_governor_snapshot(&result->governor);
+    result->dropout_cb_count = dropout_cb_count;
+}
+
+/* The driver keeps its state in statics and its thread never exits, so
+   every run of a sweep gets its own process */
+static bool run_isolated(const sim_settings_t* sim_settings, sim_result_t* result)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        run(sim_settings, result);
+        ssize_t written = write(fds[1], result, sizeof(*result));
+        _exit(written == sizeof(*result) ? 0 : 1);
+    }
+    close(fds[1]);
+    bool ok = pid > 0 && read(fds[0], result, sizeof(*result)) == sizeof(*result);
+    close(fds[0]);
+    if (pid > 0) {
+        waitpid(pid, NULL, 0);
+    }
+    return ok;
+}
+
+static uint32_t hazard_count(const sim_result_t* result)
+{
+    return result->mock.rx_hazard_count + result->mock.tx_hazard_count;
+}
+
+/* Problems that are bugs at any load, rather than overload */
+static bool has_errors(const sim_result_t* result)
+{
+    uint32_t dropouts = result->audio.dropout_count;
+    return result->start_result != NRFX_SUCCESS
+        || hazard_count(result) > 0
+        || result->mock.swap_error_count > 0
+        || result->mock.desync_count > 0
+        || result->mock.assert_count > 0
+        || result->mock.torn_block_count > 0
+        || (dropouts == 0 && (result->mock.glitch_count > 0 || result->mock.buffer_reuse_count > 0))
+        || result->dropout_cb_count != dropouts;
+}
+
+static double period_us(const sim_settings_t* sim_settings)
+{
+    return 1e6 * sim_settings->period_n_frames / AUDIO_SAMPLE_RATE;
+}
+
+static void print_csv_header(void)
+{
+    printf("period_frames,ring_depth,cost_us,jitter_us,preemption_probability,"
+           "dropouts,buffer_reuses,glitches,swap_errors,desyncs,hazards,asserts,"
+           "max_processing_us,min_headroom_us,latency_periods\n");
+}
+
+static void print_csv_row(const sim_settings_t* sim_settings, const sim_result_t* result)
+{
+    printf("%u,%u,%.1f,%.1f,%g,%u,%u,%u,%u,%u,%u,%u,%.1f,%.1f,%d\n",
+        sim_settings->period_n_frames, sim_settings->ring_depth, sim_settings->cost_us,
+        sim_settings->jitter_us, sim_settings->preemption_probability,
+        result->audio.dropout_count, result->mock.buffer_reuse_count, result->mock.glitch_count,
+        result->mock.swap_error_count, result->mock.desync_count, hazard_count(result),
+        result->mock.assert_count, result->audio.processing_time_max_ns / 1000.0,
+        result->audio.min_headroom_ns == INT32_MAX ? 0.0 : result->audio.min_headroom_ns / 1000.0,
+        result->mock.latency_periods);
+}
+
+static void print_result(const sim_settings_t* sim_settings, const sim_result_t* result)
+{
+    const i2s_mock_stats_t* mock = &result->mock;
+    printf("period %u frames (%.1f us), ring depth %u, %s path, %.1f s at %.3f Hz\n",
+        sim_settings->period_n_frames, period_us(sim_settings), sim_settings->ring_depth,
+        sim_settings->int32_path ? "int32" : "float", sim_settings->duration_s, (double)AUDIO_SAMPLE_RATE);
+    printf("callback cost %.1f us + up to %.1f us, %u preemptions, interrupt latency up to %.1f us, seed %u\n",
+        sim_settings->cost_us, sim_settings->jitter_us, mock->preemption_count,
+        sim_settings->max_isr_latency_us, sim_settings->seed);
+    printf("  %u periods, %u interrupts, %u blocks processed\n",
+        mock->period_count, mock->isr_count, result->audio.block_count);
+    printf("  dropouts:       %u (%u reported to the callback)\n", result->audio.dropout_count, result->dropout_cb_count);
+    printf("  buffer reuses:  %u\n", mock->buffer_reuse_count);
+    printf("  glitches:       %u, %u torn periods, latency %d periods\n",
+        mock->glitch_count, mock->torn_block_count, mock->latency_periods);
+    printf("  swap errors:    %u, %u desyncs\n", mock->swap_error_count, mock->desync_count);
+    printf("  hazards:        %u rx, %u tx\n", mock->rx_hazard_count, mock->tx_hazard_count);
+    printf("  assertions:     %u failed\n", mock->assert_count);
+    audio_stats_print(&result->audio);
+    if (sim_settings->governor) {
+        load_governor_print(&result->governor);
+    }
+}
+
+static bool parse_range(const char* arg, double* from, double* to, double* step)
+{
+    return sscanf(arg, "%lf:%lf:%lf", from, to, step) == 3 && *step > 0 && *to >= *from;
+}
+
+static int sweep(sim_settings_t* sim_settings, double from, double to, double step)
+{
+    bool errors = false;
+    print_csv_header();
+    for (int i = 0; from + i * step <= to + 1e-9; i++) {
+        sim_settings->cost_us = from + i * step;
+        sim_result_t result;
+        if (!run_isolated(sim_settings, &result)) {
+            fprintf(stderr, "simulation at %.1f us failed\n", sim_settings->cost_us);
+            return 1;
+        }
+        print_csv_row(sim_settings, &result);
+        errors |= has_errors(&result);
+    }
+    return errors ? 1 : 0;
+}
+
+/* Bisects the callback cost between no load and ring_depth periods,
+   assuming that dropouts only get more likely with cost */
+static int find_dropout_threshold(sim_settings_t* sim_settings)
+{
+    double low = 0.0;
+    double high = sim_settings->ring_depth * period_us(sim_settings);
+    sim_result_t result;
+    sim_settings->cost_us = high;
+    if (!run_isolated(sim_settings, &result) || result.audio.dropout_count == 0) {
+        printf("no dropouts even at a callback cost of %.1f us\n", high);
+        return 1;
+    }
+    while (high - low > 1.0) {
+        sim_settings->cost_us = 0.5 * (low + high);
+        if (!run_isolated(sim_settings, &result)) {
+            return 1;
+        }
+        if (result.audio.dropout_count > 0) {
+            high = sim_settings->cost_us;
+        } else {
+            low = sim_settings->cost_us;
+        }
+    }
+    printf("period %u frames, ring depth %u: dropouts begin at a callback cost of %.0f us (%.1f%% of a period)\n",
+        sim_settings->period_n_frames, sim_settings->ring_depth, high, 100.0 * high / period_us(sim_settings));
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    sim_settings_t sim_settings = {
+        .period_n_frames = 256,
+        .ring_depth = 2,
+        .duration_s = 10.0,
+        .max_preemption_us = 100.0,
+        .seed = 1,
+    };
+    bool sweep_cost = false;
+    bool find_threshold = false;
+    double sweep_from = 0.0, sweep_to = 0.0, sweep_step = 0.0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:d:c:j:p:P:l:x:igvS:F")) != -1) {
+        switch (opt) {
+        case 'n':
+            sim_settings.period_n_frames = (uint16_t)atoi(optarg);
+            break;
+        case 'r':
+            sim_settings.ring_depth = (uint8_t)atoi(optarg);
+            break;
+        case 'd':
+            sim_settings.duration_s = atof(optarg);
+            break;
+        case 'c':
+            sim_settings.cost_us = atof(optarg);
+            break;
+        case 'j':
+            sim_settings.jitter_us = atof(optarg);
+            break;
+        case 'p':
+            sim_settings.preemption_probability = atof(optarg);
+            break;
+        case 'P':
+            sim_settings.max_preemption_us = atof(optarg);
+            break;
+        case 'l':
+            sim_settings.max_isr_latency_us = atof(optarg);
+            break;
+        case 'x':
+            sim_settings.seed = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            sim_settings.int32_path = true;
+            break;
+        case 'g':
+            sim_settings.governor = true;
+            break;
+        case 'v':
+            sim_settings.verbose = true;
+            break;
+        case 'S':
+            sweep_cost = parse_range(optarg, &sweep_from, &sweep_to, &sweep_step);
+            if (!sweep_cost) {
+                fprintf(stderr, "expected -S from:to:step\n");
+                return 1;
+            }
+            break;
+        case 'F':
+            find_threshold = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n frames] [-r depth] [-d seconds] [-c us] [-j us] [-p prob] [-P us] "
+                            "[-l us] [-x seed] [-i] [-g] [-v] [-S from:to:step] [-F]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (sim_settings.max_isr_latency_us >= period_us(&sim_settings)) {
+        fprintf(stderr, "the interrupt latency must be shorter than a period\n");
+        return 1;
+    }
+
+    if (sweep_cost) {
+        return sweep(&sim_settings, sweep_from, sweep_to, sweep_step);
+    }
+    if (find_threshold) {
+        return find_dropout_threshold(&sim_settings);
+    }
+    sim_result_t result;
+    run(&sim_settings, &result);
+    print_result(&sim_settings, &result);
+    bool errors = has_errors(&result);
+    printf("\n%s\n", errors ? "errors FOUND" : "no errors beyond dropouts");
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * Load levels of the demo apps and the load governor that sets them (see
+ * src/load_governor.h), against an all_demos build of the crate.
+ *
+ * First feeds the governor a scripted sequence of block loads and checks
+ * its decisions: raising the level right away at the thresholds, and
+ * lowering it one step at a time only after restore_blocks quiet blocks.
+ *
+ * Then runs every demo on the same test signal at each load level, with
+ * a fresh app per run, and reports the best time per block of a few
+ * rounds and the events detected. Checks that the MPM demo gets cheaper
+ * at every level while detecting the same tones, that the NLMS demo gets
+ * cheaper once adaptation is paused, and that the MPM demo still detects
+ * the same tones when the level changes every few blocks.
+ *
+ *   load_level_bench [-r rounds] [-b blocks]
+ */
+#include <microdsp_demos/microdsp_demos.h>
+
+#include <math.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audio_callbacks.h"
+#include "bench_util.h"
+#include "load_governor.h"
+
+#define SAMPLE_RATE 44444.444f
+#define BLOCK_N_FRAMES 256
+#define MAX_BLOCK_COUNT 2048
+#define EVENT_BATCH_SIZE 8
+/* Blocks between level changes in the switching run */
+#define SWITCH_INTERVAL 37
+
+static const char* level_names[LOAD_GOVERNOR_LEVEL_COUNT] = { "full", "reduced", "minimal" };
+
+typedef struct {
+    uint64_t best_ns;
+    /* PitchDetected, NoveltyDetected and DelayEstimated events */
+    uint32_t detection_count;
+    /* Sum of the detected values, to compare the detections of runs */
+    double detection_sum;
+} run_result_t;
+
+/* Used by load_governor_snapshot */
+void k_yield(void)
+{
+    sched_yield();
+}
+
+/* The targets of the tuner demos and tones between them, 0.3 s each with
+   a harmonic and some noise, with 0.1 s of silence in between */
+static void make_blocks(float (*blocks)[BLOCK_N_FRAMES], int block_count)
+{
+    static const float frequencies[] = { 440.0f, 330.0f, 262.0f, 392.0f, 300.0f, 415.0f };
+    const uint32_t tone_frames = (uint32_t)(0.3f * SAMPLE_RATE);
+    const uint32_t case_frames = (uint32_t)(0.4f * SAMPLE_RATE);
+    uint32_t noise_state = 1;
+    for (uint32_t frame = 0; frame < (uint32_t)block_count * BLOCK_N_FRAMES; frame++) {
+        uint32_t case_index = frame / case_frames;
+        uint32_t case_frame = frame % case_frames;
+        float f = frequencies[case_index % (sizeof(frequencies) / sizeof(frequencies[0]))];
+        float t = case_frame / SAMPLE_RATE;
+        float x = 0.01f * next_noise(&noise_state);
+        if (case_frame < tone_frames) {
+            x += 0.3f * sinf(2.0f * (float)M_PI * f * t) + 0.1f * sinf(4.0f * (float)M_PI * f * t);
+        }
+        blocks[frame / BLOCK_N_FRAMES][frame % BLOCK_N_FRAMES] = x;
+    }
+}
+
+/* Raising right away, restoring one step after restore_blocks quiet
+   blocks, and the counters */
+static bool check_governor(void)
+{
+    bool ok = true;
+    load_governor_config_t config = LOAD_GOVERNOR_DEFAULT_CONFIG;
+    load_governor_init(&config);
+    uint32_t quiet = config.restore_permille - 100;
+    uint32_t block_count = 0;
+
+    for (int i = 0; i < 200; i++, block_count++) {
+        ok &= check(load_governor_update(quiet) == DEMO_LOAD_FULL, "full while the load stays low");
+    }
+    block_count++;
+    ok &= check(load_governor_update(config.reduce_permille) == DEMO_LOAD_REDUCED, "reduced at the reduce threshold");
+    block_count++;
+    ok &= check(load_governor_update(config.reduce_permille) == DEMO_LOAD_REDUCED, "reduced above the reduce threshold");
+    for (int i = 0; i < config.restore_blocks - 1; i++, block_count++) {
+        ok &= check(load_governor_update(quiet) == DEMO_LOAD_REDUCED, "reduced until restore_blocks quiet blocks");
+    }
+    block_count++;
+    ok &= check(load_governor_update(quiet) == DEMO_LOAD_FULL, "full after restore_blocks quiet blocks");
+
+    block_count++;
+    ok &= check(load_governor_update(config.minimal_permille + 50) == DEMO_LOAD_MINIMAL, "minimal at the minimal threshold");
+    /* Loads between the restore and reduce thresholds keep the level */
+    for (int i = 0; i < 5 * config.restore_blocks; i++, block_count++) {
+        uint32_t load = i % 2 ? config.restore_permille : quiet;
+        ok &= check(load_governor_update(load) == DEMO_LOAD_MINIMAL, "minimal while the load is not quiet for long");
+    }
+    for (int i = 0; i < config.restore_blocks; i++, block_count++) {
+        load_governor_update(quiet);
+    }
+    ok &= check(load_governor_level() == DEMO_LOAD_REDUCED, "restored one step at a time");
+    for (int i = 0; i < config.restore_blocks; i++, block_count++) {
+        load_governor_update(quiet);
+    }
+    ok &= check(load_governor_level() == DEMO_LOAD_FULL, "restored to full");
+
+    load_governor_stats_t stats;
+    load_governor_snapshot(&stats);
+    uint32_t level_block_sum = 0;
+    for (int i = 0; i < LOAD_GOVERNOR_LEVEL_COUNT; i++) {
+        level_block_sum += stats.level_block_counts[i];
+    }
+    ok &= check(stats.block_count == block_count && level_block_sum == block_count, "every block counted once");
+    ok &= check(stats.raise_count == 2 && stats.restore_count == 3, "raises and restores counted");
+    ok &= check(stats.max_load_permille == config.minimal_permille + 50u, "max load");
+    ok &= check(stats.level_block_counts[DEMO_LOAD_REDUCED] == 1u + config.restore_blocks * 2u, "blocks at the reduced level");
+
+    load_governor_update(config.reduce_permille);
+    load_governor_request_reset();
+    load_governor_update(quiet);
+    load_governor_snapshot(&stats);
+    ok &= check(stats.block_count == 1 && stats.raise_count == 0 && stats.level == DEMO_LOAD_REDUCED,
+                "reset clears the counters but keeps the level");
+
+    printf("load governor: reduce at %u/1000, minimal at %u/1000, restore below %u/1000 after %u blocks, %s\n",
+           config.reduce_permille, config.minimal_permille, config.restore_permille, config.restore_blocks,
+           ok ? "decisions as expected" : "unexpected decisions");
+    return ok;
+}
+
+/* Sends the messages that make the demo do its most expensive work, i.e
+   the NLMS demo playing its tone and recording through the NLMS filter */
+static void start_demo(const demo_app_vtable_t* vtable, void* app)
+{
+    if (strcmp(vtable->name, "nlms") == 0) {
+        vtable->handle_message(app, Button0Down);
+        vtable->handle_message(app, Button1Down);
+        vtable->handle_message(app, Button2Down);
+    }
+}
+
+/* Runs a fresh app over the blocks. Changes the level every
+   SWITCH_INTERVAL blocks if switching, otherwise runs at level. */
+static void run_app(const demo_app_vtable_t* vtable, float (*blocks)[BLOCK_N_FRAMES], int block_count,
+                    demo_load_level_t level, bool switching, uint64_t* ns, run_result_t* result)
+{
+    static const demo_load_level_t switch_levels[] = { DEMO_LOAD_FULL, DEMO_LOAD_MINIMAL, DEMO_LOAD_REDUCED };
+    void* app = demo_registry_create(vtable, SAMPLE_RATE);
+    start_demo(vtable, app);
+    vtable->set_load_level(app, level);
+
+    float tx_buffers[AUDIO_MAX_CHANNELS][BLOCK_N_FRAMES];
+    float* tx[AUDIO_MAX_CHANNELS];
+    for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+        tx[c] = vtable->tx_channel_mask & (1 << c) ? tx_buffers[c] : NULL;
+    }
+    result->detection_count = 0;
+    result->detection_sum = 0.0;
+    *ns = 0;
+    for (int block = 0; block < block_count; block++) {
+        if (switching && block % SWITCH_INTERVAL == 0) {
+            vtable->set_load_level(app, switch_levels[(block / SWITCH_INTERVAL) % 3]);
+        }
+        const float* rx[AUDIO_MAX_CHANNELS];
+        for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+            rx[c] = vtable->rx_channel_mask & (1 << c) ? blocks[block] : NULL;
+        }
+        memset(tx_buffers, 0, sizeof(tx_buffers));
+        uint64_t start = now_ns();
+        vtable->process_channels(app, tx, rx, BLOCK_N_FRAMES);
+        *ns += now_ns() - start;
+
+        app_event_t events[EVENT_BATCH_SIZE];
+        uint32_t event_count;
+        while ((event_count = vtable->take_events(app, events, EVENT_BATCH_SIZE)) > 0) {
+            for (uint32_t i = 0; i < event_count; i++) {
+                if (events[i].message == PitchDetected || events[i].message == NoveltyDetected
+                    || events[i].message == DelayEstimated) {
+                    result->detection_count++;
+                    result->detection_sum += events[i].value;
+                }
+            }
+        }
+    }
+    demo_registry_destroy(vtable, app);
+}
+
+static void run_rounds(const demo_app_vtable_t* vtable, float (*blocks)[BLOCK_N_FRAMES], int block_count,
+                       int round_count, demo_load_level_t level, bool switching, run_result_t* result)
+{
+    result->best_ns = UINT64_MAX;
+    for (int round = 0; round < round_count; round++) {
+        uint64_t ns;
+        run_app(vtable, blocks, block_count, level, switching, &ns, result);
+        if (ns < result->best_ns) {
+            result->best_ns = ns;
+        }
+    }
+}
+
+static bool same_detections(const run_result_t* a, const run_result_t* b)
+{
+    return a->detection_count == b->detection_count && fabs(a->detection_sum - b->detection_sum) < 1e-3;
+}
+
+int main(int argc, char** argv)
+{
+    int round_count = 5;
+    int block_count = 700;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:b:")) != -1) {
+        switch (opt) {
+        case 'r':
+            round_count = atoi(optarg);
+            break;
+        case 'b':
+            block_count = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r rounds] [-b blocks]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (round_count < 1 || block_count < 1 || block_count > MAX_BLOCK_COUNT) {
+        fprintf(stderr, "needs at least one round of 1 to %d blocks\n", MAX_BLOCK_COUNT);
+        return 1;
+    }
+
+    bool ok = check_governor();
+    ok &= check(demo_registry_abi_version() == DEMO_APP_ABI_VERSION, "ABI version");
+
+    static float blocks[MAX_BLOCK_COUNT][BLOCK_N_FRAMES];
+    make_blocks(blocks, block_count);
+    printf("\n%d blocks of %d frames, best of %d rounds\n", block_count, BLOCK_N_FRAMES, round_count);
+    for (uint32_t i = 0; i < demo_registry_count(); i++) {
+        const demo_app_vtable_t* vtable = demo_registry_get(i);
+        if (!check(vtable->size >= offsetof(demo_app_vtable_t, set_load_level) + sizeof(vtable->set_load_level),
+                   "vtable has set_load_level")) {
+            return 1;
+        }
+        run_result_t results[LOAD_GOVERNOR_LEVEL_COUNT];
+        printf("  %s\n", vtable->name);
+        for (int level = 0; level < LOAD_GOVERNOR_LEVEL_COUNT; level++) {
+            run_rounds(vtable, blocks, block_count, round_count, level, false, &results[level]);
+            printf("    %-8s %8.3f us per block (%5.1f%%), %u detections\n", level_names[level],
+                   results[level].best_ns / 1e3 / block_count,
+                   100.0 * results[level].best_ns / results[DEMO_LOAD_FULL].best_ns,
+                   (unsigned int)results[level].detection_count);
+        }
+
+        if (strcmp(vtable->name, "mpm") == 0) {
+            ok &= check(results[DEMO_LOAD_FULL].detection_count > 0, "mpm detects tones");
+            ok &= check(results[DEMO_LOAD_REDUCED].best_ns < results[DEMO_LOAD_FULL].best_ns
+                        && results[DEMO_LOAD_MINIMAL].best_ns < results[DEMO_LOAD_REDUCED].best_ns,
+                        "mpm cheaper at every level");
+            for (int level = DEMO_LOAD_REDUCED; level < LOAD_GOVERNOR_LEVEL_COUNT; level++) {
+                ok &= check(same_detections(&results[level], &results[DEMO_LOAD_FULL]), "mpm detects the same tones at every level");
+            }
+            run_result_t switched;
+            run_rounds(vtable, blocks, block_count, 1, DEMO_LOAD_FULL, true, &switched);
+            printf("    switching every %d blocks, %u detections\n", SWITCH_INTERVAL, (unsigned int)switched.detection_count);
+            ok &= check(same_detections(&switched, &results[DEMO_LOAD_FULL]), "mpm detects the same tones while switching levels");
+        } else if (strcmp(vtable->name, "nlms") == 0) {
+            ok &= check(results[DEMO_LOAD_REDUCED].best_ns < results[DEMO_LOAD_FULL].best_ns,
+                        "nlms cheaper with adaptation paused");
+        }
+    }
+
+    printf("\n%s\n", ok ? "all checks passed" : "some checks FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,369 @@
+/*
+ * Runtime parameters of the demo apps and the firmware's parameter store
+ * (src/param_store.c), against an all_demos build of the crate.
+ *
+ * First a writer thread sets parameters of a made up demo as fast as it
+ * can while a reader thread takes the published set over and over, like
+ * the shell and the thread running the app. Both threads yield at random
+ * atomic operations, so that they interleave even on a single core.
+ * Checks that the reader only ever sees whole sets, in order, and ends up
+ * with the last one.
+ *
+ * Then runs every demo with parameters on a test signal, passing the
+ * values through the store and demo_switch_apply_params like main.c.
+ * Checks that setting the defaults changes nothing, that raising the
+ * detection thresholds of the detecting demos to their max cuts their
+ * detections, and that the NLMS demo ramps its tone to silence instead of
+ * cutting it off.
+ *
+ *   param_bench [-n sets]
+ */
+#include <microdsp_demos/microdsp_demos.h>
+
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "audio_callbacks.h"
+#include "bench_util.h"
+#include "demo_switch.h"
+#include "param_store.h"
+
+#define SAMPLE_RATE 44444.444f
+#define BLOCK_N_FRAMES 256
+#define BLOCK_COUNT 700
+#define EVENT_BATCH_SIZE 8
+#define STRESS_PARAM_COUNT 4
+
+/* Kernel functions used by param_store.c */
+int k_mutex_init(struct k_mutex* mutex)
+{
+    return pthread_mutex_init(&mutex->mutex, NULL);
+}
+
+int k_mutex_lock(struct k_mutex* mutex, k_timeout_t timeout)
+{
+    (void)timeout;
+    return pthread_mutex_lock(&mutex->mutex);
+}
+
+int k_mutex_unlock(struct k_mutex* mutex)
+{
+    return pthread_mutex_unlock(&mutex->mutex);
+}
+
+int32_t k_msleep(int32_t ms)
+{
+    usleep(1000 * ms);
+    return 0;
+}
+
+/* Yields at about one in four atomic operations */
+void zephyr_shim_atomic_hook(void)
+{
+    static __thread uint32_t state = 1;
+    state = state * 1664525u + 1013904223u;
+    if ((state >> 30) == 0) {
+        sched_yield();
+    }
+}
+
+/* A demo that is only a list of parameters */
+static const demo_param_info_t stress_params[STRESS_PARAM_COUNT] = {
+    { "a", 0.0f, 1e9f, 0.0f, false },
+    { "b", 0.0f, 1e9f, 0.0f, false },
+    { "c", 0.0f, 1e9f, 0.0f, false },
+    { "d", 0.0f, 1e9f, 0.0f, true },
+};
+
+static const demo_app_vtable_t stress_vtable = {
+    .abi_version = DEMO_APP_ABI_VERSION,
+    .size = sizeof(demo_app_vtable_t),
+    .name = "stress",
+    .param_count = STRESS_PARAM_COUNT,
+    .params = stress_params,
+};
+
+typedef struct {
+    param_store_t store;
+    uint32_t set_count;
+    volatile bool done;
+} stress_t;
+
+/* Set k writes k to parameter k % STRESS_PARAM_COUNT. Exact in a float
+   up to 2^24. */
+static void* stress_writer(void* arg)
+{
+    stress_t* stress = arg;
+    for (uint32_t k = 1; k <= stress->set_count; k++) {
+        param_store_set(&stress->store, k % STRESS_PARAM_COUNT, (float)k);
+    }
+    stress->done = true;
+    return NULL;
+}
+
+/* The reset published generation 1 and set k generation k + 1, so the set
+   of generation g holds the last of the first g - 1 sets that wrote each
+   parameter */
+static bool whole_set(const param_set_t* set)
+{
+    if (set->owner != &stress_vtable || set->count != STRESS_PARAM_COUNT || set->generation == 0) {
+        return false;
+    }
+    uint32_t last = set->generation - 1;
+    for (uint32_t i = 0; i < STRESS_PARAM_COUNT; i++) {
+        uint32_t expected = last >= i ? last - (last - i) % STRESS_PARAM_COUNT : 0;
+        if (set->values[i] != (float)expected) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool check_store(uint32_t set_count)
+{
+    static stress_t stress;
+    param_store_init(&stress.store);
+    param_store_reset(&stress.store, &stress_vtable);
+    stress.set_count = set_count;
+    stress.done = false;
+
+    pthread_t writer;
+    pthread_create(&writer, NULL, stress_writer, &stress);
+    uint32_t take_count = 0;
+    uint32_t torn_count = 0;
+    uint32_t backwards_count = 0;
+    uint32_t seen_count = 0;
+    uint32_t last_generation = 0;
+    bool done;
+    do {
+        done = stress.done;
+        const param_set_t* set = param_store_take(&stress.store);
+        take_count++;
+        torn_count += !whole_set(set);
+        backwards_count += set->generation < last_generation;
+        seen_count += set->generation != last_generation;
+        last_generation = set->generation;
+    } while (!done);
+    pthread_join(writer, NULL);
+
+    bool ok = true;
+    ok &= check(torn_count == 0, "every set taken is whole");
+    ok &= check(backwards_count == 0, "sets are taken in order");
+    ok &= check(last_generation == set_count + 1, "the last set is taken");
+    float value;
+    ok &= check(param_store_set(&stress.store, STRESS_PARAM_COUNT, 1.0f) == -EINVAL, "unknown index rejected");
+    ok &= check(param_store_find(&stress.store, "d") == 3 && param_store_find(&stress.store, "e") == -1, "find by name");
+    param_store_set(&stress.store, 1, -5.0f);
+    ok &= check(param_store_get(&stress.store, 1, &value) != NULL && value == 0.0f, "values clamped to the range");
+    ok &= check(param_store_get(&stress.store, STRESS_PARAM_COUNT, &value) == NULL, "unknown index has no info");
+
+    printf("param store: %u sets written, %u takes seeing %u of them, %u torn, %u out of order, %s\n",
+           set_count, take_count, seen_count, torn_count, backwards_count, ok ? "as expected" : "unexpected");
+    return ok;
+}
+
+/* Tones at the targets of the tuner demos and between them, 0.3 s each
+   with a harmonic and some noise, with 0.1 s of silence in between */
+static void make_blocks(float (*blocks)[BLOCK_N_FRAMES], int block_count)
+{
+    static const float frequencies[] = { 440.0f, 330.0f, 262.0f, 392.0f, 300.0f, 415.0f };
+    const uint32_t tone_frames = (uint32_t)(0.3f * SAMPLE_RATE);
+    const uint32_t case_frames = (uint32_t)(0.4f * SAMPLE_RATE);
+    uint32_t noise_state = 1;
+    for (uint32_t frame = 0; frame < (uint32_t)block_count * BLOCK_N_FRAMES; frame++) {
+        uint32_t case_index = frame / case_frames;
+        uint32_t case_frame = frame % case_frames;
+        float f = frequencies[case_index % (sizeof(frequencies) / sizeof(frequencies[0]))];
+        float t = case_frame / SAMPLE_RATE;
+        float x = 0.01f * next_noise(&noise_state);
+        if (case_frame < tone_frames) {
+            x += 0.3f * sinf(2.0f * (float)M_PI * f * t) + 0.1f * sinf(4.0f * (float)M_PI * f * t);
+        }
+        blocks[frame / BLOCK_N_FRAMES][frame % BLOCK_N_FRAMES] = x;
+    }
+}
+
+typedef struct {
+    /* PitchDetected, NoveltyDetected and DelayEstimated events */
+    uint32_t detection_count;
+    double detection_sum;
+    /* Largest tx sample of each block */
+    float tx_peaks[BLOCK_COUNT];
+    /* Largest change between consecutive tx samples after the change */
+    float max_tx_step;
+} run_result_t;
+
+/* A parameter change made before a block */
+typedef struct {
+    int block;
+    const char* name;
+    /* NAN for the default */
+    float value;
+} param_change_t;
+
+/* Runs a fresh app over the blocks, making the changes through the store
+   like the demo set shell command, and applying them like run_demo_app */
+static void run_app(const demo_app_vtable_t* vtable, float (*blocks)[BLOCK_N_FRAMES], const param_change_t* changes,
+                    int change_count, run_result_t* result)
+{
+    static param_store_t store;
+    param_store_init(&store);
+    param_store_reset(&store, vtable);
+    demo_instance_t instance = {
+        .vtable = vtable,
+        .app = demo_registry_create(vtable, SAMPLE_RATE),
+        .load_level = DEMO_LOAD_FULL,
+        .param_generation = 0,
+    };
+    if (strcmp(vtable->name, "nlms") == 0) {
+        /* Play the tone */
+        vtable->handle_message(instance.app, Button0Down);
+    }
+
+    float tx_buffers[AUDIO_MAX_CHANNELS][BLOCK_N_FRAMES];
+    float* tx[AUDIO_MAX_CHANNELS];
+    for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+        tx[c] = vtable->tx_channel_mask & (1 << c) ? tx_buffers[c] : NULL;
+    }
+    memset(result, 0, sizeof(*result));
+    float last_tx = 0.0f;
+    for (int block = 0; block < BLOCK_COUNT; block++) {
+        for (int i = 0; i < change_count; i++) {
+            if (changes[i].block == block) {
+                int index = param_store_find(&store, changes[i].name);
+                float value = changes[i].value;
+                if (isnan(value)) {
+                    value = vtable->params[index].default_value;
+                }
+                param_store_set(&store, (uint32_t)index, value);
+            }
+        }
+        demo_switch_apply_params(&instance, param_store_take(&store));
+
+        const float* rx[AUDIO_MAX_CHANNELS];
+        for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+            rx[c] = vtable->rx_channel_mask & (1 << c) ? blocks[block] : NULL;
+        }
+        memset(tx_buffers, 0, sizeof(tx_buffers));
+        vtable->process_channels(instance.app, tx, rx, BLOCK_N_FRAMES);
+        if (tx[0] != NULL) {
+            for (int i = 0; i < BLOCK_N_FRAMES; i++) {
+                result->tx_peaks[block] = fmaxf(result->tx_peaks[block], fabsf(tx[0][i]));
+                if (change_count > 0 && block >= changes[0].block) {
+                    result->max_tx_step = fmaxf(result->max_tx_step, fabsf(tx[0][i] - last_tx));
+                }
+                last_tx = tx[0][i];
+            }
+        }
+
+        app_event_t events[EVENT_BATCH_SIZE];
+        uint32_t event_count;
+        while ((event_count = vtable->take_events(instance.app, events, EVENT_BATCH_SIZE)) > 0) {
+            for (uint32_t i = 0; i < event_count; i++) {
+                if (events[i].message == PitchDetected || events[i].message == NoveltyDetected
+                    || events[i].message == DelayEstimated) {
+                    result->detection_count++;
+                    result->detection_sum += events[i].value;
+                }
+            }
+        }
+    }
+    demo_registry_destroy(vtable, instance.app);
+}
+
+static bool is_threshold(const char* name)
+{
+    return strcmp(name, "min_clarity") == 0 || strcmp(name, "threshold") == 0;
+}
+
+static bool check_demo(const demo_app_vtable_t* vtable, float (*blocks)[BLOCK_N_FRAMES])
+{
+    static run_result_t baseline, defaults, raised;
+    param_change_t changes[DEMO_MAX_PARAMS];
+    bool ok = true;
+
+    run_app(vtable, blocks, NULL, 0, &baseline);
+    for (uint32_t i = 0; i < vtable->param_count; i++) {
+        changes[i] = (param_change_t){ .block = 10, .name = vtable->params[i].name, .value = NAN };
+    }
+    run_app(vtable, blocks, changes, (int)vtable->param_count, &defaults);
+    ok &= check(defaults.detection_count == baseline.detection_count
+                && fabs(defaults.detection_sum - baseline.detection_sum) < 1e-3
+                && memcmp(defaults.tx_peaks, baseline.tx_peaks, sizeof(baseline.tx_peaks)) == 0,
+                "setting the defaults changes nothing");
+
+    int threshold_count = 0;
+    for (uint32_t i = 0; i < vtable->param_count; i++) {
+        if (is_threshold(vtable->params[i].name)) {
+            changes[threshold_count++] = (param_change_t){ .block = 0, .name = vtable->params[i].name,
+                                                           .value = vtable->params[i].max };
+        }
+    }
+    printf("%-10s %u params, %4u detections", vtable->name, (unsigned int)vtable->param_count,
+           (unsigned int)baseline.detection_count);
+    if (threshold_count > 0) {
+        run_app(vtable, blocks, changes, threshold_count, &raised);
+        printf(", %4u at the max threshold", (unsigned int)raised.detection_count);
+        ok &= check(raised.detection_count < baseline.detection_count, "fewer detections at the max threshold");
+    }
+
+    if (strcmp(vtable->name, "nlms") == 0) {
+        /* The ramp takes a few blocks, the tone is gone after it */
+        const int change_block = 100;
+        changes[0] = (param_change_t){ .block = change_block, .name = "osc_gain", .value = 0.0f };
+        run_app(vtable, blocks, changes, 1, &raised);
+        float before = raised.tx_peaks[change_block - 1];
+        ok &= check(before > 0.0f, "tone playing");
+        ok &= check(raised.tx_peaks[change_block] > 0.0f && raised.tx_peaks[change_block] < before,
+                    "tone fading after the change");
+        ok &= check(raised.tx_peaks[change_block + 8] == 0.0f, "tone silent after the ramp");
+        /* Cutting the tone off would step by up to the tone's peak */
+        ok &= check(raised.max_tx_step < 0.5f * before, "no step at the change");
+        printf(", tone peak %.4f, %.4f in the block of the change, largest step %.4f",
+               before, raised.tx_peaks[change_block], raised.max_tx_step);
+    }
+    printf(", %s\n", ok ? "as expected" : "unexpected");
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t set_count = 200000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            set_count = (uint32_t)atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n sets]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (set_count == 0 || set_count >= (1u << 24)) {
+        fprintf(stderr, "sets must be 1 to %u\n", (1u << 24) - 1);
+        return 1;
+    }
+
+    bool ok = check_store(set_count);
+
+    static float blocks[BLOCK_COUNT][BLOCK_N_FRAMES];
+    make_blocks(blocks, BLOCK_COUNT);
+    for (uint32_t i = 0; i < demo_registry_count(); i++) {
+        const demo_app_vtable_t* vtable = demo_registry_get(i);
+        if (vtable->size >= offsetof(demo_app_vtable_t, set_params) + sizeof(vtable->set_params)
+            && vtable->param_count > 0) {
+            ok &= check_demo(vtable, blocks);
+        }
+    }
+
+    printf("\n%s\n", ok ? "all checks passed" : "some checks FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+/*
+ * Bit exactness checks and micro-benchmarks for the PCM conversion kernels
+ * in src/pcm_convert.c and for the two processing paths of the I2S driver:
+ * float processing via scratch buffers and in-place int32 processing.
+ *
+ * Exits with a non-zero status if any check fails.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench_util.h"
+#include "pcm_convert.h"
+
+/* Default I2S period size, see src/main.c */
+#define BLOCK_N_FRAMES 256
+#define BENCH_BLOCK_COUNT 100000
+
+static int same_bits(float a, float b)
+{
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+/* Every 24 bit PCM value must convert exactly to float and back. */
+static int check_pcm_round_trip(void)
+{
+    static int32_t pcm[2 * BLOCK_N_FRAMES];
+    static int32_t pcm_out[2 * BLOCK_N_FRAMES];
+    static float left[BLOCK_N_FRAMES];
+    static float right[BLOCK_N_FRAMES];
+    static float right_only[BLOCK_N_FRAMES];
+    int error_count = 0;
+
+    for (int32_t start = -8388608; start < 8388608; start += 2 * BLOCK_N_FRAMES) {
+        for (int i = 0; i < 2 * BLOCK_N_FRAMES; i++) {
+            pcm[i] = start + i;
+        }
+        pcm_deinterleave_to_float(pcm, BLOCK_N_FRAMES, left, right);
+        pcm_interleave_from_float(pcm_out, BLOCK_N_FRAMES, left, right);
+        pcm_deinterleave_to_float(pcm, BLOCK_N_FRAMES, NULL, right_only);
+        if (memcmp(right, right_only, sizeof(right)) != 0) {
+            if (error_count++ < 10) {
+                printf("  right channel only mismatch in block starting at %d\n", start);
+            }
+        }
+        for (int i = 0; i < BLOCK_N_FRAMES; i++) {
+            if (!same_bits(left[i], pcm_sample_to_float(pcm[2 * i])) ||
+                !same_bits(right[i], pcm_sample_to_float(pcm[2 * i + 1]))) {
+                if (error_count++ < 10) {
+                    printf("  to float mismatch at %d\n", pcm[2 * i]);
+                }
+            }
+        }
+        if (memcmp(pcm, pcm_out, sizeof(pcm)) != 0) {
+            if (error_count++ < 10) {
+                printf("  round trip mismatch in block starting at %d\n", start);
+            }
+        }
+    }
+    return error_count;
+}
+
+/* The kernels must match the reference conversion for arbitrary floats,
+   including out of range values, infinities and NaN. */
+static int check_float_to_pcm(void)
+{
+    static float left[BLOCK_N_FRAMES];
+    static float right[BLOCK_N_FRAMES];
+    static int32_t pcm[2 * BLOCK_N_FRAMES];
+    static const float special_values[] = {
+        0.0f, -0.0f, 1.0f, -1.0f, 0.99999994f, -0.99999994f, 1.5f, -1.5f,
+        1e-30f, -1e-30f, 1e30f, -1e30f, INFINITY, -INFINITY, NAN,
+    };
+    int error_count = 0;
+    srand(1234);
+
+    for (int block = 0; block < 10000; block++) {
+        for (int i = 0; i < BLOCK_N_FRAMES; i++) {
+            left[i] = 4.0f * rand() / RAND_MAX - 2.0f;
+            right[i] = 2.0f * rand() / RAND_MAX - 1.0f;
+        }
+        if (block == 0) {
+            memcpy(left, special_values, sizeof(special_values));
+        }
+        /* Stereo, left only and right only */
+        for (int mode = 0; mode < 3; mode++) {
+            pcm_interleave_from_float(pcm, BLOCK_N_FRAMES, mode == 2 ? NULL : left, mode == 1 ? NULL : right);
+            for (int i = 0; i < BLOCK_N_FRAMES; i++) {
+                int32_t expected_left = pcm_sample_from_float(mode == 2 ? right[i] : left[i]);
+                int32_t expected_right = mode == 1 ? expected_left : pcm_sample_from_float(right[i]);
+                if (pcm[2 * i] != expected_left || pcm[2 * i + 1] != expected_right) {
+                    if (error_count++ < 10) {
+                        printf("  from float mismatch for %g: %d != %d\n", left[i], pcm[2 * i], expected_left);
+                    }
+                }
+                if (expected_left < -8388608 || expected_left > 8388607) {
+                    if (error_count++ < 10) {
+                        printf("  %g did not saturate: %d\n", left[i], expected_left);
+                    }
+                }
+            }
+        }
+    }
+    return error_count;
+}
+
+/* Processing callbacks mirroring the two paths in src/i2s.c, with a
+   mono (left channel) passthrough. */
+static void passthrough_cb(void* cb_data, unsigned int frame_count, float* const* tx, const float* const* rx)
+{
+    memcpy(tx[0], rx[0], frame_count * sizeof(float));
+}
+
+static void passthrough_i32_cb(void* cb_data, unsigned int frame_count, int32_t* tx, const int32_t* rx)
+{
+    for (unsigned int i = 0; i < frame_count; i++) {
+        tx[2 * i] = rx[2 * i];
+        tx[2 * i + 1] = rx[2 * i];
+    }
+}
+
+static float scratch_in[BLOCK_N_FRAMES];
+static float scratch_out[BLOCK_N_FRAMES];
+static float* tx_channels[2] = { scratch_out, NULL };
+static const float* rx_channels[2] = { scratch_in, NULL };
+
+/* The conversion loops used before the block kernels were added */
+static void process_block_legacy(int32_t* tx, const int32_t* rx)
+{
+    for (int i = 0; i < BLOCK_N_FRAMES; i++) {
+        scratch_in[i] = rx[2 * i] / (float)8388607.0;
+    }
+    memset(scratch_out, 0, sizeof(scratch_out));
+    passthrough_cb(NULL, BLOCK_N_FRAMES, tx_channels, rx_channels);
+    for (int i = 0; i < BLOCK_N_FRAMES; i++) {
+        int32_t tx_curr = scratch_out[i] * 8388607.0f;
+        tx[2 * i] = tx_curr;
+        tx[2 * i + 1] = tx_curr;
+    }
+}
+
+static void process_block_float(int32_t* tx, const int32_t* rx)
+{
+    pcm_deinterleave_to_float(rx, BLOCK_N_FRAMES, scratch_in, NULL);
+    memset(scratch_out, 0, sizeof(scratch_out));
+    passthrough_cb(NULL, BLOCK_N_FRAMES, tx_channels, rx_channels);
+    pcm_interleave_from_float(tx, BLOCK_N_FRAMES, scratch_out, NULL);
+}
+
+static float scratch_in_right[BLOCK_N_FRAMES];
+static float scratch_out_right[BLOCK_N_FRAMES];
+
+static void process_block_float_stereo(int32_t* tx, const int32_t* rx)
+{
+    float* tx_stereo[2] = { scratch_out, scratch_out_right };
+    const float* rx_stereo[2] = { scratch_in, scratch_in_right };
+    pcm_deinterleave_to_float(rx, BLOCK_N_FRAMES, scratch_in, scratch_in_right);
+    memset(scratch_out, 0, sizeof(scratch_out));
+    memset(scratch_out_right, 0, sizeof(scratch_out_right));
+    passthrough_cb(NULL, BLOCK_N_FRAMES, tx_stereo, rx_stereo);
+    memcpy(tx_stereo[1], rx_stereo[1], sizeof(scratch_out_right));
+    pcm_interleave_from_float(tx, BLOCK_N_FRAMES, scratch_out, scratch_out_right);
+}
+
+static void process_block_i32(int32_t* tx, const int32_t* rx)
+{
+    passthrough_i32_cb(NULL, BLOCK_N_FRAMES, tx, rx);
+}
+
+/* A passthrough must give identical output on both paths. */
+static int check_paths_identical(void)
+{
+    static int32_t rx[2 * BLOCK_N_FRAMES];
+    static int32_t tx_float[2 * BLOCK_N_FRAMES];
+    static int32_t tx_i32[2 * BLOCK_N_FRAMES];
+    int error_count = 0;
+    srand(5678);
+    for (int block = 0; block < 1000; block++) {
+        for (int i = 0; i < 2 * BLOCK_N_FRAMES; i++) {
+            rx[i] = (rand() % 16777216) - 8388608;
+        }
+        process_block_float(tx_float, rx);
+        process_block_i32(tx_i32, rx);
+        if (memcmp(tx_float, tx_i32, sizeof(tx_i32)) != 0) {
+            error_count++;
+        }
+    }
+    return error_count;
+}
+
+static double bench(void (*process_block)(int32_t*, const int32_t*))
+{
+    static int32_t rx[2 * BLOCK_N_FRAMES];
+    static int32_t tx[2 * BLOCK_N_FRAMES];
+    for (int i = 0; i < 2 * BLOCK_N_FRAMES; i++) {
+        rx[i] = (rand() % 16777216) - 8388608;
+    }
+    uint64_t start = now_ns();
+    for (int block = 0; block < BENCH_BLOCK_COUNT; block++) {
+        process_block(tx, rx);
+        /* Keep the compiler from hoisting the work out of the loop */
+        __asm__ volatile("" : : "r"(tx), "r"(rx) : "memory");
+    }
+    return (double)(now_ns() - start) / BENCH_BLOCK_COUNT;
+}
+
+int main(int argc, char** argv)
+{
+    int failures = 0;
+
+    int errors = check_pcm_round_trip();
+    printf("pcm -> float -> pcm round trip, all 24 bit values: %s\n", errors ? "FAILED" : "ok");
+    failures += errors != 0;
+
+    errors = check_float_to_pcm();
+    printf("float -> pcm matches reference, with saturation: %s\n", errors ? "FAILED" : "ok");
+    failures += errors != 0;
+
+    errors = check_paths_identical();
+    printf("float and int32 passthrough paths identical: %s\n", errors ? "FAILED" : "ok");
+    failures += errors != 0;
+
+    printf("\nns per %d frame block (rx to tx conversion, passthrough callback)\n", BLOCK_N_FRAMES);
+    printf("  legacy per-sample loops  %8.1f\n", bench(process_block_legacy));
+    printf("  float block kernels      %8.1f\n", bench(process_block_float));
+    printf("  float, both channels     %8.1f\n", bench(process_block_float_stereo));
+    printf("  int32 in place           %8.1f\n", bench(process_block_i32));
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * Cost and quality of the block codecs used by the NLMS demo recording
+ * (microdsp_demos/src/recording.rs).
+ *
+ * Encodes and decodes a few seconds of synthetic test signals with each
+ * codec, like recording and playback do, and reports the time per codec
+ * block and per block of audio, the signal to noise ratio of the decoded
+ * signal, and how much audio fits in the recording buffer.
+ *
+ *   record_codec_bench [-r repetitions]
+ */
+#include <microdsp_demos/microdsp_demos.h>
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+
+#define SAMPLE_RATE 44444.444f
+#define BLOCK_N_FRAMES 256
+#define SIGNAL_DURATION_S 4.0f
+/* Must match RECORD_BUFFER_BYTES in nlms_demo.rs */
+#define RECORD_BUFFER_BYTES 144000
+
+typedef enum {
+    SIGNAL_TONE,
+    SIGNAL_SPEECH_LIKE,
+    SIGNAL_NOISE,
+    SIGNAL_COUNT,
+} signal_t;
+
+static const char* signal_names[SIGNAL_COUNT] = { "tone", "speech-like", "noise" };
+
+typedef struct {
+    recording_codec_t codec;
+    const char* name;
+    /* Size of f32 samples over the encoded size */
+    float min_compression_ratio;
+    /* Lowest acceptable SNR per signal, in dB */
+    float min_snr_db[SIGNAL_COUNT];
+} codec_case_t;
+
+static const codec_case_t codec_cases[] = {
+    { RECORDING_CODEC_PCM16, "pcm16", 2.0f, { 80.0f, 70.0f, 70.0f } },
+    { RECORDING_CODEC_IMA_ADPCM, "ima_adpcm", 4.0f, { 25.0f, 20.0f, 10.0f } },
+};
+
+static void generate_signal(signal_t signal, float* samples, uint32_t sample_count)
+{
+    uint32_t noise_state = 1;
+    float lowpassed = 0.0f;
+    for (uint32_t i = 0; i < sample_count; i++) {
+        float t = i / SAMPLE_RATE;
+        float x = 0.0f;
+        switch (signal) {
+        case SIGNAL_TONE:
+            x = 0.5f * sinf(2.0f * (float)M_PI * 1000.0f * t);
+            break;
+        case SIGNAL_SPEECH_LIKE: {
+            /* A gliding harmonic voice with syllable rate amplitude
+               modulation, alternating with hissy low pass noise */
+            float syllable = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * 4.0f * t);
+            float f0 = 140.0f + 30.0f * sinf(2.0f * (float)M_PI * 0.7f * t);
+            float voice = 0.0f;
+            for (int h = 1; h <= 8; h++) {
+                voice += sinf(2.0f * (float)M_PI * f0 * h * t) / h;
+            }
+            lowpassed += 0.3f * (next_noise(&noise_state) - lowpassed);
+            bool voiced = fmodf(t, 0.6f) < 0.45f;
+            x = syllable * (voiced ? 0.2f * voice : 0.3f * lowpassed);
+            break;
+        }
+        case SIGNAL_NOISE:
+            x = 0.3f * next_noise(&noise_state);
+            break;
+        default:
+            break;
+        }
+        samples[i] = x;
+    }
+}
+
+static float snr_db(const float* reference, const float* decoded, uint32_t sample_count)
+{
+    double signal = 0.0;
+    double error = 0.0;
+    for (uint32_t i = 0; i < sample_count; i++) {
+        double e = (double)decoded[i] - reference[i];
+        signal += (double)reference[i] * reference[i];
+        error += e * e;
+    }
+    return error > 0.0 ? (float)(10.0 * log10(signal / error)) : INFINITY;
+}
+
+int main(int argc, char** argv)
+{
+    int repetition_count = 20;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+        switch (opt) {
+        case 'r':
+            repetition_count = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r repetitions]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (repetition_count < 1) {
+        repetition_count = 1;
+    }
+
+    bool ok = true;
+    uint32_t max_sample_count = (uint32_t)(SIGNAL_DURATION_S * SAMPLE_RATE);
+    for (size_t c = 0; c < sizeof(codec_cases) / sizeof(codec_cases[0]); c++) {
+        const codec_case_t* codec_case = &codec_cases[c];
+        uint32_t block_samples, block_bytes;
+        if (!recording_codec_block_size(codec_case->codec, &block_samples, &block_bytes)) {
+            fprintf(stderr, "unknown codec %s\n", codec_case->name);
+            return 1;
+        }
+        uint32_t block_count = max_sample_count / block_samples;
+        uint32_t sample_count = block_count * block_samples;
+        float* input = malloc(sample_count * sizeof(float));
+        float* output = malloc(sample_count * sizeof(float));
+        uint8_t* blocks = malloc((size_t)block_count * block_bytes);
+
+        float compression_ratio = (float)(block_samples * sizeof(float)) / block_bytes;
+        uint32_t capacity = RECORD_BUFFER_BYTES / block_bytes * block_samples;
+        printf("%s: %u samples in %u bytes per block, %.2fx smaller than f32, %.2f s in %u bytes\n",
+            codec_case->name, block_samples, block_bytes, compression_ratio,
+            capacity / SAMPLE_RATE, RECORD_BUFFER_BYTES);
+        ok &= check_for(compression_ratio >= codec_case->min_compression_ratio, codec_case->name, "compression ratio");
+
+        for (int s = 0; s < SIGNAL_COUNT; s++) {
+            generate_signal((signal_t)s, input, sample_count);
+            uint64_t encode_ns = UINT64_MAX;
+            uint64_t decode_ns = UINT64_MAX;
+            for (int r = 0; r < repetition_count; r++) {
+                uint64_t start = now_ns();
+                recording_codec_encode(codec_case->codec, input, block_count, blocks);
+                uint64_t mid = now_ns();
+                recording_codec_decode(codec_case->codec, blocks, block_count, output);
+                uint64_t end = now_ns();
+                /* Best of the repetitions, the least disturbed run */
+                if (mid - start < encode_ns) {
+                    encode_ns = mid - start;
+                }
+                if (end - mid < decode_ns) {
+                    decode_ns = end - mid;
+                }
+            }
+            float snr = snr_db(input, output, sample_count);
+            double encode_per_sample = (double)encode_ns / sample_count;
+            double decode_per_sample = (double)decode_ns / sample_count;
+            printf("  %-12s SNR %6.1f dB, encode %6.0f ns/codec block %6.0f ns/%u frames, decode %6.0f ns/codec block %6.0f ns/%u frames\n",
+                signal_names[s], snr,
+                encode_per_sample * block_samples, encode_per_sample * BLOCK_N_FRAMES, BLOCK_N_FRAMES,
+                decode_per_sample * block_samples, decode_per_sample * BLOCK_N_FRAMES, BLOCK_N_FRAMES);
+            char description[64];
+            snprintf(description, sizeof(description), "SNR of %s >= %.0f dB", signal_names[s], codec_case->min_snr_db[s]);
+            ok &= check_for(snr >= codec_case->min_snr_db[s], codec_case->name, description);
+        }
+
+        free(input);
+        free(output);
+        free(blocks);
+    }
+    printf("\n%s\n", ok ? "all checks passed" : "some checks FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+/*
+ * Accuracy and CPU benchmark for the tuner demos (mpm_demo and
+ * goertzel_demo), which turn on LED i while a tone close to target
+ * frequency i is detected.
+ *
+ * Plays a sequence of synthetic test cases through the demo app, each a
+ * tone with harmonics and some noise followed by silence, and checks which
+ * LEDs turn on. Tones within MAX_FREQ_ERROR of a target should turn on its
+ * LED and no other. Tones further away, or too quiet, should turn on none.
+ * Build the benchmark for both demos to compare them side by side.
+ */
+#include <microdsp_demos/microdsp_demos.h>
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "audio_callbacks.h"
+#include "bench_util.h"
+
+#define SAMPLE_RATE 44444.444f
+#define BLOCK_N_FRAMES 256
+#define TONE_DURATION_S 0.5f
+#define SILENCE_DURATION_S 0.3f
+#define NOISE_AMPLITUDE 0.01f
+#define TARGET_COUNT 4
+/* Must match FREQUENCIES_TO_DETECT and MAX_FREQ_ERROR in mpm_demo.rs */
+static const float target_frequencies[TARGET_COUNT] = { 440.0f, 330.0f, 262.0f, 392.0f };
+#define MAX_FREQ_ERROR 12.0f
+
+typedef struct {
+    float frequency;
+    float amplitude;
+} test_case_t;
+
+typedef struct {
+    /* Bit i is set if LED i turned on during the case */
+    unsigned int led_mask;
+    int led_on_count;
+    /* Time from the start of the tone to the first LED turning on */
+    float latency_ms;
+    /* Value of the first PitchDetected message */
+    float detected_frequency;
+} case_result_t;
+
+/* Index of the target the frequency should be detected as, or -1 */
+static int expected_target(float frequency)
+{
+    for (int i = 0; i < TARGET_COUNT; i++) {
+        if (fabsf(frequency - target_frequencies[i]) < MAX_FREQ_ERROR) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int main(void)
+{
+    static test_case_t cases[64];
+    int case_count = 0;
+    const float offsets[] = { 0.0f, -6.0f, 6.0f, -10.0f, 10.0f, -20.0f, 20.0f, 40.0f };
+    for (int i = 0; i < TARGET_COUNT; i++) {
+        for (size_t j = 0; j < sizeof(offsets) / sizeof(offsets[0]); j++) {
+            cases[case_count++] = (test_case_t) { target_frequencies[i] + offsets[j], 0.3f };
+        }
+    }
+    /* Other notes, an octave below a target, silence with noise and a
+       tone below the detection threshold */
+    cases[case_count++] = (test_case_t) { 294.0f, 0.3f };
+    cases[case_count++] = (test_case_t) { 349.0f, 0.3f };
+    cases[case_count++] = (test_case_t) { 494.0f, 0.3f };
+    cases[case_count++] = (test_case_t) { 196.0f, 0.3f };
+    cases[case_count++] = (test_case_t) { 0.0f, 0.0f };
+    cases[case_count++] = (test_case_t) { 440.0f, 0.003f };
+
+    void* app = demo_app_create(SAMPLE_RATE);
+    static float rx[AUDIO_MAX_CHANNELS][BLOCK_N_FRAMES];
+    const float* rx_channels[AUDIO_MAX_CHANNELS] = { rx[0], NULL };
+    float* tx_channels[AUDIO_MAX_CHANNELS] = { NULL, NULL };
+
+    uint32_t tone_frames = (uint32_t)(TONE_DURATION_S * SAMPLE_RATE) / BLOCK_N_FRAMES * BLOCK_N_FRAMES;
+    uint32_t case_frames = tone_frames + (uint32_t)(SILENCE_DURATION_S * SAMPLE_RATE) / BLOCK_N_FRAMES * BLOCK_N_FRAMES;
+    uint32_t noise_state = 1;
+    uint32_t frame = 0;
+    uint64_t processing_ns = 0;
+    int correct_count = 0;
+    int detected_count = 0;
+    float latency_sum_ms = 0;
+    float frequency_error_sum = 0;
+
+    printf("%-10s %-9s %-9s %-6s %-11s %-11s %s\n", "tone (Hz)", "expected", "detected", "ons", "latency ms", "estimate Hz", "");
+    for (int c = 0; c < case_count; c++) {
+        case_result_t result = { 0 };
+        uint32_t case_start = frame;
+        double phase = 0.0;
+        for (uint32_t i = 0; i < case_frames; i += BLOCK_N_FRAMES) {
+            for (int j = 0; j < BLOCK_N_FRAMES; j++) {
+                float tone = 0;
+                if (i + j < tone_frames) {
+                    tone = cases[c].amplitude * (float)(sin(phase) + 0.3 * sin(2 * phase) + 0.15 * sin(3 * phase));
+                    phase += 2.0 * M_PI * cases[c].frequency / SAMPLE_RATE;
+                }
+                rx[0][j] = tone + NOISE_AMPLITUDE * next_noise(&noise_state);
+            }
+
+            uint64_t start = now_ns();
+            demo_app_process_channels(app, tx_channels, rx_channels, BLOCK_N_FRAMES);
+            processing_ns += now_ns() - start;
+
+            app_event_t events[64];
+            uint32_t event_count;
+            while ((event_count = demo_app_take_events(app, events, 64)) > 0) {
+                for (uint32_t e = 0; e < event_count; e++) {
+                    int message = events[e].message;
+                    if (message >= Led0On && message <= Led3On) {
+                        if (result.led_mask == 0) {
+                            result.latency_ms = 1000.0f * (events[e].timestamp - case_start) / SAMPLE_RATE;
+                        }
+                        result.led_mask |= 1u << (message - Led0On);
+                        result.led_on_count++;
+                    } else if (message == PitchDetected && result.detected_frequency == 0) {
+                        result.detected_frequency = events[e].value;
+                    }
+                }
+            }
+            frame += BLOCK_N_FRAMES;
+        }
+
+        int expected = cases[c].amplitude >= 0.01f ? expected_target(cases[c].frequency) : -1;
+        unsigned int expected_mask = expected >= 0 ? 1u << expected : 0;
+        bool correct = result.led_mask == expected_mask;
+        correct_count += correct;
+        char expected_name[16] = "none";
+        char detected_name[16] = "none";
+        if (expected >= 0) {
+            snprintf(expected_name, sizeof(expected_name), "LED %d", expected);
+        }
+        if (result.led_mask) {
+            snprintf(detected_name, sizeof(detected_name), "0x%x", result.led_mask);
+        }
+        if (correct && expected >= 0) {
+            detected_count++;
+            latency_sum_ms += result.latency_ms;
+            frequency_error_sum += fabsf(result.detected_frequency - cases[c].frequency);
+        }
+        printf("%-10.1f %-9s %-9s %-6d %-11.1f %-11.1f %s\n",
+            cases[c].frequency, expected_name, detected_name, result.led_on_count,
+            result.led_mask ? result.latency_ms : 0.0f, result.detected_frequency, correct ? "" : "WRONG");
+    }
+
+    double audio_ns = 1e9 * frame / SAMPLE_RATE;
+    printf("\ncorrect         %d of %d cases\n", correct_count, case_count);
+    if (detected_count > 0) {
+        printf("mean latency    %.1f ms (correct detections)\n", latency_sum_ms / detected_count);
+        printf("mean error      %.2f Hz (first PitchDetected value)\n", frequency_error_sum / detected_count);
+    }
+    printf("processing      %.0f ns/block\n", (double)processing_ns * BLOCK_N_FRAMES / frame);
+    printf("real-time factor %.5f (processing time / audio time)\n", processing_ns / audio_ns);
+    return correct_count == case_count ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+#include "wav.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_FLOAT 3
+#define WAV_FORMAT_EXTENSIBLE 0xfffe
+
+static uint16_t read_u16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t read_u32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void write_u16(FILE* f, uint16_t v)
+{
+    uint8_t b[2] = { v & 0xff, (v >> 8) & 0xff };
+    fwrite(b, 1, 2, f);
+}
+
+static void write_u32(FILE* f, uint32_t v)
+{
+    uint8_t b[4] = { v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff, (v >> 24) & 0xff };
+    fwrite(b, 1, 4, f);
+}
+
+static float decode_sample(const uint8_t* p, uint16_t format, uint16_t bits)
+{
+    if (format == WAV_FORMAT_FLOAT && bits == 32) {
+        float value;
+        memcpy(&value, p, sizeof(float));
+        return value;
+    }
+    switch (bits) {
+        case 16:
+            return (int16_t)read_u16(p) / 32768.0f;
+        case 24: {
+            int32_t value = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+            return (value >> 8) / 8388608.0f;
+        }
+        case 32:
+            return (int32_t)read_u32(p) / 2147483648.0f;
+    }
+    return 0;
+}
+
+int wav_read(const char* path, wav_data_t* result)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "failed to open %s\n", path);
+        return -1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* data = malloc(file_size);
+    if (!data || fread(data, 1, file_size, f) != (size_t)file_size) {
+        fprintf(stderr, "failed to read %s\n", path);
+        free(data);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    int rc = -1;
+    if (file_size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "%s is not a WAV file\n", path);
+        goto done;
+    }
+
+    uint16_t format = 0;
+    uint16_t bits = 0;
+    uint16_t channel_count = 0;
+    uint32_t sample_rate = 0;
+    const uint8_t* sample_data = NULL;
+    uint32_t sample_data_size = 0;
+
+    long pos = 12;
+    while (pos + 8 <= file_size) {
+        const uint8_t* chunk = data + pos;
+        uint32_t chunk_size = read_u32(chunk + 4);
+        if (pos + 8 + (long)chunk_size > file_size) {
+            chunk_size = file_size - pos - 8;
+        }
+        if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16) {
+            format = read_u16(chunk + 8);
+            channel_count = read_u16(chunk + 10);
+            sample_rate = read_u32(chunk + 12);
+            bits = read_u16(chunk + 22);
+            if (format == WAV_FORMAT_EXTENSIBLE && chunk_size >= 26) {
+                /* The first two bytes of the sub format GUID hold the format tag */
+                format = read_u16(chunk + 32);
+            }
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            sample_data = chunk + 8;
+            sample_data_size = chunk_size;
+        }
+        pos += 8 + chunk_size + (chunk_size & 1);
+    }
+
+    if (!sample_data || channel_count == 0) {
+        fprintf(stderr, "%s has no fmt or data chunk\n", path);
+        goto done;
+    }
+    if (!((format == WAV_FORMAT_PCM && (bits == 16 || bits == 24 || bits == 32)) ||
+          (format == WAV_FORMAT_FLOAT && bits == 32))) {
+        fprintf(stderr, "%s has unsupported sample format %d (%d bits)\n", path, format, bits);
+        goto done;
+    }
+
+    uint32_t bytes_per_sample = bits / 8;
+    uint32_t frame_count = sample_data_size / (bytes_per_sample * channel_count);
+    float* samples = malloc(sizeof(float) * frame_count * channel_count + 1);
+    if (!samples) {
+        goto done;
+    }
+    for (uint32_t i = 0; i < frame_count * channel_count; i++) {
+        samples[i] = decode_sample(sample_data + i * bytes_per_sample, format, bits);
+    }
+
+    result->sample_rate = sample_rate;
+    result->channel_count = channel_count;
+    result->frame_count = frame_count;
+    result->samples = samples;
+    rc = 0;
+
+done:
+    free(data);
+    return rc;
+}
+
+int wav_write_float(
+    const char* path,
+    const float* samples,
+    uint32_t frame_count,
+    uint16_t channel_count,
+    uint32_t sample_rate
+)
+{
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "failed to open %s for writing\n", path);
+        return -1;
+    }
+    uint32_t data_size = frame_count * channel_count * sizeof(float);
+    fwrite("RIFF", 1, 4, f);
+    write_u32(f, 36 + data_size);
+    fwrite("WAVE", 1, 4, f);
+    fwrite("fmt ", 1, 4, f);
+    write_u32(f, 16);
+    write_u16(f, WAV_FORMAT_FLOAT);
+    write_u16(f, channel_count);
+    write_u32(f, sample_rate);
+    write_u32(f, sample_rate * channel_count * sizeof(float));
+    write_u16(f, channel_count * sizeof(float));
+    write_u16(f, 32);
+    fwrite("data", 1, 4, f);
+    write_u32(f, data_size);
+    size_t written = fwrite(samples, sizeof(float), frame_count * channel_count, f);
+    fclose(f);
+    return written == frame_count * channel_count ? 0 : -1;
+}
+
+void wav_free(wav_data_t* data)
+{
+    free(data->samples);
+    data->samples = NULL;
+}
@@ -0,0 +1,34 @@
+#ifndef WAV_H
+#define WAV_H
+
+#include <stdint.h>
+
+/* A minimal WAV file reader/writer for the host tools. Reads 16, 24
+   and 32 bit integer PCM and 32 bit float files with any number of
+   channels. Samples are converted to float in the range [-1, 1]. */
+
+typedef struct {
+    uint32_t sample_rate;
+    uint16_t channel_count;
+    uint32_t frame_count;
+    /* Interleaved samples, frame_count * channel_count values. */
+    float* samples;
+} wav_data_t;
+
+/* Reads a WAV file. Returns 0 on success. On success, samples must be
+   released using wav_free. */
+int wav_read(const char* path, wav_data_t* result);
+
+/* Writes interleaved float samples as a 32 bit float WAV file.
+   Returns 0 on success. */
+int wav_write_float(
+    const char* path,
+    const float* samples,
+    uint32_t frame_count,
+    uint16_t channel_count,
+    uint32_t sample_rate
+);
+
+void wav_free(wav_data_t* data);
+
+#endif
@@ -0,0 +1,141 @@
+#include "wm8904_mock.h"
+
+#include <string.h>
+
+#define DEFAULT_BUS_FREQUENCY_HZ 100000
+#define DEFAULT_DCS_STARTUP_DELAY_US 30000
+
+/* Bit time of an I2C transaction with the given number of bytes after the
+   address byte, including start and stop conditions and acks */
+uint64_t wm8904_mock_transfer_time_us(const wm8904_mock_t* mock, size_t byte_count)
+{
+    uint64_t bit_count = 2 + 9 * (1 + byte_count);
+    return (bit_count * 1000000 + mock->bus_frequency_hz - 1) / mock->bus_frequency_hz;
+}
+
+static void reset_registers(wm8904_mock_t* mock)
+{
+    memset(mock->regs, 0, sizeof(mock->regs));
+    memset(mock->written, 0, sizeof(mock->written));
+    mock->regs[WM8904_SW_RESET_AND_ID] = 0x8904;
+    mock->fll_lock_time_us = -1;
+    mock->dcs_complete_time_us = -1;
+}
+
+static void apply_write(wm8904_mock_t* mock, uint8_t reg, uint16_t value)
+{
+    mock->register_write_count++;
+    if (reg == WM8904_SW_RESET_AND_ID) {
+        reset_registers(mock);
+        return;
+    }
+    mock->regs[reg] = value;
+    mock->written[reg] = true;
+    if (reg == WM8904_FLL_CONTROL_1 && (value & 1)) {
+        mock->fll_lock_time_us = mock->fll_lock_delay_us < 0 ? -1 : (int64_t)mock->time_us + mock->fll_lock_delay_us;
+    }
+    if (reg == WM8904_DC_SERVO_1 && (value & 0xf0)) {
+        mock->dcs_complete_time_us = (int64_t)mock->time_us + mock->dcs_startup_delay_us;
+    }
+}
+
+static uint16_t read_register(const wm8904_mock_t* mock, uint8_t reg)
+{
+    int64_t now = mock->time_us;
+    switch (reg) {
+    case WM8904_INTERRUPT_STATUS:
+        return mock->fll_lock_time_us >= 0 && now >= mock->fll_lock_time_us ? WM8904_FLL_LOCK_EINT : 0;
+    case WM8904_DC_SERVO_READBACK_0:
+        /* One DCS_CAL_COMPLETE bit per channel triggered in DC_SERVO_1 */
+        if (mock->dcs_complete_time_us >= 0 && now >= mock->dcs_complete_time_us) {
+            return ((mock->regs[WM8904_DC_SERVO_1] >> 4) & 0b1111) << 8;
+        }
+        return 0;
+    default:
+        return mock->regs[reg];
+    }
+}
+
+static int mock_write(void* ctx, const uint8_t* data, size_t len)
+{
+    wm8904_mock_t* mock = ctx;
+    if (len < 3 || (len - 1) % 2 != 0) {
+        return -1;
+    }
+    mock->time_us += wm8904_mock_transfer_time_us(mock, len);
+    mock->bus_time_us += wm8904_mock_transfer_time_us(mock, len);
+    mock->write_count++;
+    mock->bytes_written += len;
+    /* The register address auto-increments after each value */
+    for (size_t i = 0; i < (len - 1) / 2; i++) {
+        uint8_t reg = data[0] + i;
+        uint16_t value = (data[1 + 2 * i] << 8) | data[2 + 2 * i];
+        if (mock->log) {
+            fprintf(mock->log, "%10.3f ms  write R%-3d 0x%02x = 0x%04x%s\n",
+                mock->time_us / 1000.0, reg, reg, value, i > 0 ? " (burst)" : "");
+        }
+        apply_write(mock, reg, value);
+    }
+    return 0;
+}
+
+static int mock_write_read(void* ctx, const uint8_t* write_data, size_t write_len, uint8_t* read_data, size_t read_len)
+{
+    wm8904_mock_t* mock = ctx;
+    if (write_len != 1 || read_len != 2) {
+        return -1;
+    }
+    uint64_t time_us = wm8904_mock_transfer_time_us(mock, write_len) + wm8904_mock_transfer_time_us(mock, read_len);
+    mock->time_us += time_us;
+    mock->bus_time_us += time_us;
+    mock->read_count++;
+    mock->bytes_written += write_len;
+    mock->bytes_read += read_len;
+    uint16_t value = read_register(mock, write_data[0]);
+    read_data[0] = value >> 8;
+    read_data[1] = value & 0xff;
+    if (mock->log) {
+        fprintf(mock->log, "%10.3f ms  read  R%-3d 0x%02x = 0x%04x\n",
+            mock->time_us / 1000.0, write_data[0], write_data[0], value);
+    }
+    return 0;
+}
+
+static void mock_sleep_us(void* ctx, uint32_t us)
+{
+    wm8904_mock_t* mock = ctx;
+    mock->time_us += us;
+    mock->sleep_time_us += us;
+}
+
+static uint64_t mock_time_us(void* ctx)
+{
+    const wm8904_mock_t* mock = ctx;
+    return mock->time_us;
+}
+
+void wm8904_mock_reset_stats(wm8904_mock_t* mock)
+{
+    mock->bus_time_us = 0;
+    mock->sleep_time_us = 0;
+    mock->write_count = 0;
+    mock->read_count = 0;
+    mock->register_write_count = 0;
+    mock->bytes_written = 0;
+    mock->bytes_read = 0;
+}
+
+void wm8904_mock_init(wm8904_mock_t* mock, wm8904_bus_t* bus)
+{
+    memset(mock, 0, sizeof(*mock));
+    mock->bus_frequency_hz = DEFAULT_BUS_FREQUENCY_HZ;
+    mock->fll_lock_delay_us = -1;
+    mock->dcs_startup_delay_us = DEFAULT_DCS_STARTUP_DELAY_US;
+    reset_registers(mock);
+
+    bus->write = mock_write;
+    bus->write_read = mock_write_read;
+    bus->sleep_us = mock_sleep_us;
+    bus->time_us = mock_time_us;
+    bus->ctx = mock;
+}
@@ -0,0 +1,59 @@
+/*
+ * Host-side mock of the WM8904 control interface, implementing
+ * wm8904_bus_t. Keeps a register file, applies writes with auto-increment
+ * like the codec does, and advances a virtual clock by the time each
+ * transaction would take on the bus and by each sleep, so that the startup
+ * time and bus traffic of a register sequence can be measured without
+ * hardware.
+ *
+ * The status bits polled by wm8904_init are modeled with fixed delays,
+ * which are assumptions rather than datasheet figures.
+ */
+#ifndef WM8904_MOCK_H
+#define WM8904_MOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "codecs/wm8904.h"
+
+typedef struct {
+    /* Settings, which may be changed after wm8904_mock_init */
+    uint32_t bus_frequency_hz;
+    /* Time from enabling the FLL to FLL_LOCK_EINT being set, or -1 if it
+       never locks, like before BCLK is running */
+    int32_t fll_lock_delay_us;
+    /* Time from triggering DC servo startup to DCS_CAL_COMPLETE being set */
+    int32_t dcs_startup_delay_us;
+    /* If not NULL, every transaction is logged here */
+    FILE* log;
+
+    /* Register file */
+    uint16_t regs[WM8904_REG_COUNT];
+    bool written[WM8904_REG_COUNT];
+
+    /* Statistics */
+    uint64_t time_us;
+    uint64_t bus_time_us;
+    uint64_t sleep_time_us;
+    uint32_t write_count;
+    uint32_t read_count;
+    uint32_t register_write_count;
+    uint32_t bytes_written;
+    uint32_t bytes_read;
+
+    /* Virtual times at which polled status bits get set */
+    int64_t fll_lock_time_us;
+    int64_t dcs_complete_time_us;
+} wm8904_mock_t;
+
+/* Sets the default settings, clears the register file and statistics and
+   fills in bus */
+void wm8904_mock_init(wm8904_mock_t* mock, wm8904_bus_t* bus);
+/* Bus time of a transaction with byte_count bytes after the address */
+uint64_t wm8904_mock_transfer_time_us(const wm8904_mock_t* mock, size_t byte_count);
+/* Zeroes the statistics, keeping the register file and the clock */
+void wm8904_mock_reset_stats(wm8904_mock_t* mock);
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Host stand-in for the nrfx I2S driver API and the parts of the I2S HAL
+ * used by src/i2s.c. Only the I2S simulator (i2s_mock.c) implements the
+ * functions declared here.
+ */
+#ifndef HOST_NRFX_I2S_H
+#define HOST_NRFX_I2S_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef int nrfx_err_t;
+#define NRFX_SUCCESS 0
+#define NRFX_ERROR_INVALID_STATE 1
+#define NRFX_ERROR_INVALID_PARAM 2
+#define NRFX_ERROR_INVALID_ADDR 3
+
+#define NRFX_I2S_STATUS_NEXT_BUFFERS_NEEDED (1 << 0)
+#define NRFX_I2S_STATUS_TRANSFER_STOPPED (1 << 1)
+
+#define NRFX_I2S_DEFAULT_CONFIG_IRQ_PRIORITY 6
+typedef struct {
+    int unused;
+} NRF_I2S_Type;
+#define NRF_I2S0 ((NRF_I2S_Type*)0)
+#define NRFX_IRQ_NUMBER_GET(base) 37
+
+typedef enum {
+    NRF_I2S_EVENT_RXPTRUPD,
+    NRF_I2S_EVENT_TXPTRUPD,
+    NRF_I2S_EVENT_STOPPED,
+} nrf_i2s_event_t;
+
+bool nrf_i2s_event_check(NRF_I2S_Type const* p_reg, nrf_i2s_event_t event);
+
+/* Enumerators are the divider and ratio values */
+typedef enum {
+    NRF_I2S_MCK_32MDIV2 = 2,
+    NRF_I2S_MCK_32MDIV3 = 3,
+    NRF_I2S_MCK_32MDIV4 = 4,
+    NRF_I2S_MCK_32MDIV5 = 5,
+    NRF_I2S_MCK_32MDIV6 = 6,
+    NRF_I2S_MCK_32MDIV8 = 8,
+    NRF_I2S_MCK_32MDIV10 = 10,
+    NRF_I2S_MCK_32MDIV11 = 11,
+    NRF_I2S_MCK_32MDIV15 = 15,
+    NRF_I2S_MCK_32MDIV16 = 16,
+    NRF_I2S_MCK_32MDIV21 = 21,
+    NRF_I2S_MCK_32MDIV23 = 23,
+    NRF_I2S_MCK_32MDIV30 = 30,
+    NRF_I2S_MCK_32MDIV31 = 31,
+    NRF_I2S_MCK_32MDIV32 = 32,
+    NRF_I2S_MCK_32MDIV42 = 42,
+    NRF_I2S_MCK_32MDIV63 = 63,
+    NRF_I2S_MCK_32MDIV125 = 125,
+} nrf_i2s_mck_t;
+
+typedef enum {
+    NRF_I2S_RATIO_32X = 32,
+    NRF_I2S_RATIO_48X = 48,
+    NRF_I2S_RATIO_64X = 64,
+    NRF_I2S_RATIO_96X = 96,
+    NRF_I2S_RATIO_128X = 128,
+    NRF_I2S_RATIO_192X = 192,
+    NRF_I2S_RATIO_256X = 256,
+    NRF_I2S_RATIO_384X = 384,
+    NRF_I2S_RATIO_512X = 512,
+} nrf_i2s_ratio_t;
+
+typedef enum { NRF_I2S_MODE_MASTER, NRF_I2S_MODE_SLAVE } nrf_i2s_mode_t;
+typedef enum { NRF_I2S_FORMAT_I2S, NRF_I2S_FORMAT_ALIGNED } nrf_i2s_format_t;
+typedef enum { NRF_I2S_ALIGN_LEFT, NRF_I2S_ALIGN_RIGHT } nrf_i2s_align_t;
+typedef enum { NRF_I2S_SWIDTH_8BIT, NRF_I2S_SWIDTH_16BIT, NRF_I2S_SWIDTH_24BIT } nrf_i2s_swidth_t;
+typedef enum { NRF_I2S_CHANNELS_STEREO, NRF_I2S_CHANNELS_LEFT, NRF_I2S_CHANNELS_RIGHT } nrf_i2s_channels_t;
+
+typedef struct {
+    uint32_t* p_rx_buffer;
+    uint32_t const* p_tx_buffer;
+} nrfx_i2s_buffers_t;
+
+typedef struct {
+    uint8_t sck_pin;
+    uint8_t lrck_pin;
+    uint8_t mck_pin;
+    uint8_t sdout_pin;
+    uint8_t sdin_pin;
+    uint8_t irq_priority;
+    nrf_i2s_mode_t mode;
+    nrf_i2s_format_t format;
+    nrf_i2s_align_t alignment;
+    nrf_i2s_swidth_t sample_width;
+    nrf_i2s_channels_t channels;
+    nrf_i2s_mck_t mck_setup;
+    nrf_i2s_ratio_t ratio;
+} nrfx_i2s_config_t;
+
+typedef void (*nrfx_i2s_data_handler_t)(nrfx_i2s_buffers_t const* p_released, uint32_t status);
+
+nrfx_err_t nrfx_i2s_init(nrfx_i2s_config_t const* p_config, nrfx_i2s_data_handler_t handler);
+nrfx_err_t nrfx_i2s_start(nrfx_i2s_buffers_t const* p_initial_buffers, uint16_t buffer_size, uint8_t flags);
+nrfx_err_t nrfx_i2s_next_buffers_set(nrfx_i2s_buffers_t const* p_buffers);
+void nrfx_i2s_stop(void);
+void nrfx_i2s_irq_handler(void);
+
+#endif
@@ -0,0 +1 @@
+#include <zephyr/zephyr.h>
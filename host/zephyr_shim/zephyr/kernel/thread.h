@@ -0,0 +1 @@
+/* Threads are declared in <zephyr/zephyr.h> */
@@ -0,0 +1,90 @@
+/*
+ * Host stand-in for the Zephyr atomic API, so that lock-free firmware
+ * modules can be built and run on host threads. Like the Zephyr
+ * implementation, every operation is sequentially consistent.
+ *
+ * If ZEPHYR_SHIM_ATOMIC_HOOK is defined, zephyr_shim_atomic_hook is
+ * called before every operation. The I2S simulator uses it to preempt
+ * the calling thread between atomic operations.
+ */
+#ifndef HOST_ZEPHYR_SYS_ATOMIC_H
+#define HOST_ZEPHYR_SYS_ATOMIC_H
+
+#include <stdbool.h>
+
+typedef long atomic_t;
+typedef long atomic_val_t;
+
+#define ATOMIC_INIT(i) (i)
+
+#ifdef ZEPHYR_SHIM_ATOMIC_HOOK
+void zephyr_shim_atomic_hook(void);
+#else
+static inline void zephyr_shim_atomic_hook(void)
+{
+}
+#endif
+
+static inline atomic_val_t atomic_get(const atomic_t* target)
+{
+    zephyr_shim_atomic_hook();
+    return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_set(atomic_t* target, atomic_val_t value)
+{
+    zephyr_shim_atomic_hook();
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_add(atomic_t* target, atomic_val_t value)
+{
+    zephyr_shim_atomic_hook();
+    return __atomic_fetch_add(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_inc(atomic_t* target)
+{
+    return atomic_add(target, 1);
+}
+
+static inline atomic_val_t atomic_clear(atomic_t* target)
+{
+    return atomic_set(target, 0);
+}
+
+static inline bool atomic_test_bit(const atomic_t* target, int bit)
+{
+    return (atomic_get(target) >> bit) & 1;
+}
+
+static inline void atomic_set_bit(atomic_t* target, int bit)
+{
+    zephyr_shim_atomic_hook();
+    __atomic_fetch_or(target, 1L << bit, __ATOMIC_SEQ_CST);
+}
+
+static inline void atomic_clear_bit(atomic_t* target, int bit)
+{
+    zephyr_shim_atomic_hook();
+    __atomic_fetch_and(target, ~(1L << bit), __ATOMIC_SEQ_CST);
+}
+
+typedef void* atomic_ptr_t;
+typedef atomic_ptr_t atomic_ptr_val_t;
+
+#define ATOMIC_PTR_INIT(p) (p)
+
+static inline atomic_ptr_val_t atomic_ptr_get(const atomic_ptr_t* target)
+{
+    zephyr_shim_atomic_hook();
+    return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_ptr_val_t atomic_ptr_set(atomic_ptr_t* target, atomic_ptr_val_t value)
+{
+    zephyr_shim_atomic_hook();
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+#endif
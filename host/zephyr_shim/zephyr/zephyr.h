@@ -0,0 +1,108 @@
+/*
+ * Host stand-in for the parts of <zephyr/zephyr.h> used by the firmware
+ * modules that are built on the host. The kernel functions declared here
+ * are implemented by the host programs that need them, e.g the I2S
+ * simulator in i2s_mock.c.
+ */
+#ifndef HOST_ZEPHYR_ZEPHYR_H
+#define HOST_ZEPHYR_ZEPHYR_H
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <zephyr/sys/atomic.h>
+
+#define BUILD_ASSERT(condition, message) _Static_assert(condition, message)
+
+/* Failed assertions abort, unless ZEPHYR_SHIM_ASSERT_HOOK is defined, in
+   which case they are passed to zephyr_shim_assert_failed */
+#ifdef ZEPHYR_SHIM_ASSERT_HOOK
+void zephyr_shim_assert_failed(const char* file, int line, const char* condition);
+#define __ASSERT(condition, ...) \
+    do { \
+        if (!(condition)) { \
+            zephyr_shim_assert_failed(__FILE__, __LINE__, #condition); \
+        } \
+    } while (0)
+#else
+#define __ASSERT(condition, ...) assert(condition)
+#endif
+
+#define printk printf
+
+/* Timeouts */
+typedef struct {
+    int64_t ticks;
+} k_timeout_t;
+#define K_FOREVER ((k_timeout_t){ -1 })
+#define K_NO_WAIT ((k_timeout_t){ 0 })
+
+/* Semaphores */
+struct k_sem {
+    unsigned int count;
+    unsigned int limit;
+};
+#define K_SEM_DEFINE(name, initial_count, count_limit) \
+    struct k_sem name = { .count = (initial_count), .limit = (count_limit) }
+int k_sem_take(struct k_sem* sem, k_timeout_t timeout);
+void k_sem_give(struct k_sem* sem);
+
+/* Threads */
+#define CONFIG_NUM_COOP_PRIORITIES 16
+#define K_PRIO_COOP(x) (-(CONFIG_NUM_COOP_PRIORITIES - (x)))
+#define K_PRIO_PREEMPT(x) (x)
+typedef uint8_t k_thread_stack_t;
+#define K_THREAD_STACK_DEFINE(name, size) k_thread_stack_t name[size]
+#define K_THREAD_STACK_SIZEOF(name) sizeof(name)
+struct k_thread {
+    int id;
+};
+typedef struct k_thread* k_tid_t;
+typedef void (*k_thread_entry_t)(void* p1, void* p2, void* p3);
+k_tid_t k_thread_create(
+    struct k_thread* thread,
+    k_thread_stack_t* stack,
+    size_t stack_size,
+    k_thread_entry_t entry,
+    void* p1, void* p2, void* p3,
+    int priority, uint32_t options, k_timeout_t delay
+);
+void k_yield(void);
+int32_t k_msleep(int32_t ms);
+
+/* Mutexes */
+struct k_mutex {
+    pthread_mutex_t mutex;
+};
+int k_mutex_init(struct k_mutex* mutex);
+int k_mutex_lock(struct k_mutex* mutex, k_timeout_t timeout);
+int k_mutex_unlock(struct k_mutex* mutex);
+
+/* Cycle counter */
+uint32_t k_cycle_get_32(void);
+uint32_t sys_clock_hw_cycles_per_sec(void);
+static inline uint32_t k_cyc_to_ns_floor32(uint32_t cycles)
+{
+    return (uint32_t)((uint64_t)cycles * 1000000000u / sys_clock_hw_cycles_per_sec());
+}
+static inline uint32_t k_cyc_to_ns_ceil32(uint32_t cycles)
+{
+    uint64_t rate = sys_clock_hw_cycles_per_sec();
+    return (uint32_t)(((uint64_t)cycles * 1000000000u + rate - 1) / rate);
+}
+
+/* Interrupts */
+unsigned int irq_lock(void);
+void irq_unlock(unsigned int key);
+#define ISR_DIRECT_DECLARE(name) static int name(void)
+#define ISR_DIRECT_PM()
+#define IRQ_DIRECT_CONNECT(irq, priority, isr, flags) zephyr_shim_irq_connect(irq, isr)
+void zephyr_shim_irq_connect(int irq, int (*isr)(void));
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef MICRODSP_DEMO_H
 #define MICRODSP_DEMO_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 typedef enum {
     Button0Down = 1,
     Button1Down = 2,
@@ -15,8 +18,145 @@ typedef enum {
     Led1Off = 14,
     Led2Off = 15,
     Led3Off = 16,
+
+    /* Value is the detected frequency in Hz */
+    PitchDetected = 17,
+    /* Value is the detected novelty */
+    NoveltyDetected = 18,
+    /* Value is the filter mode index */
+    FilterModeChanged = 19,
+    /* Value is the estimated echo delay in samples */
+    DelayEstimated = 20,
+    /* Value is the share of recorded blocks in which the filter did not adapt */
+    AdaptationSkipped = 21,
 } app_message_t;
 
+/* A message with a timestamp and a payload. */
+typedef struct {
+    /* Index of the sample (frame) at which the event occurred, counted
+       from the start of processing. Wraps around after 2^32 samples. */
+    uint32_t timestamp;
+    /* An app_message_t */
+    uint8_t message;
+    /* Message specific payload, 0 if unused */
+    float value;
+} app_event_t;
+
+/* Stats of the arena that the demo app allocates from */
+typedef struct {
+    uint32_t arena_size;
+    /* Bytes currently taken from the arena, including padding and
+       freed bytes that could not be reclaimed */
+    uint32_t used;
+    uint32_t high_water_mark;
+    /* Bytes skipped to align allocations */
+    uint32_t alignment_padding;
+    /* Bytes freed below the top of the arena, which are lost */
+    uint32_t unreclaimed;
+    uint32_t allocation_count;
+    uint32_t failed_allocation_count;
+    /* Allocations made after demo_app_create returned, e.g on the audio thread */
+    uint32_t locked_allocation_count;
+} allocator_stats_t;
+
+void demo_app_allocator_stats(allocator_stats_t* stats);
+
+/* Counts of a stage of an app built as a processing graph, e.g the
+   decimation or the detector of the tuner demos. Cycles are in units of
+   the counter set with demo_stage_set_cycle_counter, and stay 0 if none
+   is set. */
+typedef struct {
+    const char* name;
+    uint32_t block_count;
+    uint32_t last_cycles;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+} demo_stage_stats_t;
+
+/* Sets the free running counter that the stages of all apps are timed
+   with, NULL to only count blocks. Read twice per stage and block on the
+   thread running the app, so it should be cheap, e.g the DWT cycle
+   counter. */
+void demo_stage_set_cycle_counter(uint32_t (*counter)(void));
+
+/* How much of the CPU an app may use, as decided by a load governor.
+   Apps make their analysis cheaper at higher levels, e.g by analysing
+   fewer hops, searching fewer pitch lags or pausing filter adaptation,
+   without changing their output or the timing of their events. */
+typedef enum {
+    DEMO_LOAD_FULL = 0,
+    DEMO_LOAD_REDUCED = 1,
+    DEMO_LOAD_MINIMAL = 2,
+} demo_load_level_t;
+
+/* Largest number of tunable parameters of an app */
+#define DEMO_MAX_PARAMS 8
+
+/* A tunable parameter of an app, e.g a detection threshold or a gain.
+   Values outside [min, max] are clamped. Ramped parameters move to a new
+   value over a few milliseconds instead of jumping. */
+typedef struct {
+    const char* name;
+    float min;
+    float max;
+    float default_value;
+    bool ramped;
+} demo_param_info_t;
+
+/* Version of demo_app_vtable_t and the demo_registry_* functions, bumped
+   on incompatible changes. Compare with demo_registry_abi_version() before
+   using the registry. */
+#define DEMO_APP_ABI_VERSION 1
+
+/* A demo app linked into the image. Fields are only ever appended, size
+   is sizeof the vtable of the library. The functions behave like the
+   demo_app_* functions of single demo builds below. */
+typedef struct {
+    uint32_t abi_version;
+    uint32_t size;
+    const char* name;
+    /* Upper bound of the arena bytes the app allocates when it is created */
+    uint32_t arena_budget;
+    /* Channel masks, bit 0 is the left channel and bit 1 the right one */
+    uint8_t rx_channel_mask;
+    uint8_t tx_channel_mask;
+    void (*process_channels)(void* demo_app_ptr, float* const* tx_ptrs, const float* const* rx_ptrs, uint32_t frame_count);
+    void (*handle_message)(void* demo_app_ptr, uint8_t message);
+    uint32_t (*take_events)(void* demo_app_ptr, app_event_t* events, uint32_t max_count);
+    uint32_t (*tap_signal)(void* demo_app_ptr, const float** samples);
+    uint32_t (*stage_stats)(void* demo_app_ptr, demo_stage_stats_t* stats, uint32_t max_count);
+    void (*set_load_level)(void* demo_app_ptr, uint8_t level);
+    /* Parameters of the app, param_count of at most DEMO_MAX_PARAMS */
+    uint32_t param_count;
+    const demo_param_info_t* params;
+    void (*set_params)(void* demo_app_ptr, const float* values, uint32_t count);
+} demo_app_vtable_t;
+
+/* Registry of the demo apps linked into the image. Single demo builds
+   register their one demo, builds with the all_demos feature all of them. */
+uint32_t demo_registry_abi_version(void);
+uint32_t demo_registry_count(void);
+/* Return NULL if there is no such demo */
+const demo_app_vtable_t* demo_registry_get(uint32_t index);
+const demo_app_vtable_t* demo_registry_find(const char* name);
+
+/* The arena has room for two apps, one at each end, so a new app can be
+   created while another one runs. Returns NULL if both ends are taken,
+   the free space is smaller than the app's arena_budget or the app used
+   more than its arena_budget. The allocator is locked when this function
+   returns. Must not be called concurrently with
+   itself or demo_registry_destroy. */
+void* demo_registry_create(const demo_app_vtable_t* vtable, float sample_rate);
+
+/* Destroys an app made by demo_registry_create and frees its part of the
+   arena. No thread may use the app any more. */
+void demo_registry_destroy(const demo_app_vtable_t* vtable, void* demo_app_ptr);
+
+/* The functions below are only available in single demo builds, i.e
+   without the all_demos feature. */
+
+/* Creates the demo app. All allocations are served from an arena that is
+   locked when this function returns, see allocator_stats_t. */
 void* demo_app_create(float sample_rate);
 
 void demo_app_process(
@@ -26,7 +166,62 @@ void demo_app_process(
     unsigned int sample_count
 );
 
-void demo_app_handle_message(void* demo_app_ptr, app_message_t message);
-app_message_t demo_app_next_outgoing_message(void* demo_app_ptr);
+/* Channel masks, bit 0 is the left channel and bit 1 the right one. */
+uint8_t demo_app_rx_channel_mask(void* demo_app_ptr);
+uint8_t demo_app_tx_channel_mask(void* demo_app_ptr);
+
+/* Planar multichannel processing. tx_ptrs and rx_ptrs hold one pointer per
+   channel, which is NULL for channels not in the app's channel masks. */
+void demo_app_process_channels(
+    void* demo_app_ptr,
+    float* const* tx_ptrs,
+    const float* const* rx_ptrs,
+    uint32_t frame_count
+);
+
+void demo_app_handle_message(void* demo_app_ptr, uint8_t message);
+
+/* Moves up to max_count outgoing events, oldest first, to events.
+   Returns the number of events moved. */
+uint32_t demo_app_take_events(void* demo_app_ptr, app_event_t* events, uint32_t max_count);
+
+/* Points samples at an internal signal of the last processed block, e.g
+   the NLMS filter residual, and returns its length in frames. Returns 0
+   if the app has no such signal for the block. */
+uint32_t demo_app_tap_signal(void* demo_app_ptr, const float** samples);
+
+/* Copies the stats of up to max_count stages of the app to stats, in
+   processing order, and returns the number copied. Returns 0 for apps
+   that are not built from stages. */
+uint32_t demo_app_stage_stats(void* demo_app_ptr, demo_stage_stats_t* stats, uint32_t max_count);
+
+/* Sets the demo_load_level_t the app runs at, DEMO_LOAD_FULL when it is
+   created. Must be called between blocks on the thread running the app.
+   Unknown levels are ignored. */
+void demo_app_set_load_level(void* demo_app_ptr, uint8_t level);
+
+/* Returns the tunable parameters of the app and stores their number in
+   count. */
+const demo_param_info_t* demo_app_params(uint32_t* count);
+
+/* Sets all parameters of the app at once, one value per parameter in the
+   order of demo_app_params. Must be called between blocks on the thread
+   running the app. Ignored if count does not match. */
+void demo_app_set_params(void* demo_app_ptr, const float* values, uint32_t count);
+
+/* Block codecs of the NLMS demo recording, exposed for benchmarking */
+typedef enum {
+    RECORDING_CODEC_PCM16 = 0,
+    RECORDING_CODEC_IMA_ADPCM = 1,
+} recording_codec_t;
+
+/* Returns false for unknown codecs */
+bool recording_codec_block_size(uint8_t codec, uint32_t* block_samples, uint32_t* block_bytes);
+
+/* Encodes block_count * block_samples samples into block_count blocks,
+   as consecutive blocks of one recording */
+void recording_codec_encode(uint8_t codec, const float* samples, uint32_t block_count, uint8_t* blocks);
+
+void recording_codec_decode(uint8_t codec, const uint8_t* blocks, uint32_t block_count, float* samples);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,123 @@
+/// Blocks with a mean reference power below this, about -60 dBFS, are
+/// far end silence
+const MIN_REFERENCE_POWER: f32 = 1e-6;
+/// Near end activity is declared when the microphone power is this many
+/// times the echo power expected from the reference, i.e 6 dB above it
+const DOUBLE_TALK_RATIO: f32 = 4.0;
+/// Relative growth of the echo gain estimate per sample, about 6 dB per
+/// second at 44.4 kHz, so that it follows an echo path that gets louder
+const ECHO_GAIN_RISE_PER_SAMPLE: f32 = 3e-5;
+
+/// Whether an adaptive filter should adapt during a block, and why not
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum GateDecision {
+    Adapt,
+    /// There is no echo to learn from
+    FarEndSilent,
+    /// Near end speech on top of the echo would make the filter diverge
+    DoubleTalk,
+}
+
+/// Decides once per block whether an echo cancelling filter should adapt,
+/// from the mean power of the block of its reference (far end) and
+/// microphone (near end) signals.
+///
+/// The far end is active when the reference power is above a fixed floor,
+/// which suits a reference that is generated digitally. Double-talk is
+/// detected like a Geigel detector, but on block powers and against an
+/// estimate of the echo path gain instead of a fixed threshold: the
+/// smallest ratio of microphone to reference power seen while the far end
+/// is active, which rises slowly. Both decisions are held for a hangover.
+pub struct ActivityGate {
+    far_end_hangover: usize,
+    double_talk_hangover: usize,
+    /// Samples left until the far end counts as silent
+    far_end_countdown: usize,
+    /// Samples left until adaptation resumes after double-talk
+    double_talk_countdown: usize,
+    /// Estimated power gain of the echo path, including the near end noise
+    echo_gain: f32,
+    block_count: u32,
+    skipped_block_count: u32,
+}
+
+impl ActivityGate {
+    /// far_end_hangover is the number of samples adaptation goes on after
+    /// the reference falls silent, e.g the length of the filter, whose taps
+    /// still hold the reference. double_talk_hangover is the number of
+    /// samples adaptation stays frozen after near end activity.
+    pub fn new(far_end_hangover: usize, double_talk_hangover: usize) -> Self {
+        ActivityGate {
+            far_end_hangover,
+            double_talk_hangover,
+            far_end_countdown: 0,
+            double_talk_countdown: 0,
+            echo_gain: f32::MAX,
+            block_count: 0,
+            skipped_block_count: 0,
+        }
+    }
+
+    /// Clears the state and the counters
+    pub fn reset(&mut self) {
+        self.far_end_countdown = 0;
+        self.double_talk_countdown = 0;
+        self.echo_gain = f32::MAX;
+        self.block_count = 0;
+        self.skipped_block_count = 0;
+    }
+
+    /// reference is the block of the reference signal, aligned with the
+    /// microphone block and possibly split in two, e.g by a ring buffer.
+    pub fn process(&mut self, reference: &[&[f32]], microphone: &[f32]) -> GateDecision {
+        let n = microphone.len();
+        if n == 0 {
+            return GateDecision::FarEndSilent;
+        }
+        let block_power = |x: &[f32]| x.iter().map(|x| x * x).sum::<f32>();
+        let reference_power = reference.iter().map(|x| block_power(x)).sum::<f32>() / n as f32;
+        let microphone_power = block_power(microphone) / n as f32;
+
+        let far_end_active = reference_power >= MIN_REFERENCE_POWER;
+        let far_end_silent = !far_end_active && self.far_end_countdown == 0;
+        if far_end_active {
+            self.far_end_countdown = self.far_end_hangover;
+        } else {
+            self.far_end_countdown = self.far_end_countdown.saturating_sub(n);
+        }
+
+        if far_end_active {
+            let ratio = microphone_power / reference_power;
+            if ratio > DOUBLE_TALK_RATIO * self.echo_gain {
+                self.double_talk_countdown = self.double_talk_hangover;
+            }
+            let risen = self.echo_gain * (1.0 + ECHO_GAIN_RISE_PER_SAMPLE * n as f32);
+            self.echo_gain = if ratio < risen { ratio } else { risen };
+        }
+
+        let decision = if far_end_silent {
+            GateDecision::FarEndSilent
+        } else if self.double_talk_countdown > 0 {
+            GateDecision::DoubleTalk
+        } else {
+            GateDecision::Adapt
+        };
+        self.double_talk_countdown = self.double_talk_countdown.saturating_sub(n);
+
+        self.block_count += 1;
+        if decision != GateDecision::Adapt {
+            self.skipped_block_count += 1;
+        }
+        decision
+    }
+
+    /// Share of the blocks since the last reset in which adaptation was
+    /// skipped, or None if there were none
+    pub fn skipped_fraction(&self) -> Option<f32> {
+        if self.block_count == 0 {
+            None
+        } else {
+            Some(self.skipped_block_count as f32 / self.block_count as f32)
+        }
+    }
+}
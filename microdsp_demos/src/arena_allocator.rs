@@ -0,0 +1,344 @@
+use crate::registry::ARENA_SIZE;
+use core::alloc::{GlobalAlloc, Layout};
+use core::ptr::{addr_of_mut, null_mut};
+use core::sync::atomic::{AtomicU32, AtomicU8, AtomicUsize, Ordering};
+
+/// Sized from the arena budgets of the demos in the image, see registry.rs
+#[repr(C, align(16))]
+struct Arena([u8; ARENA_SIZE]);
+
+static mut ARENA: Arena = Arena([0; ARENA_SIZE]);
+
+/// Allocator stats. Matches allocator_stats_t in microdsp_demos.h.
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct AllocatorStats {
+    pub arena_size: u32,
+    /// Bytes currently taken from the arena, including padding and
+    /// freed bytes that could not be reclaimed
+    pub used: u32,
+    pub high_water_mark: u32,
+    /// Bytes skipped to align allocations
+    pub alignment_padding: u32,
+    /// Bytes freed below the top of a region, which are lost until the
+    /// region is released
+    pub unreclaimed: u32,
+    pub allocation_count: u32,
+    pub failed_allocation_count: u32,
+    /// Allocations made after the allocator was locked, e.g on the audio thread
+    pub locked_allocation_count: u32,
+}
+
+/// The arena is shared by up to two apps, one growing up from the start
+/// and one growing down from the end, so that an app can be created while
+/// another one is still running.
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum ArenaRegion {
+    Low = 0,
+    High = 1,
+}
+
+/// Bump allocator serving all allocations from a statically allocated
+/// arena, honouring the requested alignment. Memory is only reclaimed when
+/// the most recent allocation of a region is freed or resized, which covers
+/// the temporary allocations made while setting up an app, and when the
+/// whole region is released.
+///
+/// An app claims a region before it is created, and new allocations are
+/// taken from that region until the next claim. The region is locked once
+/// the app has been created. Allocations from a locked region are still
+/// served, but counted. With the trap_locked_allocations feature, they
+/// panic instead. Claiming a region leaves the lock of the other one
+/// alone, so the app running there while the next one is created stays
+/// locked. Its allocations in the meantime are taken from the new region
+/// though, and only counted when resizing its own memory.
+pub struct ArenaAllocator {
+    /// End of the low region
+    low_top: AtomicUsize,
+    /// Start of the high region, ARENA_SIZE if it is empty
+    high_bottom: AtomicUsize,
+    /// Region new allocations are taken from, an ArenaRegion
+    region: AtomicU8,
+    /// Bit per claimed ArenaRegion
+    claimed: AtomicU8,
+    high_water_mark: AtomicUsize,
+    alignment_padding: [AtomicUsize; 2],
+    unreclaimed: [AtomicUsize; 2],
+    allocation_count: AtomicU32,
+    failed_allocation_count: AtomicU32,
+    locked_allocation_count: AtomicU32,
+    /// Bit per locked ArenaRegion
+    locked: AtomicU8,
+}
+
+impl ArenaAllocator {
+    pub const fn new() -> Self {
+        ArenaAllocator {
+            low_top: AtomicUsize::new(0),
+            high_bottom: AtomicUsize::new(ARENA_SIZE),
+            region: AtomicU8::new(ArenaRegion::Low as u8),
+            claimed: AtomicU8::new(0),
+            high_water_mark: AtomicUsize::new(0),
+            alignment_padding: [AtomicUsize::new(0), AtomicUsize::new(0)],
+            unreclaimed: [AtomicUsize::new(0), AtomicUsize::new(0)],
+            allocation_count: AtomicU32::new(0),
+            failed_allocation_count: AtomicU32::new(0),
+            locked_allocation_count: AtomicU32::new(0),
+            locked: AtomicU8::new(0),
+        }
+    }
+
+    /// Claims an unused region for a new app and unlocks it, so that the
+    /// app can be created. Returns false if the region is in use.
+    pub fn claim(&self, region: ArenaRegion) -> bool {
+        let bit = 1 << region as u8;
+        if self.claimed.fetch_or(bit, Ordering::SeqCst) & bit != 0 {
+            return false;
+        }
+        self.locked.fetch_and(!bit, Ordering::SeqCst);
+        self.region.store(region as u8, Ordering::SeqCst);
+        true
+    }
+
+    /// Frees everything allocated from a region. Only safe once the app
+    /// that claimed it is gone.
+    pub fn release(&self, region: ArenaRegion) {
+        match region {
+            ArenaRegion::Low => self.low_top.store(0, Ordering::SeqCst),
+            ArenaRegion::High => self.high_bottom.store(ARENA_SIZE, Ordering::SeqCst),
+        }
+        self.alignment_padding[region as usize].store(0, Ordering::Relaxed);
+        self.unreclaimed[region as usize].store(0, Ordering::Relaxed);
+        self.claimed.fetch_and(!(1 << region as u8), Ordering::SeqCst);
+    }
+
+    pub fn lock(&self, region: ArenaRegion) {
+        self.locked.fetch_or(1 << region as u8, Ordering::SeqCst);
+    }
+
+    /// Bytes taken from a region, including padding
+    pub fn region_used(&self, region: ArenaRegion) -> usize {
+        match region {
+            ArenaRegion::Low => self.low_top.load(Ordering::Relaxed),
+            ArenaRegion::High => ARENA_SIZE - self.high_bottom.load(Ordering::Relaxed),
+        }
+    }
+
+    /// Bytes between the two regions
+    pub fn free(&self) -> usize {
+        self.high_bottom.load(Ordering::Relaxed) - self.low_top.load(Ordering::Relaxed)
+    }
+
+    pub fn stats(&self) -> AllocatorStats {
+        let sum = |counts: &[AtomicUsize; 2]| counts.iter().map(|c| c.load(Ordering::Relaxed)).sum::<usize>() as u32;
+        AllocatorStats {
+            arena_size: ARENA_SIZE as u32,
+            used: (ARENA_SIZE - self.free()) as u32,
+            high_water_mark: self.high_water_mark.load(Ordering::Relaxed) as u32,
+            alignment_padding: sum(&self.alignment_padding),
+            unreclaimed: sum(&self.unreclaimed),
+            allocation_count: self.allocation_count.load(Ordering::Relaxed),
+            failed_allocation_count: self.failed_allocation_count.load(Ordering::Relaxed),
+            locked_allocation_count: self.locked_allocation_count.load(Ordering::Relaxed),
+        }
+    }
+
+    fn base(&self) -> *mut u8 {
+        unsafe { addr_of_mut!(ARENA.0) as *mut u8 }
+    }
+
+    fn allocated(&self, region: ArenaRegion, padding: usize) {
+        self.alignment_padding[region as usize].fetch_add(padding, Ordering::Relaxed);
+        self.high_water_mark.fetch_max(ARENA_SIZE - self.free(), Ordering::Relaxed);
+        self.allocation_count.fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Region new allocations are taken from
+    fn current_region(&self) -> ArenaRegion {
+        if self.region.load(Ordering::Relaxed) == ArenaRegion::Low as u8 {
+            ArenaRegion::Low
+        } else {
+            ArenaRegion::High
+        }
+    }
+
+    /// Region holding the memory at offset start of the arena
+    fn region_of(&self, start: usize) -> ArenaRegion {
+        if start < self.high_bottom.load(Ordering::Relaxed) {
+            ArenaRegion::Low
+        } else {
+            ArenaRegion::High
+        }
+    }
+
+    fn is_locked(&self, region: ArenaRegion) -> bool {
+        self.locked.load(Ordering::Relaxed) & (1 << region as u8) != 0
+    }
+
+    /// Counts, or with trap_locked_allocations traps, memory taken for a
+    /// region after it was locked
+    fn check_locked(&self, region: ArenaRegion) {
+        if self.is_locked(region) {
+            self.locked_allocation_count.fetch_add(1, Ordering::Relaxed);
+            #[cfg(feature = "trap_locked_allocations")]
+            panic!("allocation after the allocator was locked");
+        }
+    }
+
+    fn failed(&self) -> *mut u8 {
+        self.failed_allocation_count.fetch_add(1, Ordering::Relaxed);
+        null_mut()
+    }
+
+    /// Moves the top of a region back from taken to previous after taking
+    /// memory that overlaps the other region. The check before taking it
+    /// can race with an allocation from the other region, so the top of
+    /// the other region is loaded again afterwards, both with SeqCst, so
+    /// that at least one of the two allocations sees the other. If the top
+    /// has moved on in the meantime, the memory is lost until the region
+    /// is released.
+    fn roll_back(&self, top: &AtomicUsize, region: ArenaRegion, taken: usize, previous: usize) {
+        if top
+            .compare_exchange(taken, previous, Ordering::SeqCst, Ordering::Relaxed)
+            .is_err()
+        {
+            self.unreclaimed[region as usize].fetch_add(taken.abs_diff(previous), Ordering::Relaxed);
+        }
+    }
+
+    unsafe fn alloc_low(&self, layout: Layout) -> *mut u8 {
+        let base = self.base() as usize;
+        let mut top = self.low_top.load(Ordering::Relaxed);
+        loop {
+            let start = (base + top + layout.align() - 1) & !(layout.align() - 1);
+            let offset = start - base;
+            let new_top = match offset.checked_add(layout.size()) {
+                Some(new_top) if new_top <= self.high_bottom.load(Ordering::Relaxed) => new_top,
+                _ => return self.failed(),
+            };
+            match self
+                .low_top
+                .compare_exchange_weak(top, new_top, Ordering::SeqCst, Ordering::Relaxed)
+            {
+                Ok(_) => {
+                    if new_top > self.high_bottom.load(Ordering::SeqCst) {
+                        self.roll_back(&self.low_top, ArenaRegion::Low, new_top, top);
+                        return self.failed();
+                    }
+                    self.allocated(ArenaRegion::Low, offset - top);
+                    return start as *mut u8;
+                }
+                Err(current) => top = current,
+            }
+        }
+    }
+
+    unsafe fn alloc_in(&self, region: ArenaRegion, layout: Layout) -> *mut u8 {
+        match region {
+            ArenaRegion::Low => self.alloc_low(layout),
+            ArenaRegion::High => self.alloc_high(layout),
+        }
+    }
+
+    unsafe fn alloc_high(&self, layout: Layout) -> *mut u8 {
+        let base = self.base() as usize;
+        let mut bottom = self.high_bottom.load(Ordering::Relaxed);
+        loop {
+            let offset = match bottom.checked_sub(layout.size()) {
+                Some(end) => ((base + end) & !(layout.align() - 1)) - base,
+                None => return self.failed(),
+            };
+            if offset < self.low_top.load(Ordering::Relaxed) {
+                return self.failed();
+            }
+            match self
+                .high_bottom
+                .compare_exchange_weak(bottom, offset, Ordering::SeqCst, Ordering::Relaxed)
+            {
+                Ok(_) => {
+                    if offset < self.low_top.load(Ordering::SeqCst) {
+                        self.roll_back(&self.high_bottom, ArenaRegion::High, offset, bottom);
+                        return self.failed();
+                    }
+                    self.allocated(ArenaRegion::High, bottom - layout.size() - offset);
+                    return (base + offset) as *mut u8;
+                }
+                Err(current) => bottom = current,
+            }
+        }
+    }
+}
+
+unsafe impl GlobalAlloc for ArenaAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        let region = self.current_region();
+        self.check_locked(region);
+        self.alloc_in(region, layout)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        // Only the most recent allocation of a region can be handed back
+        let start = ptr as usize - self.base() as usize;
+        let end = start + layout.size();
+        let region = self.region_of(start);
+        let reclaimed = match region {
+            ArenaRegion::Low => self
+                .low_top
+                .compare_exchange(end, start, Ordering::Relaxed, Ordering::Relaxed)
+                .is_ok(),
+            ArenaRegion::High => self
+                .high_bottom
+                .compare_exchange(start, end, Ordering::Relaxed, Ordering::Relaxed)
+                .is_ok(),
+        };
+        if !reclaimed {
+            self.unreclaimed[region as usize].fetch_add(layout.size(), Ordering::Relaxed);
+        }
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        // Resize the most recent allocation of the low region in place
+        let start = ptr as usize - self.base() as usize;
+        let end = start + layout.size();
+        let new_end = start + new_size;
+        let resized = new_end <= self.high_bottom.load(Ordering::Relaxed)
+            && self
+                .low_top
+                .compare_exchange(end, new_end, Ordering::SeqCst, Ordering::Relaxed)
+                .is_ok();
+        // Growing races with alloc_high like alloc_low does
+        if resized && new_end > end && new_end > self.high_bottom.load(Ordering::SeqCst) {
+            self.roll_back(&self.low_top, ArenaRegion::Low, new_end, end);
+        } else if resized {
+            // Growing in place takes memory just like alloc does
+            if new_size > layout.size() {
+                self.check_locked(ArenaRegion::Low);
+            }
+            self.high_water_mark.fetch_max(ARENA_SIZE - self.free(), Ordering::Relaxed);
+            return ptr;
+        }
+        // Moving memory of a locked region is an allocation of its app,
+        // even if the copy lands in a region that is being set up
+        let own_region = self.region_of(start);
+        let region = self.current_region();
+        self.check_locked(if self.is_locked(own_region) { own_region } else { region });
+        let new_layout = Layout::from_size_align_unchecked(new_size, layout.align());
+        let new_ptr = self.alloc_in(region, new_layout);
+        if !new_ptr.is_null() {
+            core::ptr::copy_nonoverlapping(ptr, new_ptr, layout.size().min(new_size));
+            self.dealloc(ptr, layout);
+        }
+        new_ptr
+    }
+}
+
+#[no_mangle]
+pub unsafe fn __aeabi_unwind_cpp_pr0() -> () {
+    loop {}
+}
+
+// Referenced by the precompiled core and alloc libraries of hosted
+// targets, even with panic = "abort". Only needed for host builds.
+#[cfg(not(target_os = "none"))]
+#[no_mangle]
+pub extern "C" fn rust_eh_personality() {}
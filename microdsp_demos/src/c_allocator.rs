@@ -1,24 +0,0 @@
-use core::alloc::{GlobalAlloc, Layout};
-
-pub struct CAllocator;
-
-extern "C" {
-    pub fn malloc(size: usize) -> *mut u8;
-    pub fn free(ptr: *mut u8);
-}
-
-#[no_mangle]
-pub unsafe fn __aeabi_unwind_cpp_pr0() -> () {
-    loop {}
-}
-
-unsafe impl GlobalAlloc for CAllocator {
-    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
-        let result = malloc(layout.size());
-        result
-    }
-
-    unsafe fn dealloc(&self, ptr: *mut u8, _layout: Layout) {
-        free(ptr)
-    }
-}
@@ -1,41 +1,287 @@
-use crate::{AppMessage, DemoApp, DemoAppType};
-use alloc::{boxed::Box, slice};
-use core::mem::transmute;
+use crate::{
+    AllocatorStats, AppEvent, AppMessage, DemoApp, ImaAdpcmCodec, LoadLevel, Pcm16Codec, RecordingCodec,
+    StageStats, ALLOCATOR, MAX_CHANNEL_COUNT, MAX_PARAM_COUNT,
+};
+use alloc::slice;
+use core::ffi::c_void;
+
+// The functions below that take a demo app pointer are generic over the
+// app type. They make up the vtables of the demo registry, and the
+// demo_app_* functions of single demo builds call them with DemoAppType.
+
+pub(crate) unsafe extern "C" fn process_channels<T: DemoApp>(
+    demo_app_ptr: *mut c_void,
+    tx_ptrs: *const *mut f32,
+    rx_ptrs: *const *const f32,
+    frame_count: u32,
+) {
+    let demo_app = &mut *(demo_app_ptr as *mut T);
+    let frame_count = frame_count as usize;
+    let mut rx: [Option<&[f32]>; MAX_CHANNEL_COUNT] = [None; MAX_CHANNEL_COUNT];
+    let mut tx: [Option<&mut [f32]>; MAX_CHANNEL_COUNT] = [None, None];
+    for c in 0..MAX_CHANNEL_COUNT {
+        let rx_ptr = *rx_ptrs.add(c);
+        if !rx_ptr.is_null() {
+            rx[c] = Some(slice::from_raw_parts(rx_ptr, frame_count));
+        }
+        let tx_ptr = *tx_ptrs.add(c);
+        if !tx_ptr.is_null() {
+            tx[c] = Some(slice::from_raw_parts_mut(tx_ptr, frame_count));
+        }
+    }
+    demo_app.process_channels(rx, tx);
+}
+
+pub(crate) unsafe extern "C" fn handle_message<T: DemoApp>(demo_app_ptr: *mut c_void, message: u8) {
+    let demo_app = &mut *(demo_app_ptr as *mut T);
+    if let Some(message) = AppMessage::from_u8(message) {
+        demo_app.handle_message(message);
+    }
+}
+
+pub(crate) unsafe extern "C" fn take_events<T: DemoApp>(
+    demo_app_ptr: *mut c_void,
+    events_ptr: *mut AppEvent,
+    max_count: u32,
+) -> u32 {
+    let demo_app = &mut *(demo_app_ptr as *mut T);
+    let mut count = 0;
+    while count < max_count {
+        match demo_app.next_outgoing_event() {
+            Some(event) => events_ptr.add(count as usize).write(event),
+            None => break,
+        }
+        count += 1;
+    }
+    count
+}
+
+pub(crate) unsafe extern "C" fn tap_signal<T: DemoApp>(demo_app_ptr: *mut c_void, samples: *mut *const f32) -> u32 {
+    let demo_app = &*(demo_app_ptr as *const T);
+    match demo_app.tap_signal() {
+        Some(signal) => {
+            samples.write(signal.as_ptr());
+            signal.len() as u32
+        }
+        None => 0,
+    }
+}
+
+pub(crate) unsafe extern "C" fn stage_stats<T: DemoApp>(
+    demo_app_ptr: *mut c_void,
+    stats_ptr: *mut StageStats,
+    max_count: u32,
+) -> u32 {
+    let demo_app = &*(demo_app_ptr as *const T);
+    let stats = slice::from_raw_parts_mut(stats_ptr, max_count as usize);
+    demo_app.stage_stats(stats) as u32
+}
+
+pub(crate) unsafe extern "C" fn set_load_level<T: DemoApp>(demo_app_ptr: *mut c_void, level: u8) {
+    let demo_app = &mut *(demo_app_ptr as *mut T);
+    if let Some(level) = LoadLevel::from_u8(level) {
+        demo_app.set_load_level(level);
+    }
+}
+
+/// Ignores value counts that do not match T::PARAMS, and clamps the values
+/// to their ranges
+pub(crate) unsafe extern "C" fn set_params<T: DemoApp>(demo_app_ptr: *mut c_void, values_ptr: *const f32, count: u32) {
+    let demo_app = &mut *(demo_app_ptr as *mut T);
+    if count as usize != T::PARAMS.len() || T::PARAMS.len() > MAX_PARAM_COUNT {
+        return;
+    }
+    let mut values = [0.0; MAX_PARAM_COUNT];
+    for (i, param) in T::PARAMS.iter().enumerate() {
+        values[i] = param.clamp(*values_ptr.add(i));
+    }
+    demo_app.set_params(&values[..T::PARAMS.len()]);
+}
 
 #[no_mangle]
-pub extern "C" fn demo_app_create(sample_rate: f32) -> *mut DemoAppType {
-    unsafe { transmute(Box::new(DemoAppType::new(sample_rate))) }
+pub extern "C" fn demo_app_allocator_stats(stats: *mut AllocatorStats) {
+    unsafe { stats.write(ALLOCATOR.stats()) };
+}
+
+/// The C API of single demo builds, which link exactly one demo app.
+/// Builds with all_demos select apps through the registry instead, see
+/// registry.rs.
+#[cfg(not(feature = "all_demos"))]
+mod single_demo {
+    use super::*;
+    use crate::{arena_allocator::ArenaRegion, DemoAppType, ParamInfo};
+    #[cfg(not(feature = "static_app"))]
+    use alloc::boxed::Box;
+    #[cfg(feature = "static_app")]
+    use core::{
+        mem::MaybeUninit,
+        ptr::addr_of_mut,
+        sync::atomic::{AtomicBool, Ordering},
+    };
+
+    #[no_mangle]
+    pub extern "C" fn demo_app_create(sample_rate: f32) -> *mut DemoAppType {
+        // The app owns the low region of the arena from now on
+        assert!(ALLOCATOR.claim(ArenaRegion::Low));
+        // With the static_app feature, the app is placed in a static instead
+        // of being boxed, so it can only be created once.
+        #[cfg(feature = "static_app")]
+        let demo_app = {
+            static mut DEMO_APP: MaybeUninit<DemoAppType> = MaybeUninit::uninit();
+            static CREATED: AtomicBool = AtomicBool::new(false);
+            assert!(!CREATED.swap(true, Ordering::Relaxed));
+            unsafe { (*addr_of_mut!(DEMO_APP)).write(DemoAppType::new(sample_rate)) as *mut DemoAppType }
+        };
+        #[cfg(not(feature = "static_app"))]
+        let demo_app = Box::into_raw(Box::new(DemoAppType::new(sample_rate)));
+        // All memory the app needs should have been allocated by now
+        ALLOCATOR.lock(ArenaRegion::Low);
+        demo_app
+    }
+
+    #[no_mangle]
+    pub extern "C" fn demo_app_process(
+        demo_app_ptr: *mut DemoAppType,
+        tx_ptr: *mut f32,
+        rx_ptr: *const f32,
+        sample_count: u32,
+    ) {
+        let (demo_app, tx, rx) = unsafe {
+            (
+                &mut *demo_app_ptr,
+                slice::from_raw_parts_mut(tx_ptr, sample_count as usize),
+                slice::from_raw_parts(rx_ptr, sample_count as usize),
+            )
+        };
+        demo_app.process(rx, tx);
+    }
+
+    #[no_mangle]
+    pub extern "C" fn demo_app_rx_channel_mask(_demo_app_ptr: *mut DemoAppType) -> u8 {
+        DemoAppType::RX_CHANNEL_MASK
+    }
+
+    #[no_mangle]
+    pub extern "C" fn demo_app_tx_channel_mask(_demo_app_ptr: *mut DemoAppType) -> u8 {
+        DemoAppType::TX_CHANNEL_MASK
+    }
+
+    #[no_mangle]
+    pub extern "C" fn demo_app_process_channels(
+        demo_app_ptr: *mut DemoAppType,
+        tx_ptrs: *const *mut f32,
+        rx_ptrs: *const *const f32,
+        frame_count: u32,
+    ) {
+        unsafe { process_channels::<DemoAppType>(demo_app_ptr as *mut c_void, tx_ptrs, rx_ptrs, frame_count) }
+    }
+
+    #[no_mangle]
+    pub extern "C" fn demo_app_handle_message(demo_app_ptr: *mut DemoAppType, message: u8) {
+        unsafe { handle_message::<DemoAppType>(demo_app_ptr as *mut c_void, message) }
+    }
+
+    #[no_mangle]
+    pub extern "C" fn demo_app_take_events(
+        demo_app_ptr: *mut DemoAppType,
+        events_ptr: *mut AppEvent,
+        max_count: u32,
+    ) -> u32 {
+        unsafe { take_events::<DemoAppType>(demo_app_ptr as *mut c_void, events_ptr, max_count) }
+    }
+
+    #[no_mangle]
+    pub extern "C" fn demo_app_tap_signal(demo_app_ptr: *mut DemoAppType, samples: *mut *const f32) -> u32 {
+        unsafe { tap_signal::<DemoAppType>(demo_app_ptr as *mut c_void, samples) }
+    }
+
+    #[no_mangle]
+    pub extern "C" fn demo_app_stage_stats(
+        demo_app_ptr: *mut DemoAppType,
+        stats_ptr: *mut StageStats,
+        max_count: u32,
+    ) -> u32 {
+        unsafe { stage_stats::<DemoAppType>(demo_app_ptr as *mut c_void, stats_ptr, max_count) }
+    }
+
+    #[no_mangle]
+    pub extern "C" fn demo_app_set_load_level(demo_app_ptr: *mut DemoAppType, level: u8) {
+        unsafe { set_load_level::<DemoAppType>(demo_app_ptr as *mut c_void, level) }
+    }
+
+    #[no_mangle]
+    pub extern "C" fn demo_app_params(count: *mut u32) -> *const ParamInfo {
+        unsafe { count.write(DemoAppType::PARAMS.len() as u32) };
+        DemoAppType::PARAMS.as_ptr()
+    }
+
+    #[no_mangle]
+    pub extern "C" fn demo_app_set_params(demo_app_ptr: *mut DemoAppType, values_ptr: *const f32, count: u32) {
+        unsafe { set_params::<DemoAppType>(demo_app_ptr as *mut c_void, values_ptr, count) }
+    }
 }
 
+const RECORDING_CODEC_PCM16: u8 = 0;
+const RECORDING_CODEC_IMA_ADPCM: u8 = 1;
+
+/// Writes the block size of a recording codec in samples and bytes.
+/// Returns false for unknown codecs.
 #[no_mangle]
-pub fn demo_app_process(
-    demo_app_ptr: *mut DemoAppType,
-    tx_ptr: *mut f32,
-    rx_ptr: *const f32,
-    sample_count: usize,
-) {
-    let (demo_app, tx, rx) = unsafe {
+pub extern "C" fn recording_codec_block_size(codec: u8, block_samples: *mut u32, block_bytes: *mut u32) -> bool {
+    let (samples, bytes) = match codec {
+        RECORDING_CODEC_PCM16 => (Pcm16Codec::BLOCK_SAMPLES, Pcm16Codec::BLOCK_BYTES),
+        RECORDING_CODEC_IMA_ADPCM => (ImaAdpcmCodec::BLOCK_SAMPLES, ImaAdpcmCodec::BLOCK_BYTES),
+        _ => return false,
+    };
+    unsafe {
+        block_samples.write(samples as u32);
+        block_bytes.write(bytes as u32);
+    }
+    true
+}
+
+fn encode_blocks<C: RecordingCodec>(samples: *const f32, block_count: u32, blocks: *mut u8) {
+    let block_count = block_count as usize;
+    let (samples, blocks) = unsafe {
         (
-            &mut *demo_app_ptr,
-            slice::from_raw_parts_mut(tx_ptr, sample_count),
-            slice::from_raw_parts(rx_ptr, sample_count),
+            slice::from_raw_parts(samples, block_count * C::BLOCK_SAMPLES),
+            slice::from_raw_parts_mut(blocks, block_count * C::BLOCK_BYTES),
         )
     };
-    demo_app.process(rx, tx);
+    let mut codec = C::new();
+    for (samples, block) in samples.chunks_exact(C::BLOCK_SAMPLES).zip(blocks.chunks_exact_mut(C::BLOCK_BYTES)) {
+        codec.encode(block, 0, samples);
+    }
+}
+
+fn decode_blocks<C: RecordingCodec>(blocks: *const u8, block_count: u32, samples: *mut f32) {
+    let block_count = block_count as usize;
+    let (blocks, samples) = unsafe {
+        (
+            slice::from_raw_parts(blocks, block_count * C::BLOCK_BYTES),
+            slice::from_raw_parts_mut(samples, block_count * C::BLOCK_SAMPLES),
+        )
+    };
+    for (block, samples) in blocks.chunks_exact(C::BLOCK_BYTES).zip(samples.chunks_exact_mut(C::BLOCK_SAMPLES)) {
+        C::decode(block, samples);
+    }
 }
 
+/// Encodes block_count blocks of samples as one recording
 #[no_mangle]
-pub fn demo_app_handle_message(demo_app_ptr: *mut DemoAppType, message: AppMessage) {
-    let demo_app = unsafe { &mut *demo_app_ptr };
-    demo_app.handle_message(message);
+pub extern "C" fn recording_codec_encode(codec: u8, samples: *const f32, block_count: u32, blocks: *mut u8) {
+    match codec {
+        RECORDING_CODEC_PCM16 => encode_blocks::<Pcm16Codec>(samples, block_count, blocks),
+        RECORDING_CODEC_IMA_ADPCM => encode_blocks::<ImaAdpcmCodec>(samples, block_count, blocks),
+        _ => {}
+    }
 }
 
 #[no_mangle]
-pub fn demo_app_next_outgoing_message(demo_app_ptr: *mut DemoAppType) -> u8 {
-    let demo_app = unsafe { &mut *demo_app_ptr };
-    if let Some(message) = demo_app.next_outgoing_message() {
-        message as u8
-    } else {
-        0
+pub extern "C" fn recording_codec_decode(codec: u8, blocks: *const u8, block_count: u32, samples: *mut f32) {
+    match codec {
+        RECORDING_CODEC_PCM16 => decode_blocks::<Pcm16Codec>(blocks, block_count, samples),
+        RECORDING_CODEC_IMA_ADPCM => decode_blocks::<ImaAdpcmCodec>(blocks, block_count, samples),
+        _ => {}
     }
 }
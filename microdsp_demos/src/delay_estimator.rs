@@ -0,0 +1,164 @@
+use alloc::{vec, vec::Vec};
+use micromath::F32Ext;
+
+/// Cross-correlation decay applied at each estimate update
+const CORRELATION_DECAY: f32 = 0.7;
+/// The correlation peak must be this many times larger than the largest
+/// correlation at lags further than PEAK_EXCLUSION_LAGS away from it.
+/// Filters out periodic signals, which give ambiguous peaks.
+const MIN_PEAK_RATIO: f32 = 1.4;
+const PEAK_EXCLUSION_LAGS: usize = 2;
+/// Updates are skipped if the decimated reference power is below this.
+const MIN_REFERENCE_POWER: f32 = 1e-6;
+
+/// Estimates the delay of a reference signal in another signal, e.g the
+/// delay from the speaker signal to its echo in the microphone signal,
+/// by finding the peak of their cross-correlation. Both signals are
+/// decimated by averaging before correlating, which makes the estimate
+/// cheap enough to update every block at the cost of a resolution of
+/// decimation samples.
+///
+/// A new estimate is only accepted once the same peak has been found
+/// in two consecutive updates.
+pub struct DelayEstimator {
+    decimation: usize,
+    update_interval: usize,
+    /// Decimated reference, stored twice so that the last lag_count
+    /// samples are always contiguous
+    reference: Vec<f32>,
+    reference_pos: usize,
+    correlation: Vec<f32>,
+    reference_sum: f32,
+    signal_sum: f32,
+    decimation_count: usize,
+    reference_power: f32,
+    samples_until_update: usize,
+    candidate_lag: Option<usize>,
+    delay: Option<usize>,
+}
+
+impl DelayEstimator {
+    /// max_delay and the returned delays are in samples. update_interval is
+    /// the number of decimated samples between estimate updates.
+    pub fn new(max_delay: usize, decimation: usize, update_interval: usize) -> Self {
+        let lag_count = max_delay / decimation + 1;
+        DelayEstimator {
+            decimation,
+            update_interval,
+            reference: vec![0.0; 2 * lag_count],
+            reference_pos: 0,
+            correlation: vec![0.0; lag_count],
+            reference_sum: 0.0,
+            signal_sum: 0.0,
+            decimation_count: 0,
+            reference_power: 0.0,
+            samples_until_update: update_interval,
+            candidate_lag: None,
+            delay: None,
+        }
+    }
+
+    pub fn reset(&mut self) {
+        self.reference.fill(0.0);
+        self.reference_pos = 0;
+        self.correlation.fill(0.0);
+        self.reference_sum = 0.0;
+        self.signal_sum = 0.0;
+        self.decimation_count = 0;
+        self.reference_power = 0.0;
+        self.samples_until_update = self.update_interval;
+        self.candidate_lag = None;
+        self.delay = None;
+    }
+
+    /// The most recent confident delay estimate, if any.
+    pub fn delay(&self) -> Option<usize> {
+        self.delay
+    }
+
+    /// reference and signal are blocks of the same length, covering the
+    /// same time span. Returns true if the delay estimate changed.
+    pub fn process(&mut self, reference: &[f32], signal: &[f32]) -> bool {
+        assert!(reference.len() == signal.len());
+        let mut delay_changed = false;
+        for (x, y) in reference.iter().zip(signal) {
+            self.reference_sum += *x;
+            self.signal_sum += *y;
+            self.decimation_count += 1;
+            if self.decimation_count == self.decimation {
+                let scale = 1.0 / self.decimation as f32;
+                let x = self.reference_sum * scale;
+                let y = self.signal_sum * scale;
+                self.reference_sum = 0.0;
+                self.signal_sum = 0.0;
+                self.decimation_count = 0;
+                delay_changed |= self.process_decimated(x, y);
+            }
+        }
+        delay_changed
+    }
+
+    fn process_decimated(&mut self, x: f32, y: f32) -> bool {
+        let lag_count = self.correlation.len();
+        self.reference[self.reference_pos] = x;
+        self.reference[self.reference_pos + lag_count] = x;
+        self.reference_pos = (self.reference_pos + 1) % lag_count;
+        self.reference_power += x * x;
+
+        // The window holds the last lag_count reference samples, oldest
+        // first, so lag l is at lag_count - 1 - l.
+        let window = &self.reference[self.reference_pos..self.reference_pos + lag_count];
+        for (c, x) in self.correlation.iter_mut().zip(window.iter().rev()) {
+            *c += y * *x;
+        }
+
+        self.samples_until_update -= 1;
+        if self.samples_until_update == 0 {
+            self.samples_until_update = self.update_interval;
+            self.update_estimate()
+        } else {
+            false
+        }
+    }
+
+    fn update_estimate(&mut self) -> bool {
+        let reference_power = self.reference_power / self.update_interval as f32;
+        self.reference_power = 0.0;
+        if reference_power < MIN_REFERENCE_POWER {
+            // Nothing to correlate. Keep the accumulated correlation.
+            return false;
+        }
+
+        let mut peak_lag = 0;
+        let mut peak = 0.0;
+        for (lag, c) in self.correlation.iter().enumerate() {
+            if F32Ext::abs(*c) > peak {
+                peak = F32Ext::abs(*c);
+                peak_lag = lag;
+            }
+        }
+        let mut runner_up = 0.0;
+        for (lag, c) in self.correlation.iter().enumerate() {
+            if lag + PEAK_EXCLUSION_LAGS < peak_lag || lag > peak_lag + PEAK_EXCLUSION_LAGS {
+                runner_up = F32Ext::abs(*c).max(runner_up);
+            }
+        }
+        for c in self.correlation.iter_mut() {
+            *c *= CORRELATION_DECAY;
+        }
+
+        if peak == 0.0 || peak < MIN_PEAK_RATIO * runner_up {
+            self.candidate_lag = None;
+            return false;
+        }
+        let confirmed = self.candidate_lag == Some(peak_lag);
+        self.candidate_lag = Some(peak_lag);
+        let delay = peak_lag * self.decimation;
+        if confirmed && self.delay != Some(delay) {
+            self.delay = Some(delay);
+            true
+        } else {
+            false
+        }
+    }
+}
@@ -0,0 +1,81 @@
+use crate::AppMessage;
+
+/// An outgoing message with a timestamp and a payload. Matches
+/// app_event_t in microdsp_demos.h.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct AppEvent {
+    /// Index of the sample (frame) at which the event occurred, counted
+    /// from the start of processing. Wraps around after 2^32 samples.
+    pub timestamp: u32,
+    pub message: AppMessage,
+    /// Message specific payload, e.g a detected frequency in Hz.
+    /// 0 for messages without a payload.
+    pub value: f32,
+}
+
+/// Fixed capacity FIFO of outgoing events. Events are dropped when
+/// the queue is full.
+///
+/// Also keeps track of the current time, i.e the index of the first
+/// sample of the block being processed, so that events can be
+/// timestamped. The app calls end_block after processing each block.
+pub struct EventQueue<const N: usize> {
+    events: [AppEvent; N],
+    read_pos: usize,
+    len: usize,
+    time: u32,
+}
+
+impl<const N: usize> EventQueue<N> {
+    pub fn new() -> Self {
+        EventQueue {
+            events: [AppEvent {
+                timestamp: 0,
+                message: AppMessage::Led0Off,
+                value: 0.0,
+            }; N],
+            read_pos: 0,
+            len: 0,
+            time: 0,
+        }
+    }
+
+    /// Index of the first sample of the current block
+    pub fn time(&self) -> u32 {
+        self.time
+    }
+
+    pub fn end_block(&mut self, sample_count: usize) {
+        self.time = self.time.wrapping_add(sample_count as u32);
+    }
+
+    /// Queues an event at the start of the current block
+    pub fn push(&mut self, message: AppMessage, value: f32) -> bool {
+        self.push_at(self.time, message, value)
+    }
+
+    /// Queues an event with an explicit timestamp
+    pub fn push_at(&mut self, timestamp: u32, message: AppMessage, value: f32) -> bool {
+        if self.len == N {
+            return false;
+        }
+        self.events[(self.read_pos + self.len) % N] = AppEvent {
+            timestamp,
+            message,
+            value,
+        };
+        self.len += 1;
+        true
+    }
+
+    pub fn pop(&mut self) -> Option<AppEvent> {
+        if self.len == 0 {
+            return None;
+        }
+        let event = self.events[self.read_pos];
+        self.read_pos = (self.read_pos + 1) % N;
+        self.len -= 1;
+        Some(event)
+    }
+}
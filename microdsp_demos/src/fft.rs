@@ -0,0 +1,206 @@
+use alloc::{vec, vec::Vec};
+use core::ops::{Add, Mul, Sub};
+
+#[derive(Clone, Copy, Default, Debug, PartialEq)]
+pub struct Complex {
+    pub re: f32,
+    pub im: f32,
+}
+
+impl Complex {
+    pub const ZERO: Complex = Complex { re: 0.0, im: 0.0 };
+
+    #[inline]
+    pub fn new(re: f32, im: f32) -> Self {
+        Complex { re, im }
+    }
+
+    #[inline]
+    pub fn conj(self) -> Self {
+        Complex::new(self.re, -self.im)
+    }
+
+    #[inline]
+    pub fn norm_sqr(self) -> f32 {
+        self.re * self.re + self.im * self.im
+    }
+
+    /// Multiplication by i
+    #[inline]
+    fn mul_i(self) -> Self {
+        Complex::new(-self.im, self.re)
+    }
+}
+
+impl Add for Complex {
+    type Output = Complex;
+    #[inline]
+    fn add(self, other: Complex) -> Complex {
+        Complex::new(self.re + other.re, self.im + other.im)
+    }
+}
+
+impl Sub for Complex {
+    type Output = Complex;
+    #[inline]
+    fn sub(self, other: Complex) -> Complex {
+        Complex::new(self.re - other.re, self.im - other.im)
+    }
+}
+
+impl Mul for Complex {
+    type Output = Complex;
+    #[inline]
+    fn mul(self, other: Complex) -> Complex {
+        Complex::new(
+            self.re * other.re - self.im * other.im,
+            self.re * other.im + self.im * other.re,
+        )
+    }
+}
+
+impl Mul<f32> for Complex {
+    type Output = Complex;
+    #[inline]
+    fn mul(self, other: f32) -> Complex {
+        Complex::new(self.re * other, self.im * other)
+    }
+}
+
+/// e^(i * angle) for |angle| <= pi, evaluated in double precision using
+/// a Taylor series. Only used when building tables.
+pub(crate) fn unit_phasor(angle: f64) -> Complex {
+    let mut cos = 0.0;
+    let mut sin = 0.0;
+    let mut term = 1.0;
+    for n in 0..40 {
+        match n % 4 {
+            0 => cos += term,
+            1 => sin += term,
+            2 => cos -= term,
+            _ => sin -= term,
+        }
+        term *= angle / (n + 1) as f64;
+    }
+    Complex::new(cos as f32, sin as f32)
+}
+
+/// FFT of real valued signals of a power of two size n, computed as a
+/// complex FFT of size n / 2. Spectra are stored as the n / 2 + 1 non-
+/// negative frequency bins. The inverse transform is scaled by 1 / n, so
+/// that inverse(forward(x)) == x.
+pub struct RealFft {
+    size: usize,
+    /// e^(-2 pi i k / (n / 2)) for k < n / 4, used by the complex FFT
+    twiddles: Vec<Complex>,
+    /// e^(-2 pi i k / n) for k <= n / 4, used to split the complex FFT
+    /// into the spectrum of the real signal
+    real_twiddles: Vec<Complex>,
+    bit_reverse: Vec<u16>,
+    work: Vec<Complex>,
+}
+
+impl RealFft {
+    pub fn new(size: usize) -> Self {
+        assert!(size >= 4 && size.is_power_of_two() && size / 2 <= u16::MAX as usize);
+        let m = size / 2;
+        let pi = core::f64::consts::PI;
+        let twiddles = (0..m / 2)
+            .map(|k| unit_phasor(-2.0 * pi * k as f64 / m as f64))
+            .collect();
+        let real_twiddles = (0..=m / 2)
+            .map(|k| unit_phasor(-2.0 * pi * k as f64 / size as f64))
+            .collect();
+        let bits = m.trailing_zeros();
+        let bit_reverse = (0..m)
+            .map(|k| ((k as u32).reverse_bits() >> (32 - bits)) as u16)
+            .collect();
+        RealFft {
+            size,
+            twiddles,
+            real_twiddles,
+            bit_reverse,
+            work: vec![Complex::ZERO; m],
+        }
+    }
+
+    pub fn size(&self) -> usize {
+        self.size
+    }
+
+    /// Number of bins in a spectrum, i.e size / 2 + 1
+    pub fn bin_count(&self) -> usize {
+        self.size / 2 + 1
+    }
+
+    pub fn forward(&mut self, input: &[f32], output: &mut [Complex]) {
+        let m = self.size / 2;
+        assert!(input.len() == self.size && output.len() == m + 1);
+
+        // Pack even and odd samples into the real and imaginary parts
+        for k in 0..m {
+            self.work[self.bit_reverse[k] as usize] = Complex::new(input[2 * k], input[2 * k + 1]);
+        }
+        self.butterflies(false);
+
+        // Separate the spectra of the even and odd samples and combine them
+        let z0 = self.work[0];
+        output[0] = Complex::new(z0.re + z0.im, 0.0);
+        output[m] = Complex::new(z0.re - z0.im, 0.0);
+        for k in 1..=m / 2 {
+            let a = self.work[k];
+            let b = self.work[m - k].conj();
+            let even = (a + b) * 0.5;
+            let odd = (b - a).mul_i() * 0.5;
+            let odd = odd * self.real_twiddles[k];
+            output[k] = even + odd;
+            output[m - k] = (even - odd).conj();
+        }
+    }
+
+    pub fn inverse(&mut self, input: &[Complex], output: &mut [f32]) {
+        let m = self.size / 2;
+        assert!(input.len() == m + 1 && output.len() == self.size);
+
+        // Recover the spectra of the even and odd samples, including the
+        // 1 / n scaling
+        let scale = 1.0 / self.size as f32;
+        for k in 0..=m / 2 {
+            let a = input[k];
+            let b = input[m - k].conj();
+            let even = (a + b) * scale;
+            let odd = (a - b) * scale * self.real_twiddles[k].conj();
+            self.work[self.bit_reverse[k] as usize] = even + odd.mul_i();
+            if k != 0 && k != m - k {
+                self.work[self.bit_reverse[m - k] as usize] = even.conj() + odd.conj().mul_i();
+            }
+        }
+        self.butterflies(true);
+
+        for k in 0..m {
+            output[2 * k] = self.work[k].re;
+            output[2 * k + 1] = self.work[k].im;
+        }
+    }
+
+    /// In-place radix 2 decimation in time FFT of the bit reversed work buffer
+    fn butterflies(&mut self, inverse: bool) {
+        let m = self.work.len();
+        let mut len = 2;
+        while len <= m {
+            let half = len / 2;
+            let stride = m / len;
+            for start in (0..m).step_by(len) {
+                for j in 0..half {
+                    let w = self.twiddles[j * stride];
+                    let w = if inverse { w.conj() } else { w };
+                    let a = self.work[start + j];
+                    let b = self.work[start + j + half] * w;
+                    self.work[start + j] = a + b;
+                    self.work[start + j + half] = a - b;
+                }
+            }
+            len *= 2;
+        }
+    }
+}
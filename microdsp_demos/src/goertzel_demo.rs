@@ -0,0 +1,156 @@
+use micromath::F32Ext;
+
+use crate::{
+    graph::{Decimate, Metered, Stage, StageStats},
+    mpm_demo::{TargetIndicators, FREQUENCIES_TO_DETECT, MAX_FREQ_ERROR, OUT_MSG_BUFFER_SIZE},
+    tone_bank::ToneBank,
+    AppEvent, DemoApp, EventQueue, ParamInfo, MAX_BLOCK_SIZE,
+};
+
+// The targets are below 500 Hz, so a rate of 2.8 kHz is enough
+const DOWNSAMPLING: usize = 16;
+// Anti-alias filter length at the input rate, 8 multiply-adds per input sample
+const DOWNSAMPLING_FILTER_TAPS: usize = 128;
+// One estimate every 64 input samples (1.4 ms at 44.1 kHz)
+const HOP_SIZE: usize = 4;
+// Bins at the target frequency and 8 Hz above and below it, covering the
+// MAX_FREQ_ERROR window
+const BINS_PER_TARGET: usize = 3;
+const BIN_SPACING: f32 = 8.0;
+// Gives estimates a time constant of about 20 ms
+const BIN_BANDWIDTH: f32 = 16.0;
+const MIN_CLARITY: f32 = 0.5;
+// A detected tone stays detected down to a lower clarity, so that the LEDs
+// do not flicker for tones near the edge of the error window
+const MIN_HOLD_CLARITY: f32 = 0.35;
+// About -40 dBFS
+const MIN_POWER: f32 = 1e-4;
+// Indices of the values passed to set_params
+const PARAM_MIN_CLARITY: usize = 0;
+const PARAM_MIN_HOLD_CLARITY: usize = 1;
+const PARAM_MIN_POWER: usize = 2;
+const PARAM_MAX_FREQ_ERROR: usize = 3;
+
+/// The target indicators of the MPM demo, driven by a Goertzel filter bank
+/// tuned to the target frequencies instead of a pitch search. Passes its
+/// input through.
+pub struct ToneDetect {
+    detector: ToneBank,
+    min_clarity: f32,
+    min_hold_clarity: f32,
+    min_power: f32,
+    max_freq_error: f32,
+    /// Timestamp of the next detector result, i.e the end of its hop
+    next_result_time: u32,
+    /// Graph input samples per hop
+    result_interval: u32,
+    indicators: TargetIndicators,
+}
+
+impl ToneDetect {
+    /// decimation is the ratio of the graph input rate to the rate of
+    /// the stage, filter_delay the delay of the decimation filter in
+    /// input samples
+    fn new(sample_rate: f32, decimation: usize, filter_delay: usize) -> Self {
+        ToneDetect {
+            detector: ToneBank::new(
+                sample_rate / decimation as f32,
+                &FREQUENCIES_TO_DETECT,
+                BINS_PER_TARGET,
+                BIN_SPACING,
+                BIN_BANDWIDTH,
+                HOP_SIZE,
+            ),
+            min_clarity: MIN_CLARITY,
+            min_hold_clarity: MIN_HOLD_CLARITY,
+            min_power: MIN_POWER,
+            max_freq_error: MAX_FREQ_ERROR,
+            // Results are timestamped at the end of their hop, which the
+            // filter delays
+            next_result_time: ((HOP_SIZE * decimation) as u32).wrapping_sub(filter_delay as u32),
+            result_interval: (HOP_SIZE * decimation) as u32,
+            indicators: TargetIndicators::new(),
+        }
+    }
+}
+
+impl Stage for ToneDetect {
+    #[inline(always)]
+    fn process<'a, const N: usize>(&'a mut self, input: &'a [f32], events: &mut EventQueue<N>) -> &'a [f32] {
+        let next_result_time = &mut self.next_result_time;
+        let result_interval = self.result_interval;
+        let indicators = &mut self.indicators;
+        let (min_clarity, min_hold_clarity) = (self.min_clarity, self.min_hold_clarity);
+        let (min_power, max_freq_error) = (self.min_power, self.max_freq_error);
+        self.detector.process(input, |estimates, power| {
+            let timestamp = *next_result_time;
+            *next_result_time = timestamp.wrapping_add(result_interval);
+            let mut detections = [None; FREQUENCIES_TO_DETECT.len()];
+            for (i, (estimate, f)) in estimates.iter().zip(FREQUENCIES_TO_DETECT).enumerate() {
+                let freq_error = F32Ext::abs(estimate.frequency - f);
+                let min_clarity = if indicators.is_detected(i) { min_hold_clarity } else { min_clarity };
+                if estimate.clarity >= min_clarity && power >= min_power && freq_error < max_freq_error {
+                    detections[i] = Some(estimate.frequency);
+                }
+            }
+            indicators.update(events, timestamp, detections);
+        });
+        input
+    }
+}
+
+/// The ukulele tuner of the MPM demo, using a Goertzel filter bank tuned to
+/// the target frequencies instead of a pitch search.
+pub struct GoertzelDemoApp {
+    graph: (Metered<Decimate>, Metered<ToneDetect>),
+    events: EventQueue<OUT_MSG_BUFFER_SIZE>,
+}
+
+impl DemoApp for GoertzelDemoApp {
+    fn new(sample_rate: f32) -> Self {
+        let decimate = Decimate::new(DOWNSAMPLING, DOWNSAMPLING_FILTER_TAPS, MAX_BLOCK_SIZE);
+        let tone_detect = ToneDetect::new(sample_rate, DOWNSAMPLING, decimate.delay());
+        GoertzelDemoApp {
+            graph: (
+                Metered::new(b"decimate\0", decimate),
+                Metered::new(b"tones\0", tone_detect),
+            ),
+            events: EventQueue::new(),
+        }
+    }
+
+    fn process(&mut self, rx: &[f32], _: &mut [f32]) {
+        self.graph.process(rx, &mut self.events);
+        self.events.end_block(rx.len());
+    }
+
+    // Analysis only, leave the output silent
+    const TX_CHANNEL_MASK: u8 = 0;
+
+    fn handle_message(&mut self, _: crate::AppMessage) {}
+
+    fn next_outgoing_event(&mut self) -> Option<AppEvent> {
+        self.events.pop()
+    }
+
+    fn stage_stats(&self, stats: &mut [StageStats]) -> usize {
+        self.graph.stage_stats(stats)
+    }
+
+    // The bins only cover MAX_FREQ_ERROR around the targets, so a larger
+    // error finds little more
+    const PARAMS: &'static [ParamInfo] = &[
+        ParamInfo::new(b"min_clarity\0", 0.0, 1.0, MIN_CLARITY),
+        ParamInfo::new(b"min_hold_clarity\0", 0.0, 1.0, MIN_HOLD_CLARITY),
+        ParamInfo::new(b"min_power\0", 0.0, 1.0, MIN_POWER),
+        ParamInfo::new(b"max_freq_error\0", 0.0, 24.0, MAX_FREQ_ERROR),
+    ];
+
+    fn set_params(&mut self, values: &[f32]) {
+        let tone_detect = self.graph.1.stage_mut();
+        tone_detect.min_clarity = values[PARAM_MIN_CLARITY];
+        tone_detect.min_hold_clarity = values[PARAM_MIN_HOLD_CLARITY];
+        tone_detect.min_power = values[PARAM_MIN_POWER];
+        tone_detect.max_freq_error = values[PARAM_MAX_FREQ_ERROR];
+    }
+}
@@ -0,0 +1,185 @@
+use core::ffi::c_char;
+use core::sync::atomic::{AtomicUsize, Ordering};
+
+use crate::{multirate::ResampledStream, EventQueue, LoadLevel};
+
+/// A step of a processing graph, e.g a resampler or a detector.
+///
+/// Stages are chained at compile time by putting them in tuples, which are
+/// stages themselves, e.g `(Metered<Decimate>, Metered<PitchDetect>)`.
+/// Each stage takes the output block of the stage before it, so a chain
+/// monomorphises into straight line code with no indirect calls. Stages
+/// allocate their output buffers when they are created and reuse them for
+/// every block.
+pub trait Stage {
+    /// Processes a block and returns the block for the next stage, i.e
+    /// the stage's own output buffer, or input for stages that only
+    /// analyse it. Events are timestamped relative to events.time(), the
+    /// first sample of the block at the rate of the graph input.
+    fn process<'a, const N: usize>(&'a mut self, input: &'a [f32], events: &mut EventQueue<N>) -> &'a [f32];
+
+    /// Copies the stats of the metered stages, in chain order, to stats.
+    /// Returns the number of stats copied.
+    fn stage_stats(&self, _stats: &mut [StageStats]) -> usize {
+        0
+    }
+
+    /// Passes the load level of the app on to the stage, see
+    /// DemoApp::set_load_level
+    fn set_load_level(&mut self, _level: LoadLevel) {}
+}
+
+/// Cycle counts of a stage. Matches demo_stage_stats_t in
+/// microdsp_demos.h.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct StageStats {
+    /// NUL terminated
+    pub name: *const c_char,
+    pub block_count: u32,
+    pub last_cycles: u32,
+    pub max_cycles: u32,
+    pub total_cycles: u64,
+}
+
+impl StageStats {
+    pub const fn new(name: &'static [u8]) -> Self {
+        StageStats {
+            name: name.as_ptr() as *const c_char,
+            block_count: 0,
+            last_cycles: 0,
+            max_cycles: 0,
+            total_cycles: 0,
+        }
+    }
+}
+
+/// The counter read by Metered, as set by demo_stage_set_cycle_counter,
+/// 0 if none is set
+static CYCLE_COUNTER: AtomicUsize = AtomicUsize::new(0);
+
+#[inline(always)]
+fn cycle_counter() -> Option<extern "C" fn() -> u32> {
+    match CYCLE_COUNTER.load(Ordering::Relaxed) {
+        0 => None,
+        counter => Some(unsafe { core::mem::transmute::<usize, extern "C" fn() -> u32>(counter) }),
+    }
+}
+
+/// Sets the free running counter the stages of all apps are timed with,
+/// e.g a CPU cycle counter. Without one, only blocks are counted.
+#[no_mangle]
+pub extern "C" fn demo_stage_set_cycle_counter(counter: Option<extern "C" fn() -> u32>) {
+    CYCLE_COUNTER.store(counter.map_or(0, |counter| counter as usize), Ordering::Relaxed);
+}
+
+/// Counts the blocks and cycles spent in a stage
+pub struct Metered<S: Stage> {
+    stage: S,
+    stats: StageStats,
+}
+
+impl<S: Stage> Metered<S> {
+    /// name must be NUL terminated
+    pub fn new(name: &'static [u8], stage: S) -> Self {
+        assert!(name.last() == Some(&0));
+        Metered {
+            stage,
+            stats: StageStats::new(name),
+        }
+    }
+
+    pub fn stage(&self) -> &S {
+        &self.stage
+    }
+
+    pub fn stage_mut(&mut self) -> &mut S {
+        &mut self.stage
+    }
+}
+
+impl<S: Stage> Stage for Metered<S> {
+    #[inline(always)]
+    fn process<'a, const N: usize>(&'a mut self, input: &'a [f32], events: &mut EventQueue<N>) -> &'a [f32] {
+        let counter = cycle_counter();
+        let start = counter.map_or(0, |counter| counter());
+        let output = self.stage.process(input, events);
+        let stats = &mut self.stats;
+        stats.block_count = stats.block_count.wrapping_add(1);
+        if let Some(counter) = counter {
+            let cycles = counter().wrapping_sub(start);
+            stats.last_cycles = cycles;
+            stats.max_cycles = stats.max_cycles.max(cycles);
+            stats.total_cycles += cycles as u64;
+        }
+        output
+    }
+
+    fn stage_stats(&self, stats: &mut [StageStats]) -> usize {
+        match stats.first_mut() {
+            Some(first) => {
+                *first = self.stats;
+                1
+            }
+            None => 0,
+        }
+    }
+
+    fn set_load_level(&mut self, level: LoadLevel) {
+        self.stage.set_load_level(level);
+    }
+}
+
+// Chains of up to four stages. Longer chains nest, e.g ((a, b), c, d).
+macro_rules! impl_stage_chain {
+    ($($stage:ident $index:tt),+) => {
+        impl<$($stage: Stage),+> Stage for ($($stage,)+) {
+            #[inline(always)]
+            fn process<'a, const N: usize>(&'a mut self, input: &'a [f32], events: &mut EventQueue<N>) -> &'a [f32] {
+                let block = input;
+                $(let block = self.$index.process(block, events);)+
+                block
+            }
+
+            fn stage_stats(&self, stats: &mut [StageStats]) -> usize {
+                let mut count = 0;
+                $(count += self.$index.stage_stats(&mut stats[count..]);)+
+                count
+            }
+
+            fn set_load_level(&mut self, level: LoadLevel) {
+                $(self.$index.set_load_level(level);)+
+            }
+        }
+    };
+}
+
+impl_stage_chain!(A 0, B 1);
+impl_stage_chain!(A 0, B 1, C 2);
+impl_stage_chain!(A 0, B 1, C 2, D 3);
+
+/// Resamples the block, see ResampledStream
+pub struct Decimate {
+    stream: ResampledStream,
+}
+
+impl Decimate {
+    /// max_input_len is the largest block passed to process
+    pub fn new(factor: usize, taps_per_phase: usize, max_input_len: usize) -> Self {
+        Decimate {
+            stream: ResampledStream::decimated(factor, taps_per_phase, max_input_len),
+        }
+    }
+
+    /// Group delay of the filter in input samples
+    pub fn delay(&self) -> usize {
+        self.stream.resampler().delay()
+    }
+}
+
+impl Stage for Decimate {
+    #[inline(always)]
+    fn process<'a, const N: usize>(&'a mut self, input: &'a [f32], _: &mut EventQueue<N>) -> &'a [f32] {
+        self.stream.process(input)
+    }
+}
@@ -0,0 +1,55 @@
+use crate::static_storage::Zeroable;
+
+/// Ring buffer holding the N most recent samples of a signal, used to
+/// look up the signal at a given delay.
+pub struct HistoryRing<const N: usize> {
+    buffer: [f32; N],
+    /// Index of the next sample to write
+    write_pos: usize,
+}
+
+// An all zero ring is an empty ring
+unsafe impl<const N: usize> Zeroable for HistoryRing<N> {}
+
+impl<const N: usize> HistoryRing<N> {
+    pub fn new() -> Self {
+        HistoryRing {
+            buffer: [0.0; N],
+            write_pos: 0,
+        }
+    }
+
+    pub fn capacity(&self) -> usize {
+        N
+    }
+
+    pub fn clear(&mut self) {
+        self.buffer.fill(0.0);
+        self.write_pos = 0;
+    }
+
+    pub fn push(&mut self, samples: &[f32]) {
+        assert!(samples.len() <= self.buffer.len());
+        let first_len = samples.len().min(self.buffer.len() - self.write_pos);
+        let (first, second) = samples.split_at(first_len);
+        self.buffer[self.write_pos..self.write_pos + first_len].copy_from_slice(first);
+        self.buffer[..second.len()].copy_from_slice(second);
+        self.write_pos = (self.write_pos + samples.len()) % self.buffer.len();
+    }
+
+    /// Returns len consecutive samples, the first of which was pushed age
+    /// samples ago. An age of 1 refers to the most recently pushed sample.
+    /// The samples are returned as two slices, since they may wrap around
+    /// the end of the ring.
+    pub fn get(&self, age: usize, len: usize) -> (&[f32], &[f32]) {
+        assert!(len <= age && age <= self.buffer.len());
+        let capacity = self.buffer.len();
+        let start = (self.write_pos + capacity - age) % capacity;
+        if start + len <= capacity {
+            (&self.buffer[start..start + len], &[])
+        } else {
+            let (second, first) = self.buffer.split_at(start);
+            (first, &second[..start + len - capacity])
+        }
+    }
+}
@@ -4,7 +4,7 @@
 #![feature(alloc_error_handler)]
 
 #[global_allocator]
-static mut ALLOCATOR: CAllocator = CAllocator;
+static ALLOCATOR: ArenaAllocator = ArenaAllocator::new();
 
 #[alloc_error_handler]
 fn alloc_error(layout: core::alloc::Layout) -> ! {
@@ -20,17 +20,52 @@ fn panic(_panic: &PanicInfo<'_>) -> ! {
     loop {}
 }
 
+#[macro_use]
+mod static_storage;
+
+mod activity_gate;
+mod delay_estimator;
+mod events;
+pub mod fft;
+mod goertzel_demo;
+mod graph;
+mod history;
 mod mpm_demo;
+mod multirate;
+mod nlms;
 mod nlms_demo;
+mod novelty;
+mod params;
+mod pbfdaf;
+mod pitch_tracker;
+mod recording;
+mod registry;
 mod sfnov_demo;
+mod tone_bank;
 
 pub use mpm_demo::MpmDemoApp;
+pub use multirate::{PolyphaseResampler, ResampledStream};
+pub use activity_gate::{ActivityGate, GateDecision};
+pub use delay_estimator::DelayEstimator;
+pub use events::{AppEvent, EventQueue};
+pub use goertzel_demo::GoertzelDemoApp;
+pub use graph::{Decimate, Metered, Stage, StageStats};
+pub use history::HistoryRing;
+pub use nlms::NlmsFilter;
 pub use nlms_demo::NlmsDemoApp;
+pub use novelty::{locate_energy_onset, SpectralFluxDetector};
+pub use params::{GainRamp, ParamInfo, MAX_PARAM_COUNT};
+pub use pbfdaf::PbfdafFilter;
+pub use pitch_tracker::{OverlappedMpm, PitchEstimate};
+pub use recording::{ImaAdpcmCodec, Pcm16Codec, Recording, RecordingCodec, RecordingStorage};
+pub use registry::{DemoAppVtable, DEMO_APP_ABI_VERSION};
 pub use sfnov_demo::SfnovDemoApp;
+pub use tone_bank::{ToneBank, ToneEstimate};
 
 extern crate alloc;
-mod c_allocator;
-use c_allocator::CAllocator;
+mod arena_allocator;
+use arena_allocator::ArenaAllocator;
+pub use arena_allocator::AllocatorStats;
 
 pub mod c_api;
 
@@ -54,18 +89,130 @@ pub enum AppMessage {
     Led1Off = 14,
     Led2Off = 15,
     Led3Off = 16,
+
+    /// A tone was detected. The value is its frequency in Hz.
+    PitchDetected = 17,
+    /// A novelty peak was detected. The value is the novelty.
+    NoveltyDetected = 18,
+    /// The active filter changed. The value is the filter mode index.
+    FilterModeChanged = 19,
+    /// The echo delay estimate changed. The value is the delay in samples.
+    DelayEstimated = 20,
+    /// Recording with a filter active stopped. The value is the share of
+    /// the blocks in which the filter did not adapt.
+    AdaptationSkipped = 21,
+}
+
+impl AppMessage {
+    pub fn from_u8(value: u8) -> Option<AppMessage> {
+        use AppMessage::*;
+        const MESSAGES: [AppMessage; 21] = [
+            Button0Down, Button1Down, Button2Down, Button3Down,
+            Button0Up, Button1Up, Button2Up, Button3Up,
+            Led0On, Led1On, Led2On, Led3On,
+            Led0Off, Led1Off, Led2Off, Led3Off,
+            PitchDetected, NoveltyDetected, FilterModeChanged, DelayEstimated,
+            AdaptationSkipped,
+        ];
+        MESSAGES.get((value as usize).wrapping_sub(1)).copied()
+    }
 }
 
+/// How much of the CPU the app may use, as decided by the load governor of
+/// the firmware. Matches demo_load_level_t in microdsp_demos.h.
+#[repr(u8)]
+#[derive(Clone, Copy, PartialEq, Eq, PartialOrd, Ord)]
+pub enum LoadLevel {
+    /// Full analysis quality
+    Full = 0,
+    /// Other work is running late, analysis should get cheaper
+    Reduced = 1,
+    /// The block deadline is at risk, analysis should be as cheap as
+    /// possible while still producing results
+    Minimal = 2,
+}
+
+impl LoadLevel {
+    pub fn from_u8(value: u8) -> Option<LoadLevel> {
+        match value {
+            0 => Some(LoadLevel::Full),
+            1 => Some(LoadLevel::Reduced),
+            2 => Some(LoadLevel::Minimal),
+            _ => None,
+        }
+    }
+}
+
+pub const MAX_CHANNEL_COUNT: usize = 2;
+/// Largest number of frames passed to process at a time
+pub const MAX_BLOCK_SIZE: usize = 1024; // I2S_MAX_PERIOD_N_FRAMES
+pub const CHANNEL_LEFT: u8 = 1 << 0;
+pub const CHANNEL_RIGHT: u8 = 1 << 1;
+
 pub trait DemoApp {
+    /// Bit mask of the input channels passed to process_channels. The masks
+    /// are constants, so that they are known before the app is created.
+    const RX_CHANNEL_MASK: u8 = CHANNEL_LEFT;
+    /// Bit mask of the output channels passed to process_channels. A single
+    /// channel is played on both outputs, no channels means silence.
+    const TX_CHANNEL_MASK: u8 = CHANNEL_LEFT;
+    /// Parameters that can be tuned while the app runs, at most
+    /// MAX_PARAM_COUNT. The app starts with their default values.
+    const PARAMS: &'static [ParamInfo] = &[];
     fn new(sample_rate: f32) -> Self;
     fn process(&mut self, rx: &[f32], tx: &mut [f32]);
+    /// Planar multichannel processing. Channel c is Some if it is set in the
+    /// corresponding channel mask. Defaults to mono processing of the left
+    /// channel.
+    fn process_channels(
+        &mut self,
+        rx: [Option<&[f32]>; MAX_CHANNEL_COUNT],
+        tx: [Option<&mut [f32]>; MAX_CHANNEL_COUNT],
+    ) {
+        let [tx_left, _] = tx;
+        if let Some(rx_left) = rx[0] {
+            match tx_left {
+                Some(tx_left) => self.process(rx_left, tx_left),
+                None => self.process(rx_left, &mut []),
+            }
+        }
+    }
     fn handle_message(&mut self, message: AppMessage);
-    fn next_outgoing_message(&mut self) -> Option<AppMessage>;
+    /// Outgoing events, oldest first
+    fn next_outgoing_event(&mut self) -> Option<AppEvent>;
+    /// An internal signal of the last processed block, e.g a filter
+    /// residual, for streaming to a host through the audio tap. None if
+    /// the app has nothing to show for the block.
+    fn tap_signal(&self) -> Option<&[f32]> {
+        None
+    }
+    /// Cycle counts of the stages of apps built as a processing graph,
+    /// see graph.rs. Returns the number of stats written.
+    fn stage_stats(&self, _stats: &mut [StageStats]) -> usize {
+        0
+    }
+    /// Trades analysis quality for CPU time, e.g by analysing fewer hops
+    /// or pausing filter adaptation, and restores it at LoadLevel::Full.
+    /// The output and the timing of events must not change. Called
+    /// between blocks on the thread running the app.
+    fn set_load_level(&mut self, _level: LoadLevel) {}
+    /// Applies new parameter values, one per entry of PARAMS and within
+    /// its range. Called between blocks on the thread running the app.
+    fn set_params(&mut self, _values: &[f32]) {}
 }
 
-#[cfg(feature = "nlms_demo")]
+// Single demo builds. With all_demos, apps are created through the
+// registry instead.
+#[cfg(all(feature = "nlms_demo", not(feature = "all_demos")))]
 type DemoAppType = nlms_demo::NlmsDemoApp;
-#[cfg(feature = "sfnov_demo")]
+#[cfg(all(feature = "sfnov_demo", not(feature = "all_demos")))]
 type DemoAppType = sfnov_demo::SfnovDemoApp;
-#[cfg(feature = "mpm_demo")]
+#[cfg(all(feature = "mpm_demo", not(feature = "all_demos")))]
 type DemoAppType = mpm_demo::MpmDemoApp;
+#[cfg(all(feature = "goertzel_demo", not(feature = "all_demos")))]
+type DemoAppType = goertzel_demo::GoertzelDemoApp;
+
+// The statics of static_app can only be taken once, so apps could not be
+// swapped
+#[cfg(all(feature = "all_demos", feature = "static_app"))]
+compile_error!("static_app can not be combined with all_demos");
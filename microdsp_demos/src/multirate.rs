@@ -0,0 +1,166 @@
+use alloc::{vec, vec::Vec};
+
+use crate::fft::unit_phasor;
+
+/// Polyphase FIR resampler changing the sample rate by up / down.
+///
+/// Conceptually, the input is upsampled by up by inserting zeros, lowpass
+/// filtered at the lower of the two Nyquist frequencies and downsampled by
+/// down. The filter is split into up phases of taps_per_phase taps, and
+/// each output sample is a single dot product of one phase with the most
+/// recent input, so no multiplications are spent on the inserted zeros or
+/// the dropped samples. The input history is kept twice, one copy after
+/// the other, so that the most recent taps_per_phase samples are always a
+/// contiguous slice, which keeps the dot product a simple, vectorizable
+/// loop. State persists across calls to process, so the input can be
+/// given in blocks of any size.
+///
+/// Each output costs taps_per_phase multiply-adds. A decimator has a
+/// single phase, so for decimators taps_per_phase is the filter length.
+pub struct PolyphaseResampler {
+    up: usize,
+    down: usize,
+    taps_per_phase: usize,
+    /// Coefficients of each phase, newest input sample last
+    coefficients: Vec<f32>,
+    history: Vec<f32>,
+    history_pos: usize,
+    /// Position of the next output between input samples, in units of
+    /// 1 / up input samples
+    phase: usize,
+}
+
+impl PolyphaseResampler {
+    pub fn new(up: usize, down: usize, taps_per_phase: usize) -> Self {
+        assert!(up > 0 && down > 0 && taps_per_phase > 0);
+        let coefficients = design_lowpass(up, down, taps_per_phase);
+        PolyphaseResampler {
+            up,
+            down,
+            taps_per_phase,
+            coefficients,
+            history: vec![0.0; 2 * taps_per_phase],
+            history_pos: 0,
+            // Outputs come at the end of each group of down input samples,
+            // like the outputs of a decimator that averages the groups
+            phase: down - 1,
+        }
+    }
+
+    /// Decimates by an integer factor
+    pub fn decimator(factor: usize, taps_per_phase: usize) -> Self {
+        PolyphaseResampler::new(1, factor, taps_per_phase)
+    }
+
+    /// Interpolates by an integer factor
+    pub fn interpolator(factor: usize, taps_per_phase: usize) -> Self {
+        PolyphaseResampler::new(factor, 1, taps_per_phase)
+    }
+
+    /// Upper bound of the number of output samples for input_len input
+    /// samples
+    pub fn max_output_len(&self, input_len: usize) -> usize {
+        (input_len * self.up + self.down - 1) / self.down + 1
+    }
+
+    /// Group delay of the filter, rounded to whole input samples
+    pub fn delay(&self) -> usize {
+        (self.up * self.taps_per_phase - 1 + self.up) / (2 * self.up)
+    }
+
+    /// Resamples input into output, which must hold max_output_len samples.
+    /// Returns the number of output samples written.
+    pub fn process(&mut self, input: &[f32], output: &mut [f32]) -> usize {
+        assert!(output.len() >= self.max_output_len(input.len()));
+        let taps = self.taps_per_phase;
+        let mut output_len = 0;
+        for x in input {
+            self.history[self.history_pos] = *x;
+            self.history[self.history_pos + taps] = *x;
+            self.history_pos = if self.history_pos + 1 == taps { 0 } else { self.history_pos + 1 };
+            let recent = &self.history[self.history_pos..self.history_pos + taps];
+            while self.phase < self.up {
+                let phase_coefficients = &self.coefficients[self.phase * taps..(self.phase + 1) * taps];
+                output[output_len] = recent.iter().zip(phase_coefficients).map(|(x, h)| x * h).sum();
+                output_len += 1;
+                self.phase += self.down;
+            }
+            self.phase -= self.up;
+        }
+        output_len
+    }
+}
+
+/// Blackman windowed sinc lowpass of up * taps_per_phase taps at the
+/// upsampled rate, cut off at the lower of the input and output Nyquist
+/// frequencies, with a DC gain of up. Returned as up phases, phase p
+/// holding taps p, p + up, p + 2 up ... in reverse order.
+fn design_lowpass(up: usize, down: usize, taps_per_phase: usize) -> Vec<f32> {
+    let pi = core::f64::consts::PI;
+    let length = up * taps_per_phase;
+    let cutoff = 0.5 / up.max(down) as f64;
+    let center = 0.5 * (length - 1) as f64;
+    let prototype: Vec<f64> = (0..length)
+        .map(|n| {
+            let t = n as f64 - center;
+            let sin = |x: f64| unit_phasor(x).im as f64;
+            let cos = |x: f64| unit_phasor(x).re as f64;
+            let sinc = if t == 0.0 { 2.0 * cutoff } else { sin(2.0 * pi * cutoff * t) / (pi * t) };
+            let x = 2.0 * pi * n as f64 / (length - 1).max(1) as f64;
+            let window = 0.42 - 0.5 * cos(x) + 0.08 * cos(2.0 * x);
+            sinc * window
+        })
+        .collect();
+    let gain = up as f64 / prototype.iter().sum::<f64>();
+
+    let mut coefficients = vec![0.0; length];
+    for phase in 0..up {
+        for tap in 0..taps_per_phase {
+            coefficients[phase * taps_per_phase + taps_per_phase - 1 - tap] =
+                (gain * prototype[phase + tap * up]) as f32;
+        }
+    }
+    coefficients
+}
+
+/// A resampled input stream that several analyses can consume, so that the
+/// input is filtered once per block rather than once per analysis.
+pub struct ResampledStream {
+    resampler: PolyphaseResampler,
+    block: Vec<f32>,
+    block_len: usize,
+}
+
+impl ResampledStream {
+    /// max_input_len is the largest number of input samples passed to
+    /// process at a time
+    pub fn new(resampler: PolyphaseResampler, max_input_len: usize) -> Self {
+        let block = vec![0.0; resampler.max_output_len(max_input_len)];
+        ResampledStream {
+            resampler,
+            block,
+            block_len: 0,
+        }
+    }
+
+    /// Decimating stream
+    pub fn decimated(factor: usize, taps_per_phase: usize, max_input_len: usize) -> Self {
+        ResampledStream::new(PolyphaseResampler::decimator(factor, taps_per_phase), max_input_len)
+    }
+
+    pub fn resampler(&self) -> &PolyphaseResampler {
+        &self.resampler
+    }
+
+    /// Resamples input and returns the resulting block, which is also
+    /// available from block() until the next call
+    pub fn process(&mut self, input: &[f32]) -> &[f32] {
+        self.block_len = self.resampler.process(input, &mut self.block);
+        &self.block[..self.block_len]
+    }
+
+    /// The block produced by the last call to process
+    pub fn block(&self) -> &[f32] {
+        &self.block[..self.block_len]
+    }
+}
@@ -0,0 +1,102 @@
+use alloc::{vec, vec::Vec};
+
+/// Normalized least mean squares (NLMS) adaptive FIR filter, updated
+/// every sample. The step is normalized by the power of the reference
+/// samples under the filter taps.
+///
+/// Adaptation can be paused, in which case the filter keeps removing the
+/// signal estimated with its current weights at about half the cost.
+///
+/// Memory is allocated for max_tap_count taps, so that the number of taps
+/// can be changed later without allocating.
+pub struct NlmsFilter {
+    step_size: f32,
+    regularization: f32,
+    tap_count: usize,
+    /// max_tap_count weights, of which the first tap_count are used
+    weights: Vec<f32>,
+    /// The last tap_count reference samples, stored twice so that they
+    /// are contiguous, oldest first, at history[pos..pos + tap_count]
+    history: Vec<f32>,
+    pos: usize,
+    /// Sum of squares of the reference samples under the taps
+    power: f32,
+    adapt: bool,
+}
+
+impl NlmsFilter {
+    /// step_size is in (0, 2). regularization is added to the reference
+    /// power when normalizing the step.
+    pub fn new(tap_count: usize, max_tap_count: usize, step_size: f32, regularization: f32) -> Self {
+        assert!(tap_count > 0 && tap_count <= max_tap_count);
+        NlmsFilter {
+            step_size,
+            regularization,
+            tap_count,
+            weights: vec![0.0; max_tap_count],
+            history: vec![0.0; 2 * max_tap_count],
+            pos: 0,
+            power: 0.0,
+            adapt: true,
+        }
+    }
+
+    pub fn reset(&mut self) {
+        self.weights.fill(0.0);
+        self.history.fill(0.0);
+        self.pos = 0;
+        self.power = 0.0;
+    }
+
+    /// Resets the filter if the number of taps changes. tap_count is
+    /// clamped to [1, max_tap_count].
+    pub fn set_tap_count(&mut self, tap_count: usize) {
+        let tap_count = tap_count.clamp(1, self.weights.len());
+        if tap_count != self.tap_count {
+            self.tap_count = tap_count;
+            self.reset();
+        }
+    }
+
+    pub fn set_step_size(&mut self, step_size: f32) {
+        self.step_size = step_size;
+    }
+
+    /// Whether update adapts the weights. Paused adaptation keeps the
+    /// weights, and resumes where it left off.
+    pub fn set_adaptation(&mut self, adapt: bool) {
+        self.adapt = adapt;
+    }
+
+    /// Filters the reference sample x, adapting the filter to estimate
+    /// the desired sample d unless adaptation is paused. Returns the
+    /// estimation error.
+    #[inline]
+    pub fn update(&mut self, x: f32, d: f32) -> f32 {
+        let n = self.tap_count;
+        let oldest = self.history[self.pos];
+        self.history[self.pos] = x;
+        self.history[self.pos + n] = x;
+        self.pos += 1;
+        if self.pos == n {
+            self.pos = 0;
+            // Recomputed once per tap_count samples, so that rounding
+            // errors of the running sum do not build up
+            self.power = self.history[..n].iter().map(|x| x * x).sum();
+        } else {
+            self.power = (self.power + x * x - oldest * oldest).max(0.0);
+        }
+
+        let reference = &self.history[self.pos..self.pos + n];
+        let weights = &mut self.weights[..n];
+        let estimate: f32 = weights.iter().zip(reference).map(|(w, x)| w * x).sum();
+        let error = d - estimate;
+        if self.adapt {
+            let scale = self.step_size * error / (self.regularization + self.power);
+            for (w, x) in weights.iter_mut().zip(reference) {
+                *w += scale * x;
+            }
+        }
+        error
+    }
+}
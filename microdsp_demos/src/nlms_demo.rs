@@ -1,11 +1,52 @@
-use crate::{AppMessage, DemoApp};
-use alloc::{vec, vec::Vec};
-use microdsp::nlms::NlmsFilter;
+use crate::{
+    activity_gate::{ActivityGate, GateDecision},
+    delay_estimator::DelayEstimator,
+    history::HistoryRing,
+    nlms::NlmsFilter,
+    pbfdaf::PbfdafFilter,
+    recording::{Recording, RecordingStorage},
+    static_storage::StorageBox,
+    AppEvent, AppMessage, DemoApp, EventQueue, GainRamp, LoadLevel, ParamInfo,
+};
 
-const RECORD_BUFFER_SIZE: usize = 44000; // size in samples. about a second
+// Size of the recording in bytes, the RAM of the former buffer of 36000
+// f32 samples. Holds about 6.4 s at 44.4 kHz with IMA ADPCM, or 1.6 s
+// with 16 bit PCM.
+const RECORD_BUFFER_BYTES: usize = 144000;
 const OUT_MSG_BUFFER_SIZE: usize = 16;
-const MAX_TX_BUFFER_SIZE: usize = 512;
+const MAX_TX_BUFFER_SIZE: usize = 1024; // I2S_MAX_PERIOD_N_FRAMES
 const OSC_FREQ: f32 = 1000.0;
+const OSC_GAIN: f32 = 0.02;
+// Oscillator gain changes are spread over this many seconds
+const OSC_GAIN_RAMP_TIME: f32 = 0.02;
+const NLMS_TAP_COUNT: usize = 20;
+// Largest tap count that can be tuned at runtime
+const MAX_NLMS_TAP_COUNT: usize = 64;
+const NLMS_STEP_SIZE: f32 = 0.3;
+const PBFDAF_STEP_SIZE: f32 = 0.5;
+// 512 taps, i.e about 11.5 ms of echo path
+const PBFDAF_PARTITION_SIZE: usize = 128;
+const PBFDAF_PARTITION_COUNT: usize = 4;
+// Longest speaker to microphone delay that can be compensated for,
+// in samples. Covers the I2S buffer ring and the codec latency.
+const MAX_REFERENCE_DELAY: usize = 2048;
+const TX_HISTORY_SIZE: usize = MAX_REFERENCE_DELAY + MAX_TX_BUFFER_SIZE;
+const DELAY_ESTIMATOR_DECIMATION: usize = 8;
+// About 0.1 s, in decimated samples
+const DELAY_ESTIMATOR_UPDATE_INTERVAL: usize = 512;
+// The reference is delayed slightly less than the estimated delay, so
+// that the first filter taps cover the start of the echo despite the
+// coarse resolution of the estimate.
+const REFERENCE_DELAY_MARGIN: usize = DELAY_ESTIMATOR_DECIMATION;
+// Adaptation stays frozen for this long after near end speech, in seconds
+const DOUBLE_TALK_HANGOVER: f32 = 0.05;
+// Indices of the values passed to set_params
+const PARAM_NLMS_STEP_SIZE: usize = 0;
+const PARAM_NLMS_TAP_COUNT: usize = 1;
+const PARAM_PBFDAF_STEP_SIZE: usize = 2;
+const PARAM_OSC_GAIN: usize = 3;
+// The filter LED blinks at this rate when the PBFDAF filter is active
+const LED_BLINK_FREQUENCY: f32 = 4.0;
 
 /// Sine-ish oscillator, approximating sin(pi * x) as
 // 4x + 4x^2 on [-1, 0]
@@ -57,6 +98,20 @@ impl Oscillator {
     }
 }
 
+#[derive(PartialEq, Clone, Copy)]
+enum FilterMode {
+    Off = 0,
+    /// Time domain NLMS filter, updated every sample
+    Nlms,
+    /// Partitioned block frequency domain filter with many more taps
+    Pbfdaf,
+}
+
+#[cfg(not(feature = "record_pcm16"))]
+type RecordingCodec = crate::recording::ImaAdpcmCodec;
+#[cfg(feature = "record_pcm16")]
+type RecordingCodec = crate::recording::Pcm16Codec;
+
 #[derive(PartialEq)]
 enum RecordingState {
     Playing,
@@ -66,22 +121,96 @@ enum RecordingState {
 
 pub struct NlmsDemoApp {
     filter: NlmsFilter,
-    tx_prev: Vec<f32>,
-    record_buffer: Vec<f32>,
-    record_buffer_pos: usize,
-    out_msg_buffer: Vec<AppMessage>,
-    filter_is_active: bool,
+    pbfdaf: PbfdafFilter,
+    /// Previously played tx samples, the reference signal of the filters
+    tx_history: StorageBox<HistoryRing<TX_HISTORY_SIZE>>,
+    delay_estimator: DelayEstimator,
+    /// Skips adaptation of the filters while the far end is silent and
+    /// during double-talk
+    gate: ActivityGate,
+    /// Delay from tx to rx used when filtering, or None to use the previous
+    /// block until a delay has been estimated
+    reference_delay: Option<usize>,
+    recording: Recording<RecordingCodec, RECORD_BUFFER_BYTES>,
+    /// Filter output of the last block while recording, which is also
+    /// the tap signal
+    residual: StorageBox<[f32; MAX_TX_BUFFER_SIZE]>,
+    residual_len: usize,
+    events: EventQueue<OUT_MSG_BUFFER_SIZE>,
+    filter_mode: FilterMode,
+    led_blink_interval: usize,
+    led_blink_countdown: usize,
+    led_blink_state: bool,
     oscillator_enabled: bool,
     recording_state: RecordingState,
+    load_level: LoadLevel,
 
     tone_osc: Oscillator,
     pitch_lfo: Oscillator,
+    osc_gain: GainRamp,
 }
 
 impl NlmsDemoApp {
     fn send_message(&mut self, message: AppMessage) {
-        if self.out_msg_buffer.len() < OUT_MSG_BUFFER_SIZE {
-            self.out_msg_buffer.push(message)
+        self.events.push(message, 0.0);
+    }
+
+    fn blink_filter_led(&mut self, sample_count: usize) {
+        if self.led_blink_countdown > sample_count {
+            self.led_blink_countdown -= sample_count;
+            return;
+        }
+        self.led_blink_countdown = self.led_blink_interval;
+        self.led_blink_state = !self.led_blink_state;
+        self.send_message(if self.led_blink_state {
+            AppMessage::Led1On
+        } else {
+            AppMessage::Led1Off
+        });
+    }
+
+    /// Records rx, with the echo of tx removed if a filter is active
+    fn record(&mut self, rx: &[f32]) {
+        let n = rx.len().min(self.recording.capacity() - self.recording.len());
+        let record = &mut self.residual[..n];
+
+        // tx for this block has been pushed, so the reference for rx[i]
+        // was pushed rx.len() + reference_delay - i samples ago
+        let delay = self.reference_delay.unwrap_or(rx.len());
+        let (x_first, x_second) = self.tx_history.get(rx.len() + delay, n);
+        let rx = &rx[..n];
+
+        if self.filter_mode != FilterMode::Off {
+            // Filtering without adapting costs about half as much, and
+            // keeps the weights from drifting away from the echo path
+            let decision = self.gate.process(&[x_first, x_second], rx);
+            let adapt = decision == GateDecision::Adapt && self.load_level == LoadLevel::Full;
+            self.filter.set_adaptation(adapt);
+            self.pbfdaf.set_adaptation(adapt);
+        }
+
+        match self.filter_mode {
+            FilterMode::Nlms => {
+                let x = x_first.iter().chain(x_second.iter());
+                for ((x, rx), record) in x.zip(rx.iter()).zip(record.iter_mut()) {
+                    *record = self.filter.update(*x, *rx);
+                }
+            }
+            FilterMode::Pbfdaf => {
+                // Filters the whole block at once. The recorded error
+                // signal lags by PBFDAF_PARTITION_SIZE samples.
+                let (rx_first, rx_second) = rx.split_at(x_first.len());
+                let (record_first, record_second) = record.split_at_mut(x_first.len());
+                self.pbfdaf.process(x_first, rx_first, record_first);
+                self.pbfdaf.process(x_second, rx_second, record_second);
+            }
+            FilterMode::Off => record.copy_from_slice(rx),
+        }
+
+        self.recording.record(record);
+        self.residual_len = n;
+        if self.recording.is_full() {
+            self.stop_recording();
         }
     }
 
@@ -89,6 +218,9 @@ impl NlmsDemoApp {
         assert!(self.recording_state == RecordingState::Recording);
         self.recording_state = RecordingState::Idle;
         self.send_message(AppMessage::Led2Off);
+        if let Some(skipped) = self.gate.skipped_fraction() {
+            self.events.push(AppMessage::AdaptationSkipped, skipped);
+        }
     }
 }
 
@@ -98,34 +230,47 @@ impl DemoApp for NlmsDemoApp {
         tone_osc.set_frequency(OSC_FREQ);
         let mut pitch_lfo = Oscillator::new(sample_rate);
         pitch_lfo.set_frequency(5.0);
-        let tx_prev = vec![0.0; MAX_TX_BUFFER_SIZE];
-        let record_buffer = vec![0.0; RECORD_BUFFER_SIZE];
-        let out_msg_buffer = Vec::with_capacity(OUT_MSG_BUFFER_SIZE);
         NlmsDemoApp {
-            filter: NlmsFilter::new(20, 0.3, 0.001),
-            tx_prev,
-            record_buffer,
-            record_buffer_pos: 0,
-            out_msg_buffer,
-            filter_is_active: false,
+            filter: NlmsFilter::new(NLMS_TAP_COUNT, MAX_NLMS_TAP_COUNT, NLMS_STEP_SIZE, 0.001),
+            pbfdaf: PbfdafFilter::new(PBFDAF_PARTITION_SIZE, PBFDAF_PARTITION_COUNT, PBFDAF_STEP_SIZE, 0.001),
+            tx_history: zeroed_storage!(NLMS_TX_HISTORY: HistoryRing<TX_HISTORY_SIZE>),
+            delay_estimator: DelayEstimator::new(
+                MAX_REFERENCE_DELAY,
+                DELAY_ESTIMATOR_DECIMATION,
+                DELAY_ESTIMATOR_UPDATE_INTERVAL,
+            ),
+            gate: ActivityGate::new(
+                PBFDAF_PARTITION_SIZE * PBFDAF_PARTITION_COUNT,
+                (DOUBLE_TALK_HANGOVER * sample_rate) as usize,
+            ),
+            reference_delay: None,
+            recording: Recording::new(zeroed_storage!(NLMS_RECORD_BUFFER: RecordingStorage<RECORD_BUFFER_BYTES>)),
+            residual: zeroed_storage!(NLMS_RESIDUAL: [f32; MAX_TX_BUFFER_SIZE]),
+            residual_len: 0,
+            events: EventQueue::new(),
+            filter_mode: FilterMode::Off,
+            led_blink_interval: (0.5 * sample_rate / LED_BLINK_FREQUENCY) as usize,
+            led_blink_countdown: 0,
+            led_blink_state: false,
             oscillator_enabled: false,
             recording_state: RecordingState::Idle,
+            load_level: LoadLevel::Full,
             tone_osc,
             pitch_lfo,
+            osc_gain: GainRamp::new(OSC_GAIN, (OSC_GAIN_RAMP_TIME * sample_rate) as usize),
         }
     }
 
     fn process(&mut self, rx: &[f32], tx: &mut [f32]) {
-        assert!(tx.len() < MAX_TX_BUFFER_SIZE);
+        assert!(tx.len() <= MAX_TX_BUFFER_SIZE);
         if self.oscillator_enabled {
             let lfo_depth = 0.1;
             let lfo = self.pitch_lfo.next_sample();
             self.pitch_lfo.advance(rx.len() - 1);
             let freq = OSC_FREQ * (1.0 + lfo * lfo_depth);
             self.tone_osc.set_frequency(freq);
-            let osc_gain = 0.02;
             for tx in tx.iter_mut() {
-                *tx += osc_gain * self.tone_osc.next_sample();
+                *tx += self.osc_gain.next() * self.tone_osc.next_sample();
             }
         }
 
@@ -133,45 +278,34 @@ impl DemoApp for NlmsDemoApp {
             RecordingState::Idle => {
                 // Nothing
             }
-            RecordingState::Playing => {
-                for tx in tx.iter_mut() {
-                    self.record_buffer_pos = if self.record_buffer_pos == RECORD_BUFFER_SIZE - 1 {
-                        0
-                    } else {
-                        self.record_buffer_pos + 1
-                    };
-                    *tx += self.record_buffer[self.record_buffer_pos];
-                }
-            }
-            RecordingState::Recording => {
-                if self.filter_is_active {
-                    let tx_prev = &self.tx_prev;
-                    for (rx, tx_prev) in rx.iter().zip(tx_prev.iter()) {
-                        self.record_buffer[self.record_buffer_pos] =
-                            self.filter.update(*tx_prev, *rx);
-                        self.record_buffer_pos += 1;
-                        if self.record_buffer_pos == RECORD_BUFFER_SIZE {
-                            self.stop_recording();
-                            break;
-                        }
-                    }
-                } else {
-                    for rx in rx.iter() {
-                        self.record_buffer[self.record_buffer_pos] = *rx;
-                        self.record_buffer_pos += 1;
-                        if self.record_buffer_pos == RECORD_BUFFER_SIZE {
-                            self.stop_recording();
-                            break;
-                        }
-                    }
-                }
+            RecordingState::Playing => self.recording.play_add(tx),
+            RecordingState::Recording => {}
+        }
+
+        // Align the filter reference with the echo in rx. Under the
+        // heaviest load the estimate is kept as it is. An estimate needs
+        // two consecutive updates to agree, so the gap in its input when
+        // it resumes does not cause a spurious one.
+        self.tx_history.push(tx);
+        let estimate_delay = self.filter_mode != FilterMode::Off && self.load_level != LoadLevel::Minimal;
+        if estimate_delay && self.delay_estimator.process(tx, rx) {
+            if let Some(delay) = self.delay_estimator.delay() {
+                self.reference_delay = Some(delay.saturating_sub(REFERENCE_DELAY_MARGIN));
+                self.filter.reset();
+                self.pbfdaf.reset();
+                self.events.push(AppMessage::DelayEstimated, delay as f32);
             }
         }
 
-        // Store the current tx buffer. Used in next filter update.
-        for (tx, tx_prev) in tx.iter().zip(self.tx_prev.iter_mut()) {
-            *tx_prev = *tx;
+        self.residual_len = 0;
+        if self.recording_state == RecordingState::Recording {
+            self.record(rx);
         }
+
+        if self.filter_mode == FilterMode::Pbfdaf {
+            self.blink_filter_led(rx.len());
+        }
+        self.events.end_block(rx.len());
     }
 
     fn handle_message(&mut self, message: crate::AppMessage) {
@@ -189,21 +323,31 @@ impl DemoApp for NlmsDemoApp {
                 }
             }
             AppMessage::Button1Down => {
-                // Toggle filter
-                self.filter_is_active = !self.filter_is_active;
-                if self.filter_is_active {
-                    self.send_message(AppMessage::Led1On)
-                } else {
-                    self.send_message(AppMessage::Led1Off)
+                // Cycle between no filter, the NLMS filter and the PBFDAF filter
+                self.filter_mode = match self.filter_mode {
+                    FilterMode::Off => FilterMode::Nlms,
+                    FilterMode::Nlms => FilterMode::Pbfdaf,
+                    FilterMode::Pbfdaf => FilterMode::Off,
+                };
+                match self.filter_mode {
+                    FilterMode::Nlms => self.send_message(AppMessage::Led1On),
+                    FilterMode::Pbfdaf => {
+                        self.led_blink_countdown = self.led_blink_interval;
+                        self.led_blink_state = true;
+                    }
+                    FilterMode::Off => self.send_message(AppMessage::Led1Off),
                 }
+                self.events.push(AppMessage::FilterModeChanged, self.filter_mode as u8 as f32);
             }
             AppMessage::Button2Down => {
                 match self.recording_state {
                     RecordingState::Idle | RecordingState::Playing => {
                         // Start recording
-                        self.record_buffer_pos = 0;
+                        self.recording.clear();
                         self.recording_state = RecordingState::Recording;
                         self.filter.reset();
+                        self.pbfdaf.reset();
+                        self.gate.reset();
                         self.send_message(AppMessage::Led2On);
                     }
                     RecordingState::Recording => {
@@ -216,7 +360,7 @@ impl DemoApp for NlmsDemoApp {
                 match self.recording_state {
                     RecordingState::Idle => {
                         // Start playback
-                        self.record_buffer_pos = 0;
+                        self.recording.rewind();
                         self.recording_state = RecordingState::Playing;
                         self.send_message(AppMessage::Led3On);
                     }
@@ -234,7 +378,39 @@ impl DemoApp for NlmsDemoApp {
         }
     }
 
-    fn next_outgoing_message(&mut self) -> Option<crate::AppMessage> {
-        self.out_msg_buffer.pop()
+    fn next_outgoing_event(&mut self) -> Option<AppEvent> {
+        self.events.pop()
+    }
+
+    fn tap_signal(&self) -> Option<&[f32]> {
+        if self.residual_len > 0 {
+            Some(&self.residual[..self.residual_len])
+        } else {
+            None
+        }
+    }
+
+    /// The filters only clean up the recording, so the output is never
+    /// affected. Adapting costs about as much as filtering, so below the
+    /// full level it is paused and both filters keep cancelling with the
+    /// weights found so far. The delay estimate is frozen at the minimal
+    /// level.
+    fn set_load_level(&mut self, level: LoadLevel) {
+        self.load_level = level;
+    }
+
+    const PARAMS: &'static [ParamInfo] = &[
+        ParamInfo::new(b"nlms_step\0", 0.0, 2.0, NLMS_STEP_SIZE),
+        ParamInfo::new(b"nlms_taps\0", 1.0, MAX_NLMS_TAP_COUNT as f32, NLMS_TAP_COUNT as f32),
+        ParamInfo::new(b"pbfdaf_step\0", 0.0, 1.0, PBFDAF_STEP_SIZE),
+        ParamInfo::new(b"osc_gain\0", 0.0, 0.5, OSC_GAIN).ramped(),
+    ];
+
+    /// A new tap count resets the NLMS filter
+    fn set_params(&mut self, values: &[f32]) {
+        self.filter.set_step_size(values[PARAM_NLMS_STEP_SIZE]);
+        self.filter.set_tap_count((values[PARAM_NLMS_TAP_COUNT] + 0.5) as usize);
+        self.pbfdaf.set_step_size(values[PARAM_PBFDAF_STEP_SIZE]);
+        self.osc_gain.set_target(values[PARAM_OSC_GAIN]);
     }
 }
@@ -0,0 +1,214 @@
+use alloc::{vec, vec::Vec};
+use micromath::F32Ext;
+
+use crate::fft::{unit_phasor, Complex, RealFft};
+
+/// Gain applied to spectral magnitudes before log compression
+const COMPRESSION_GAIN: f32 = 100.0;
+
+/// Spectral flux novelty detector. The input is analyzed in Hann windowed
+/// frames of window_size samples, one every hop_size samples. The novelty of a frame is the mean increase of the log
+/// compressed magnitude spectrum relative to the frame one window earlier.
+///
+/// With hop_size < window_size, frames overlap, so onsets are detected
+/// sooner after they occur. The compressed spectra of the last
+/// window_size / hop_size frames are kept in a ring, so each hop transforms
+/// only the newest frame and compares it to a stored, non-overlapping
+/// earlier frame, which keeps the novelty scale independent of the hop size.
+pub struct SpectralFluxDetector {
+    window_size: usize,
+    hop_size: usize,
+    fft: RealFft,
+    window_function: Vec<f32>,
+    /// The current frame, oldest sample first. New samples are written
+    /// to the last hop_size samples.
+    frame: Vec<f32>,
+    windowed_frame: Vec<f32>,
+    spectrum: Vec<Complex>,
+    /// Compressed spectra of the last window_size / hop_size + 1 frames.
+    /// Spectrum j of the ring starts at bin j * bin_count.
+    compressed_spectra: Vec<f32>,
+    newest_spectrum: usize,
+    novelty: f32,
+    hop_pos: usize,
+    /// Only every frame_stride-th frame is analysed, see set_frame_stride
+    frame_stride: usize,
+    /// Position of the next frame within the stride, frames at 0 are
+    /// analysed
+    hop_phase: usize,
+    /// Whether each spectrum of the ring was computed, i.e not skipped
+    spectrum_valid: Vec<bool>,
+    analysed: bool,
+}
+
+impl SpectralFluxDetector {
+    /// window_size must be a power of two and a multiple of hop_size
+    pub fn new(window_size: usize, hop_size: usize) -> Self {
+        assert!(hop_size > 0 && window_size % hop_size == 0);
+        let fft = RealFft::new(window_size);
+        let bin_count = fft.bin_count();
+        let spectrum_count = window_size / hop_size + 1;
+        // Periodic Hann window, 0.5 - 0.5 cos(2 pi k / n) = 0.5 + 0.5 cos(2 pi k / n - pi)
+        let window_function = (0..window_size)
+            .map(|k| {
+                let angle = 2.0 * core::f64::consts::PI * k as f64 / window_size as f64;
+                0.5 + 0.5 * unit_phasor(angle - core::f64::consts::PI).re
+            })
+            .collect();
+        SpectralFluxDetector {
+            window_size,
+            hop_size,
+            fft,
+            window_function,
+            frame: vec![0.0; window_size],
+            windowed_frame: vec![0.0; window_size],
+            spectrum: vec![Complex::ZERO; bin_count],
+            compressed_spectra: vec![0.0; spectrum_count * bin_count],
+            newest_spectrum: 0,
+            novelty: 0.0,
+            hop_pos: 0,
+            frame_stride: 1,
+            hop_phase: 0,
+            spectrum_valid: vec![true; spectrum_count],
+            analysed: false,
+        }
+    }
+
+    /// Analyses only every stride-th frame, to save CPU time. The stride
+    /// is limited to window_size / hop_size, and rounded down to a
+    /// divisor of it, so that the frames that are analysed are compared
+    /// to frames that were analysed too. Frames overlap less, and onsets
+    /// are detected later, by up to stride - 1 hops. Going back to a
+    /// smaller stride, frames are analysed again once the frame they are
+    /// compared to was.
+    pub fn set_frame_stride(&mut self, stride: usize) {
+        let frames_per_window = self.window_size / self.hop_size;
+        let mut stride = stride.clamp(1, frames_per_window);
+        while frames_per_window % stride != 0 {
+            stride -= 1;
+        }
+        self.frame_stride = stride;
+        self.hop_phase %= stride;
+    }
+
+    /// Whether the frame of the last hop was analysed. If not, novelty
+    /// still holds the novelty of an earlier frame.
+    pub fn analysed(&self) -> bool {
+        self.analysed
+    }
+
+    /// Novelty of the most recent frame
+    pub fn novelty(&self) -> f32 {
+        self.novelty
+    }
+
+    pub fn hop_size(&self) -> usize {
+        self.hop_size
+    }
+
+    pub fn window_size(&self) -> usize {
+        self.window_size
+    }
+
+    /// Calls result_handler after each hop, whether its frame was
+    /// analysed or not
+    pub fn process<F: FnMut(&Self)>(&mut self, buffer: &[f32], mut result_handler: F) {
+        for x in buffer {
+            self.frame[self.window_size - self.hop_size + self.hop_pos] = *x;
+            self.hop_pos += 1;
+            if self.hop_pos == self.hop_size {
+                self.hop_pos = 0;
+                self.analysed = self.process_frame();
+                result_handler(self);
+                self.frame.copy_within(self.hop_size.., 0);
+            }
+        }
+    }
+
+    /// Returns whether the frame was analysed, i.e its novelty computed
+    fn process_frame(&mut self) -> bool {
+        let bin_count = self.spectrum.len();
+        let spectrum_count = self.compressed_spectra.len() / bin_count;
+        self.newest_spectrum = (self.newest_spectrum + 1) % spectrum_count;
+        let skipped = self.hop_phase != 0;
+        self.hop_phase = (self.hop_phase + 1) % self.frame_stride;
+        self.spectrum_valid[self.newest_spectrum] = !skipped;
+        if skipped {
+            return false;
+        }
+
+        for ((y, x), w) in self.windowed_frame.iter_mut().zip(&self.frame).zip(&self.window_function) {
+            *y = *x * *w;
+        }
+        self.fft.forward(&self.windowed_frame, &mut self.spectrum);
+
+        // The oldest spectrum in the ring is from one window earlier
+        let reference_spectrum = (self.newest_spectrum + 1) % spectrum_count;
+        let (newest, reference) = if reference_spectrum > self.newest_spectrum {
+            let (a, b) = self.compressed_spectra.split_at_mut(reference_spectrum * bin_count);
+            (&mut a[self.newest_spectrum * bin_count..], &b[..bin_count])
+        } else {
+            let (a, b) = self.compressed_spectra.split_at_mut(self.newest_spectrum * bin_count);
+            (&mut b[..bin_count], &a[reference_spectrum * bin_count..][..bin_count])
+        };
+
+        let mut flux = 0.0;
+        for ((y, x), reference) in newest.iter_mut().zip(&self.spectrum).zip(reference) {
+            *y = F32Ext::ln(1.0 + COMPRESSION_GAIN * F32Ext::sqrt(x.norm_sqr()));
+            flux += (*y - *reference).max(0.0);
+        }
+        // Without a reference, the spectrum is only stored for later frames
+        if !self.spectrum_valid[reference_spectrum] {
+            return false;
+        }
+        self.novelty = flux / bin_count as f32;
+        true
+    }
+}
+
+/// Returns the index of the sample in samples, given as two consecutive
+/// slices, at which the signal energy increases the most, i.e where the
+/// ratio between the mean energy of the energy_window samples after and
+/// before it is highest. Used to locate an onset detected at a coarser
+/// time resolution to the sample. Near the end of samples, the mean after
+/// an index is taken over the remaining samples, down to a quarter window.
+pub fn locate_energy_onset(samples: (&[f32], &[f32]), energy_window: usize) -> usize {
+    let (first, second) = samples;
+    let len = first.len() + second.len();
+    let energy = |i: usize| {
+        let x = if i < first.len() { first[i] } else { second[i - first.len()] };
+        x * x
+    };
+    let w = energy_window;
+    let min_after_len = (w / 4).max(1);
+    if len < w + min_after_len {
+        return len / 2;
+    }
+
+    // Sliding sums of the w samples before index i and of up to w
+    // samples from it
+    let mut before: f32 = (0..w).map(energy).sum();
+    let mut after_len = w.min(len - w);
+    let mut after: f32 = (w..w + after_len).map(energy).sum();
+    // Keeps silence from giving huge ratios
+    let floor = 1e-9;
+    let mut onset = w;
+    let mut max_ratio = 0.0;
+    for i in w..=len - min_after_len {
+        if i > w {
+            before += energy(i - 1) - energy(i - 1 - w);
+            after -= energy(i - 1);
+            if i - 1 + w < len {
+                after += energy(i - 1 + w);
+            } else {
+                after_len -= 1;
+            }
+        }
+        let ratio = (after.max(0.0) / after_len as f32 + floor) / (before.max(0.0) / w as f32 + floor);
+        if ratio > max_ratio {
+            max_ratio = ratio;
+            onset = i;
+        }
+    }
+    onset
+}
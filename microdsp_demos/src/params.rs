@@ -0,0 +1,88 @@
+use core::ffi::c_char;
+
+/// Largest number of parameters of an app. Matches DEMO_MAX_PARAMS in
+/// microdsp_demos.h.
+pub const MAX_PARAM_COUNT: usize = 8;
+
+/// Describes a tunable parameter of a demo app, see DemoApp::PARAMS.
+/// Matches demo_param_info_t in microdsp_demos.h.
+#[repr(C)]
+pub struct ParamInfo {
+    /// NUL terminated
+    pub name: *const c_char,
+    pub min: f32,
+    pub max: f32,
+    pub default_value: f32,
+    /// Whether the app ramps to new values instead of jumping, e.g gains
+    pub ramped: bool,
+}
+
+// Only holds pointers to statics
+unsafe impl Sync for ParamInfo {}
+
+impl ParamInfo {
+    /// name must be NUL terminated
+    pub const fn new(name: &'static [u8], min: f32, max: f32, default_value: f32) -> Self {
+        assert!(name[name.len() - 1] == 0);
+        ParamInfo {
+            name: name.as_ptr() as *const c_char,
+            min,
+            max,
+            default_value,
+            ramped: false,
+        }
+    }
+
+    pub const fn ramped(self) -> Self {
+        ParamInfo { ramped: true, ..self }
+    }
+
+    pub fn clamp(&self, value: f32) -> f32 {
+        // Also maps NaN to min
+        if value >= self.min {
+            value.min(self.max)
+        } else {
+            self.min
+        }
+    }
+}
+
+/// A gain that moves linearly to a new value over a fixed number of
+/// samples, so that gain changes do not click
+pub struct GainRamp {
+    value: f32,
+    target: f32,
+    step: f32,
+    ramp_length: usize,
+    remaining: usize,
+}
+
+impl GainRamp {
+    pub fn new(value: f32, ramp_length: usize) -> Self {
+        GainRamp {
+            value,
+            target: value,
+            step: 0.0,
+            ramp_length: ramp_length.max(1),
+            remaining: 0,
+        }
+    }
+
+    pub fn set_target(&mut self, target: f32) {
+        if target != self.target {
+            self.target = target;
+            self.remaining = self.ramp_length;
+            self.step = (target - self.value) / self.ramp_length as f32;
+        }
+    }
+
+    /// The gain of the next sample
+    #[inline]
+    pub fn next(&mut self) -> f32 {
+        if self.remaining > 0 {
+            self.remaining -= 1;
+            self.value = if self.remaining == 0 { self.target } else { self.value + self.step };
+        }
+        self.value
+    }
+}
@@ -0,0 +1,199 @@
+use alloc::{vec, vec::Vec};
+
+use crate::fft::{Complex, RealFft};
+
+/// Smoothing factor of the per-bin reference power estimate, per block
+const POWER_SMOOTHING: f32 = 0.9;
+
+/// Partitioned block frequency domain adaptive filter (PBFDAF), using
+/// overlap-save. The filter has partition_size * partition_count taps,
+/// split into partitions of partition_size taps that are each applied
+/// as a product of spectra of size 2 * partition_size. The cost per
+/// sample grows with the partition count but not with the partition
+/// size, apart from the log factor of the FFTs.
+///
+/// Samples are processed in blocks of partition_size, so the error
+/// signal is delayed by partition_size samples.
+///
+/// Each block, the weights of all partitions are updated using a
+/// per-bin normalized step, but only one partition has the gradient
+/// constraint applied, i.e the circular convolution part of its
+/// impulse response zeroed. Constraining the partitions in turn keeps
+/// the weights close to a linear convolution at a fraction of the cost.
+///
+/// Adaptation can be paused, which leaves two of the five transforms
+/// per block.
+pub struct PbfdafFilter {
+    partition_size: usize,
+    partition_count: usize,
+    step_size: f32,
+    regularization: f32,
+    fft: RealFft,
+    /// The previous and the current reference block
+    reference: Vec<f32>,
+    /// Reference spectra of the last partition_count blocks, stored as
+    /// a ring. Spectrum j of the ring starts at bin j * bin_count.
+    reference_spectra: Vec<Complex>,
+    /// Ring index of the most recent reference spectrum
+    newest_spectrum: usize,
+    /// Weights of each partition, in the frequency domain
+    weights: Vec<Complex>,
+    /// Smoothed power of the reference spectrum
+    power: Vec<f32>,
+    spectrum: Vec<Complex>,
+    time: Vec<f32>,
+    reference_block: Vec<f32>,
+    desired_block: Vec<f32>,
+    error_block: Vec<f32>,
+    block_pos: usize,
+    next_constrained_partition: usize,
+    adapt: bool,
+}
+
+impl PbfdafFilter {
+    /// step_size is in (0, 1]. regularization is added to the
+    /// reference power estimate of each bin, normalized to a per
+    /// sample power, like the eps parameter of the time domain filter.
+    pub fn new(
+        partition_size: usize,
+        partition_count: usize,
+        step_size: f32,
+        regularization: f32,
+    ) -> Self {
+        assert!(partition_count > 0);
+        let fft = RealFft::new(2 * partition_size);
+        let bin_count = fft.bin_count();
+        PbfdafFilter {
+            partition_size,
+            partition_count,
+            step_size,
+            regularization: regularization * fft.size() as f32,
+            fft,
+            reference: vec![0.0; 2 * partition_size],
+            reference_spectra: vec![Complex::ZERO; partition_count * bin_count],
+            newest_spectrum: 0,
+            weights: vec![Complex::ZERO; partition_count * bin_count],
+            power: vec![0.0; bin_count],
+            spectrum: vec![Complex::ZERO; bin_count],
+            time: vec![0.0; 2 * partition_size],
+            reference_block: vec![0.0; partition_size],
+            desired_block: vec![0.0; partition_size],
+            error_block: vec![0.0; partition_size],
+            block_pos: 0,
+            next_constrained_partition: 0,
+            adapt: true,
+        }
+    }
+
+    pub fn tap_count(&self) -> usize {
+        self.partition_size * self.partition_count
+    }
+
+    pub fn reset(&mut self) {
+        self.reference.fill(0.0);
+        self.reference_spectra.fill(Complex::ZERO);
+        self.weights.fill(Complex::ZERO);
+        self.power.fill(0.0);
+        self.reference_block.fill(0.0);
+        self.desired_block.fill(0.0);
+        self.error_block.fill(0.0);
+        self.block_pos = 0;
+        self.next_constrained_partition = 0;
+    }
+
+    pub fn set_step_size(&mut self, step_size: f32) {
+        self.step_size = step_size;
+    }
+
+    /// Whether process adapts the weights. Paused adaptation keeps the
+    /// weights, and resumes where it left off.
+    pub fn set_adaptation(&mut self, adapt: bool) {
+        self.adapt = adapt;
+    }
+
+    /// Filters the reference signal x, adapting the filter to estimate
+    /// the desired signal d unless adaptation is paused. The estimation
+    /// error, delayed by partition_size samples, is written to e.
+    pub fn process(&mut self, x: &[f32], d: &[f32], e: &mut [f32]) {
+        assert!(x.len() == d.len() && d.len() == e.len());
+        for ((x, d), e) in x.iter().zip(d.iter()).zip(e.iter_mut()) {
+            self.reference_block[self.block_pos] = *x;
+            self.desired_block[self.block_pos] = *d;
+            *e = self.error_block[self.block_pos];
+            self.block_pos += 1;
+            if self.block_pos == self.partition_size {
+                self.block_pos = 0;
+                self.process_block();
+            }
+        }
+    }
+
+    fn process_block(&mut self) {
+        let n = self.partition_size;
+        let bin_count = self.fft.bin_count();
+        let partition_count = self.partition_count;
+
+        // Transform the previous and the current reference block,
+        // replacing the oldest spectrum in the ring
+        self.reference.copy_within(n.., 0);
+        self.reference[n..].copy_from_slice(&self.reference_block);
+        self.newest_spectrum = (self.newest_spectrum + partition_count - 1) % partition_count;
+        let newest = self.newest_spectrum * bin_count;
+        self.fft.forward(
+            &self.reference,
+            &mut self.reference_spectra[newest..newest + bin_count],
+        );
+        for (power, x) in self.power.iter_mut().zip(&self.reference_spectra[newest..newest + bin_count]) {
+            *power = POWER_SMOOTHING * *power + (1.0 - POWER_SMOOTHING) * x.norm_sqr();
+        }
+
+        // Filter output. Partition j is applied to the reference
+        // spectrum from j blocks ago. The last n samples of the
+        // inverse transform are the linear convolution.
+        self.spectrum.fill(Complex::ZERO);
+        for j in 0..partition_count {
+            let x_start = ((self.newest_spectrum + j) % partition_count) * bin_count;
+            let x = &self.reference_spectra[x_start..x_start + bin_count];
+            let w = &self.weights[j * bin_count..(j + 1) * bin_count];
+            for ((y, x), w) in self.spectrum.iter_mut().zip(x).zip(w) {
+                *y = *y + *x * *w;
+            }
+        }
+        self.fft.inverse(&self.spectrum, &mut self.time);
+        for ((e, d), y) in self.error_block.iter_mut().zip(&self.desired_block).zip(&self.time[n..]) {
+            *e = *d - *y;
+        }
+        if !self.adapt {
+            return;
+        }
+
+        // Normalized error spectrum
+        self.time[..n].fill(0.0);
+        self.time[n..].copy_from_slice(&self.error_block);
+        self.fft.forward(&self.time, &mut self.spectrum);
+        let step_size = self.step_size;
+        let partition_scale = partition_count as f32;
+        let regularization = self.regularization;
+        for (e, power) in self.spectrum.iter_mut().zip(&self.power) {
+            *e = *e * (step_size / (partition_scale * *power + regularization));
+        }
+
+        // Unconstrained update of all partitions
+        for j in 0..partition_count {
+            let x_start = ((self.newest_spectrum + j) % partition_count) * bin_count;
+            let x = &self.reference_spectra[x_start..x_start + bin_count];
+            let w = &mut self.weights[j * bin_count..(j + 1) * bin_count];
+            for ((w, x), e) in w.iter_mut().zip(x).zip(&self.spectrum) {
+                *w = *w + x.conj() * *e;
+            }
+        }
+
+        // Constrain one partition to n taps
+        let j = self.next_constrained_partition;
+        let w = &mut self.weights[j * bin_count..(j + 1) * bin_count];
+        self.fft.inverse(w, &mut self.time);
+        self.time[n..].fill(0.0);
+        self.fft.forward(&self.time, w);
+        self.next_constrained_partition = (j + 1) % partition_count;
+    }
+}
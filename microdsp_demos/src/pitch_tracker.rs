@@ -0,0 +1,236 @@
+use alloc::{vec, vec::Vec};
+
+/// A key maximum of the NSDF is a period candidate if it is at least
+/// this fraction of the highest key maximum (k in the MPM paper).
+const KEY_MAXIMUM_THRESHOLD: f32 = 0.9;
+
+pub struct PitchEstimate {
+    /// Estimated fundamental frequency in Hz
+    pub frequency: f32,
+    /// NSDF value at the chosen period, close to 1 for a clean tone
+    pub clarity: f32,
+    /// Mean square of the analysis window
+    pub power: f32,
+}
+
+impl PitchEstimate {
+    pub fn is_tone(&self, min_clarity: f32, min_power: f32) -> bool {
+        self.clarity >= min_clarity && self.power >= min_power
+    }
+}
+
+/// McLeod pitch method (MPM) pitch tracker with overlapping windows.
+///
+/// The input is analyzed in windows of window_size samples, one every hop_size samples. Instead of
+/// recomputing the autocorrelation of each window from scratch, the
+/// window is split into segments of hop_size samples, and the products
+/// of each pair of segments are stored as partial autocorrelations when
+/// the later segment of the pair arrives. The autocorrelation of a window
+/// is the sum of the partials of the segments in it, so each hop only
+/// costs lag_count * hop_size multiply-adds, independently of the
+/// overlap. Summing the stored partials, rather than keeping a running
+/// sum, avoids accumulating rounding errors.
+pub struct OverlappedMpm {
+    sample_rate: f32,
+    window_size: usize,
+    hop_size: usize,
+    lag_count: usize,
+    segment_count: usize,
+    /// Number of segment distances spanned by the lags
+    distance_count: usize,
+    /// The current window, oldest sample first. The newest segment is
+    /// filled in at the end.
+    window: Vec<f32>,
+    /// Partial autocorrelations, lag_count values for each segment slot
+    /// and distance. The partial of slot s at distance d holds the
+    /// products of the segment in slot s with the segment d hops later.
+    partials: Vec<f32>,
+    newest_slot: usize,
+    nsdf: Vec<f32>,
+    hop_pos: usize,
+    /// Hops until the first window is complete
+    hops_until_full: usize,
+    /// Lags for which partials are computed, at most lag_count
+    active_lag_count: usize,
+    /// Lags of the NSDF searched by estimate. Lags that were just
+    /// activated have stale partials until every segment of the window
+    /// has arrived, so this trails active_lag_count when it grows.
+    estimate_lag_count: usize,
+    /// Hops until estimate_lag_count catches up with active_lag_count
+    hops_until_active: usize,
+}
+
+impl OverlappedMpm {
+    /// window_size must be a multiple of hop_size, and lag_count at most
+    /// window_size / 2.
+    pub fn new(
+        sample_rate: f32,
+        window_size: usize,
+        hop_size: usize,
+        lag_count: usize,
+    ) -> Self {
+        assert!(hop_size > 0 && window_size % hop_size == 0);
+        assert!(lag_count >= 3 && lag_count <= window_size / 2);
+        let segment_count = window_size / hop_size;
+        let distance_count = ((lag_count + hop_size - 2) / hop_size + 1).min(segment_count);
+        OverlappedMpm {
+            sample_rate,
+            window_size,
+            hop_size,
+            lag_count,
+            segment_count,
+            distance_count,
+            window: vec![0.0; window_size],
+            partials: vec![0.0; segment_count * distance_count * lag_count],
+            newest_slot: 0,
+            nsdf: vec![0.0; lag_count],
+            hop_pos: 0,
+            hops_until_full: segment_count,
+            active_lag_count: lag_count,
+            estimate_lag_count: lag_count,
+            hops_until_active: 0,
+        }
+    }
+
+    /// Limits the period search to the first lag_count lags, at least 3
+    /// and at most the lag_count passed to new. The cost of a hop shrinks
+    /// about in proportion, and frequencies below
+    /// sample_rate / (lag_count - 2) are no longer detected. Fewer lags
+    /// take effect right away, more lags once their partials cover the
+    /// window, i.e after window_size / hop_size hops.
+    pub fn set_active_lag_count(&mut self, lag_count: usize) {
+        let lag_count = lag_count.clamp(3, self.lag_count);
+        self.active_lag_count = lag_count;
+        if lag_count <= self.estimate_lag_count {
+            self.estimate_lag_count = lag_count;
+            self.hops_until_active = 0;
+        } else {
+            self.hops_until_active = self.segment_count;
+        }
+    }
+
+    /// Calls result_handler for each window completed by buffer
+    pub fn process<F: FnMut(&PitchEstimate)>(&mut self, buffer: &[f32], mut result_handler: F) {
+        for x in buffer {
+            self.window[self.window_size - self.hop_size + self.hop_pos] = *x;
+            self.hop_pos += 1;
+            if self.hop_pos == self.hop_size {
+                self.hop_pos = 0;
+                self.update_partials();
+                if self.hops_until_active > 0 {
+                    self.hops_until_active -= 1;
+                    if self.hops_until_active == 0 {
+                        self.estimate_lag_count = self.active_lag_count;
+                    }
+                }
+                if self.hops_until_full > 0 {
+                    self.hops_until_full -= 1;
+                }
+                if self.hops_until_full == 0 {
+                    result_handler(&self.estimate());
+                }
+                self.window.copy_within(self.hop_size.., 0);
+            }
+        }
+    }
+
+    /// Computes the partials of all pairs of samples ending in the
+    /// newest segment, i.e in the last hop_size samples of the window,
+    /// for the active lags.
+    fn update_partials(&mut self) {
+        let (w, h, l) = (self.window_size, self.hop_size, self.lag_count);
+        let dc = self.distance_count;
+        self.newest_slot = (self.newest_slot + 1) % self.segment_count;
+        let slot = self.newest_slot;
+        // The slot held the segment that just left the window
+        self.partials[slot * dc * l..(slot + 1) * dc * l].fill(0.0);
+
+        // Pairs further apart than the active lags span are all zero
+        let active_lags = self.active_lag_count;
+        let active_distances = ((active_lags + h - 2) / h + 1).min(dc);
+        for d in 0..active_distances {
+            let earlier_slot = (slot + self.segment_count - d) % self.segment_count;
+            let partial = &mut self.partials[(earlier_slot * dc + d) * l..][..active_lags];
+            let segment_start = w - (d + 1) * h;
+            for (lag, p) in partial.iter_mut().enumerate() {
+                // Products x[j] * x[j + lag] with j in the earlier segment
+                // and j + lag in the newest one
+                let start = segment_start.max((w - h).saturating_sub(lag));
+                let end = (segment_start + h).min(w - lag);
+                let mut sum = 0.0;
+                for j in start..end {
+                    sum += self.window[j] * self.window[j + lag];
+                }
+                *p = sum;
+            }
+        }
+    }
+
+    fn estimate(&mut self) -> PitchEstimate {
+        let l = self.estimate_lag_count;
+        let nsdf = &mut self.nsdf[..l];
+        for (lag, n) in nsdf.iter_mut().enumerate() {
+            *n = 0.0;
+            for p in self.partials.chunks_exact(self.lag_count) {
+                *n += p[lag];
+            }
+        }
+
+        // Normalize by m(lag) = sum of x[j]^2 + x[j + lag]^2, updated
+        // incrementally from m(0) = 2 * sum of x[j]^2
+        let energy: f32 = self.window.iter().map(|x| x * x).sum();
+        let mut m = 2.0 * energy;
+        for lag in 0..l {
+            if lag > 0 {
+                let a = self.window[lag - 1];
+                let b = self.window[self.window_size - lag];
+                m -= a * a + b * b;
+            }
+            nsdf[lag] = if m > 0.0 { 2.0 * nsdf[lag] / m } else { 0.0 };
+        }
+
+        let power = energy / self.window_size as f32;
+        let highest = key_maxima(nsdf).map(|lag| nsdf[lag]).fold(0.0, f32::max);
+        let period_lag = key_maxima(nsdf).find(|lag| nsdf[*lag] >= KEY_MAXIMUM_THRESHOLD * highest);
+        match period_lag {
+            Some(lag) if highest > 0.0 && lag + 1 < l => {
+                // Parabolic interpolation of the peak
+                let (a, b, c) = (nsdf[lag - 1], nsdf[lag], nsdf[lag + 1]);
+                let denominator = a - 2.0 * b + c;
+                let offset = if denominator != 0.0 { 0.5 * (a - c) / denominator } else { 0.0 };
+                PitchEstimate {
+                    frequency: self.sample_rate / (lag as f32 + offset),
+                    clarity: b - 0.25 * (a - c) * offset,
+                    power,
+                }
+            }
+            _ => PitchEstimate {
+                frequency: 0.0,
+                clarity: 0.0,
+                power,
+            },
+        }
+    }
+}
+
+/// Lags of the highest NSDF value of each positive region, skipping the
+/// region around lag 0.
+fn key_maxima(nsdf: &[f32]) -> impl Iterator<Item = usize> + '_ {
+    let mut lag = nsdf.iter().position(|n| *n <= 0.0).unwrap_or(nsdf.len());
+    core::iter::from_fn(move || {
+        while lag < nsdf.len() && nsdf[lag] <= 0.0 {
+            lag += 1;
+        }
+        if lag >= nsdf.len() {
+            return None;
+        }
+        let mut max_lag = lag;
+        while lag < nsdf.len() && nsdf[lag] > 0.0 {
+            if nsdf[lag] > nsdf[max_lag] {
+                max_lag = lag;
+            }
+            lag += 1;
+        }
+        Some(max_lag)
+    })
+}
@@ -0,0 +1,280 @@
+use crate::static_storage::{StorageBox, Zeroable};
+
+/// Block codec for recordings. Samples are encoded as they stream in and
+/// decoded a block at a time. Every block can be decoded on its own.
+pub trait RecordingCodec {
+    /// Samples and bytes per block
+    const BLOCK_SAMPLES: usize;
+    const BLOCK_BYTES: usize;
+    fn new() -> Self;
+    /// Encodes samples into block, starting at sample index start of the
+    /// block. Samples must not extend past the end of the block.
+    fn encode(&mut self, block: &mut [u8], start: usize, samples: &[f32]);
+    /// Decodes all BLOCK_SAMPLES samples of block
+    fn decode(block: &[u8], samples: &mut [f32]);
+}
+
+/// Largest BLOCK_SAMPLES of the codecs
+pub const MAX_CODEC_BLOCK_SAMPLES: usize = ImaAdpcmCodec::BLOCK_SAMPLES;
+
+#[inline]
+fn sample_to_i16(sample: f32) -> i16 {
+    // Rounds to nearest, the cast saturates
+    ((sample * 32768.0 + 32768.5) as i32 - 32768).clamp(i16::MIN as i32, i16::MAX as i32) as i16
+}
+
+#[inline]
+fn sample_from_i16(sample: i16) -> f32 {
+    sample as f32 * (1.0 / 32768.0)
+}
+
+/// 16 bit PCM, half the size of f32 samples
+pub struct Pcm16Codec;
+
+impl RecordingCodec for Pcm16Codec {
+    const BLOCK_SAMPLES: usize = 128;
+    const BLOCK_BYTES: usize = 256;
+
+    fn new() -> Self {
+        Pcm16Codec
+    }
+
+    fn encode(&mut self, block: &mut [u8], start: usize, samples: &[f32]) {
+        let bytes = &mut block[2 * start..2 * (start + samples.len())];
+        for (bytes, sample) in bytes.chunks_exact_mut(2).zip(samples) {
+            bytes.copy_from_slice(&sample_to_i16(*sample).to_le_bytes());
+        }
+    }
+
+    fn decode(block: &[u8], samples: &mut [f32]) {
+        for (bytes, sample) in block.chunks_exact(2).zip(samples.iter_mut()) {
+            *sample = sample_from_i16(i16::from_le_bytes([bytes[0], bytes[1]]));
+        }
+    }
+}
+
+const IMA_STEP_TABLE: [i16; 89] = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66,
+    73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408,
+    449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630,
+    9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767,
+];
+const IMA_INDEX_TABLE: [i8; 8] = [-1, -1, -1, -1, 2, 4, 6, 8];
+
+/// IMA ADPCM in the block layout of mono IMA ADPCM WAV files: a header
+/// with the first sample and the step index, followed by 4 bits for each
+/// of the other samples, low nibble first. About 7.9 times smaller than
+/// f32 samples.
+pub struct ImaAdpcmCodec {
+    predictor: i32,
+    step_index: i32,
+}
+
+const IMA_HEADER_BYTES: usize = 4;
+
+impl ImaAdpcmCodec {
+    #[inline]
+    fn encode_sample(&mut self, sample: i16) -> u8 {
+        let step = IMA_STEP_TABLE[self.step_index as usize] as i32;
+        let mut diff = sample as i32 - self.predictor;
+        let mut nibble = 0;
+        if diff < 0 {
+            nibble = 8;
+            diff = -diff;
+        }
+        // Quantizes diff / step to 3 bits, accumulating the same
+        // reconstruction as the decoder
+        let mut delta = step >> 3;
+        if diff >= step {
+            nibble |= 4;
+            diff -= step;
+            delta += step;
+        }
+        if diff >= step >> 1 {
+            nibble |= 2;
+            diff -= step >> 1;
+            delta += step >> 1;
+        }
+        if diff >= step >> 2 {
+            nibble |= 1;
+            delta += step >> 2;
+        }
+        self.predictor = if nibble & 8 != 0 { self.predictor - delta } else { self.predictor + delta }
+            .clamp(i16::MIN as i32, i16::MAX as i32);
+        self.step_index = (self.step_index + IMA_INDEX_TABLE[(nibble & 7) as usize] as i32).clamp(0, 88);
+        nibble
+    }
+}
+
+#[inline]
+fn ima_decode_sample(nibble: u8, predictor: &mut i32, step_index: &mut i32) -> i16 {
+    let step = IMA_STEP_TABLE[*step_index as usize] as i32;
+    let mut delta = step >> 3;
+    if nibble & 4 != 0 {
+        delta += step;
+    }
+    if nibble & 2 != 0 {
+        delta += step >> 1;
+    }
+    if nibble & 1 != 0 {
+        delta += step >> 2;
+    }
+    *predictor = if nibble & 8 != 0 { *predictor - delta } else { *predictor + delta }
+        .clamp(i16::MIN as i32, i16::MAX as i32);
+    *step_index = (*step_index + IMA_INDEX_TABLE[(nibble & 7) as usize] as i32).clamp(0, 88);
+    *predictor as i16
+}
+
+impl RecordingCodec for ImaAdpcmCodec {
+    const BLOCK_SAMPLES: usize = 1 + 2 * (Self::BLOCK_BYTES - IMA_HEADER_BYTES);
+    const BLOCK_BYTES: usize = 256;
+
+    fn new() -> Self {
+        ImaAdpcmCodec {
+            predictor: 0,
+            step_index: 0,
+        }
+    }
+
+    fn encode(&mut self, block: &mut [u8], start: usize, samples: &[f32]) {
+        assert!(start + samples.len() <= Self::BLOCK_SAMPLES);
+        let mut samples = samples.iter();
+        let mut index = start;
+        if index == 0 {
+            // The first sample goes into the header as is, along with the
+            // step index to continue with
+            if let Some(sample) = samples.next() {
+                let sample = sample_to_i16(*sample);
+                self.predictor = sample as i32;
+                block[0..2].copy_from_slice(&sample.to_le_bytes());
+                block[2] = self.step_index as u8;
+                block[3] = 0;
+                index = 1;
+            }
+        }
+        for sample in samples {
+            let nibble = self.encode_sample(sample_to_i16(*sample));
+            let byte = &mut block[IMA_HEADER_BYTES + (index - 1) / 2];
+            *byte = if index % 2 == 1 { nibble } else { *byte | (nibble << 4) };
+            index += 1;
+        }
+    }
+
+    fn decode(block: &[u8], samples: &mut [f32]) {
+        let mut predictor = i16::from_le_bytes([block[0], block[1]]) as i32;
+        let mut step_index = (block[2] as i32).clamp(0, 88);
+        samples[0] = sample_from_i16(predictor as i16);
+        let data = &block[IMA_HEADER_BYTES..Self::BLOCK_BYTES];
+        for (byte, pair) in data.iter().zip(samples[1..Self::BLOCK_SAMPLES].chunks_exact_mut(2)) {
+            pair[0] = sample_from_i16(ima_decode_sample(byte & 0xf, &mut predictor, &mut step_index));
+            pair[1] = sample_from_i16(ima_decode_sample(byte >> 4, &mut predictor, &mut step_index));
+        }
+    }
+}
+
+/// Recording storage of N bytes, and the block being played back. Zero
+/// initialized storage holds an empty recording.
+pub struct RecordingStorage<const N: usize> {
+    bytes: [u8; N],
+    decoded: [f32; MAX_CODEC_BLOCK_SAMPLES],
+}
+
+unsafe impl<const N: usize> Zeroable for RecordingStorage<N> {}
+
+/// A mono recording, encoded with codec C as it is recorded and decoded a
+/// block at a time when it is played back.
+pub struct Recording<C: RecordingCodec, const N: usize> {
+    storage: StorageBox<RecordingStorage<N>>,
+    codec: C,
+    /// Number of recorded samples
+    len: usize,
+    /// Index of the next sample to play, and the block decoded into
+    /// storage.decoded, if any
+    play_pos: usize,
+    decoded_block: Option<usize>,
+}
+
+impl<C: RecordingCodec, const N: usize> Recording<C, N> {
+    pub fn new(storage: StorageBox<RecordingStorage<N>>) -> Self {
+        assert!(C::BLOCK_SAMPLES <= MAX_CODEC_BLOCK_SAMPLES && N >= C::BLOCK_BYTES);
+        Recording {
+            storage,
+            codec: C::new(),
+            len: 0,
+            play_pos: 0,
+            decoded_block: None,
+        }
+    }
+
+    /// Capacity in samples
+    pub fn capacity(&self) -> usize {
+        N / C::BLOCK_BYTES * C::BLOCK_SAMPLES
+    }
+
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    pub fn is_full(&self) -> bool {
+        self.len == self.capacity()
+    }
+
+    /// Discards the recording
+    pub fn clear(&mut self) {
+        self.codec = C::new();
+        self.len = 0;
+        self.play_pos = 0;
+        self.decoded_block = None;
+    }
+
+    /// Appends as many samples as fit and returns their number
+    pub fn record(&mut self, samples: &[f32]) -> usize {
+        let count = samples.len().min(self.capacity() - self.len);
+        let mut samples = &samples[..count];
+        while !samples.is_empty() {
+            let block_index = self.len / C::BLOCK_SAMPLES;
+            let start = self.len % C::BLOCK_SAMPLES;
+            let n = samples.len().min(C::BLOCK_SAMPLES - start);
+            let block = &mut self.storage.bytes[block_index * C::BLOCK_BYTES..(block_index + 1) * C::BLOCK_BYTES];
+            self.codec.encode(block, start, &samples[..n]);
+            samples = &samples[n..];
+            self.len += n;
+        }
+        if self.decoded_block == Some(self.len / C::BLOCK_SAMPLES) {
+            self.decoded_block = None;
+        }
+        count
+    }
+
+    /// Restarts playback from the beginning
+    pub fn rewind(&mut self) {
+        self.play_pos = 0;
+    }
+
+    /// Adds the recording to output, looping back to the start at the end
+    pub fn play_add(&mut self, output: &mut [f32]) {
+        if self.len == 0 {
+            return;
+        }
+        let mut output = output;
+        while !output.is_empty() {
+            let block_index = self.play_pos / C::BLOCK_SAMPLES;
+            if self.decoded_block != Some(block_index) {
+                let storage = &mut *self.storage;
+                let block = &storage.bytes[block_index * C::BLOCK_BYTES..(block_index + 1) * C::BLOCK_BYTES];
+                C::decode(block, &mut storage.decoded[..C::BLOCK_SAMPLES]);
+                self.decoded_block = Some(block_index);
+            }
+            let start = self.play_pos % C::BLOCK_SAMPLES;
+            let block_end = (block_index * C::BLOCK_SAMPLES + C::BLOCK_SAMPLES).min(self.len);
+            let n = output.len().min(block_end - self.play_pos);
+            for (out, sample) in output[..n].iter_mut().zip(&self.storage.decoded[start..start + n]) {
+                *out += sample;
+            }
+            output = &mut output[n..];
+            self.play_pos = if self.play_pos + n == self.len { 0 } else { self.play_pos + n };
+        }
+    }
+}
@@ -0,0 +1,235 @@
+use crate::arena_allocator::ArenaRegion;
+use crate::c_api::{
+    handle_message, process_channels, set_load_level, set_params, stage_stats, take_events, tap_signal,
+};
+use crate::{AppEvent, DemoApp, ParamInfo, StageStats, ALLOCATOR, MAX_PARAM_COUNT};
+use alloc::boxed::Box;
+use core::ffi::{c_char, c_void, CStr};
+use core::mem::size_of;
+use core::ptr::{null, null_mut};
+use core::sync::atomic::{AtomicPtr, Ordering};
+
+/// Version of the vtable layout and of the registry functions. Matches
+/// DEMO_APP_ABI_VERSION in microdsp_demos.h.
+pub const DEMO_APP_ABI_VERSION: u32 = 1;
+
+/// The C interface of a demo app. Matches demo_app_vtable_t in
+/// microdsp_demos.h. New fields are only ever appended, so size tells
+/// which of them are present.
+#[repr(C)]
+pub struct DemoAppVtable {
+    pub abi_version: u32,
+    pub size: u32,
+    /// NUL terminated
+    pub name: *const c_char,
+    /// Upper bound of the arena bytes the app allocates when it is created
+    pub arena_budget: u32,
+    pub rx_channel_mask: u8,
+    pub tx_channel_mask: u8,
+    pub process_channels: unsafe extern "C" fn(*mut c_void, *const *mut f32, *const *const f32, u32),
+    pub handle_message: unsafe extern "C" fn(*mut c_void, u8),
+    pub take_events: unsafe extern "C" fn(*mut c_void, *mut AppEvent, u32) -> u32,
+    pub tap_signal: unsafe extern "C" fn(*mut c_void, *mut *const f32) -> u32,
+    pub stage_stats: unsafe extern "C" fn(*mut c_void, *mut StageStats, u32) -> u32,
+    pub set_load_level: unsafe extern "C" fn(*mut c_void, u8),
+    /// The tunable parameters, param_count entries
+    pub param_count: u32,
+    pub params: *const ParamInfo,
+    pub set_params: unsafe extern "C" fn(*mut c_void, *const f32, u32),
+}
+
+// Only holds pointers to statics
+unsafe impl Sync for DemoAppVtable {}
+
+struct RegistryEntry {
+    vtable: DemoAppVtable,
+    create: fn(f32) -> *mut c_void,
+    destroy: unsafe fn(*mut c_void),
+}
+
+fn create<T: DemoApp>(sample_rate: f32) -> *mut c_void {
+    Box::into_raw(Box::new(T::new(sample_rate))) as *mut c_void
+}
+
+unsafe fn destroy<T: DemoApp>(demo_app_ptr: *mut c_void) {
+    drop(Box::from_raw(demo_app_ptr as *mut T));
+}
+
+const fn entry<T: DemoApp>(name: &'static [u8], arena_budget: usize) -> RegistryEntry {
+    assert!(T::PARAMS.len() <= MAX_PARAM_COUNT);
+    RegistryEntry {
+        vtable: DemoAppVtable {
+            abi_version: DEMO_APP_ABI_VERSION,
+            size: size_of::<DemoAppVtable>() as u32,
+            name: name.as_ptr() as *const c_char,
+            arena_budget: arena_budget as u32,
+            rx_channel_mask: T::RX_CHANNEL_MASK,
+            tx_channel_mask: T::TX_CHANNEL_MASK,
+            process_channels: process_channels::<T>,
+            handle_message: handle_message::<T>,
+            take_events: take_events::<T>,
+            tap_signal: tap_signal::<T>,
+            stage_stats: stage_stats::<T>,
+            set_load_level: set_load_level::<T>,
+            param_count: T::PARAMS.len() as u32,
+            params: T::PARAMS.as_ptr(),
+            set_params: set_params::<T>,
+        },
+        create: create::<T>,
+        destroy: destroy::<T>,
+    }
+}
+
+// Arena budgets, measured with host/demo_swap_bench and
+// host/demo_dispatch_bench plus some margin. The benches check them.
+#[cfg(all(feature = "nlms_demo", not(feature = "static_app")))]
+const NLMS_ARENA_BUDGET: usize = 180 * 1024;
+#[cfg(all(feature = "nlms_demo", feature = "static_app"))]
+const NLMS_ARENA_BUDGET: usize = 20 * 1024;
+#[cfg(feature = "sfnov_demo")]
+const SFNOV_ARENA_BUDGET: usize = 12 * 1024;
+#[cfg(feature = "mpm_demo")]
+const MPM_ARENA_BUDGET: usize = 12 * 1024;
+#[cfg(feature = "goertzel_demo")]
+const GOERTZEL_ARENA_BUDGET: usize = 6 * 1024;
+
+/// Size of the arena all allocations are served from, see
+/// arena_allocator.rs. It holds the NLMS demo on its own, or any two of
+/// the other demos side by side, so that swaps between those are seamless.
+/// NLMS needs several times as much as all the others together, so swaps
+/// to and from it retire the old app first.
+pub const ARENA_SIZE: usize = {
+    let others = largest_pair_sum(&[
+        #[cfg(feature = "sfnov_demo")]
+        SFNOV_ARENA_BUDGET,
+        #[cfg(feature = "mpm_demo")]
+        MPM_ARENA_BUDGET,
+        #[cfg(feature = "goertzel_demo")]
+        GOERTZEL_ARENA_BUDGET,
+        #[cfg(feature = "graph_reference")]
+        MPM_ARENA_BUDGET,
+    ]);
+    #[cfg(feature = "nlms_demo")]
+    let size = if NLMS_ARENA_BUDGET > others { NLMS_ARENA_BUDGET } else { others };
+    #[cfg(not(feature = "nlms_demo"))]
+    let size = others;
+    size
+};
+
+const fn largest_pair_sum(budgets: &[usize]) -> usize {
+    let (mut first, mut second) = (0, 0);
+    let mut i = 0;
+    while i < budgets.len() {
+        if budgets[i] > first {
+            second = first;
+            first = budgets[i];
+        } else if budgets[i] > second {
+            second = budgets[i];
+        }
+        i += 1;
+    }
+    first + second
+}
+
+/// The demo apps linked into the image, selected by the demo features
+static ENTRIES: &[RegistryEntry] = &[
+    #[cfg(feature = "nlms_demo")]
+    entry::<crate::NlmsDemoApp>(b"nlms\0", NLMS_ARENA_BUDGET),
+    #[cfg(feature = "sfnov_demo")]
+    entry::<crate::SfnovDemoApp>(b"sfnov\0", SFNOV_ARENA_BUDGET),
+    #[cfg(feature = "mpm_demo")]
+    entry::<crate::MpmDemoApp>(b"mpm\0", MPM_ARENA_BUDGET),
+    #[cfg(feature = "goertzel_demo")]
+    entry::<crate::GoertzelDemoApp>(b"goertzel\0", GOERTZEL_ARENA_BUDGET),
+    #[cfg(feature = "graph_reference")]
+    entry::<crate::mpm_demo::HandWrittenMpmDemoApp>(b"mpm_reference\0", MPM_ARENA_BUDGET),
+];
+
+/// The app living in each arena region, null if the region is free
+static REGION_APPS: [AtomicPtr<c_void>; 2] = [AtomicPtr::new(null_mut()), AtomicPtr::new(null_mut())];
+const REGIONS: [ArenaRegion; 2] = [ArenaRegion::Low, ArenaRegion::High];
+
+fn find_entry(vtable: *const DemoAppVtable) -> Option<&'static RegistryEntry> {
+    ENTRIES.iter().find(|entry| core::ptr::eq(&entry.vtable, vtable))
+}
+
+#[no_mangle]
+pub extern "C" fn demo_registry_abi_version() -> u32 {
+    DEMO_APP_ABI_VERSION
+}
+
+#[no_mangle]
+pub extern "C" fn demo_registry_count() -> u32 {
+    ENTRIES.len() as u32
+}
+
+#[no_mangle]
+pub extern "C" fn demo_registry_get(index: u32) -> *const DemoAppVtable {
+    match ENTRIES.get(index as usize) {
+        Some(entry) => &entry.vtable,
+        None => null(),
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn demo_registry_find(name: *const c_char) -> *const DemoAppVtable {
+    let name = unsafe { CStr::from_ptr(name) };
+    match ENTRIES.iter().find(|entry| unsafe { CStr::from_ptr(entry.vtable.name) } == name) {
+        Some(entry) => &entry.vtable,
+        None => null(),
+    }
+}
+
+/// Creates an app in a free region of the arena. Returns null if both
+/// regions are taken, the free part of the arena is smaller than the
+/// app's budget or the app took more than its budget. Must not be called
+/// from more than one thread at a time.
+#[no_mangle]
+pub extern "C" fn demo_registry_create(vtable: *const DemoAppVtable, sample_rate: f32) -> *mut c_void {
+    let entry = match find_entry(vtable) {
+        Some(entry) => entry,
+        None => return null_mut(),
+    };
+    // Checked up front, since running out of memory halfway through
+    // creating the app is fatal
+    let budget = entry.vtable.arena_budget as usize;
+    if budget > ARENA_SIZE || ALLOCATOR.free() < budget {
+        return null_mut();
+    }
+    let region = match REGIONS.iter().find(|&&region| ALLOCATOR.claim(region)) {
+        Some(&region) => region,
+        None => return null_mut(),
+    };
+    let demo_app = (entry.create)(sample_rate);
+    // All memory the app needs should have been allocated by now
+    ALLOCATOR.lock(region);
+    // An app over budget could leave too little room for the next one to
+    // be created next to it, so it is not used at all
+    if ALLOCATOR.region_used(region) > budget {
+        unsafe { (entry.destroy)(demo_app) };
+        ALLOCATOR.release(region);
+        return null_mut();
+    }
+    REGION_APPS[region as usize].store(demo_app, Ordering::SeqCst);
+    demo_app
+}
+
+/// Destroys an app made by demo_registry_create and frees its region.
+/// The app must no longer be in use by any thread.
+#[no_mangle]
+pub extern "C" fn demo_registry_destroy(vtable: *const DemoAppVtable, demo_app_ptr: *mut c_void) {
+    let entry = match find_entry(vtable) {
+        Some(entry) => entry,
+        None => return,
+    };
+    let region = match REGIONS
+        .iter()
+        .find(|&&region| REGION_APPS[region as usize].load(Ordering::SeqCst) == demo_app_ptr)
+    {
+        Some(&region) => region,
+        None => return,
+    };
+    unsafe { (entry.destroy)(demo_app_ptr) };
+    REGION_APPS[region as usize].store(null_mut(), Ordering::SeqCst);
+    ALLOCATOR.release(region);
+}
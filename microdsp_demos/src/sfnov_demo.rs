@@ -1,62 +1,172 @@
-use alloc::vec::Vec;
-use microdsp::{
-    common::WindowFunctionType,
-    sfnov::{HardKneeCompression, SpectralFluxNoveltyDetector},
+use crate::{
+    history::HistoryRing,
+    multirate::ResampledStream,
+    novelty::{locate_energy_onset, SpectralFluxDetector},
+    static_storage::StorageBox,
+    AppEvent, AppMessage, DemoApp, EventQueue, LoadLevel, ParamInfo, MAX_BLOCK_SIZE,
 };
 
-use crate::{AppMessage, DemoApp};
-
 const DOWNSAMPLING: usize = 4;
+// Anti-alias filter length at the input rate, 8 multiply-adds per input sample
+const DOWNSAMPLING_FILTER_TAPS: usize = 32;
 const WINDOW_SIZE: usize = 256 / DOWNSAMPLING;
+// With the sfnov_low_latency feature, frames overlap by 3/4, so onsets
+// are detected about 1.5 ms after they occur instead of about 3.5 ms,
+// for four times the FFTs.
+#[cfg(not(feature = "sfnov_low_latency"))]
 const HOP_SIZE: usize = WINDOW_SIZE;
-const DETECTION_THRESHOLD: f32 = 0.005;
+#[cfg(feature = "sfnov_low_latency")]
+const HOP_SIZE: usize = WINDOW_SIZE / 4;
+// Frames analysed under load, one in every REDUCED_FRAME_STRIDE hops at
+// LoadLevel::Reduced and one per window at LoadLevel::Minimal, i.e
+// without overlap. Has no effect without sfnov_low_latency.
+const REDUCED_FRAME_STRIDE: usize = 2;
+// A frame is an onset if its novelty exceeds DETECTION_THRESHOLD plus
+// ADAPTIVE_THRESHOLD_GAIN times the average novelty of the last
+// NOVELTY_AVERAGING_TIME seconds, which suppresses detections caused by
+// fluctuations of loud, noisy sounds
+const DETECTION_THRESHOLD: f32 = 0.5;
+const ADAPTIVE_THRESHOLD_GAIN: f32 = 2.0;
+const NOVELTY_AVERAGING_TIME: f32 = 0.05;
+// Indices of the values passed to set_params
+const PARAM_DETECTION_THRESHOLD: usize = 0;
+const PARAM_ADAPTIVE_THRESHOLD_GAIN: usize = 1;
+// Onsets closer than this to the previous one are ignored, so that the
+// novelty fluctuations of a noisy sound do not retrigger its onset
+const MIN_ONSET_INTERVAL: f32 = 0.05;
 const OUT_MSG_BUFFER_SIZE: usize = 16;
+// Onsets are located to the sample within the input of the last frame and
+// hop, by looking for the largest increase in energy over this many samples
+const ONSET_ENERGY_WINDOW: usize = 32;
+const ONSET_SEARCH_SPAN: usize = (WINDOW_SIZE + HOP_SIZE) * DOWNSAMPLING + ONSET_ENERGY_WINDOW;
+// Frames end up to the filter delay before the newest input
+const RX_HISTORY_SIZE: usize = ONSET_SEARCH_SPAN + MAX_BLOCK_SIZE + DOWNSAMPLING_FILTER_TAPS;
 
 pub struct SfnovDemoApp {
-    detector: SpectralFluxNoveltyDetector<HardKneeCompression>,
+    decimated: ResampledStream,
+    detector: SpectralFluxDetector,
+    /// Recent input, for locating onsets
+    rx_history: StorageBox<HistoryRing<RX_HISTORY_SIZE>>,
+    /// Exponential moving average of the novelty
+    novelty_average: f32,
+    novelty_smoothing: f32,
+    detection_threshold: f32,
+    adaptive_threshold_gain: f32,
+    /// Hops since the last analysed frame
+    skipped_hops: usize,
     should_trigger: bool,
-    out_msg_buffer: Vec<AppMessage>,
+    /// Input samples since the last onset, saturating
+    samples_since_onset: usize,
+    min_onset_interval: usize,
+    events: EventQueue<OUT_MSG_BUFFER_SIZE>,
+    /// Timestamp of the next detector result, i.e the end of its frame
+    next_result_time: u32,
     led_state: bool,
 }
 
 impl DemoApp for SfnovDemoApp {
-    fn new(_: f32) -> Self {
-        let comp_func = HardKneeCompression::from_options(0.05, 0.9);
+    fn new(sample_rate: f32) -> Self {
+        let decimated = ResampledStream::decimated(DOWNSAMPLING, DOWNSAMPLING_FILTER_TAPS, MAX_BLOCK_SIZE);
+        // Results are timestamped at the end of their frame, which the
+        // filter delays
+        let first_result_time = HOP_SIZE * DOWNSAMPLING - decimated.resampler().delay();
         SfnovDemoApp {
-            detector: SpectralFluxNoveltyDetector::from_options(
-                WindowFunctionType::Hann,
-                comp_func,
-                WINDOW_SIZE,
-                DOWNSAMPLING,
-                HOP_SIZE,
-            ),
+            decimated,
+            detector: SpectralFluxDetector::new(WINDOW_SIZE, HOP_SIZE),
+            rx_history: zeroed_storage!(SFNOV_RX_HISTORY: HistoryRing<RX_HISTORY_SIZE>),
+            novelty_average: 0.0,
+            novelty_smoothing: (HOP_SIZE * DOWNSAMPLING) as f32 / (NOVELTY_AVERAGING_TIME * sample_rate),
+            detection_threshold: DETECTION_THRESHOLD,
+            adaptive_threshold_gain: ADAPTIVE_THRESHOLD_GAIN,
+            skipped_hops: 0,
             should_trigger: true,
-            out_msg_buffer: Vec::with_capacity(OUT_MSG_BUFFER_SIZE),
+            // No onsets are reported before the first frame is complete
+            samples_since_onset: 0,
+            min_onset_interval: ((MIN_ONSET_INTERVAL * sample_rate) as usize).max(WINDOW_SIZE * DOWNSAMPLING),
+            events: EventQueue::new(),
+            next_result_time: first_result_time as u32,
             led_state: false,
         }
     }
     fn process(&mut self, rx: &[f32], _: &mut [f32]) {
+        assert!(rx.len() <= MAX_BLOCK_SIZE);
+        self.rx_history.push(rx);
+        let block_end_time = self.events.time().wrapping_add(rx.len() as u32);
+        let rx_history = &self.rx_history;
+        let novelty_average = &mut self.novelty_average;
+        let novelty_smoothing = self.novelty_smoothing;
+        let (detection_threshold, adaptive_threshold_gain) = (self.detection_threshold, self.adaptive_threshold_gain);
+        let skipped_hops = &mut self.skipped_hops;
         let should_trigger = &mut self.should_trigger;
-        let out_msg_buffer = &mut self.out_msg_buffer;
+        let samples_since_onset = &mut self.samples_since_onset;
+        let min_onset_interval = self.min_onset_interval;
+        let events = &mut self.events;
+        let next_result_time = &mut self.next_result_time;
+
+        self.detector.process(self.decimated.process(rx), |detector| {
+            let timestamp = *next_result_time;
+            *next_result_time = timestamp.wrapping_add((HOP_SIZE * DOWNSAMPLING) as u32);
+            *samples_since_onset = samples_since_onset.saturating_add(HOP_SIZE * DOWNSAMPLING);
+            if !detector.analysed() {
+                *skipped_hops += 1;
+                return;
+            }
+            // The average covers the same time with frames skipped
+            let smoothing = (novelty_smoothing * (*skipped_hops + 1) as f32).min(1.0);
+            *skipped_hops = 0;
+            let threshold = detection_threshold + adaptive_threshold_gain * *novelty_average;
+            *novelty_average += smoothing * (detector.novelty() - *novelty_average);
+            if detector.novelty() > threshold {
+                if *should_trigger && *samples_since_onset >= min_onset_interval {
+                    // The frame ends before the end of the block, which is
+                    // the newest sample in the history
+                    let frame_end_age = block_end_time.wrapping_sub(timestamp) as usize;
+                    let onset_index = locate_energy_onset(
+                        rx_history.get(frame_end_age + ONSET_SEARCH_SPAN, ONSET_SEARCH_SPAN),
+                        ONSET_ENERGY_WINDOW,
+                    );
+                    let onset_time = timestamp.wrapping_sub((ONSET_SEARCH_SPAN - onset_index) as u32);
 
-        self.detector.process(rx, |result| {
-            if result.novelty() > DETECTION_THRESHOLD {
-                if *should_trigger {
                     self.led_state = !self.led_state;
-                    out_msg_buffer.push(if self.led_state {
+                    let led_message = if self.led_state {
                         AppMessage::Led0On
                     } else {
                         AppMessage::Led0Off
-                    });
+                    };
+                    events.push_at(onset_time, led_message, 0.0);
+                    events.push_at(onset_time, AppMessage::NoveltyDetected, detector.novelty());
                     *should_trigger = false;
+                    *samples_since_onset = 0;
                 }
             } else {
                 *should_trigger = true;
             }
-        })
+        });
+        self.events.end_block(rx.len());
     }
+    // Analysis only, leave the output silent
+    const TX_CHANNEL_MASK: u8 = 0;
+
     fn handle_message(&mut self, _: crate::AppMessage) {}
-    fn next_outgoing_message(&mut self) -> Option<crate::AppMessage> {
-        self.out_msg_buffer.pop()
+    fn next_outgoing_event(&mut self) -> Option<AppEvent> {
+        self.events.pop()
+    }
+
+    fn set_load_level(&mut self, level: LoadLevel) {
+        self.detector.set_frame_stride(match level {
+            LoadLevel::Full => 1,
+            LoadLevel::Reduced => REDUCED_FRAME_STRIDE,
+            LoadLevel::Minimal => WINDOW_SIZE / HOP_SIZE,
+        });
+    }
+
+    const PARAMS: &'static [ParamInfo] = &[
+        ParamInfo::new(b"threshold\0", 0.0, 10.0, DETECTION_THRESHOLD),
+        ParamInfo::new(b"adaptive_gain\0", 0.0, 10.0, ADAPTIVE_THRESHOLD_GAIN),
+    ];
+
+    fn set_params(&mut self, values: &[f32]) {
+        self.detection_threshold = values[PARAM_DETECTION_THRESHOLD];
+        self.adaptive_threshold_gain = values[PARAM_ADAPTIVE_THRESHOLD_GAIN];
     }
 }
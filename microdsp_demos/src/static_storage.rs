@@ -0,0 +1,49 @@
+/// Types for which all zero bytes is a valid value, so that they can be
+/// initialized in place by zeroing memory.
+pub unsafe trait Zeroable {}
+
+unsafe impl<const N: usize> Zeroable for [f32; N] {}
+
+#[doc(hidden)]
+pub fn assert_zeroable<T: Zeroable>() {}
+
+/// Owner of storage returned by zeroed_storage!. A static with the
+/// static_app feature, otherwise a Box, which returns the memory to the
+/// arena when the app is dropped.
+#[cfg(feature = "static_app")]
+pub type StorageBox<T> = &'static mut T;
+#[cfg(not(feature = "static_app"))]
+pub type StorageBox<T> = alloc::boxed::Box<T>;
+
+/// Returns a zero initialized `StorageBox<$ty>`, without constructing the
+/// value on the stack. Used for large, fixed size app state.
+///
+/// With the static_app feature, the storage is a static named `$name`,
+/// so its size is known at link time and shows up in the linker map.
+/// Otherwise, it is allocated from the arena. Each expansion must only be
+/// evaluated once.
+macro_rules! zeroed_storage {
+    ($name:ident: $ty:ty) => {{
+        $crate::static_storage::assert_zeroable::<$ty>();
+        #[cfg(feature = "static_app")]
+        let storage: $crate::static_storage::StorageBox<$ty> = {
+            static mut $name: core::mem::MaybeUninit<$ty> = core::mem::MaybeUninit::uninit();
+            static TAKEN: core::sync::atomic::AtomicBool = core::sync::atomic::AtomicBool::new(false);
+            assert!(!TAKEN.swap(true, core::sync::atomic::Ordering::Relaxed));
+            // Taking the address of a static mut is only unsafe on older toolchains
+            #[allow(unused_unsafe)]
+            let ptr = unsafe { core::ptr::addr_of_mut!($name) as *mut $ty };
+            unsafe {
+                ptr.write_bytes(0, 1);
+                &mut *ptr
+            }
+        };
+        #[cfg(not(feature = "static_app"))]
+        let storage: $crate::static_storage::StorageBox<$ty> = {
+            let ptr = unsafe { alloc::alloc::alloc_zeroed(core::alloc::Layout::new::<$ty>()) as *mut $ty };
+            assert!(!ptr.is_null());
+            unsafe { alloc::boxed::Box::from_raw(ptr) }
+        };
+        storage
+    }};
+}
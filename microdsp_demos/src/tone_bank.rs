@@ -0,0 +1,172 @@
+use alloc::{vec, vec::Vec};
+
+use crate::fft::unit_phasor;
+
+/// Damped Goertzel resonator, i.e a complex one pole filter
+/// y[n] = r e^(iw) y[n - 1] + x[n], evaluated as a real two pole filter.
+/// Its output power is a sliding, exponentially windowed estimate of the
+/// power of the input at w.
+struct Resonator {
+    /// 2 r cos(w)
+    coefficient: f32,
+    r_cos: f32,
+    r_sin: f32,
+    s1: f32,
+    s2: f32,
+}
+
+impl Resonator {
+    fn output_power(&self) -> f32 {
+        let re = self.s1 - self.r_cos * self.s2;
+        let im = self.r_sin * self.s2;
+        re * re + im * im
+    }
+}
+
+/// Estimate for one target frequency
+#[derive(Clone, Copy, Default)]
+pub struct ToneEstimate {
+    /// Estimated frequency, interpolated between the bins of the target
+    pub frequency: f32,
+    /// Fraction of the input power in the strongest bin of the target,
+    /// close to 1 for a clean tone at the bin frequency
+    pub clarity: f32,
+}
+
+/// Bank of Goertzel resonators for detecting tones close to a set of known
+/// target frequencies, as a much cheaper alternative to a full pitch
+/// search. Each target is covered by bins_per_target bins, bin_spacing Hz
+/// apart and centered on the target.
+///
+/// The input is processed in hops of hop_size samples. Within a hop, the resonators are updated
+/// one at a time over all samples, so that their state stays in registers.
+/// Estimates are made at the end of each hop, so the hop size can be as
+/// small as a single sample.
+pub struct ToneBank {
+    targets: Vec<f32>,
+    bins_per_target: usize,
+    bin_spacing: f32,
+    /// r^2, also the decay of the input power estimate
+    decay: f32,
+    /// Scale from resonator output power relative to the input power to
+    /// the fraction of power in the bin, i.e 2 (1 - r) / (1 + r)
+    clarity_scale: f32,
+    resonators: Vec<Resonator>,
+    estimates: Vec<ToneEstimate>,
+    /// Exponentially windowed input power, with the same window as the
+    /// resonators
+    power: f32,
+    hop: Vec<f32>,
+    hop_pos: usize,
+}
+
+impl ToneBank {
+    /// bandwidth is the -3 dB bandwidth of each bin in Hz, which sets the
+    /// time constant of the estimates to about 1 / (pi * bandwidth).
+    pub fn new(
+        sample_rate: f32,
+        target_frequencies: &[f32],
+        bins_per_target: usize,
+        bin_spacing: f32,
+        bandwidth: f32,
+        hop_size: usize,
+    ) -> Self {
+        assert!(bins_per_target > 0 && hop_size > 0);
+        let r = 1.0 - core::f32::consts::PI * bandwidth / sample_rate;
+        let mut resonators = Vec::with_capacity(target_frequencies.len() * bins_per_target);
+        for target in target_frequencies {
+            for bin in 0..bins_per_target {
+                let offset = bin as f32 - 0.5 * (bins_per_target - 1) as f32;
+                let frequency = (target + offset * bin_spacing) as f64;
+                let phasor = unit_phasor(2.0 * core::f64::consts::PI * frequency / sample_rate as f64);
+                resonators.push(Resonator {
+                    coefficient: 2.0 * r * phasor.re,
+                    r_cos: r * phasor.re,
+                    r_sin: r * phasor.im,
+                    s1: 0.0,
+                    s2: 0.0,
+                });
+            }
+        }
+        ToneBank {
+            targets: target_frequencies.to_vec(),
+            bins_per_target,
+            bin_spacing,
+            decay: r * r,
+            clarity_scale: 2.0 * (1.0 - r) / (1.0 + r),
+            resonators,
+            estimates: vec![ToneEstimate::default(); target_frequencies.len()],
+            power: 0.0,
+            hop: vec![0.0; hop_size],
+            hop_pos: 0,
+        }
+    }
+
+    /// Exponentially windowed mean square of the input
+    pub fn power(&self) -> f32 {
+        self.power * (1.0 - self.decay)
+    }
+
+    /// Calls result_handler with one estimate per target at the end of
+    /// each hop
+    pub fn process<F: FnMut(&[ToneEstimate], f32)>(&mut self, buffer: &[f32], mut result_handler: F) {
+        for x in buffer {
+            self.hop[self.hop_pos] = *x;
+            self.hop_pos += 1;
+            if self.hop_pos == self.hop.len() {
+                self.hop_pos = 0;
+                self.process_hop();
+                result_handler(&self.estimates, self.power());
+            }
+        }
+    }
+
+    fn process_hop(&mut self) {
+        let r_squared = self.decay;
+        for x in self.hop.iter() {
+            self.power = r_squared * self.power + x * x;
+        }
+        for resonator in self.resonators.iter_mut() {
+            let (mut s1, mut s2) = (resonator.s1, resonator.s2);
+            for x in self.hop.iter() {
+                let s = *x + resonator.coefficient * s1 - r_squared * s2;
+                s2 = s1;
+                s1 = s;
+            }
+            resonator.s1 = s1;
+            resonator.s2 = s2;
+        }
+
+        let bin_count = self.bins_per_target;
+        let clarity_scale = self.clarity_scale / self.power.max(1e-20);
+        let bins = self.resonators.chunks_exact(bin_count);
+        for ((target, frequency), estimate) in bins.zip(&self.targets).zip(self.estimates.iter_mut()) {
+            let mut peak_bin = 0;
+            let mut peak = 0.0;
+            for (bin, resonator) in target.iter().enumerate() {
+                let power = resonator.output_power();
+                if power > peak {
+                    peak = power;
+                    peak_bin = bin;
+                }
+            }
+            // The steady state response of a resonator to a tone is
+            // Lorentzian, so the inverse bin power is a parabola in the
+            // frequency of the tone, with its minimum at that frequency
+            let mut position = peak_bin as f32;
+            if bin_count >= 3 && peak > 0.0 {
+                let center = peak_bin.clamp(1, bin_count - 2);
+                let a = 1.0 / target[center - 1].output_power().max(1e-30);
+                let b = 1.0 / target[center].output_power().max(1e-30);
+                let c = 1.0 / target[center + 1].output_power().max(1e-30);
+                let denominator = a - 2.0 * b + c;
+                if denominator > 0.0 {
+                    position = center as f32 + (0.5 * (a - c) / denominator).clamp(-2.0, 2.0);
+                }
+            }
+            let center_offset = position - 0.5 * (bin_count - 1) as f32;
+            estimate.frequency = frequency + center_offset * self.bin_spacing;
+            estimate.clarity = peak * clarity_scale;
+        }
+    }
+}
@@ -1,18 +1,59 @@
 #ifndef AUDIO_CALLBACKS_H
 #define AUDIO_CALLBACKS_H
 
+#include <stdint.h>
+
+#define AUDIO_MAX_CHANNELS 2
+#define AUDIO_CHANNEL_LEFT (1 << 0)
+#define AUDIO_CHANNEL_RIGHT (1 << 1)
+
+/* Processes planar float audio. rx[c] and tx[c] point to frame_count
+   samples of channel c if c is set in the rx/tx channel mask of
+   audio_callbacks_t, and are NULL otherwise. tx channels are zeroed
+   before the call. */
 typedef void (*audio_processing_callback_t)(
   void* cb_data,
-  unsigned int sample_count,
-  float* tx,
-  const float* rx
+  unsigned int frame_count,
+  float* const* tx,
+  const float* const* rx
+);
+
+/* Processes interleaved stereo PCM directly in the I2S DMA buffers,
+   without any conversion or copying. Samples are 24 bit, sign extended
+   to 32 bits (Q23). tx holds the previously rendered block and all
+   2 * frame_count samples must be written. */
+typedef void (*audio_processing_i32_callback_t)(
+  void* cb_data,
+  unsigned int frame_count,
+  int32_t* tx,
+  const int32_t* rx
 );
+
 typedef void (*audio_dropout_callback_t)(void* cb_data);
 
+/* Reports the time taken by a block, from the interrupt that released it
+   until it was processed, and the time available for it, i.e until the
+   I2S driver needs it back. Both are in hardware cycles. */
+typedef void (*audio_load_callback_t)(
+  void* cb_data,
+  uint32_t busy_cycles,
+  uint32_t deadline_cycles
+);
+
 typedef struct {
+  /* Exactly one of processing_cb and processing_i32_cb should be set. */
   audio_processing_callback_t processing_cb;
+  audio_processing_i32_callback_t processing_i32_cb;
+  /* Channels passed to processing_cb. Channels not in rx_channel_mask are
+     never converted. If tx_channel_mask has a single channel, it is written
+     to both outputs. If it is 0, silence is output without any conversion. */
+  uint8_t rx_channel_mask;
+  uint8_t tx_channel_mask;
   audio_dropout_callback_t dropout_cb;
+  /* Optional, called after each processed block, except the first which
+     has no period measurement yet */
+  audio_load_callback_t load_cb;
   void* cb_data;
 } audio_callbacks_t;
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,140 @@
+#include "audio_stats.h"
+#include "seqlock.h"
+
+#include <zephyr/zephyr.h>
+#include <string.h>
+
+static audio_stats_t stats = { .min_headroom_ns = INT32_MAX };
+static seqlock_t stats_lock = SEQLOCK_INIT;
+static atomic_t reset_requested = ATOMIC_INIT(0);
+
+static void begin_update(void)
+{
+    seqlock_write_begin(&stats_lock);
+    if (atomic_clear(&reset_requested)) {
+        memset(&stats, 0, sizeof(stats));
+        stats.min_headroom_ns = INT32_MAX;
+    }
+}
+
+static void end_update(void)
+{
+    seqlock_write_end(&stats_lock);
+}
+
+static int latency_bin(uint32_t ns)
+{
+    uint32_t us = ns / 1000;
+    int bin = 0;
+    while (us > 0 && bin < AUDIO_STATS_LATENCY_BIN_COUNT - 1) {
+        us >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+static int load_bin(uint32_t processing_cycles, uint32_t period_cycles)
+{
+    if (period_cycles == 0) {
+        return 0;
+    }
+    uint32_t bin = (uint32_t)(((uint64_t)processing_cycles * 10) / period_cycles);
+    return bin < AUDIO_STATS_LOAD_BIN_COUNT - 1 ? bin : AUDIO_STATS_LOAD_BIN_COUNT - 1;
+}
+
+void audio_stats_record_block(
+    uint32_t wakeup_latency_cycles,
+    uint32_t processing_cycles,
+    uint32_t period_cycles,
+    uint32_t deadline_cycles
+)
+{
+    uint32_t latency_ns = k_cyc_to_ns_ceil32(wakeup_latency_cycles);
+    uint32_t processing_ns = k_cyc_to_ns_ceil32(processing_cycles);
+    uint32_t period_ns = k_cyc_to_ns_floor32(period_cycles);
+    uint32_t deadline_ns = k_cyc_to_ns_floor32(deadline_cycles);
+    int32_t headroom_ns = (int32_t)deadline_ns - (int32_t)latency_ns - (int32_t)processing_ns;
+
+    begin_update();
+    stats.block_count++;
+    stats.wakeup_latency_hist[latency_bin(latency_ns)]++;
+    stats.processing_time_hist[load_bin(processing_cycles, period_cycles)]++;
+    if (latency_ns > stats.wakeup_latency_max_ns) {
+        stats.wakeup_latency_max_ns = latency_ns;
+    }
+    if (processing_ns > stats.processing_time_max_ns) {
+        stats.processing_time_max_ns = processing_ns;
+    }
+    /* The first block has no period measurement yet */
+    if (period_cycles > 0 && headroom_ns < stats.min_headroom_ns) {
+        stats.min_headroom_ns = headroom_ns;
+    }
+    stats.period_ns = period_ns;
+    end_update();
+}
+
+void audio_stats_record_dropout(void)
+{
+    begin_update();
+    stats.dropout_count++;
+    end_update();
+}
+
+void audio_stats_snapshot(audio_stats_t* result)
+{
+    seqlock_read(&stats_lock, result, &stats, sizeof(stats));
+}
+
+void audio_stats_request_reset(void)
+{
+    atomic_set(&reset_requested, 1);
+}
+
+void audio_stats_print(const audio_stats_t* stats)
+{
+    printk("audio stats: %u blocks, %u dropouts, period %u ns\n",
+        stats->block_count, stats->dropout_count, stats->period_ns);
+    printk("  wakeup latency (max %u ns)\n", stats->wakeup_latency_max_ns);
+    for (int i = 0; i < AUDIO_STATS_LATENCY_BIN_COUNT; i++) {
+        if (stats->wakeup_latency_hist[i] > 0) {
+            printk("    < %6u us: %u\n", 1u << i, stats->wakeup_latency_hist[i]);
+        }
+    }
+    printk("  processing time (max %u ns)\n", stats->processing_time_max_ns);
+    for (int i = 0; i < AUDIO_STATS_LOAD_BIN_COUNT; i++) {
+        if (stats->processing_time_hist[i] > 0) {
+            if (i == AUDIO_STATS_LOAD_BIN_COUNT - 1) {
+                printk("    >= 100%% of period: %u\n", stats->processing_time_hist[i]);
+            } else {
+                printk("    < %3d%% of period: %u\n", 10 * (i + 1), stats->processing_time_hist[i]);
+            }
+        }
+    }
+    if (stats->min_headroom_ns != INT32_MAX) {
+        printk("  min headroom %d ns\n", stats->min_headroom_ns);
+    }
+}
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+
+static int cmd_audio_stats(const struct shell *sh, size_t argc, char **argv)
+{
+    audio_stats_t snapshot;
+    audio_stats_snapshot(&snapshot);
+    audio_stats_print(&snapshot);
+    return 0;
+}
+
+static int cmd_audio_stats_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    audio_stats_request_reset();
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(audio_stats_cmds,
+    SHELL_CMD(reset, NULL, "Clear audio stats", cmd_audio_stats_reset),
+    SHELL_SUBCMD_SET_END
+);
+SHELL_CMD_REGISTER(audio_stats, &audio_stats_cmds, "Print audio thread timing stats", cmd_audio_stats);
+#endif
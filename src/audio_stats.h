@@ -0,0 +1,60 @@
+#ifndef AUDIO_STATS_H
+#define AUDIO_STATS_H
+
+#include <stdint.h>
+
+/* Always-on timing instrumentation for the audio processing thread.
+   The audio thread is the only writer. Other threads read consistent
+   snapshots without taking any locks. */
+
+/* Wakeup latency bin i counts latencies in [2^(i - 1), 2^i) us.
+   Bin 0 counts latencies below 1 us, the last bin is open ended. */
+#define AUDIO_STATS_LATENCY_BIN_COUNT 12
+/* Processing time bin i counts blocks processed in
+   [10 * i, 10 * (i + 1)) % of the buffer period. The last bin
+   counts blocks that took a full period or more. */
+#define AUDIO_STATS_LOAD_BIN_COUNT 11
+
+typedef struct {
+    /* Number of processed blocks */
+    uint32_t block_count;
+    /* Number of missed buffer swaps */
+    uint32_t dropout_count;
+    /* Time from the I2S interrupt to the processing thread waking up */
+    uint32_t wakeup_latency_hist[AUDIO_STATS_LATENCY_BIN_COUNT];
+    uint32_t wakeup_latency_max_ns;
+    /* Time spent converting and processing a block */
+    uint32_t processing_time_hist[AUDIO_STATS_LOAD_BIN_COUNT];
+    uint32_t processing_time_max_ns;
+    /* Smallest margin between finishing a block and the
+       NRFX_I2S_STATUS_NEXT_BUFFERS_NEEDED event at which it is
+       needed. Negative if late. */
+    int32_t min_headroom_ns;
+    /* Most recently measured buffer period */
+    uint32_t period_ns;
+} audio_stats_t;
+
+/* Called from the audio thread once per processed block. All arguments
+   are in hardware cycles as returned by k_cycle_get_32. deadline_cycles
+   is the time from the interrupt that released the block until the
+   processed block must be handed back to the I2S driver. */
+void audio_stats_record_block(
+    uint32_t wakeup_latency_cycles,
+    uint32_t processing_cycles,
+    uint32_t period_cycles,
+    uint32_t deadline_cycles
+);
+
+/* Called from the audio thread when a dropout has been detected. */
+void audio_stats_record_dropout(void);
+
+/* Copies a consistent snapshot of the stats. Safe to call from any thread
+   with lower priority than the audio thread. */
+void audio_stats_snapshot(audio_stats_t* result);
+
+/* Asks the audio thread to clear the stats before recording the next block. */
+void audio_stats_request_reset(void);
+
+void audio_stats_print(const audio_stats_t* stats);
+
+#endif
@@ -0,0 +1,156 @@
+#include "audio_tap.h"
+
+#include <zephyr/zephyr.h>
+
+BUILD_ASSERT((AUDIO_TAP_MAX_SLOTS & (AUDIO_TAP_MAX_SLOTS - 1)) == 0, "AUDIO_TAP_MAX_SLOTS must be a power of two");
+BUILD_ASSERT(AUDIO_TAP_SOURCE_COUNT <= 8, "Sources must fit in the source byte");
+
+static void put_u16(uint8_t* dst, uint16_t value)
+{
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* dst, uint32_t value)
+{
+    put_u16(dst, (uint16_t)value);
+    put_u16(dst + 2, (uint16_t)(value >> 16));
+}
+
+/* Rounds to nearest, saturating. NaN maps to 0. */
+static inline int16_t sample_to_s16(float sample)
+{
+    float scaled = sample * 32768.0f;
+    if (scaled >= 32767.0f) {
+        return INT16_MAX;
+    }
+    if (scaled > -32768.0f) {
+        return (int16_t)(scaled + (scaled >= 0.0f ? 0.5f : -0.5f));
+    }
+    return scaled <= -32768.0f ? INT16_MIN : 0;
+}
+
+bool audio_tap_init(audio_tap_t* tap, unsigned int frames_per_block, uint32_t sample_rate)
+{
+    uint32_t slot_size = AUDIO_TAP_FRAME_SIZE(frames_per_block);
+    /* Frame sizes are stored in 16 bits */
+    if (frames_per_block == 0 || slot_size > UINT16_MAX) {
+        return false;
+    }
+    uint32_t slot_count = AUDIO_TAP_MAX_SLOTS;
+    while (slot_count * slot_size > AUDIO_TAP_POOL_SIZE) {
+        slot_count >>= 1;
+    }
+    if (slot_count < 2) {
+        return false;
+    }
+    tap->frames_per_block = frames_per_block;
+    tap->slot_count = slot_count;
+    tap->slot_size = slot_size;
+    tap->sample_rate = sample_rate;
+    tap->sequence = 0;
+    atomic_set(&tap->source_mask, 0);
+    atomic_set(&tap->push_count, 0);
+    atomic_set(&tap->pop_count, 0);
+    atomic_set(&tap->dropped_count, 0);
+    atomic_set(&tap->dropped_frame_count, 0);
+    atomic_set(&tap->max_depth, 0);
+    atomic_set(&tap->sent_byte_count, 0);
+    return true;
+}
+
+void audio_tap_set_sources(audio_tap_t* tap, uint32_t source_mask)
+{
+    atomic_set(&tap->source_mask, (atomic_val_t)source_mask);
+}
+
+bool audio_tap_push(audio_tap_t* tap, audio_tap_source_t source, const float* samples, unsigned int frame_count, uint32_t timestamp)
+{
+    if (!audio_tap_enabled(tap, source) || samples == NULL || frame_count == 0) {
+        return false;
+    }
+    __ASSERT(frame_count <= tap->frames_per_block, "Unexpected block size %u", frame_count);
+    /* Gaps in the sequence numbers tell the host that frames were lost */
+    uint16_t sequence = tap->sequence++;
+    uint32_t push_count = (uint32_t)atomic_get(&tap->push_count);
+    uint32_t pop_count = (uint32_t)atomic_get(&tap->pop_count);
+    uint32_t depth = push_count - pop_count;
+    if (depth > (uint32_t)atomic_get(&tap->max_depth)) {
+        atomic_set(&tap->max_depth, (atomic_val_t)depth);
+    }
+    if (depth == tap->slot_count) {
+        atomic_inc(&tap->dropped_count);
+        atomic_add(&tap->dropped_frame_count, (atomic_val_t)frame_count);
+        return false;
+    }
+
+    uint32_t slot = push_count & (tap->slot_count - 1);
+    uint8_t* frame = &tap->pool[slot * tap->slot_size];
+    put_u16(&frame[0], AUDIO_TAP_SYNC);
+    frame[2] = (uint8_t)source;
+    frame[3] = AUDIO_TAP_FORMAT_S16;
+    put_u16(&frame[4], sequence);
+    put_u16(&frame[6], (uint16_t)frame_count);
+    put_u32(&frame[8], timestamp);
+    put_u32(&frame[12], tap->sample_rate);
+    uint8_t* payload = &frame[AUDIO_TAP_HEADER_SIZE];
+    for (unsigned int i = 0; i < frame_count; i++) {
+        put_u16(&payload[2 * i], (uint16_t)sample_to_s16(samples[i]));
+    }
+    /* The CRC is left to the consumer, off the audio thread */
+    tap->frame_sizes[slot] = (uint16_t)AUDIO_TAP_FRAME_SIZE(frame_count);
+    /* atomic_set is a full barrier, so the frame is written before it is published */
+    atomic_set(&tap->push_count, (atomic_val_t)(push_count + 1));
+    return true;
+}
+
+size_t audio_tap_peek(audio_tap_t* tap, const uint8_t** frame)
+{
+    uint32_t pop_count = (uint32_t)atomic_get(&tap->pop_count);
+    uint32_t push_count = (uint32_t)atomic_get(&tap->push_count);
+    if (push_count == pop_count) {
+        return 0;
+    }
+    uint32_t slot = pop_count & (tap->slot_count - 1);
+    uint8_t* slot_frame = &tap->pool[slot * tap->slot_size];
+    size_t size = tap->frame_sizes[slot];
+    size_t crc_offset = size - AUDIO_TAP_CRC_SIZE;
+    put_u16(&slot_frame[crc_offset], audio_tap_crc16(&slot_frame[2], crc_offset - 2));
+    *frame = slot_frame;
+    return size;
+}
+
+void audio_tap_release(audio_tap_t* tap)
+{
+    uint32_t pop_count = (uint32_t)atomic_get(&tap->pop_count);
+    __ASSERT(pop_count != (uint32_t)atomic_get(&tap->push_count), "Released a frame from an empty tap");
+    uint32_t slot = pop_count & (tap->slot_count - 1);
+    atomic_add(&tap->sent_byte_count, (atomic_val_t)tap->frame_sizes[slot]);
+    /* Publishes the free slot only after the transport is done with it */
+    atomic_set(&tap->pop_count, (atomic_val_t)(pop_count + 1));
+}
+
+void audio_tap_stats(audio_tap_t* tap, audio_tap_stats_t* stats)
+{
+    stats->pushed_count = (uint32_t)atomic_get(&tap->push_count);
+    stats->dropped_count = (uint32_t)atomic_get(&tap->dropped_count);
+    stats->dropped_frame_count = (uint32_t)atomic_get(&tap->dropped_frame_count);
+    stats->max_depth = (uint32_t)atomic_get(&tap->max_depth);
+    stats->sent_count = (uint32_t)atomic_get(&tap->pop_count);
+    stats->sent_byte_count = (uint32_t)atomic_get(&tap->sent_byte_count);
+}
+
+uint16_t audio_tap_crc16(const uint8_t* data, size_t size)
+{
+    /* Nibble table for polynomial 0x1021 */
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+        0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    };
+    uint16_t crc = 0xffff;
+    for (size_t i = 0; i < size; i++) {
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)]);
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] & 0x0f)]);
+    }
+    return crc;
+}
@@ -0,0 +1,126 @@
+#ifndef AUDIO_TAP_H
+#define AUDIO_TAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/sys/atomic.h>
+
+/* Debug tap that streams selected audio signals to a host. The thread
+   running the demo app pushes blocks of the enabled sources, which are
+   converted to 16 bit PCM and framed in a lock-free single producer,
+   single consumer ring. A low priority thread drains the frames to a byte
+   transport, e.g a UART. The producer never blocks. If the ring is full,
+   the block is dropped and counted.
+
+   Frame format, all fields little endian:
+
+     offset  size
+     0       2     sync word AUDIO_TAP_SYNC
+     2       1     source, an audio_tap_source_t
+     3       1     sample format, AUDIO_TAP_FORMAT_S16
+     4       2     sequence number, incremented for every block offered
+                   to the tap, including dropped ones
+     6       2     frame count
+     8       4     timestamp, index of the first frame in the stream
+     12      4     sample rate in Hz, rounded
+     16      2n    frame count samples
+     16+2n   2     CRC-16/CCITT-FALSE of bytes 2 to 16+2n
+
+   host/audio_tap_receive.py parses the stream and writes a WAV file per
+   source. */
+
+#define AUDIO_TAP_SYNC 0xa55a
+#define AUDIO_TAP_FORMAT_S16 1
+#define AUDIO_TAP_HEADER_SIZE 16
+#define AUDIO_TAP_CRC_SIZE 2
+#define AUDIO_TAP_FRAME_SIZE(frame_count) (AUDIO_TAP_HEADER_SIZE + 2 * (frame_count) + AUDIO_TAP_CRC_SIZE)
+
+/* All slots are taken from a statically allocated pool, i.e the number
+   of slots is the largest power of two such that
+   slot_count * AUDIO_TAP_FRAME_SIZE(frames_per_block) fits in this. */
+#ifndef AUDIO_TAP_POOL_SIZE
+#define AUDIO_TAP_POOL_SIZE (4 * AUDIO_TAP_FRAME_SIZE(256))
+#endif
+/* Must be a power of two */
+#define AUDIO_TAP_MAX_SLOTS 16
+
+typedef enum {
+    AUDIO_TAP_RX_LEFT = 0,
+    AUDIO_TAP_RX_RIGHT = 1,
+    AUDIO_TAP_TX_LEFT = 2,
+    AUDIO_TAP_TX_RIGHT = 3,
+    /* The demo app's tap signal, see demo_app_tap_signal */
+    AUDIO_TAP_APP = 4,
+    AUDIO_TAP_SOURCE_COUNT
+} audio_tap_source_t;
+
+#define AUDIO_TAP_SOURCE_BIT(source) (1u << (source))
+
+typedef struct {
+    /* Number of blocks framed and dropped because the ring was full */
+    uint32_t pushed_count;
+    uint32_t dropped_count;
+    uint32_t dropped_frame_count;
+    /* Largest number of frames waiting at the time of a push */
+    uint32_t max_depth;
+    /* Frames and bytes handed to the transport */
+    uint32_t sent_count;
+    uint32_t sent_byte_count;
+} audio_tap_stats_t;
+
+typedef struct {
+    uint8_t pool[AUDIO_TAP_POOL_SIZE];
+    uint16_t frame_sizes[AUDIO_TAP_MAX_SLOTS];
+    unsigned int frames_per_block;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint32_t sample_rate;
+    /* Enabled sources, a mask of AUDIO_TAP_SOURCE_BIT. May be changed from
+       any thread. */
+    atomic_t source_mask;
+    /* Only used by the producer */
+    uint16_t sequence;
+    /* Free running counts of pushed and popped frames. Each is only
+       written by one side. */
+    atomic_t push_count;
+    atomic_t pop_count;
+    /* Only written by the producer */
+    atomic_t dropped_count;
+    atomic_t dropped_frame_count;
+    atomic_t max_depth;
+    /* Only written by the consumer */
+    atomic_t sent_byte_count;
+} audio_tap_t;
+
+/* Sets up the tap for blocks of at most frames_per_block frames, with no
+   sources enabled. Returns false if not even two frames fit in the pool. */
+bool audio_tap_init(audio_tap_t* tap, unsigned int frames_per_block, uint32_t sample_rate);
+
+/* Enables the sources in source_mask and disables the others */
+void audio_tap_set_sources(audio_tap_t* tap, uint32_t source_mask);
+
+static inline bool audio_tap_enabled(audio_tap_t* tap, audio_tap_source_t source)
+{
+    return (atomic_get(&tap->source_mask) & AUDIO_TAP_SOURCE_BIT(source)) != 0;
+}
+
+/* Producer side. Frames frame_count samples of source, if the source is
+   enabled. Returns true if a frame was queued, false if the source is
+   disabled or the block was dropped. */
+bool audio_tap_push(audio_tap_t* tap, audio_tap_source_t source, const float* samples, unsigned int frame_count, uint32_t timestamp);
+
+/* Consumer side. Points frame at the oldest frame, fills in its CRC and
+   returns its size, or returns 0 if the ring is empty. The frame stays
+   valid until it is released with audio_tap_release. */
+size_t audio_tap_peek(audio_tap_t* tap, const uint8_t** frame);
+void audio_tap_release(audio_tap_t* tap);
+
+/* Safe to call from any context. The counts may be from slightly
+   different points in time. */
+void audio_tap_stats(audio_tap_t* tap, audio_tap_stats_t* stats);
+
+/* CRC-16/CCITT-FALSE, as used in the frames */
+uint16_t audio_tap_crc16(const uint8_t* data, size_t size);
+
+#endif
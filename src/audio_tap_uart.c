@@ -0,0 +1,95 @@
+#include "audio_tap_uart.h"
+
+#include <zephyr/zephyr.h>
+#include <zephyr/drivers/uart.h>
+
+#define AUDIO_TAP_UART_NODE DT_ALIAS(audio_tap_uart)
+
+#if DT_NODE_HAS_STATUS(AUDIO_TAP_UART_NODE, okay)
+
+#define AUDIO_TAP_THREAD_STACK_SIZE 1024
+#define AUDIO_TAP_THREAD_PRIORITY K_LOWEST_APPLICATION_THREAD_PRIO
+K_THREAD_STACK_DEFINE(audio_tap_thread_stack_area, AUDIO_TAP_THREAD_STACK_SIZE);
+static struct k_thread audio_tap_thread_data;
+/* Given by the producer when frames have been queued */
+K_SEM_DEFINE(audio_tap_semaphore, 0, 1);
+
+static const struct device *const tap_uart = DEVICE_DT_GET(AUDIO_TAP_UART_NODE);
+
+#ifdef CONFIG_UART_ASYNC_API
+static bool async_tx = false;
+K_SEM_DEFINE(tx_done_semaphore, 0, 1);
+
+static void uart_callback(const struct device *dev, struct uart_event *evt, void *user_data)
+{
+    if (evt->type == UART_TX_DONE || evt->type == UART_TX_ABORTED) {
+        k_sem_give(&tx_done_semaphore);
+    }
+}
+#endif
+
+static void write_frame(const uint8_t *data, size_t size)
+{
+#ifdef CONFIG_UART_ASYNC_API
+    /* DMA straight from the ring slot, which stays taken until done */
+    if (async_tx && uart_tx(tap_uart, data, size, SYS_FOREVER_US) == 0) {
+        k_sem_take(&tx_done_semaphore, K_FOREVER);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < size; i++) {
+        uart_poll_out(tap_uart, data[i]);
+    }
+}
+
+static void audio_tap_thread_entry_point(void *p1, void *p2, void *p3)
+{
+    audio_tap_t *tap = (audio_tap_t *)p1;
+    while (true) {
+        k_sem_take(&audio_tap_semaphore, K_FOREVER);
+        const uint8_t *frame;
+        size_t size;
+        while ((size = audio_tap_peek(tap, &frame)) > 0) {
+            write_frame(frame, size);
+            audio_tap_release(tap);
+        }
+    }
+}
+
+bool audio_tap_uart_start(audio_tap_t *tap)
+{
+    if (!device_is_ready(tap_uart)) {
+        printk("audio tap uart not ready\n");
+        return false;
+    }
+#ifdef CONFIG_UART_ASYNC_API
+    async_tx = uart_callback_set(tap_uart, uart_callback, NULL) == 0;
+#endif
+    k_thread_create(
+        &audio_tap_thread_data,
+        audio_tap_thread_stack_area,
+        K_THREAD_STACK_SIZEOF(audio_tap_thread_stack_area),
+        audio_tap_thread_entry_point,
+        tap, NULL, NULL,
+        AUDIO_TAP_THREAD_PRIORITY, 0, K_NO_WAIT
+    );
+    return true;
+}
+
+void audio_tap_uart_notify(void)
+{
+    k_sem_give(&audio_tap_semaphore);
+}
+
+#else
+
+bool audio_tap_uart_start(audio_tap_t *tap)
+{
+    return false;
+}
+
+void audio_tap_uart_notify(void)
+{
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef AUDIO_TAP_UART_H
+#define AUDIO_TAP_UART_H
+
+#include <stdbool.h>
+
+#include "audio_tap.h"
+
+/* Drains an audio tap to the UART with the devicetree alias
+   audio-tap-uart, on a thread with the lowest application priority, so
+   that it only uses CPU time nothing else needs. Frames are sent with
+   DMA if the UART supports the async API, and polled out otherwise, e.g
+   to the pty backed UART of native_posix. */
+
+/* Returns false if there is no audio-tap-uart or it is not ready */
+bool audio_tap_uart_start(audio_tap_t* tap);
+
+/* Wakes the drain thread. Call after pushing frames. Never blocks. */
+void audio_tap_uart_notify(void);
+
+#endif
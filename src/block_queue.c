@@ -0,0 +1,116 @@
+#include "block_queue.h"
+
+#include <zephyr/zephyr.h>
+#include <string.h>
+
+BUILD_ASSERT((BLOCK_QUEUE_MAX_SLOTS & (BLOCK_QUEUE_MAX_SLOTS - 1)) == 0, "BLOCK_QUEUE_MAX_SLOTS must be a power of two");
+
+static int channel_count(uint8_t channel_mask)
+{
+    int count = 0;
+    for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+        if (channel_mask & (1 << c)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+bool block_queue_init(block_queue_t* queue, unsigned int frames_per_block, uint8_t channel_mask)
+{
+    uint32_t slot_n_samples = frames_per_block * channel_count(channel_mask);
+    if (slot_n_samples == 0) {
+        return false;
+    }
+    uint32_t slot_count = BLOCK_QUEUE_MAX_SLOTS;
+    while (slot_count * slot_n_samples > BLOCK_QUEUE_POOL_N_SAMPLES) {
+        slot_count >>= 1;
+    }
+    if (slot_count < 2) {
+        return false;
+    }
+    queue->frames_per_block = frames_per_block;
+    queue->channel_mask = channel_mask;
+    queue->slot_count = slot_count;
+    queue->slot_n_samples = slot_n_samples;
+    atomic_set(&queue->push_count, 0);
+    atomic_set(&queue->pop_count, 0);
+    atomic_set(&queue->overrun_count, 0);
+    atomic_set(&queue->dropped_frame_count, 0);
+    atomic_set(&queue->max_depth, 0);
+    return true;
+}
+
+bool block_queue_push(block_queue_t* queue, const float* const* channels, unsigned int frame_count, uint32_t timestamp)
+{
+    __ASSERT(frame_count == queue->frames_per_block, "Unexpected block size %u", frame_count);
+    uint32_t push_count = (uint32_t)atomic_get(&queue->push_count);
+    uint32_t pop_count = (uint32_t)atomic_get(&queue->pop_count);
+    uint32_t depth = push_count - pop_count;
+    if (depth > (uint32_t)atomic_get(&queue->max_depth)) {
+        atomic_set(&queue->max_depth, (atomic_val_t)depth);
+    }
+    if (depth == queue->slot_count) {
+        atomic_inc(&queue->overrun_count);
+        atomic_add(&queue->dropped_frame_count, (atomic_val_t)frame_count);
+        return false;
+    }
+
+    uint32_t slot = push_count & (queue->slot_count - 1);
+    float* dst = &queue->pool[slot * queue->slot_n_samples];
+    for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+        if (queue->channel_mask & (1 << c)) {
+            memcpy(dst, channels[c], frame_count * sizeof(float));
+            dst += frame_count;
+        }
+    }
+    queue->timestamps[slot] = timestamp;
+    /* atomic_set is a full barrier, so the block is written before it is published */
+    atomic_set(&queue->push_count, (atomic_val_t)(push_count + 1));
+    return true;
+}
+
+bool block_queue_peek(block_queue_t* queue, audio_block_t* block)
+{
+    uint32_t pop_count = (uint32_t)atomic_get(&queue->pop_count);
+    uint32_t push_count = (uint32_t)atomic_get(&queue->push_count);
+    if (push_count == pop_count) {
+        return false;
+    }
+
+    uint32_t slot = pop_count & (queue->slot_count - 1);
+    const float* src = &queue->pool[slot * queue->slot_n_samples];
+    for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+        if (queue->channel_mask & (1 << c)) {
+            block->channels[c] = src;
+            src += queue->frames_per_block;
+        } else {
+            block->channels[c] = NULL;
+        }
+    }
+    block->frame_count = queue->frames_per_block;
+    block->timestamp = queue->timestamps[slot];
+    return true;
+}
+
+void block_queue_release(block_queue_t* queue)
+{
+    uint32_t pop_count = (uint32_t)atomic_get(&queue->pop_count);
+    __ASSERT(pop_count != (uint32_t)atomic_get(&queue->push_count), "Released a block from an empty queue");
+    /* Hands the slot back to the producer once the block has been used */
+    atomic_set(&queue->pop_count, (atomic_val_t)(pop_count + 1));
+}
+
+uint32_t block_queue_depth(block_queue_t* queue)
+{
+    uint32_t pop_count = (uint32_t)atomic_get(&queue->pop_count);
+    return (uint32_t)atomic_get(&queue->push_count) - pop_count;
+}
+
+void block_queue_stats(block_queue_t* queue, block_queue_stats_t* stats)
+{
+    stats->pushed_count = (uint32_t)atomic_get(&queue->push_count);
+    stats->overrun_count = (uint32_t)atomic_get(&queue->overrun_count);
+    stats->dropped_frame_count = (uint32_t)atomic_get(&queue->dropped_frame_count);
+    stats->max_depth = (uint32_t)atomic_get(&queue->max_depth);
+}
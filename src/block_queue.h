@@ -0,0 +1,81 @@
+#ifndef BLOCK_QUEUE_H
+#define BLOCK_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/sys/atomic.h>
+
+#include "audio_callbacks.h"
+
+/* Lock-free single producer, single consumer queue of planar float audio
+   blocks, used to hand rx audio from the audio thread to work that may
+   lag behind it. The producer never blocks. If the queue is full, the
+   block is dropped and counted as an overrun. */
+
+/* All slots are taken from a statically allocated pool, i.e the number
+   of slots is the largest power of two such that
+   slot_count * frames_per_block * channel_count fits in this. */
+#ifndef BLOCK_QUEUE_POOL_N_SAMPLES
+#define BLOCK_QUEUE_POOL_N_SAMPLES 1024
+#endif
+/* Must be a power of two */
+#define BLOCK_QUEUE_MAX_SLOTS 16
+
+typedef struct {
+    /* Index of the first frame of the block in the producer's stream */
+    uint32_t timestamp;
+    unsigned int frame_count;
+    /* One pointer per channel, NULL for channels not in the channel mask */
+    const float* channels[AUDIO_MAX_CHANNELS];
+} audio_block_t;
+
+typedef struct {
+    /* Number of blocks pushed and dropped because the queue was full */
+    uint32_t pushed_count;
+    uint32_t overrun_count;
+    /* Frames in dropped blocks */
+    uint32_t dropped_frame_count;
+    /* Largest number of blocks waiting at the time of a push */
+    uint32_t max_depth;
+} block_queue_stats_t;
+
+typedef struct {
+    float pool[BLOCK_QUEUE_POOL_N_SAMPLES];
+    uint32_t timestamps[BLOCK_QUEUE_MAX_SLOTS];
+    unsigned int frames_per_block;
+    uint8_t channel_mask;
+    uint32_t slot_count;
+    uint32_t slot_n_samples;
+    /* Free running counts of pushed and popped blocks. Each is only
+       written by one side. */
+    atomic_t push_count;
+    atomic_t pop_count;
+    /* Only written by the producer */
+    atomic_t overrun_count;
+    atomic_t dropped_frame_count;
+    atomic_t max_depth;
+} block_queue_t;
+
+/* Sets up the queue for blocks of frames_per_block frames of the channels
+   in channel_mask. Returns false if not even two blocks fit in the pool. */
+bool block_queue_init(block_queue_t* queue, unsigned int frames_per_block, uint8_t channel_mask);
+
+/* Producer side. Copies frame_count frames of each channel in the channel
+   mask, which must equal frames_per_block. Returns false and counts an
+   overrun if the queue is full. */
+bool block_queue_push(block_queue_t* queue, const float* const* channels, unsigned int frame_count, uint32_t timestamp);
+
+/* Consumer side. Points block at the oldest block and returns true, or
+   returns false if the queue is empty. The block stays valid until it is
+   released with block_queue_release. */
+bool block_queue_peek(block_queue_t* queue, audio_block_t* block);
+void block_queue_release(block_queue_t* queue);
+
+/* Number of blocks waiting. Safe to call from any context. */
+uint32_t block_queue_depth(block_queue_t* queue);
+
+/* Safe to call from any context. The counts may be from slightly
+   different points in time. */
+void block_queue_stats(block_queue_t* queue, block_queue_stats_t* stats);
+
+#endif
@@ -1,123 +1,429 @@
-#include <zephyr/drivers/i2c.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "audio_clock_config.h"
 #include "wm8904.h"
 
-#ifdef CONFIG_SOC_SERIES_NRF53X
-#define I2C_NODE DT_NODELABEL(i2c1)
-#else
-#define I2C_NODE DT_NODELABEL(i2c0)
-#endif
-static const struct device *i2c_dev = DEVICE_DT_GET(I2C_NODE);
+/* Catches hand edited clock plans, the limits are checked by clock_planner.py */
+_Static_assert(WM8904_FLL_OUTDIV >= 4 && WM8904_FLL_OUTDIV <= 64, "FLL_OUTDIV out of range");
+_Static_assert(WM8904_SYSCLK_RATIO >= 256, "sysclk must be at least 256fs with both ADC and DAC enabled");
 
-int wm8904_read_reg(uint8_t reg_addr, uint16_t* result)
+/* Longest run of consecutive registers sent in one transfer */
+#define WM8904_MAX_BURST_LEN 8
+/* Interval between reads of a polled register */
+#define WM8904_POLL_INTERVAL_US 1000
+
+static struct {
+    const wm8904_bus_t* bus;
+    /* Last value written to each register, if its bit in cached is set */
+    uint16_t values[WM8904_REG_COUNT];
+    uint32_t cached[WM8904_REG_COUNT / 32];
+} codec;
+
+const wm8904_op_t wm8904_init_sequence[] = {
+    WM8904_WRITE(WM8904_BIAS_CONTROL_0, 0b1000),
+    WM8904_WRITE(WM8904_VMID_CONTROL_0, 0b1000111),
+    WM8904_DELAY_MS(5),
+    WM8904_WRITE(WM8904_VMID_CONTROL_0, 0b1000011),
+    WM8904_WRITE(WM8904_BIAS_CONTROL_0, 0b01001),
+    WM8904_WRITE(WM8904_POWER_MANAGEMENT_0, 0b11),
+    WM8904_WRITE(WM8904_POWER_MANAGEMENT_2, 0b11),
+    WM8904_WRITE(WM8904_DAC_DIGITAL_1, 0b0),
+    WM8904_WRITE(WM8904_ANALOGUE_OUT12_ZC, 0b0),
+    WM8904_WRITE(WM8904_CHARGE_PUMP_0, 0b1),
+    WM8904_WRITE(WM8904_CLASS_W_0, 0b1),
+
+    /* FLL settings from the clock plan in audio_clock_config.h.
+       NOTE: Bit pattern does NOT correspond to FLL_RATIO number */
+    WM8904_WRITE(WM8904_FLL_CONTROL_2, ((WM8904_FLL_OUTDIV - 1) << 8) | WM8904_FLL_FRATIO_CODE),
+    WM8904_WRITE(WM8904_FLL_CONTROL_3, WM8904_FLL_K),
+    WM8904_WRITE(WM8904_FLL_CONTROL_4, WM8904_FLL_N << 5),
+    /* use bitckl as FLL reference */
+    WM8904_WRITE(WM8904_FLL_CONTROL_5, (WM8904_FLL_CLK_REF_DIV_CODE << 3) | 0b1),
+    WM8904_WRITE(WM8904_FLL_CONTROL_1, 0b101), /* ENABLE FLL  FRACN_ENA true */
+    /* The FLL only locks once BCLK is running, i.e after I2S has been
+       started, so this usually runs into the timeout */
+    WM8904_POLL(WM8904_INTERRUPT_STATUS, WM8904_FLL_LOCK_EINT, WM8904_FLL_LOCK_EINT, 5),
+
+    WM8904_WRITE(WM8904_CLOCK_RATES_0, 0b0),
+    WM8904_WRITE(WM8904_CLOCK_RATES_1, WM8904_SAMPLE_RATE_CODE | (WM8904_CLK_SYS_RATE_CODE << 10)),
+
+    WM8904_WRITE(WM8904_AUDIO_INTERFACE_1, 0b1010), /* 24 bit i2s */
+    WM8904_WRITE(WM8904_POWER_MANAGEMENT_6, 0b1111),
+    WM8904_DELAY_MS(5),
+
+    WM8904_WRITE(WM8904_ANALOGUE_HP_0, 0b10001),
+    WM8904_WRITE(WM8904_ANALOGUE_LINEOUT_0, 0b10001),
+    WM8904_DELAY_MS(1),
+
+    WM8904_WRITE(WM8904_ANALOGUE_HP_0, 0b110011),
+    WM8904_WRITE(WM8904_ANALOGUE_LINEOUT_0, 0b110011),
+
+    /* Start up calibration of all four outputs, done when their
+       DCS_CAL_COMPLETE bits are set */
+    WM8904_WRITE(WM8904_DC_SERVO_0, 0b1111),
+    WM8904_WRITE(WM8904_DC_SERVO_1, (1 << 4) | (1 << 5) | (1 << 6) | (1 << 7)),
+    WM8904_POLL(WM8904_DC_SERVO_READBACK_0, WM8904_DCS_CAL_COMPLETE_ALL, WM8904_DCS_CAL_COMPLETE_ALL, 100),
+
+    WM8904_WRITE(WM8904_ANALOGUE_HP_0, 0b1110111),
+    WM8904_WRITE(WM8904_ANALOGUE_LINEOUT_0, 0b1110111),
+
+    WM8904_WRITE(WM8904_ANALOGUE_HP_0, 0b11111111),
+    WM8904_WRITE(WM8904_ANALOGUE_LINEOUT_0, 0b11111111),
+
+    WM8904_WRITE(WM8904_ANALOGUE_OUT1_LEFT, 0b111001 | (1 << 7)),
+    WM8904_WRITE(WM8904_ANALOGUE_OUT1_RIGHT, 0b111001 | (1 << 7)),
+    WM8904_WRITE(WM8904_ANALOGUE_OUT2_LEFT, 0b111001 | (1 << 7)),
+    WM8904_WRITE(WM8904_ANALOGUE_OUT2_RIGHT, 0b111001 | (1 << 7)),
+
+    WM8904_DELAY_MS(100),
+
+    /* set digital volume */
+    WM8904_WRITE(WM8904_ADC_DIGITAL_VOLUME_LEFT, 0b11000000),
+    WM8904_WRITE(WM8904_ADC_DIGITAL_VOLUME_RIGHT, 0b11000000),
+    /* unmute, +19.2 dB gain */
+    WM8904_WRITE(WM8904_ANALOGUE_LEFT_INPUT_0, 0b11100),
+    WM8904_WRITE(WM8904_ANALOGUE_RIGHT_INPUT_0, 0b11100),
+    WM8904_WRITE(WM8904_ANALOGUE_LEFT_INPUT_1, 0b0010000),
+    WM8904_WRITE(WM8904_ANALOGUE_RIGHT_INPUT_1, 0b0010000),
+
+    /* mic bypass */
+    /* WM8904_WRITE(WM8904_ANALOGUE_OUT12_ZC, 0b1111), */
+
+    /* digital loopback */
+    /* WM8904_WRITE(WM8904_AUDIO_INTERFACE_0, 0b101010000), */
+
+    /* sysclk src = pll, enable sys clk, enable dsp clk
+       if there's no mclk input, make sure this is the last write. */
+    WM8904_WRITE(WM8904_CLOCK_RATES_2, (1 << 1) | (1 << 2) | (1 << 14)),
+};
+
+const size_t wm8904_init_sequence_len = sizeof(wm8904_init_sequence) / sizeof(wm8904_init_sequence[0]);
+
+/* Registers that change on their own or have side effects when written,
+   which are never cached */
+static bool is_volatile(uint8_t reg_addr)
+{
+    switch (reg_addr) {
+    case WM8904_SW_RESET_AND_ID:
+    case WM8904_DC_SERVO_1:
+    case WM8904_DC_SERVO_READBACK_0:
+    case WM8904_WRITE_SEQUENCER_4:
+    case WM8904_INTERRUPT_STATUS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_cached(uint8_t reg_addr)
+{
+    return (codec.cached[reg_addr / 32] >> (reg_addr % 32)) & 1;
+}
+
+static void cache_write(uint8_t reg_addr, uint16_t value)
+{
+    if (reg_addr == WM8904_SW_RESET_AND_ID) {
+        /* Every register is back at its default, which is not known here */
+        memset(codec.cached, 0, sizeof(codec.cached));
+    } else if (!is_volatile(reg_addr)) {
+        codec.values[reg_addr] = value;
+        codec.cached[reg_addr / 32] |= 1u << (reg_addr % 32);
+    }
+}
+
+/* Register writes waiting to be sent as a single transfer */
+static struct {
+    uint8_t buf[1 + 2 * WM8904_MAX_BURST_LEN];
+    size_t len;
+} burst;
+
+static int flush_burst(void)
+{
+    if (burst.len == 0) {
+        return 0;
+    }
+    int rc = codec.bus->write(codec.bus->ctx, burst.buf, 1 + 2 * burst.len);
+    if (rc == 0) {
+        for (size_t i = 0; i < burst.len; i++) {
+            cache_write(burst.buf[0] + i, (burst.buf[1 + 2 * i] << 8) | burst.buf[2 + 2 * i]);
+        }
+    }
+    burst.len = 0;
+    return rc;
+}
+
+static int queue_write(uint8_t reg_addr, uint16_t data)
+{
+    if (is_cached(reg_addr) && codec.values[reg_addr] == data) {
+        return 0;
+    }
+    bool extends_burst = WM8904_BURST_WRITES && burst.len > 0 && burst.len < WM8904_MAX_BURST_LEN
+        && reg_addr == burst.buf[0] + burst.len && burst.buf[0] != WM8904_SW_RESET_AND_ID;
+    if (!extends_burst) {
+        int rc = flush_burst();
+        if (rc != 0) {
+            return rc;
+        }
+        burst.buf[0] = reg_addr;
+    }
+    burst.buf[1 + 2 * burst.len] = (data & 0xff00) >> 8; /* msb */
+    burst.buf[2 + 2 * burst.len] = data & 0xff; /* lsb */
+    burst.len++;
+    return 0;
+}
+
+static int read_device_reg(uint8_t reg_addr, uint16_t* result)
 {
     uint8_t write_buf[1] = { reg_addr };
     uint8_t read_buf[2] = { 0, 0 };
-    int read_rc = i2c_write_read(i2c_dev, WM8904_ADDRESS, write_buf, 1, read_buf, 2);
-    if (read_rc == 0) {
+    int rc = codec.bus->write_read(codec.bus->ctx, write_buf, 1, read_buf, 2);
+    if (rc == 0) {
         *result = ((read_buf[0] << 8) & 0xff00) | read_buf[1];
     }
-    __ASSERT(read_rc == 0, "wm8904_read_reg failed");
-    return read_rc;
+    return rc;
+}
+
+int wm8904_read_reg(uint8_t reg_addr, uint16_t* result)
+{
+    if (is_cached(reg_addr)) {
+        *result = codec.values[reg_addr];
+        return 0;
+    }
+    int rc = read_device_reg(reg_addr, result);
+    if (rc == 0 && !is_volatile(reg_addr)) {
+        codec.values[reg_addr] = *result;
+        codec.cached[reg_addr / 32] |= 1u << (reg_addr % 32);
+    }
+    return rc;
 }
 
 int wm8904_write_reg(uint8_t reg_addr, uint16_t data)
 {
-    uint8_t write_buf[3] = {
-        reg_addr,
-        (data & 0xff00) >> 8, /* msb */
-        data & 0xff  /* lsb */
-    };
-    uint8_t read_buf[2] = { 0, 0 };
-    int write_rc = i2c_write_read(i2c_dev, WM8904_ADDRESS, write_buf, 3, read_buf, 2);
-    /* printk("write_reg result %d\n", write_rc); */
-    __ASSERT(write_rc == 0, "wm8904_write_reg failed");
-    return write_rc;
-}
-
-void wm8904_init()
-{
-    if (device_is_ready(i2c_dev))
-    {
-        /* Reset the device, making sure CLK_SYS_ENA = 0. From the datasheet:
-           Note that, if it cannot be assured that MCLK is present when accessing
-           the register map, then it is required to set CLK_SYS_ENA = 0 to
-           ensure correct operation. */
-        wm8904_write_reg(WM8904_SW_RESET_AND_ID, 0);
-
-        uint16_t device_id = 0;
-        wm8904_read_reg(WM8904_SW_RESET_AND_ID, &device_id);
-        __ASSERT(device_id == 0x8904, "Failed to read wm8904 device id");
-
-        wm8904_write_reg(WM8904_BIAS_CONTROL_0, 0b1000);
-        wm8904_write_reg(WM8904_VMID_CONTROL_0, 0b1000111);
-        k_msleep(5);
-        wm8904_write_reg(WM8904_VMID_CONTROL_0, 0b1000011);
-        wm8904_write_reg(WM8904_BIAS_CONTROL_0, 0b01001);
-        wm8904_write_reg(WM8904_POWER_MANAGEMENT_0, 0b11);
-        wm8904_write_reg(WM8904_POWER_MANAGEMENT_2, 0b11);
-        wm8904_write_reg(WM8904_DAC_DIGITAL_1, 0b0);
-        wm8904_write_reg(WM8904_ANALOGUE_OUT12_ZC, 0b0);
-        wm8904_write_reg(WM8904_CHARGE_PUMP_0, 0b1);
-        wm8904_write_reg(WM8904_CLASS_W_0, 0b1);
-
-        /* NOTE: Bit pattern does NOT correspond to FLL_RATIO number */
-        wm8904_write_reg(WM8904_FLL_CONTROL_2, (8 - 1) << 8);
-        wm8904_write_reg(WM8904_FLL_CONTROL_3, 0xaaab);
-        wm8904_write_reg(WM8904_FLL_CONTROL_4, 42 << 5); //
-
-        wm8904_write_reg(WM8904_FLL_CONTROL_5, 0b1); /* use bitckl as FLL reference */
-        wm8904_write_reg(WM8904_FLL_CONTROL_1, 0b101); /* ENABLE FLL  FRACN_ENA true */
-        k_msleep(5);
-
-        wm8904_write_reg(WM8904_CLOCK_RATES_0, 0b0);
-        wm8904_write_reg(WM8904_CLOCK_RATES_1, 0b101 | (0b11 << 10)); /* sysclk = 256fs, fs =~ 44.1 khz */
-
-        wm8904_write_reg(WM8904_AUDIO_INTERFACE_1, 0b1010); /* 24 bit i2s */
-        wm8904_write_reg(WM8904_POWER_MANAGEMENT_6, 0b1111);
-        k_msleep(5);
-
-        wm8904_write_reg(WM8904_ANALOGUE_HP_0, 0b10001);
-        wm8904_write_reg(WM8904_ANALOGUE_LINEOUT_0, 0b10001);
-        k_msleep(1);
-
-        wm8904_write_reg(WM8904_ANALOGUE_HP_0, 0b110011);
-        wm8904_write_reg(WM8904_ANALOGUE_LINEOUT_0, 0b110011);
-
-        wm8904_write_reg(WM8904_DC_SERVO_0, 0b1111);
-        wm8904_write_reg(WM8904_DC_SERVO_1, (1 << 4) | (1 << 5) | (1 << 6) | (1 << 7));
-        k_msleep(100);
-
-        wm8904_write_reg(WM8904_ANALOGUE_HP_0, 0b1110111);
-        wm8904_write_reg(WM8904_ANALOGUE_LINEOUT_0, 0b1110111);
-
-        wm8904_write_reg(WM8904_ANALOGUE_HP_0, 0b11111111);
-        wm8904_write_reg(WM8904_ANALOGUE_LINEOUT_0, 0b11111111);
-
-        wm8904_write_reg(WM8904_ANALOGUE_OUT1_LEFT, 0b111001 | (1 << 7));
-        wm8904_write_reg(WM8904_ANALOGUE_OUT1_RIGHT, 0b111001 | (1 << 7));
-        wm8904_write_reg(WM8904_ANALOGUE_OUT2_LEFT, 0b111001 | (1 << 7));
-        wm8904_write_reg(WM8904_ANALOGUE_OUT2_RIGHT, 0b111001 | (1 << 7));
-
-        k_msleep(100);
-
-        /* unmute, +19.2 dB gain */
-        wm8904_write_reg(WM8904_ANALOGUE_LEFT_INPUT_0, 0b11100);
-        wm8904_write_reg(WM8904_ANALOGUE_RIGHT_INPUT_0, 0b11100);
-        /* set digital volume */
-        wm8904_write_reg(WM8904_ADC_DIGITAL_VOLUME_LEFT,  0b11000000);
-        wm8904_write_reg(WM8904_ADC_DIGITAL_VOLUME_RIGHT, 0b11000000);
-
-        wm8904_write_reg(WM8904_ANALOGUE_LEFT_INPUT_1, 0b0010000);
-        wm8904_write_reg(WM8904_ANALOGUE_RIGHT_INPUT_1, 0b0010000);
-
-        /* mic bypass */
-        /* wm8904_write_reg(WM8904_ANALOGUE_OUT12_ZC, 0b1111); */
-
-        /* digital loopback */
-        /* wm8904_write_reg(WM8904_AUDIO_INTERFACE_0, 0b101010000); */
-
-        /* sysclk src = pll, enable sys clk, enable dsp clk
-           if there's no mclk input, make sure this is the last write. */
-        wm8904_write_reg(WM8904_CLOCK_RATES_2, (1 << 1) | (1 << 2) | (1 << 14));
-    }
-}
\ No newline at end of file
+    int rc = queue_write(reg_addr, data);
+    return rc == 0 ? flush_burst() : rc;
+}
+
+int wm8904_update_bits(uint8_t reg_addr, uint16_t mask, uint16_t value)
+{
+    uint16_t current;
+    int rc = wm8904_read_reg(reg_addr, &current);
+    if (rc != 0) {
+        return rc;
+    }
+    return wm8904_write_reg(reg_addr, (current & ~mask) | (value & mask));
+}
+
+const wm8904_gain_t wm8904_gains[WM8904_GAIN_COUNT] = {
+    /* Set to code 28 by the init sequence */
+    [WM8904_GAIN_INPUT_PGA] = {
+        .name = "input", .left_reg = WM8904_ANALOGUE_LEFT_INPUT_0, .right_reg = WM8904_ANALOGUE_RIGHT_INPUT_0,
+        .code_mask = 0x1f, .update_bit = 0, .max_code = 31, .zero_db_code = 0, .step_millidb = 0,
+    },
+    /* Code 0 mutes, 1 is -71.625 dB */
+    [WM8904_GAIN_ADC] = {
+        .name = "adc", .left_reg = WM8904_ADC_DIGITAL_VOLUME_LEFT, .right_reg = WM8904_ADC_DIGITAL_VOLUME_RIGHT,
+        .code_mask = 0xff, .update_bit = 1 << 8, .max_code = 255, .zero_db_code = 0xc0, .step_millidb = 375,
+    },
+    [WM8904_GAIN_HEADPHONE] = {
+        .name = "headphone", .left_reg = WM8904_ANALOGUE_OUT1_LEFT, .right_reg = WM8904_ANALOGUE_OUT1_RIGHT,
+        .code_mask = 0x3f, .update_bit = 1 << 7, .max_code = 63, .zero_db_code = 57, .step_millidb = 1000,
+    },
+    [WM8904_GAIN_LINE_OUT] = {
+        .name = "line", .left_reg = WM8904_ANALOGUE_OUT2_LEFT, .right_reg = WM8904_ANALOGUE_OUT2_RIGHT,
+        .code_mask = 0x3f, .update_bit = 1 << 7, .max_code = 63, .zero_db_code = 57, .step_millidb = 1000,
+    },
+};
+
+int wm8904_find_gain(const char* name)
+{
+    for (int i = 0; i < WM8904_GAIN_COUNT; i++) {
+        if (strcmp(wm8904_gains[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int wm8904_get_gain(wm8904_gain_id_t gain, uint16_t* code)
+{
+    if (gain >= WM8904_GAIN_COUNT) {
+        return -EINVAL;
+    }
+    uint16_t value;
+    int rc = wm8904_read_reg(wm8904_gains[gain].left_reg, &value);
+    if (rc == 0) {
+        *code = value & wm8904_gains[gain].code_mask;
+    }
+    return rc;
+}
+
+/* Writes one code to both registers, in a single transfer since they are
+   adjacent. The right register carries the update bit, which applies
+   both at the same time. */
+static int write_gain(const wm8904_gain_t* info, uint16_t code)
+{
+    uint16_t left, right;
+    int rc = wm8904_read_reg(info->left_reg, &left);
+    if (rc == 0) {
+        rc = wm8904_read_reg(info->right_reg, &right);
+    }
+    if (rc == 0) {
+        rc = queue_write(info->left_reg, (left & ~info->code_mask) | code);
+    }
+    if (rc == 0) {
+        rc = queue_write(info->right_reg, (right & ~info->code_mask) | info->update_bit | code);
+    }
+    if (rc != 0) {
+        burst.len = 0;
+        return rc;
+    }
+    return flush_burst();
+}
+
+int wm8904_set_gain(wm8904_gain_id_t gain, uint16_t code)
+{
+    if (gain >= WM8904_GAIN_COUNT || code > wm8904_gains[gain].max_code) {
+        return -EINVAL;
+    }
+    const wm8904_gain_t* info = &wm8904_gains[gain];
+    uint16_t current;
+    int rc = wm8904_get_gain(gain, &current);
+    /* Also brings the right side to the same code if it differs */
+    rc = rc == 0 ? write_gain(info, current) : rc;
+    while (rc == 0 && current != code) {
+        current = current < code ? current + 1 : current - 1;
+        codec.bus->sleep_us(codec.bus->ctx, WM8904_GAIN_RAMP_STEP_US);
+        rc = write_gain(info, current);
+    }
+    return rc;
+}
+
+/* Polls are bounded by their timeout like the fixed delays they replace, and
+   end without an error if the condition is not met by then */
+static int poll_reg(const wm8904_op_t* op)
+{
+    uint64_t deadline_us = codec.bus->time_us(codec.bus->ctx) + 1000u * op->time_ms;
+    while (1) {
+        uint16_t value;
+        int rc = read_device_reg(op->reg, &value);
+        if (rc != 0) {
+            return rc;
+        }
+        uint64_t now_us = codec.bus->time_us(codec.bus->ctx);
+        if ((value & op->mask) == op->value || now_us >= deadline_us) {
+            return 0;
+        }
+        uint64_t remaining_us = deadline_us - now_us;
+        codec.bus->sleep_us(codec.bus->ctx, remaining_us < WM8904_POLL_INTERVAL_US ? remaining_us : WM8904_POLL_INTERVAL_US);
+    }
+}
+
+int wm8904_run_sequence(const wm8904_op_t* ops, size_t op_count)
+{
+    for (size_t i = 0; i < op_count; i++) {
+        const wm8904_op_t* op = &ops[i];
+        int rc = 0;
+        if (op->type == WM8904_OP_WRITE) {
+            rc = queue_write(op->reg, op->value);
+        } else {
+            rc = flush_burst();
+            if (rc == 0 && op->type == WM8904_OP_DELAY) {
+                codec.bus->sleep_us(codec.bus->ctx, 1000u * op->time_ms);
+            } else if (rc == 0 && op->type == WM8904_OP_POLL) {
+                rc = poll_reg(op);
+            }
+        }
+        if (rc != 0) {
+            burst.len = 0;
+            return rc;
+        }
+    }
+    return flush_burst();
+}
+
+int wm8904_init(const wm8904_bus_t* bus)
+{
+    codec.bus = bus;
+    burst.len = 0;
+    memset(codec.cached, 0, sizeof(codec.cached));
+
+    /* Reset the device, making sure CLK_SYS_ENA = 0. From the datasheet:
+       Note that, if it cannot be assured that MCLK is present when accessing
+       the register map, then it is required to set CLK_SYS_ENA = 0 to
+       ensure correct operation. */
+    int rc = wm8904_write_reg(WM8904_SW_RESET_AND_ID, 0);
+    if (rc != 0) {
+        return rc;
+    }
+
+    uint16_t device_id = 0;
+    rc = wm8904_read_reg(WM8904_SW_RESET_AND_ID, &device_id);
+    if (rc != 0) {
+        return rc;
+    }
+    if (device_id != 0x8904) {
+        return -ENODEV;
+    }
+
+    return wm8904_run_sequence(wm8904_init_sequence, wm8904_init_sequence_len);
+}
+
+#ifdef CONFIG_SHELL
+#include <stdlib.h>
+#include <zephyr/shell/shell.h>
+
+static void print_gain(const struct shell *sh, wm8904_gain_id_t gain)
+{
+    const wm8904_gain_t* info = &wm8904_gains[gain];
+    uint16_t code;
+    if (wm8904_get_gain(gain, &code) != 0) {
+        shell_error(sh, "could not read %s", info->name);
+        return;
+    }
+    if (info->step_millidb == 0) {
+        shell_print(sh, "%-10s code %3u of %u", info->name, (unsigned int)code, (unsigned int)info->max_code);
+    } else {
+        int millidb = ((int)code - info->zero_db_code) * info->step_millidb;
+        shell_print(sh, "%-10s code %3u of %u, %d mdB", info->name, (unsigned int)code,
+                    (unsigned int)info->max_code, millidb);
+    }
+}
+
+static int cmd_codec_gain(const struct shell *sh, size_t argc, char **argv)
+{
+    if (argc == 1) {
+        for (int i = 0; i < WM8904_GAIN_COUNT; i++) {
+            print_gain(sh, (wm8904_gain_id_t)i);
+        }
+        return 0;
+    }
+    int gain = wm8904_find_gain(argv[1]);
+    if (gain < 0) {
+        shell_error(sh, "no gain %s, see codec gain", argv[1]);
+        return -EINVAL;
+    }
+    if (argc == 3) {
+        char *end;
+        unsigned long code = strtoul(argv[2], &end, 10);
+        if (end == argv[2] || *end != '\0' || code > wm8904_gains[gain].max_code) {
+            shell_error(sh, "code must be 0 to %u", (unsigned int)wm8904_gains[gain].max_code);
+            return -EINVAL;
+        }
+        int rc = wm8904_set_gain((wm8904_gain_id_t)gain, (uint16_t)code);
+        if (rc != 0) {
+            shell_error(sh, "could not set %s: %d", argv[1], rc);
+            return rc;
+        }
+    }
+    print_gain(sh, (wm8904_gain_id_t)gain);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(codec_cmds,
+    SHELL_CMD_ARG(gain, NULL, "Print or ramp a codec gain: gain [name [code]]", cmd_codec_gain, 1, 2),
+    SHELL_SUBCMD_SET_END
+);
+SHELL_CMD_REGISTER(codec, &codec_cmds, "WM8904 codec", NULL);
+#endif
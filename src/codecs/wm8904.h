@@ -1,6 +1,9 @@
 #ifndef WM8904_H
 #define WM8904_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define WM8904_ADDRESS 0b11010
 
 /* Registers */
@@ -104,8 +107,114 @@
 #define WM8904_FLL_NCO_TEST_0 0xF7
 #define WM8904_FLL_NCO_TEST_1 0xF8
 
+#define WM8904_REG_COUNT 0x100
+
+/* Bits polled during initialisation */
+#define WM8904_FLL_LOCK_EINT (1 << 2) /* WM8904_INTERRUPT_STATUS */
+#define WM8904_DCS_CAL_COMPLETE_ALL (0b1111 << 8) /* WM8904_DC_SERVO_READBACK_0 */
+
+/* Consecutive register writes are sent as a single transfer, relying on the
+   auto-incrementing register address of the control interface. Set to 0 to
+   send one transfer per register. */
+#ifndef WM8904_BURST_WRITES
+#define WM8904_BURST_WRITES 1
+#endif
+
+/* The bus the codec is connected to. The firmware uses I2C, see
+   wm8904_i2c.c, and the host tools use a mock that records transactions. */
+typedef struct {
+    /* Writes len bytes in a single transaction */
+    int (*write)(void* ctx, const uint8_t* data, size_t len);
+    /* Writes write_len bytes, then reads read_len bytes after a repeated start */
+    int (*write_read)(void* ctx, const uint8_t* write_data, size_t write_len, uint8_t* read_data, size_t read_len);
+    void (*sleep_us)(void* ctx, uint32_t us);
+    /* Monotonic time, for poll timeouts */
+    uint64_t (*time_us)(void* ctx);
+    void* ctx;
+} wm8904_bus_t;
+
+typedef enum {
+    WM8904_OP_WRITE,
+    WM8904_OP_DELAY,
+    /* Waits until (reg & mask) == value, for at most time_ms */
+    WM8904_OP_POLL,
+} wm8904_op_type_t;
+
+/* One step of a register programming sequence */
+typedef struct {
+    uint8_t type;
+    uint8_t reg;
+    uint16_t value;
+    uint16_t mask;
+    uint16_t time_ms;
+} wm8904_op_t;
+
+#define WM8904_WRITE(reg_, value_) { .type = WM8904_OP_WRITE, .reg = (reg_), .value = (value_) }
+#define WM8904_DELAY_MS(ms_) { .type = WM8904_OP_DELAY, .time_ms = (ms_) }
+#define WM8904_POLL(reg_, mask_, value_, timeout_ms_) \
+    { .type = WM8904_OP_POLL, .reg = (reg_), .mask = (mask_), .value = (value_), .time_ms = (timeout_ms_) }
+
+/* The sequence run by wm8904_init, for checking the resulting register
+   state in the host tools */
+extern const wm8904_op_t wm8904_init_sequence[];
+extern const size_t wm8904_init_sequence_len;
+
+/* Returns the bus of the codec on the board, or NULL if it is not ready */
+const wm8904_bus_t* wm8904_i2c_bus(void);
+
+/* Resets the codec and runs wm8904_init_sequence. Returns 0 on success. */
+int wm8904_init(const wm8904_bus_t* bus);
+/* Runs a register programming sequence. Returns 0 on success. */
+int wm8904_run_sequence(const wm8904_op_t* ops, size_t op_count);
+
+/* Register access through a shadow cache of the written values. Reads of
+   cached registers and writes of the value a register already has do not
+   touch the bus, so read-modify-write updates of gains and routing cost a
+   single write. Status registers are always read from the device. */
 int wm8904_read_reg(uint8_t reg_addr, uint16_t* result);
 int wm8904_write_reg(uint8_t reg_addr, uint16_t data);
-void wm8904_init();
+int wm8904_update_bits(uint8_t reg_addr, uint16_t mask, uint16_t value);
+
+/* Gains that can be changed at runtime, each a pair of left and right
+   registers that are always set to the same code */
+typedef enum {
+    WM8904_GAIN_INPUT_PGA,
+    WM8904_GAIN_ADC,
+    WM8904_GAIN_HEADPHONE,
+    WM8904_GAIN_LINE_OUT,
+    WM8904_GAIN_COUNT
+} wm8904_gain_id_t;
+
+typedef struct {
+    const char* name;
+    uint8_t left_reg;
+    uint8_t right_reg;
+    /* Bits of the gain code, starting at bit 0 */
+    uint16_t code_mask;
+    /* Written with the right register so both sides change at once, 0 if
+       the registers have none and take effect when written */
+    uint16_t update_bit;
+    uint16_t max_code;
+    /* Gain of code c is (c - zero_db_code) * step_millidb / 1000 dB. A
+       step of 0 means the steps are uneven, see the datasheet. */
+    uint16_t zero_db_code;
+    uint16_t step_millidb;
+} wm8904_gain_t;
+
+extern const wm8904_gain_t wm8904_gains[WM8904_GAIN_COUNT];
+
+/* Interval between the codes a gain passes through on its way to a new
+   one, so that gain changes do not click */
+#define WM8904_GAIN_RAMP_STEP_US 1000
+
+/* Returns the id of the gain called name, -1 if there is none */
+int wm8904_find_gain(const char* name);
+
+/* Moves a gain to code one code at a time, every WM8904_GAIN_RAMP_STEP_US,
+   i.e this blocks for up to a quarter second. Call from a single control
+   thread, like the other register access functions. Returns -EINVAL if
+   code is above the max_code of the gain. */
+int wm8904_set_gain(wm8904_gain_id_t gain, uint16_t code);
+int wm8904_get_gain(wm8904_gain_id_t gain, uint16_t* code);
 
 #endif
\ No newline at end of file
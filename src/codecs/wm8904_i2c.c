@@ -0,0 +1,43 @@
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/i2c.h>
+#include "wm8904.h"
+
+#ifdef CONFIG_SOC_SERIES_NRF53X
+#define I2C_NODE DT_NODELABEL(i2c1)
+#else
+#define I2C_NODE DT_NODELABEL(i2c0)
+#endif
+static const struct device *i2c_dev = DEVICE_DT_GET(I2C_NODE);
+
+static int i2c_bus_write(void* ctx, const uint8_t* data, size_t len)
+{
+    return i2c_write(i2c_dev, data, len, WM8904_ADDRESS);
+}
+
+static int i2c_bus_write_read(void* ctx, const uint8_t* write_data, size_t write_len, uint8_t* read_data, size_t read_len)
+{
+    return i2c_write_read(i2c_dev, WM8904_ADDRESS, write_data, write_len, read_data, read_len);
+}
+
+static void i2c_bus_sleep_us(void* ctx, uint32_t us)
+{
+    k_usleep(us);
+}
+
+static uint64_t i2c_bus_time_us(void* ctx)
+{
+    return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static const wm8904_bus_t i2c_bus = {
+    .write = i2c_bus_write,
+    .write_read = i2c_bus_write_read,
+    .sleep_us = i2c_bus_sleep_us,
+    .time_us = i2c_bus_time_us,
+    .ctx = NULL,
+};
+
+const wm8904_bus_t* wm8904_i2c_bus(void)
+{
+    return device_is_ready(i2c_dev) ? &i2c_bus : NULL;
+}
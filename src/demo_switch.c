@@ -0,0 +1,146 @@
+#include "demo_switch.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+void demo_switch_init(demo_switch_t* demo_switch, float sample_rate, bool deferred_analysis)
+{
+    memset(demo_switch->slots, 0, sizeof(demo_switch->slots));
+    atomic_ptr_set(&demo_switch->current, NULL);
+    for (int t = 0; t < DEMO_SWITCH_THREAD_COUNT; t++) {
+        atomic_ptr_set(&demo_switch->in_use[t], NULL);
+    }
+    demo_switch->sample_rate = sample_rate;
+    demo_switch->deferred_analysis = deferred_analysis;
+    k_mutex_init(&demo_switch->mutex);
+    demo_switch->seamless_swap_count = 0;
+    demo_switch->gap_swap_count = 0;
+}
+
+demo_instance_t* demo_switch_acquire(demo_switch_t* demo_switch, demo_switch_thread_t thread)
+{
+    /* Once in_use is set and current still holds the same instance, the
+       control thread sees the mark before it destroys the instance. The
+       control thread only updates current once per swap, so this loops
+       at most a few times. */
+    demo_instance_t* instance;
+    do {
+        instance = atomic_ptr_get(&demo_switch->current);
+        atomic_ptr_set(&demo_switch->in_use[thread], instance);
+    } while (instance != atomic_ptr_get(&demo_switch->current));
+    return instance;
+}
+
+void demo_switch_release(demo_switch_t* demo_switch, demo_switch_thread_t thread)
+{
+    atomic_ptr_set(&demo_switch->in_use[thread], NULL);
+}
+
+const demo_app_vtable_t* demo_switch_current(demo_switch_t* demo_switch)
+{
+    demo_instance_t* instance = atomic_ptr_get(&demo_switch->current);
+    return instance ? instance->vtable : NULL;
+}
+
+uint32_t demo_switch_stage_stats(demo_switch_t* demo_switch, demo_stage_stats_t* stats, uint32_t max_count)
+{
+    /* Holding the mutex keeps the app from being destroyed */
+    k_mutex_lock(&demo_switch->mutex, K_FOREVER);
+    uint32_t count = 0;
+    demo_instance_t* instance = atomic_ptr_get(&demo_switch->current);
+    if (instance != NULL
+        && instance->vtable->size >= offsetof(demo_app_vtable_t, stage_stats) + sizeof(instance->vtable->stage_stats)) {
+        count = instance->vtable->stage_stats(instance->app, stats, max_count);
+    }
+    k_mutex_unlock(&demo_switch->mutex);
+    return count;
+}
+
+void demo_switch_set_load_level(demo_instance_t* instance, uint8_t level)
+{
+    if (level == instance->load_level) {
+        return;
+    }
+    if (instance->vtable->size >= offsetof(demo_app_vtable_t, set_load_level) + sizeof(instance->vtable->set_load_level)) {
+        instance->vtable->set_load_level(instance->app, level);
+    }
+    instance->load_level = level;
+}
+
+void demo_switch_apply_params(demo_instance_t* instance, const param_set_t* set)
+{
+    if (set->owner != instance->vtable || set->generation == instance->param_generation) {
+        return;
+    }
+    if (instance->vtable->size >= offsetof(demo_app_vtable_t, set_params) + sizeof(instance->vtable->set_params)) {
+        instance->vtable->set_params(instance->app, set->values, set->count);
+    }
+    instance->param_generation = set->generation;
+}
+
+static bool in_use(demo_switch_t* demo_switch, demo_instance_t* instance)
+{
+    for (int t = 0; t < DEMO_SWITCH_THREAD_COUNT; t++) {
+        if (atomic_ptr_get(&demo_switch->in_use[t]) == instance) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Unpublishes instance if it is still current, and destroys its app once
+   no thread uses it */
+static void retire(demo_switch_t* demo_switch, demo_instance_t* instance)
+{
+    if (atomic_ptr_get(&demo_switch->current) == instance) {
+        atomic_ptr_set(&demo_switch->current, NULL);
+    }
+    while (in_use(demo_switch, instance)) {
+        k_msleep(1);
+    }
+    demo_registry_destroy(instance->vtable, instance->app);
+    instance->vtable = NULL;
+    instance->app = NULL;
+}
+
+int demo_switch_select(demo_switch_t* demo_switch, const demo_app_vtable_t* vtable)
+{
+    k_mutex_lock(&demo_switch->mutex, K_FOREVER);
+    demo_instance_t* old = atomic_ptr_get(&demo_switch->current);
+    if (old != NULL && old->vtable == vtable) {
+        k_mutex_unlock(&demo_switch->mutex);
+        return 0;
+    }
+
+    bool deferred = demo_switch->deferred_analysis && vtable->tx_channel_mask == 0;
+    demo_instance_t* instance = &demo_switch->slots[old == &demo_switch->slots[0] ? 1 : 0];
+    /* Returns NULL if the arena has no room next to the old app */
+    void* app = old == NULL || old->deferred == deferred
+        ? demo_registry_create(vtable, demo_switch->sample_rate)
+        : NULL;
+    bool seamless = old != NULL && app != NULL;
+    if (old != NULL && !seamless) {
+        retire(demo_switch, old);
+        app = demo_registry_create(vtable, demo_switch->sample_rate);
+    }
+    if (app == NULL) {
+        k_mutex_unlock(&demo_switch->mutex);
+        return -ENOMEM;
+    }
+
+    instance->vtable = vtable;
+    instance->app = app;
+    instance->deferred = deferred;
+    instance->load_level = DEMO_LOAD_FULL;
+    instance->param_generation = 0;
+    atomic_ptr_set(&demo_switch->current, instance);
+    if (seamless) {
+        retire(demo_switch, old);
+        demo_switch->seamless_swap_count++;
+    } else if (old != NULL) {
+        demo_switch->gap_swap_count++;
+    }
+    k_mutex_unlock(&demo_switch->mutex);
+    return 0;
+}
@@ -0,0 +1,96 @@
+#ifndef DEMO_SWITCH_H
+#define DEMO_SWITCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/zephyr.h>
+#include <microdsp_demos/microdsp_demos.h>
+
+#include "param_store.h"
+
+/* Runtime selection of the demo app among the ones in the registry, see
+   demo_registry_* in microdsp_demos.h.
+
+   A control thread, e.g the shell, creates the new app while the old one
+   keeps running, and publishes it with an atomic pointer swap. The
+   threads running apps pick up the current app at the start of every
+   block, so the audio thread never waits for a swap. Each of them marks
+   the app it is using (a hazard pointer), and the old app is destroyed
+   once neither of them uses it any more.
+
+   Apps without tx channels run on the analysis thread (deferred), the
+   others on the audio thread (inline). Going from one kind to the other,
+   the old app is retired before the new one is published, so that two
+   apps never run at the same time and share the app event queues. The
+   output is silent either way, since one of them has no tx channels.
+   The old app is also retired first if the arena has no room for both,
+   in which case the output is silent until the new app has been created. */
+
+typedef enum {
+    DEMO_SWITCH_AUDIO_THREAD = 0,
+    DEMO_SWITCH_ANALYSIS_THREAD = 1,
+    DEMO_SWITCH_THREAD_COUNT
+} demo_switch_thread_t;
+
+typedef struct {
+    const demo_app_vtable_t* vtable;
+    void* app;
+    /* Runs on the analysis thread */
+    bool deferred;
+    /* The demo_load_level_t last passed to the app */
+    uint8_t load_level;
+    /* Generation of the param_set_t last passed to the app, 0 for none */
+    uint32_t param_generation;
+} demo_instance_t;
+
+typedef struct {
+    /* A new app is created in the slot not holding the current one */
+    demo_instance_t slots[2];
+    /* The demo_instance_t the app threads should run, NULL for none */
+    atomic_ptr_t current;
+    /* The demo_instance_t each thread is using, NULL while it uses none */
+    atomic_ptr_t in_use[DEMO_SWITCH_THREAD_COUNT];
+    float sample_rate;
+    /* Whether apps without tx channels run on the analysis thread */
+    bool deferred_analysis;
+    /* Serializes swaps */
+    struct k_mutex mutex;
+    /* Swaps with the old app running until the new one took over, and
+       swaps with no app running in between */
+    uint32_t seamless_swap_count;
+    uint32_t gap_swap_count;
+} demo_switch_t;
+
+void demo_switch_init(demo_switch_t* demo_switch, float sample_rate, bool deferred_analysis);
+
+/* Control threads. Makes the app of vtable the current one, creating it
+   and destroying the previous app. Blocks until no thread uses the
+   previous app any more, which takes up to a block. Returns 0, or
+   -ENOMEM if the app could not be created, in which case no app is
+   current. */
+int demo_switch_select(demo_switch_t* demo_switch, const demo_app_vtable_t* vtable);
+
+/* App threads. Returns the app to run for the next block, NULL if there
+   is none, and marks it as used by thread until demo_switch_release. */
+demo_instance_t* demo_switch_acquire(demo_switch_t* demo_switch, demo_switch_thread_t thread);
+void demo_switch_release(demo_switch_t* demo_switch, demo_switch_thread_t thread);
+
+/* The current app, NULL if there is none */
+const demo_app_vtable_t* demo_switch_current(demo_switch_t* demo_switch);
+
+/* App threads. Passes a demo_load_level_t on to the app of instance if
+   it differs from the last one, see demo_app_set_load_level. */
+void demo_switch_set_load_level(demo_instance_t* instance, uint8_t level);
+
+/* App threads. Passes the values of set on to the app of instance if they
+   are meant for its demo and it has not seen them yet, see
+   demo_app_set_params. */
+void demo_switch_apply_params(demo_instance_t* instance, const param_set_t* set);
+
+/* Control threads. Copies the stage stats of the current app, see
+   demo_app_stage_stats. The app threads keep updating them meanwhile, so
+   the counts of a stage may be a block apart. Returns 0 if there is no
+   app or it has no stages. */
+uint32_t demo_switch_stage_stats(demo_switch_t* demo_switch, demo_stage_stats_t* stats, uint32_t max_count);
+
+#endif
@@ -0,0 +1,41 @@
+#include "event_queue.h"
+
+#include <zephyr/zephyr.h>
+
+#define EVENT_QUEUE_INDEX_MASK (EVENT_QUEUE_CAPACITY - 1)
+BUILD_ASSERT((EVENT_QUEUE_CAPACITY & EVENT_QUEUE_INDEX_MASK) == 0, "EVENT_QUEUE_CAPACITY must be a power of two");
+
+void event_queue_init(event_queue_t* queue)
+{
+    atomic_set(&queue->push_count, 0);
+    atomic_set(&queue->pop_count, 0);
+}
+
+bool event_queue_push(event_queue_t* queue, const app_event_t* event)
+{
+    uint32_t push_count = (uint32_t)atomic_get(&queue->push_count);
+    uint32_t pop_count = (uint32_t)atomic_get(&queue->pop_count);
+    if (push_count - pop_count == EVENT_QUEUE_CAPACITY) {
+        return false;
+    }
+    queue->events[push_count & EVENT_QUEUE_INDEX_MASK] = *event;
+    /* atomic_set is a full barrier, so the event is written before it is published */
+    atomic_set(&queue->push_count, (atomic_val_t)(push_count + 1));
+    return true;
+}
+
+uint32_t event_queue_pop(event_queue_t* queue, app_event_t* events, uint32_t max_count)
+{
+    uint32_t pop_count = (uint32_t)atomic_get(&queue->pop_count);
+    uint32_t push_count = (uint32_t)atomic_get(&queue->push_count);
+    uint32_t count = push_count - pop_count;
+    if (count > max_count) {
+        count = max_count;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        events[i] = queue->events[(pop_count + i) & EVENT_QUEUE_INDEX_MASK];
+    }
+    /* Hands the slots back to the producer once they have been read */
+    atomic_set(&queue->pop_count, (atomic_val_t)(pop_count + count));
+    return count;
+}
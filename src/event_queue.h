@@ -0,0 +1,33 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/sys/atomic.h>
+#include <microdsp_demos/microdsp_demos.h>
+
+/* Lock-free single producer, single consumer queue of app events. One
+   context (e.g an ISR or the audio thread) may push while one other
+   context pops, without any locking. */
+
+/* Must be a power of two */
+#define EVENT_QUEUE_CAPACITY 32
+
+typedef struct {
+    app_event_t events[EVENT_QUEUE_CAPACITY];
+    /* Free running counts of pushed and popped events. Each is only
+       written by one side. */
+    atomic_t push_count;
+    atomic_t pop_count;
+} event_queue_t;
+
+void event_queue_init(event_queue_t* queue);
+
+/* Producer side. Returns false if the queue is full. */
+bool event_queue_push(event_queue_t* queue, const app_event_t* event);
+
+/* Consumer side. Moves up to max_count events, oldest first, to events
+   and returns the number of events moved. */
+uint32_t event_queue_pop(event_queue_t* queue, app_event_t* events, uint32_t max_count);
+
+#endif
@@ -1,50 +1,95 @@
 #include "i2s.h"
+#include "audio_clock_config.h"
+#include "audio_stats.h"
+#include "pcm_convert.h"
 #include <zephyr.h>
 #include <zephyr/kernel/thread.h>
 
 /***********************************************************
  * Audio buffers
  ***********************************************************/
-#define AUDIO_BUFFER_N_FRAMES 256
 #define AUDIO_BUFFER_N_CHANNELS 2
 #define BYTES_PER_SAMPLE 4 /* 24 bit samples are transfered in 32 bit words */
-#define AUDIO_BUFFER_N_SAMPLES (AUDIO_BUFFER_N_FRAMES * AUDIO_BUFFER_N_CHANNELS)
-#define AUDIO_BUFFER_BYTE_SIZE (BYTES_PER_SAMPLE * AUDIO_BUFFER_N_SAMPLES)
-#define AUDIO_BUFFER_WORD_SIZE (AUDIO_BUFFER_BYTE_SIZE / 4)
-
-/* Floating point mono scratch buffers. */
-static float scratch_buffer_out[AUDIO_BUFFER_N_FRAMES];
-static float scratch_buffer_in[AUDIO_BUFFER_N_FRAMES];
-
-/* Use two pairs of rx/tx buffers for double buffering,
-   i.e process/render one pair of buffers while the other is
-   being received/transfered. */
-static int32_t __attribute__((aligned(4))) rx_1[AUDIO_BUFFER_N_SAMPLES];
-static int32_t __attribute__((aligned(4))) tx_1[AUDIO_BUFFER_N_SAMPLES];
-static int32_t __attribute__((aligned(4))) rx_2[AUDIO_BUFFER_N_SAMPLES];
-static int32_t __attribute__((aligned(4))) tx_2[AUDIO_BUFFER_N_SAMPLES];
-nrfx_i2s_buffers_t nrfx_i2s_buffers_1 = {
-    .p_rx_buffer = (uint32_t *)(&rx_1), .p_tx_buffer = (uint32_t *)(&tx_1)
-};
-nrfx_i2s_buffers_t nrfx_i2s_buffers_2 = {
-    .p_rx_buffer = (uint32_t *)(&rx_2), .p_tx_buffer = (uint32_t *)(&tx_2)
-};
+
+/* Each LRCK period has to fit two 24 bit samples */
+BUILD_ASSERT(AUDIO_I2S_RATIO % (AUDIO_BUFFER_N_CHANNELS * 24) == 0, "AUDIO_I2S_RATIO must be a multiple of 48");
+#define AUDIO_BUFFER_POOL_N_SAMPLES (I2S_BUFFER_POOL_N_FRAMES * AUDIO_BUFFER_N_CHANNELS)
+
+/* Floating point planar scratch buffers, one per channel. A period is
+   at most the pool shared by the shortest ring. */
+#if I2S_BUFFER_POOL_N_FRAMES / I2S_MIN_RING_DEPTH < I2S_MAX_PERIOD_N_FRAMES
+#define SCRATCH_N_FRAMES (I2S_BUFFER_POOL_N_FRAMES / I2S_MIN_RING_DEPTH)
+#else
+#define SCRATCH_N_FRAMES I2S_MAX_PERIOD_N_FRAMES
+#endif
+static float scratch_buffer_out[AUDIO_MAX_CHANNELS][SCRATCH_N_FRAMES];
+static float scratch_buffer_in[AUDIO_MAX_CHANNELS][SCRATCH_N_FRAMES];
+
+/* Pools that the rx/tx buffers of each period in the ring are taken
+   from. One period is processed/rendered while the others are
+   being received/transfered or are waiting to be. */
+static int32_t __attribute__((aligned(4))) rx_pool[AUDIO_BUFFER_POOL_N_SAMPLES];
+static int32_t __attribute__((aligned(4))) tx_pool[AUDIO_BUFFER_POOL_N_SAMPLES];
+static nrfx_i2s_buffers_t buffer_ring[I2S_MAX_RING_DEPTH];
+static i2s_buffer_cfg_t buffer_cfg;
 
 /***********************************************************
  * Audio processing synchronization
+ *
+ * Periods are released by the driver, processed and handed
+ * back to the driver in ring order, so they are tracked
+ * using free running sequence numbers. The period with
+ * sequence number n uses buffer_ring[n % ring_depth].
  ***********************************************************/
-/* Flag indicating which buffer pair is currently available for
-   processing/rendering. */
-static int processing_buffers_1 = 0;
+/* Number of periods released by the driver. Only accessed from the ISR. */
+static uint32_t released_count = 0;
+/* Number of periods handed to the driver, including the first one passed
+   to nrfx_i2s_start. Sequence numbers below ready_limit have been processed
+   and may be handed to the driver. Both are updated by the ISR and by the
+   processing thread with interrupts locked. */
+static uint32_t queued_count = 0;
+static uint32_t ready_limit = 0;
+/* Set when the driver asked for the next buffers but the next period
+   in the ring had not been processed yet. The processing thread hands
+   it over as soon as it is done. */
+static bool next_buffers_pending = false;
 /* A semaphore used to trigger audio processing on a dedicated thread
-   from the I2S interrupt handler. */
-K_SEM_DEFINE(processing_thread_semaphore, 0, 1);
-/* Indicates if the current buffer pair is being processed/rendered. */
-atomic_t processing_in_progress = ATOMIC_INIT(0x00);
+   from the I2S interrupt handler. Counts released periods. */
+K_SEM_DEFINE(processing_thread_semaphore, 0, I2S_MAX_RING_DEPTH);
 /* Indicates if a dropout occurred, i.e that audio buffers were
    not processed in time for the next buffer swap. */
 atomic_t dropout_occurred = ATOMIC_INIT(0x00);
 
+/* Time of the most recent NRFX_I2S_STATUS_NEXT_BUFFERS_NEEDED event
+   and the number of cycles since the one before it, which stays 0 until
+   there has been a previous event. k_cycle_get_32 wraps and may return
+   0, so whether there was one is tracked separately. */
+uint32_t processing_sem_give_time = 0;
+uint32_t buffer_period_cycles = 0;
+static bool has_previous_event = false;
+/* Time at which each period in the ring was released */
+static uint32_t release_times[I2S_MAX_RING_DEPTH];
+
+/* True if the hardware has latched the buffer pointers for a new period,
+   but the interrupt handler has not handled it yet */
+static bool pointer_update_pending(void)
+{
+    return nrf_i2s_event_check(NRF_I2S0, NRF_I2S_EVENT_TXPTRUPD)
+        || nrf_i2s_event_check(NRF_I2S0, NRF_I2S_EVENT_RXPTRUPD);
+}
+
+/* Must be called from the ISR or with interrupts locked */
+static void queue_next_buffers(void)
+{
+    nrfx_i2s_buffers_t* buffers = &buffer_ring[queued_count % buffer_cfg.ring_depth];
+    nrfx_err_t result = nrfx_i2s_next_buffers_set(buffers);
+    if (result != NRFX_SUCCESS) {
+        __ASSERT(result == NRFX_SUCCESS, "nrfx_i2s_next_buffers_set failed with result %d", result);
+        return;
+    }
+    queued_count++;
+}
+
 /***********************************************************
  * Audio processing thread
  ***********************************************************/
@@ -54,66 +99,99 @@ atomic_t dropout_occurred = ATOMIC_INIT(0x00);
 K_THREAD_STACK_DEFINE(processing_thread_stack_area, PROCESSING_THREAD_STACK_SIZE);
 struct k_thread processing_thread_data;
 
-uint32_t processing_sem_give_time = 0;
-
 static void processing_thread_entry_point(void *p1, void *p2, void *p3) {
+    /* Sequence number of the next period to process */
+    uint32_t processed_count = 0;
     while (true) {
         if (k_sem_take(&processing_thread_semaphore, K_FOREVER) == 0) {
             audio_callbacks_t* audio_callbacks = (audio_callbacks_t*)p1;
+            uint32_t slot = processed_count % buffer_cfg.ring_depth;
+            uint32_t period_n_frames = buffer_cfg.period_n_frames;
+            uint32_t processing_sem_take_time = k_cycle_get_32();
+            uint32_t wakeup_latency_cycles = processing_sem_take_time - release_times[slot];
+            uint32_t period_cycles = buffer_period_cycles;
             if (atomic_test_bit(&dropout_occurred, 0)) {
+                audio_stats_record_dropout();
                 audio_callbacks->dropout_cb(audio_callbacks->cb_data);
                 atomic_clear_bit(&dropout_occurred, 0);
             }
-            uint32_t processing_sem_take_time = k_cycle_get_32();
-            uint32_t cycles_spent = processing_sem_take_time - processing_sem_give_time;
-            uint32_t ns_spent = k_cyc_to_ns_ceil32(cycles_spent);
-            /* printk("processing thread start took %d ns\n", ns_spent); */
-
-            if (!atomic_test_bit(&processing_in_progress, 0)) {
-                printk("processing_in_progress is not set");
-                __ASSERT(atomic_test_bit(&processing_in_progress, 0), "processing_in_progress is not set");
-            }
 
-            nrfx_i2s_buffers_t* buffers_to_process = processing_buffers_1 ? &nrfx_i2s_buffers_1 : &nrfx_i2s_buffers_2;
+            nrfx_i2s_buffers_t* buffers_to_process = &buffer_ring[slot];
             int32_t *tx = (int32_t *)buffers_to_process->p_tx_buffer;
             int32_t *rx = (int32_t *)buffers_to_process->p_rx_buffer;
 
-            /* Convert incoming audio from PCM, discarding right channel */
-            float max_sq = 0.0;
-            for (int i = 0; i < AUDIO_BUFFER_N_FRAMES; i++) {
-                int32_t rx_l = rx[2 * i];
-                float val_f = rx_l / (float)8388607.0;
-                scratch_buffer_in[i] = val_f;
-            }
+            if (audio_callbacks->processing_i32_cb) {
+                /* Process the DMA buffers in place */
+                audio_callbacks->processing_i32_cb(
+                    audio_callbacks->cb_data,
+                    period_n_frames,
+                    tx,
+                    rx
+                );
+            } else {
+                float* tx_channels[AUDIO_MAX_CHANNELS] = { NULL };
+                float* rx_channels[AUDIO_MAX_CHANNELS] = { NULL };
+                for (int c = 0; c < AUDIO_MAX_CHANNELS; c++) {
+                    if (audio_callbacks->rx_channel_mask & (1 << c)) {
+                        rx_channels[c] = scratch_buffer_in[c];
+                    }
+                    if (audio_callbacks->tx_channel_mask & (1 << c)) {
+                        tx_channels[c] = scratch_buffer_out[c];
+                        memset(scratch_buffer_out[c], 0, period_n_frames * sizeof(float));
+                    }
+                }
 
-            /* Process audio using the proved callback */
-            memset(scratch_buffer_out, 0, AUDIO_BUFFER_N_FRAMES * sizeof(float));
-            audio_callbacks->processing_cb(
-                audio_callbacks->cb_data,
-                AUDIO_BUFFER_N_FRAMES,
-                scratch_buffer_out,
-                scratch_buffer_in
-            );
+                /* Convert incoming audio from PCM, skipping unused channels */
+                pcm_deinterleave_to_float(rx, period_n_frames, rx_channels[0], rx_channels[1]);
 
-            /* Convert outgoing audio to PCM */
-            int32_t tx_min = 0;
-            int32_t tx_max = 0;
-            for (int i = 0; i < AUDIO_BUFFER_N_FRAMES; i++) {
-                int32_t tx_curr = scratch_buffer_out[i] * 8388607.0f;
-                tx[2 * i] = tx_curr;
-                tx[2 * i + 1] = tx_curr;
+                /* Process audio using the provided callback */
+                audio_callbacks->processing_cb(
+                    audio_callbacks->cb_data,
+                    period_n_frames,
+                    tx_channels,
+                    (const float* const*)rx_channels
+                );
+
+                /* Convert outgoing audio to PCM. A single channel is written
+                   to both outputs. Without any tx channels the tx buffers
+                   keep the silence they were initialized with. */
+                if (audio_callbacks->tx_channel_mask) {
+                    pcm_interleave_from_float(tx, period_n_frames, tx_channels[0], tx_channels[1]);
+                }
             }
 
-            /* Swap buffers */
-            nrfx_err_t result = nrfx_i2s_next_buffers_set(buffers_to_process);
-            if (result != NRFX_SUCCESS) {
-                /* printk("nrfx_i2s_next_buffers_set failed with %d\n", result); */
-                __ASSERT(result == NRFX_SUCCESS, "nrfx_i2s_next_buffers_set failed with result %d", result);
+            uint32_t processing_cycles = k_cycle_get_32() - processing_sem_take_time;
+            uint32_t deadline_cycles = (buffer_cfg.ring_depth - 1) * period_cycles;
+            audio_stats_record_block(
+                wakeup_latency_cycles,
+                processing_cycles,
+                period_cycles,
+                deadline_cycles
+            );
+            /* No deadline is known until the period has been measured */
+            if (audio_callbacks->load_cb && period_cycles > 0) {
+                audio_callbacks->load_cb(
+                    audio_callbacks->cb_data,
+                    wakeup_latency_cycles + processing_cycles,
+                    deadline_cycles
+                );
             }
-            processing_buffers_1 = !processing_buffers_1;
+            processed_count++;
 
-            /* Done processing */
-            atomic_clear_bit(&processing_in_progress, 0);
+            /* Mark the period as ready to be handed back to the driver. If the
+               driver is already waiting for it, hand it over right away,
+               unless the hardware has already moved on to the next period
+               and its interrupt is pending. The hardware has then latched
+               the old buffers again, but the driver would take the new ones
+               for current when it handles the interrupt. It is left to the
+               interrupt handler, which sees the reuse and reports a dropout. */
+            unsigned int key = irq_lock();
+            ready_limit++;
+            if (next_buffers_pending && queued_count < ready_limit && !pointer_update_pending()) {
+                next_buffers_pending = false;
+                queue_next_buffers();
+            }
+            irq_unlock(key);
         }
     }
 }
@@ -128,22 +206,70 @@ ISR_DIRECT_DECLARE(i2s_isr_handler)
 void nrfx_i2s_data_handler(nrfx_i2s_buffers_t const *p_released, uint32_t status)
 {
     if (status == NRFX_I2S_STATUS_NEXT_BUFFERS_NEEDED) {
-        if (atomic_test_bit(&processing_in_progress, 0) == false) {
-            atomic_set_bit(&processing_in_progress, 0);
-            processing_sem_give_time = k_cycle_get_32();
+        uint32_t now = k_cycle_get_32();
+        if (has_previous_event) {
+            buffer_period_cycles = now - processing_sem_give_time;
+        }
+        processing_sem_give_time = now;
+        has_previous_event = true;
+
+        /* Pass released buffers on for processing. Nothing has been
+           released on the first event after starting. */
+        if (p_released != NULL && p_released->p_rx_buffer != NULL) {
+            uint32_t slot = released_count % buffer_cfg.ring_depth;
+            __ASSERT(p_released->p_rx_buffer == buffer_ring[slot].p_rx_buffer, "Unexpected released buffer");
+            release_times[slot] = now;
+            released_count++;
             k_sem_give(&processing_thread_semaphore);
-        } else {
-            /* Missed deadline! */
+        }
+
+        if (next_buffers_pending) {
+            /* Missed deadline! The previous request for buffers was never served. */
             atomic_set_bit(&dropout_occurred, 0);
         }
+        if (queued_count < ready_limit) {
+            next_buffers_pending = false;
+            queue_next_buffers();
+        } else {
+            next_buffers_pending = true;
+        }
     }
     else if (status == NRFX_I2S_STATUS_TRANSFER_STOPPED) {
         /* */
     }
 }
 
-nrfx_err_t i2s_start(i2s_pin_cfg_t* pin_cfg, audio_callbacks_t* audio_callbacks)
+nrfx_err_t i2s_start(
+    i2s_pin_cfg_t* pin_cfg,
+    const i2s_buffer_cfg_t* cfg,
+    audio_callbacks_t* audio_callbacks
+)
 {
+    if (cfg->period_n_frames < I2S_MIN_PERIOD_N_FRAMES ||
+        cfg->period_n_frames > I2S_MAX_PERIOD_N_FRAMES ||
+        cfg->ring_depth < I2S_MIN_RING_DEPTH ||
+        cfg->ring_depth > I2S_MAX_RING_DEPTH ||
+        cfg->period_n_frames * cfg->ring_depth > I2S_BUFFER_POOL_N_FRAMES) {
+        printk("i2s_start: invalid buffer config, %d frames x %d periods\n", cfg->period_n_frames, cfg->ring_depth);
+        return NRFX_ERROR_INVALID_PARAM;
+    }
+
+    /* Carve the ring out of the buffer pools. All periods start out as
+       silence that is ready to be transferred. */
+    buffer_cfg = *cfg;
+    uint32_t period_n_samples = cfg->period_n_frames * AUDIO_BUFFER_N_CHANNELS;
+    for (int i = 0; i < cfg->ring_depth; i++) {
+        buffer_ring[i].p_rx_buffer = (uint32_t *)&rx_pool[i * period_n_samples];
+        buffer_ring[i].p_tx_buffer = (uint32_t *)&tx_pool[i * period_n_samples];
+    }
+    memset(tx_pool, 0, sizeof(tx_pool));
+    released_count = 0;
+    queued_count = 1; /* The first period is passed to nrfx_i2s_start */
+    ready_limit = cfg->ring_depth;
+    next_buffers_pending = false;
+    has_previous_event = false;
+    buffer_period_cycles = 0;
+
     /* Start a dedicated, high priority thread for audio processing. */
     k_tid_t processing_thread_tid = k_thread_create(
         &processing_thread_data,
@@ -163,8 +289,8 @@ nrfx_err_t i2s_start(i2s_pin_cfg_t* pin_cfg, audio_callbacks_t* audio_callbacks)
         .mck_pin = pin_cfg->mck_pin,
         .sdout_pin = pin_cfg->sdout_pin,
         .sdin_pin = pin_cfg->sdin_pin,
-        .mck_setup = NRF_I2S_MCK_32MDIV15,
-        .ratio = NRF_I2S_RATIO_48X,
+        .mck_setup = AUDIO_I2S_MCK_SETUP,
+        .ratio = AUDIO_I2S_RATIO_SETUP,
         .irq_priority = NRFX_I2S_DEFAULT_CONFIG_IRQ_PRIORITY,
         .mode = NRF_I2S_MODE_MASTER,
         .format = NRF_I2S_FORMAT_I2S,
@@ -180,7 +306,9 @@ nrfx_err_t i2s_start(i2s_pin_cfg_t* pin_cfg, audio_callbacks_t* audio_callbacks)
         return result;
     }
 
-    result = nrfx_i2s_start(&nrfx_i2s_buffers_1, AUDIO_BUFFER_WORD_SIZE, 0);
+    /* Buffer size is given in 32 bit words */
+    uint16_t buffer_word_size = period_n_samples * BYTES_PER_SAMPLE / 4;
+    result = nrfx_i2s_start(&buffer_ring[0], buffer_word_size, 0);
     if (result != NRFX_SUCCESS) {
         printk("nrfx_i2s_start failed with result %d", result);
         __ASSERT(result == NRFX_SUCCESS, "nrfx_i2s_start failed with result %d", result);
@@ -188,4 +316,4 @@ nrfx_err_t i2s_start(i2s_pin_cfg_t* pin_cfg, audio_callbacks_t* audio_callbacks)
     }
 
     return NRFX_SUCCESS;
-}
\ No newline at end of file
+}
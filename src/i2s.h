@@ -4,6 +4,20 @@
 #include <nrfx_i2s.h>
 #include "audio_callbacks.h"
 
+/* Limits for the period size, i.e the number of frames passed to
+   the processing callback at a time. */
+#define I2S_MIN_PERIOD_N_FRAMES 32
+#define I2S_MAX_PERIOD_N_FRAMES 1024
+/* Limits for the number of periods in the buffer ring. */
+#define I2S_MIN_RING_DEPTH 2
+#define I2S_MAX_RING_DEPTH 4
+/* All periods in the ring are taken from a statically allocated pool,
+   i.e period_n_frames * ring_depth must not exceed this. The default
+   fits the 256 frame periods and ring depth of 2 used in main.c. */
+#ifndef I2S_BUFFER_POOL_N_FRAMES
+#define I2S_BUFFER_POOL_N_FRAMES 512
+#endif
+
 typedef struct {
     uint8_t sck_pin;
     uint8_t lrck_pin;
@@ -12,6 +26,19 @@ typedef struct {
     uint8_t sdin_pin;
 } i2s_pin_cfg_t;
 
-nrfx_err_t i2s_start(i2s_pin_cfg_t* pin_cfg, audio_callbacks_t* audio_callbacks);
+/* Trades latency for dropout tolerance. A processed period is handed back
+   to the driver (ring_depth - 1) periods after it was received, which is
+   also the time available for processing it. The round trip latency is
+   ring_depth periods. */
+typedef struct {
+    uint16_t period_n_frames;
+    uint8_t ring_depth;
+} i2s_buffer_cfg_t;
+
+nrfx_err_t i2s_start(
+    i2s_pin_cfg_t* pin_cfg,
+    const i2s_buffer_cfg_t* buffer_cfg,
+    audio_callbacks_t* audio_callbacks
+);
 
-#endif
\ No newline at end of file
+#endif
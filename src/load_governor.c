@@ -0,0 +1,113 @@
+#include "load_governor.h"
+#include "seqlock.h"
+
+#include <zephyr/zephyr.h>
+#include <string.h>
+
+static const char* level_names[LOAD_GOVERNOR_LEVEL_COUNT] = { "full", "reduced", "minimal" };
+
+static load_governor_config_t config = LOAD_GOVERNOR_DEFAULT_CONFIG;
+/* Blocks in a row with a load below restore_permille */
+static uint32_t quiet_block_count;
+static atomic_t level = ATOMIC_INIT(DEMO_LOAD_FULL);
+static load_governor_stats_t stats;
+static seqlock_t stats_lock = SEQLOCK_INIT;
+static atomic_t reset_requested = ATOMIC_INIT(0);
+
+void load_governor_init(const load_governor_config_t* new_config)
+{
+    config = *new_config;
+    quiet_block_count = 0;
+    atomic_set(&level, DEMO_LOAD_FULL);
+    memset(&stats, 0, sizeof(stats));
+    atomic_set(&reset_requested, 0);
+}
+
+demo_load_level_t load_governor_update(uint32_t load_permille)
+{
+    demo_load_level_t current = (demo_load_level_t)atomic_get(&level);
+    demo_load_level_t next = current;
+    if (load_permille >= config.minimal_permille) {
+        next = DEMO_LOAD_MINIMAL;
+    } else if (load_permille >= config.reduce_permille && current < DEMO_LOAD_REDUCED) {
+        next = DEMO_LOAD_REDUCED;
+    }
+
+    bool raised = next > current;
+    bool restored = false;
+    if (raised || load_permille >= config.restore_permille) {
+        quiet_block_count = 0;
+    } else if (current > DEMO_LOAD_FULL && ++quiet_block_count >= config.restore_blocks) {
+        next = current - 1;
+        quiet_block_count = 0;
+        restored = true;
+    }
+    if (next != current) {
+        atomic_set(&level, next);
+    }
+
+    seqlock_write_begin(&stats_lock);
+    if (atomic_clear(&reset_requested)) {
+        memset(&stats, 0, sizeof(stats));
+    }
+    stats.block_count++;
+    /* The block was processed at the old level */
+    stats.level_block_counts[current]++;
+    stats.raise_count += raised;
+    stats.restore_count += restored;
+    if (load_permille > stats.max_load_permille) {
+        stats.max_load_permille = load_permille;
+    }
+    stats.level = next;
+    seqlock_write_end(&stats_lock);
+    return next;
+}
+
+demo_load_level_t load_governor_level(void)
+{
+    return (demo_load_level_t)atomic_get(&level);
+}
+
+void load_governor_snapshot(load_governor_stats_t* result)
+{
+    seqlock_read(&stats_lock, result, &stats, sizeof(stats));
+}
+
+void load_governor_request_reset(void)
+{
+    atomic_set(&reset_requested, 1);
+}
+
+void load_governor_print(const load_governor_stats_t* stats)
+{
+    printk("load governor: level %s, %u blocks, %u raises, %u restores, max load %u/1000\n",
+        level_names[stats->level], stats->block_count, stats->raise_count, stats->restore_count,
+        stats->max_load_permille);
+    for (int i = 0; i < LOAD_GOVERNOR_LEVEL_COUNT; i++) {
+        printk("  %-8s %u blocks\n", level_names[i], stats->level_block_counts[i]);
+    }
+}
+
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+
+static int cmd_load_governor(const struct shell *sh, size_t argc, char **argv)
+{
+    load_governor_stats_t snapshot;
+    load_governor_snapshot(&snapshot);
+    load_governor_print(&snapshot);
+    return 0;
+}
+
+static int cmd_load_governor_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    load_governor_request_reset();
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(load_governor_cmds,
+    SHELL_CMD(reset, NULL, "Clear load governor counters", cmd_load_governor_reset),
+    SHELL_SUBCMD_SET_END
+);
+SHELL_CMD_REGISTER(load_governor, &load_governor_cmds, "Print load governor decisions", cmd_load_governor);
+#endif
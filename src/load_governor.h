@@ -0,0 +1,76 @@
+#ifndef LOAD_GOVERNOR_H
+#define LOAD_GOVERNOR_H
+
+#include <stdint.h>
+#include <microdsp_demos/microdsp_demos.h>
+
+/* Decides how much of the CPU the demo app may use, as a
+   demo_load_level_t, from the load of each audio block. The load is the
+   share of the block deadline that was used, in permille.
+
+   Loads at or above a threshold raise the level right away, so that the
+   app gets cheaper before the deadline is missed, e.g while BLE or other
+   work on the same core delays the audio thread. The level is lowered
+   again one step at a time, once the load has stayed below the restore
+   threshold for restore_blocks blocks in a row. The gap between the
+   thresholds and the wait keep the level from flapping.
+
+   The audio thread is the only writer. Other threads read the level and
+   consistent snapshots of the counters without taking any locks. */
+
+#define LOAD_GOVERNOR_LEVEL_COUNT (DEMO_LOAD_MINIMAL + 1)
+
+typedef struct {
+    /* Loads at or above which the level is raised to at least
+       DEMO_LOAD_REDUCED and DEMO_LOAD_MINIMAL */
+    uint16_t reduce_permille;
+    uint16_t minimal_permille;
+    /* Loads below which the level is lowered again, after restore_blocks
+       consecutive blocks */
+    uint16_t restore_permille;
+    uint16_t restore_blocks;
+} load_governor_config_t;
+
+/* 0.7 and 0.9 of the deadline, restored after about 0.6 s below 0.5 of
+   it with 256 frame blocks at 44.1 kHz */
+#define LOAD_GOVERNOR_DEFAULT_CONFIG { \
+    .reduce_permille = 700, \
+    .minimal_permille = 900, \
+    .restore_permille = 500, \
+    .restore_blocks = 100, \
+}
+
+typedef struct {
+    uint32_t block_count;
+    /* Blocks processed at each demo_load_level_t */
+    uint32_t level_block_counts[LOAD_GOVERNOR_LEVEL_COUNT];
+    /* Number of times the level was raised and lowered */
+    uint32_t raise_count;
+    uint32_t restore_count;
+    uint32_t max_load_permille;
+    /* Current demo_load_level_t */
+    uint8_t level;
+} load_governor_stats_t;
+
+/* Clears the counters and starts at DEMO_LOAD_FULL. Call before the
+   audio thread starts. */
+void load_governor_init(const load_governor_config_t* config);
+
+/* Called from the audio thread once per processed block. Returns the
+   level for the next block. */
+demo_load_level_t load_governor_update(uint32_t load_permille);
+
+/* The current level. Safe to call from any thread. */
+demo_load_level_t load_governor_level(void);
+
+/* Copies a consistent snapshot of the counters. Safe to call from any
+   thread with lower priority than the audio thread. */
+void load_governor_snapshot(load_governor_stats_t* result);
+
+/* Asks the audio thread to clear the counters, but not the level, before
+   the next block. */
+void load_governor_request_reset(void);
+
+void load_governor_print(const load_governor_stats_t* stats);
+
+#endif
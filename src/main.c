@@ -1,13 +1,28 @@
 #include <zephyr/zephyr.h>
 #include <zephyr/drivers/gpio.h>
-#include <sys/ring_buffer.h>
 #include <microdsp_demos/microdsp_demos.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+#ifdef CONFIG_TIMING_FUNCTIONS
+#include <zephyr/timing/timing.h>
+#endif
 
 #include "audio_callbacks.h"
+#include "audio_clock_config.h"
+#include "audio_stats.h"
+#include "audio_tap.h"
+#include "audio_tap_uart.h"
+#include "block_queue.h"
 #include "buttons.h"
+#include "demo_switch.h"
+#include "event_queue.h"
 #include "i2s.h"
 #include "leds.h"
+#include "load_governor.h"
+#include "param_store.h"
 #include "codecs/wm8904.h"
 
 #ifdef CONFIG_SOC_SERIES_NRF53X
@@ -30,57 +45,250 @@ static i2s_pin_cfg_t i2s_pin_cfg = {
 };
 #endif
 
-#define APP_MSG_BUFFER_SIZE 64
+/* Signals streamed to the host by the audio tap, a mask of
+   AUDIO_TAP_SOURCE_BIT. One 256 frame source takes about 92 KB/s,
+   i.e most of a 1 Mbaud UART. */
+#ifndef AUDIO_TAP_SOURCES
+#define AUDIO_TAP_SOURCES AUDIO_TAP_SOURCE_BIT(AUDIO_TAP_RX_LEFT)
+#endif
+
+/* Demo app started at boot. Falls back to the first demo in the
+   registry if the image has no demo of that name. */
+#ifndef DEFAULT_DEMO
+#define DEFAULT_DEMO "nlms"
+#endif
+
+/* Number of events moved between queues at a time */
+#define APP_EVENT_BATCH_SIZE 8
 typedef struct
 {
-    void *rust_app_ptr;
-    uint8_t msg_rx_buffer[APP_MSG_BUFFER_SIZE];
-    uint8_t msg_tx_buffer[APP_MSG_BUFFER_SIZE];
-    struct ring_buf msg_rx; /* to rust app */
-    struct ring_buf msg_tx; /* from rust app */
+    /* The running app, see demo_switch.h. The queues are shared by the
+       apps of the image, since only one of them runs at a time. */
+    demo_switch_t demo_switch;
+    /* Tunable parameters of the running app, set from the shell */
+    param_store_t params;
+    event_queue_t to_app;   /* from the button ISR */
+    event_queue_t from_app; /* to the main loop */
+    /* Number of frames processed so far. Used to timestamp incoming events. */
+    atomic_t frame_count;
 } demo_app_t;
 
 static demo_app_t demo_app;
 
-static void processing_cb(void *cb_data, uint32_t sample_count, float *tx, const float *rx)
+/* Given by the thread running the demo app when events have been queued
+   for the main loop */
+K_SEM_DEFINE(app_event_semaphore, 0, 1);
+
+/* Only pushed to by the thread running the demo app */
+static audio_tap_t audio_tap;
+static bool audio_tap_running = false;
+
+/* Streams the signals of a processed block to the host. Dropped frames
+   are counted by the tap and reported from the main loop. */
+static void tap_block(demo_app_t *demo_app, demo_instance_t *instance, unsigned int frame_count, float *const *tx, const float *const *rx)
 {
-    demo_app_t *demo_app = (demo_app_t *)cb_data;
+    uint32_t timestamp = (uint32_t)atomic_get(&demo_app->frame_count);
+    bool pushed = false;
+    for (int c = 0; c < AUDIO_MAX_CHANNELS; c++)
+    {
+        pushed |= audio_tap_push(&audio_tap, AUDIO_TAP_RX_LEFT + c, rx[c], frame_count, timestamp);
+        pushed |= audio_tap_push(&audio_tap, AUDIO_TAP_TX_LEFT + c, tx[c], frame_count, timestamp);
+    }
+    if (audio_tap_enabled(&audio_tap, AUDIO_TAP_APP))
+    {
+        const float *samples;
+        uint32_t sample_count = instance->vtable->tap_signal(instance->app, &samples);
+        pushed |= audio_tap_push(&audio_tap, AUDIO_TAP_APP, samples, sample_count, timestamp);
+    }
+    if (pushed)
+    {
+        audio_tap_uart_notify();
+    }
+}
+
+/* Passes pending events to the demo app, processes a block and passes the
+   events it produced on to the main loop. Runs on the audio thread, or on
+   the analysis thread for demos without tx channels. */
+static void run_demo_app(demo_app_t *demo_app, demo_instance_t *instance, unsigned int frame_count, float *const *tx, const float *const *rx)
+{
+    const demo_app_vtable_t *vtable = instance->vtable;
+
+    /* The I2S runs the channels of all demos in the image. Pass on the
+       ones this demo uses, the other tx channels stay silent. */
+    float *app_tx[AUDIO_MAX_CHANNELS];
+    const float *app_rx[AUDIO_MAX_CHANNELS];
+    for (int c = 0; c < AUDIO_MAX_CHANNELS; c++)
+    {
+        app_tx[c] = vtable->tx_channel_mask & (1 << c) ? tx[c] : NULL;
+        app_rx[c] = vtable->rx_channel_mask & (1 << c) ? rx[c] : NULL;
+    }
 
     /* Pass incoming messages to the demo app */
-    uint8_t command = 0;
-    while (ring_buf_get(&demo_app->msg_rx, &command, 1) > 0)
+    app_event_t events[APP_EVENT_BATCH_SIZE];
+    uint32_t event_count;
+    while ((event_count = event_queue_pop(&demo_app->to_app, events, APP_EVENT_BATCH_SIZE)) > 0)
     {
-        demo_app_handle_message(demo_app->rust_app_ptr, command);
+        for (uint32_t i = 0; i < event_count; i++)
+        {
+            vtable->handle_message(instance->app, events[i].message);
+        }
     }
 
-    /* Process audio */
-    demo_app_process(demo_app->rust_app_ptr, tx, rx, sample_count);
+    /* Let the app trade analysis quality for time while the CPU is
+       loaded, see load_governor.h */
+    demo_switch_set_load_level(instance, (uint8_t)load_governor_level());
+    /* Pick up parameters set since the last block */
+    demo_switch_apply_params(instance, param_store_take(&demo_app->params));
+
+    /* Process audio. A single tx channel is played on both outputs. */
+    vtable->process_channels(instance->app, app_tx, app_rx, frame_count);
+    if (vtable->tx_channel_mask == AUDIO_CHANNEL_LEFT && tx[1])
+    {
+        memcpy(tx[1], tx[0], frame_count * sizeof(float));
+    }
+    else if (vtable->tx_channel_mask == AUDIO_CHANNEL_RIGHT && tx[0])
+    {
+        memcpy(tx[0], tx[1], frame_count * sizeof(float));
+    }
 
     /* Debug listen to mic signal */
     if (false)
     {
-        for (int i = 0; i < sample_count; i++)
+        for (int c = 0; c < AUDIO_MAX_CHANNELS; c++)
         {
-            tx[i] = 0.5 * rx[i];
+            for (int i = 0; tx[c] && rx[c] && i < frame_count; i++)
+            {
+                tx[c][i] = 0.5 * rx[c][i];
+            }
         }
     }
 
-    /* Pass outgoing messages to the main loop */
+    /* Pass outgoing events to the main loop and wake it up */
+    bool events_queued = false;
+    while ((event_count = vtable->take_events(instance->app, events, APP_EVENT_BATCH_SIZE)) > 0)
+    {
+        for (uint32_t i = 0; i < event_count; i++)
+        {
+            /* Events are dropped if the main loop falls behind */
+            events_queued |= event_queue_push(&demo_app->from_app, &events[i]);
+        }
+    }
+    if (events_queued)
+    {
+        k_sem_give(&app_event_semaphore);
+    }
+
+    if (audio_tap_running)
+    {
+        tap_block(demo_app, instance, frame_count, tx, rx);
+    }
+
+    atomic_add(&demo_app->frame_count, frame_count);
+}
+
+/***********************************************************
+ * Deferred analysis
+ *
+ * Demos without tx channels only analyse the input, and their
+ * results are not needed within the block deadline. The audio
+ * thread just queues their rx blocks, and they are processed on
+ * a preemptible thread below it, which uses the time left over
+ * by the audio thread. If the analysis thread falls too far
+ * behind, blocks are dropped and counted as overruns. App
+ * timestamps then fall behind the stream by the dropped frames.
+ ***********************************************************/
+#define ANALYSIS_THREAD_STACK_SIZE 2048
+#define ANALYSIS_THREAD_PRIORITY K_PRIO_PREEMPT(1)
+K_THREAD_STACK_DEFINE(analysis_thread_stack_area, ANALYSIS_THREAD_STACK_SIZE);
+static struct k_thread analysis_thread_data;
+static block_queue_t analysis_queue;
+/* Given by the audio thread when a block has been queued */
+K_SEM_DEFINE(analysis_semaphore, 0, 1);
+
+static void processing_cb(void *cb_data, unsigned int frame_count, float *const *tx, const float *const *rx)
+{
+    /* Index of the first frame of the block in the rx stream */
+    static uint32_t stream_frame_count = 0;
+    demo_app_t *demo_app = (demo_app_t *)cb_data;
+    demo_instance_t *instance = demo_switch_acquire(&demo_app->demo_switch, DEMO_SWITCH_AUDIO_THREAD);
+    if (instance != NULL && instance->deferred)
+    {
+        /* Dropped blocks are counted by the queue and reported from the main loop */
+        if (block_queue_push(&analysis_queue, rx, frame_count, stream_frame_count))
+        {
+            k_sem_give(&analysis_semaphore);
+        }
+    }
+    else if (instance != NULL)
+    {
+        run_demo_app(demo_app, instance, frame_count, tx, rx);
+    }
+    /* With no app, e.g while swapping apps, tx stays silent */
+    demo_switch_release(&demo_app->demo_switch, DEMO_SWITCH_AUDIO_THREAD);
+    stream_frame_count += frame_count;
+}
+
+static void analysis_thread_entry_point(void *p1, void *p2, void *p3)
+{
+    demo_app_t *demo_app = (demo_app_t *)p1;
+    float *tx[AUDIO_MAX_CHANNELS] = { NULL };
     while (true) {
-        app_message_t message = demo_app_next_outgoing_message(demo_app->rust_app_ptr);
-        if (message == 0) {
-            break;
-        } else {
-            ring_buf_put(&demo_app->msg_tx, &message, 1);
+        k_sem_take(&analysis_semaphore, K_FOREVER);
+        audio_block_t block;
+        while (block_queue_peek(&analysis_queue, &block)) {
+            /* Blocks left over from a deferred app that has been swapped
+               for an inline one are dropped */
+            demo_instance_t *instance = demo_switch_acquire(&demo_app->demo_switch, DEMO_SWITCH_ANALYSIS_THREAD);
+            if (instance != NULL && instance->deferred) {
+                run_demo_app(demo_app, instance, block.frame_count, tx, block.channels);
+            }
+            demo_switch_release(&demo_app->demo_switch, DEMO_SWITCH_ANALYSIS_THREAD);
+            block_queue_release(&analysis_queue);
         }
     }
 }
 
 static void dropout_cb(void *data)
 {
-    printk("dropout!\n");
+    /* Called on the audio thread. Dropouts are counted by audio_stats
+       and reported from the main loop. */
 }
 
+static void load_cb(void *cb_data, uint32_t busy_cycles, uint32_t deadline_cycles)
+{
+    /* Called on the audio thread. Deferred apps hardly load the audio
+       thread, so the backlog of the analysis thread counts too. It is
+       at least the block just queued, since the analysis thread runs
+       below the audio thread. */
+    demo_app_t *demo_app = (demo_app_t *)cb_data;
+    uint32_t load_permille = (uint32_t)((uint64_t)busy_cycles * 1000 / deadline_cycles);
+    if (demo_app->demo_switch.deferred_analysis && analysis_queue.slot_count > 1) {
+        uint32_t depth = block_queue_depth(&analysis_queue);
+        uint32_t backlog_permille = depth > 1 ? (depth - 1) * 1000 / (analysis_queue.slot_count - 1) : 0;
+        load_permille = MAX(load_permille, backlog_permille);
+    }
+    load_governor_update(load_permille);
+}
+
+static void print_allocator_stats(const allocator_stats_t *stats)
+{
+    printk("demo app arena: %u of %u bytes used (high water mark %u, %u padding, %u unreclaimed), "
+           "%u allocations, %u failed, %u after create\n",
+           (unsigned int)stats->used, (unsigned int)stats->arena_size, (unsigned int)stats->high_water_mark,
+           (unsigned int)stats->alignment_padding, (unsigned int)stats->unreclaimed,
+           (unsigned int)stats->allocation_count, (unsigned int)stats->failed_allocation_count,
+           (unsigned int)stats->locked_allocation_count);
+}
+
+#ifdef CONFIG_TIMING_FUNCTIONS
+/* Times the stages of the demo apps. The DWT cycle counter on the nRF
+   cores, which wraps every minute at 64 MHz, longer than any stage. */
+static uint32_t stage_cycle_counter(void)
+{
+    return (uint32_t)timing_counter_get();
+}
+#endif
+
 void button_callback(int btn_idx) {
     uint8_t msg = 0;
 
@@ -100,74 +308,411 @@ void button_callback(int btn_idx) {
     }
 
     if (msg) {
-        ring_buf_put(&demo_app.msg_rx, &msg, 1);
+        app_event_t event = {
+            .timestamp = (uint32_t)atomic_get(&demo_app.frame_count),
+            .message = msg,
+            .value = 0,
+        };
+        event_queue_push(&demo_app.to_app, &event);
+    }
+}
+
+#ifdef CONFIG_SHELL
+/***********************************************************
+ * Shell commands for switching demos at runtime, e.g
+ *
+ *   demo list
+ *   demo select mpm
+ *   demo params
+ *   demo set min_clarity 0.8
+ ***********************************************************/
+static int cmd_demo_list(const struct shell *sh, size_t argc, char **argv)
+{
+    const demo_app_vtable_t *current = demo_switch_current(&demo_app.demo_switch);
+    for (uint32_t i = 0; i < demo_registry_count(); i++) {
+        const demo_app_vtable_t *vtable = demo_registry_get(i);
+        shell_print(sh, "%c %u %-10s rx 0x%x tx 0x%x, arena budget %u bytes",
+                    vtable == current ? '*' : ' ', (unsigned int)i, vtable->name,
+                    vtable->rx_channel_mask, vtable->tx_channel_mask, (unsigned int)vtable->arena_budget);
+    }
+    return 0;
+}
+
+static int cmd_demo_select(const struct shell *sh, size_t argc, char **argv)
+{
+    const demo_app_vtable_t *vtable = demo_registry_find(argv[1]);
+    if (vtable == NULL) {
+        char *end;
+        unsigned long index = strtoul(argv[1], &end, 10);
+        if (end != argv[1] && *end == '\0') {
+            vtable = demo_registry_get((uint32_t)index);
+        }
+    }
+    if (vtable == NULL) {
+        shell_error(sh, "no demo %s, see demo list", argv[1]);
+        return -EINVAL;
+    }
+
+    uint32_t start_ms = k_uptime_get_32();
+    param_store_reset(&demo_app.params, vtable);
+    int rc = demo_switch_select(&demo_app.demo_switch, vtable);
+    if (rc != 0) {
+        shell_error(sh, "could not create %s, no demo running", vtable->name);
+        return rc;
+    }
+    /* LEDs are owned by the demo */
+    for (int led = 0; led < 4; led++) {
+        set_led_state(led, 0);
+    }
+    allocator_stats_t stats;
+    demo_app_allocator_stats(&stats);
+    shell_print(sh, "running %s after %u ms, arena %u of %u bytes used, %u seamless and %u gapped swaps",
+                vtable->name, (unsigned int)(k_uptime_get_32() - start_ms),
+                (unsigned int)stats.used, (unsigned int)stats.arena_size,
+                (unsigned int)demo_app.demo_switch.seamless_swap_count,
+                (unsigned int)demo_app.demo_switch.gap_swap_count);
+    return 0;
+}
+
+static int cmd_demo_stages(const struct shell *sh, size_t argc, char **argv)
+{
+    demo_stage_stats_t stats[8];
+    uint32_t count = demo_switch_stage_stats(&demo_app.demo_switch, stats, ARRAY_SIZE(stats));
+    if (count == 0) {
+        shell_print(sh, "the running demo has no stages");
+        return 0;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t mean_cycles = stats[i].block_count ? stats[i].total_cycles / stats[i].block_count : 0;
+#ifdef CONFIG_TIMING_FUNCTIONS
+        shell_print(sh, "%-10s %u blocks, mean %u ns, max %u ns, last %u ns",
+                    stats[i].name, (unsigned int)stats[i].block_count,
+                    (unsigned int)timing_cycles_to_ns(mean_cycles),
+                    (unsigned int)timing_cycles_to_ns(stats[i].max_cycles),
+                    (unsigned int)timing_cycles_to_ns(stats[i].last_cycles));
+#else
+        (void)mean_cycles;
+        shell_print(sh, "%-10s %u blocks", stats[i].name, (unsigned int)stats[i].block_count);
+#endif
+    }
+    return 0;
+}
+
+/* Parses a decimal number like -12.5. The minimal libc has no strtof. */
+static bool parse_decimal(const char *text, float *value)
+{
+    const char *c = text;
+    float sign = 1.0f;
+    if (*c == '-' || *c == '+') {
+        sign = *c++ == '-' ? -1.0f : 1.0f;
+    }
+    float result = 0.0f;
+    float scale = 1.0f;
+    bool fraction = false;
+    bool digits = false;
+    for (; *c != '\0'; c++) {
+        if (*c == '.' && !fraction) {
+            fraction = true;
+        } else if (*c >= '0' && *c <= '9') {
+            if (fraction) {
+                scale *= 0.1f;
+                result += (*c - '0') * scale;
+            } else {
+                result = result * 10.0f + (*c - '0');
+            }
+            digits = true;
+        } else {
+            return false;
+        }
+    }
+    *value = sign * result;
+    return digits;
+}
+
+/* printk has no floats without CONFIG_CBPRINTF_FP_SUPPORT, parameter
+   values are printed in thousandths */
+static int thousandths(float value)
+{
+    return (int)(value * 1000.0f + (value < 0.0f ? -0.5f : 0.5f));
+}
+
+static int cmd_demo_params(const struct shell *sh, size_t argc, char **argv)
+{
+    if (demo_switch_current(&demo_app.demo_switch) == NULL) {
+        shell_print(sh, "no demo running");
+        return 0;
     }
+    float value;
+    const demo_param_info_t *param;
+    uint32_t i;
+    for (i = 0; (param = param_store_get(&demo_app.params, i, &value)) != NULL; i++) {
+        shell_print(sh, "%-16s %7d, range %d to %d, default %d%s",
+                    param->name, thousandths(value), thousandths(param->min),
+                    thousandths(param->max), thousandths(param->default_value),
+                    param->ramped ? ", ramped" : "");
+    }
+    if (i == 0) {
+        shell_print(sh, "the running demo has no parameters");
+    } else {
+        shell_print(sh, "values in thousandths");
+    }
+    return 0;
 }
 
+static int cmd_demo_set(const struct shell *sh, size_t argc, char **argv)
+{
+    int index = param_store_find(&demo_app.params, argv[1]);
+    if (index < 0) {
+        shell_error(sh, "no parameter %s, see demo params", argv[1]);
+        return -EINVAL;
+    }
+    float value;
+    if (!parse_decimal(argv[2], &value)) {
+        shell_error(sh, "%s is not a number", argv[2]);
+        return -EINVAL;
+    }
+    param_store_set(&demo_app.params, (uint32_t)index, value);
+    param_store_get(&demo_app.params, (uint32_t)index, &value);
+    shell_print(sh, "%s set to %d thousandths", argv[1], thousandths(value));
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(demo_commands,
+    SHELL_CMD(list, NULL, "List the demos in the image, * marks the running one", cmd_demo_list),
+    SHELL_CMD_ARG(select, NULL, "Switch to a demo, by name or index", cmd_demo_select, 2, 0),
+    SHELL_CMD(stages, NULL, "Time spent in each stage of the running demo", cmd_demo_stages),
+    SHELL_CMD(params, NULL, "List the parameters of the running demo", cmd_demo_params),
+    SHELL_CMD_ARG(set, NULL, "Set a parameter of the running demo: set <name> <value>", cmd_demo_set, 3, 0),
+    SHELL_SUBCMD_SET_END
+);
+SHELL_CMD_REGISTER(demo, &demo_commands, "Demo app selection", NULL);
+#endif
+
 void main(void)
 {
-    /* Determined by NRF_I2S_MCK_32MDIV... and NRF_I2S_RATIO_... */
-    float sample_rate = 44444.444;
+    /* The exact rate of the clock plan, see clock_planner.py */
+    float sample_rate = AUDIO_SAMPLE_RATE;
+
+    /* Create queues for sending events to and from the demo app */
+    event_queue_init(&demo_app.to_app);
+    event_queue_init(&demo_app.from_app);
+    atomic_set(&demo_app.frame_count, 0);
 
     /* LEDs and buttons  */
     init_leds();
     init_buttons(&button_callback);
 
-    /* Create demo app */
-    demo_app.rust_app_ptr = demo_app_create(sample_rate);
-
-    /* Create ring buffers for sending messages to and from the demo app */
-    ring_buf_init(&demo_app.msg_rx, ARRAY_SIZE(demo_app.msg_rx_buffer), demo_app.msg_rx_buffer);
-    ring_buf_init(&demo_app.msg_tx, ARRAY_SIZE(demo_app.msg_tx_buffer), demo_app.msg_tx_buffer);
+    if (demo_registry_abi_version() != DEMO_APP_ABI_VERSION) {
+        printk("microdsp_demos ABI version %u, expected %u\n",
+               (unsigned int)demo_registry_abi_version(), (unsigned int)DEMO_APP_ABI_VERSION);
+        return;
+    }
 
     /* Init audio codec  */
-    wm8904_init();
+    const wm8904_bus_t* codec_bus = wm8904_i2c_bus();
+    if (codec_bus) {
+        int codec_rc = wm8904_init(codec_bus);
+        __ASSERT(codec_rc == 0, "wm8904_init failed");
+        (void)codec_rc;
+    } else {
+        printk("codec i2c bus not ready\n");
+    }
 
-    /* Start I2S  */
+    /* Start I2S. 256 frame periods, double buffered. */
+    i2s_buffer_cfg_t i2s_buffer_cfg = {
+        .period_n_frames = 256,
+        .ring_depth = 2,
+    };
     audio_callbacks_t audio_callbacks = {
         .dropout_cb = dropout_cb,
+        .load_cb = load_cb,
         .processing_cb = processing_cb,
         .cb_data = &demo_app,
     };
-    i2s_start(&i2s_pin_cfg, &audio_callbacks);
+    /* The I2S and the analysis queue run the channels of every demo in the
+       image, so that demos can be swapped without restarting them */
+    uint8_t deferred_rx_channel_mask = 0;
+    for (uint32_t i = 0; i < demo_registry_count(); i++) {
+        const demo_app_vtable_t *vtable = demo_registry_get(i);
+        audio_callbacks.rx_channel_mask |= vtable->rx_channel_mask;
+        audio_callbacks.tx_channel_mask |= vtable->tx_channel_mask;
+        if (vtable->tx_channel_mask == 0) {
+            deferred_rx_channel_mask |= vtable->rx_channel_mask;
+        }
+    }
+    bool deferred_analysis = deferred_rx_channel_mask != 0
+        && block_queue_init(&analysis_queue, i2s_buffer_cfg.period_n_frames, deferred_rx_channel_mask);
+    if (deferred_analysis) {
+        k_thread_create(
+            &analysis_thread_data,
+            analysis_thread_stack_area,
+            K_THREAD_STACK_SIZEOF(analysis_thread_stack_area),
+            analysis_thread_entry_point,
+            &demo_app, NULL, NULL,
+            ANALYSIS_THREAD_PRIORITY, 0, K_NO_WAIT
+        );
+        printk("analysis deferred to a worker thread, %u blocks of buffering\n",
+               (unsigned int)analysis_queue.slot_count);
+    }
+
+#ifdef CONFIG_TIMING_FUNCTIONS
+    timing_init();
+    timing_start();
+    demo_stage_set_cycle_counter(stage_cycle_counter);
+#endif
+
+    load_governor_config_t load_governor_config = LOAD_GOVERNOR_DEFAULT_CONFIG;
+    load_governor_init(&load_governor_config);
+
+    /* Create the demo app */
+    demo_switch_init(&demo_app.demo_switch, sample_rate, deferred_analysis);
+    const demo_app_vtable_t *default_demo = demo_registry_find(DEFAULT_DEMO);
+    if (default_demo == NULL) {
+        default_demo = demo_registry_get(0);
+    }
+    param_store_init(&demo_app.params);
+    param_store_reset(&demo_app.params, default_demo);
+    int select_rc = demo_switch_select(&demo_app.demo_switch, default_demo);
+    __ASSERT(select_rc == 0, "could not create %s", default_demo->name);
+    (void)select_rc;
+    printk("running demo %s, %u in image\n", default_demo->name, (unsigned int)demo_registry_count());
+    allocator_stats_t allocator_stats;
+    demo_app_allocator_stats(&allocator_stats);
+    print_allocator_stats(&allocator_stats);
 
-    /* Main loop. Poll and react to messages from the rust app. */
-    int32_t poll_interval_ms = 10;
+    /* Stream audio to the host, if the board has an audio-tap-uart */
+    audio_tap_running = audio_tap_init(&audio_tap, i2s_buffer_cfg.period_n_frames, (uint32_t)(sample_rate + 0.5f))
+        && audio_tap_uart_start(&audio_tap);
+    if (audio_tap_running) {
+        audio_tap_set_sources(&audio_tap, AUDIO_TAP_SOURCES);
+        printk("audio tap running, sources 0x%02x, %u frames of buffering\n",
+               (unsigned int)AUDIO_TAP_SOURCES, (unsigned int)audio_tap.slot_count);
+    }
+
+    i2s_start(&i2s_pin_cfg, &i2s_buffer_cfg, &audio_callbacks);
+
+    /* Main loop. Wait for and react to events from the rust app. */
+    int32_t stats_poll_interval_ms = 100;
+    uint32_t reported_dropout_count = 0;
+    uint32_t reported_overrun_count = 0;
+    uint32_t reported_tap_dropped_count = 0;
+    uint32_t tap_report_time_ms = 0;
+    uint8_t reported_load_level = DEMO_LOAD_FULL;
     while (1)
     {
-        uint8_t command = 0;
-        while (ring_buf_get(&demo_app.msg_tx, &command, 1) > 0)
+        /* Print audio thread timing stats whenever new dropouts occur. */
+        audio_stats_t stats;
+        audio_stats_snapshot(&stats);
+        if (stats.dropout_count != reported_dropout_count) {
+            if (stats.dropout_count > reported_dropout_count) {
+                printk("dropout!\n");
+                audio_stats_print(&stats);
+            }
+            reported_dropout_count = stats.dropout_count;
+        }
+
+        /* Report changes of the load level. Brief ones between polls
+           are only counted, see the load_governor shell command. */
+        load_governor_stats_t load_stats;
+        load_governor_snapshot(&load_stats);
+        if (load_stats.level != reported_load_level) {
+            printk("load level %u (was %u), %u raises and %u restores so far, max load %u/1000\n",
+                   load_stats.level, reported_load_level, load_stats.raise_count,
+                   load_stats.restore_count, load_stats.max_load_permille);
+            reported_load_level = load_stats.level;
+        }
+
+        /* Report blocks the analysis thread could not keep up with */
+        if (deferred_analysis) {
+            block_queue_stats_t queue_stats;
+            block_queue_stats(&analysis_queue, &queue_stats);
+            if (queue_stats.overrun_count != reported_overrun_count) {
+                printk("analysis overrun! %u of %u blocks (%u frames) dropped, max depth %u of %u\n",
+                       queue_stats.overrun_count, queue_stats.pushed_count + queue_stats.overrun_count,
+                       queue_stats.dropped_frame_count, queue_stats.max_depth,
+                       (unsigned int)analysis_queue.slot_count);
+                reported_overrun_count = queue_stats.overrun_count;
+            }
+        }
+
+        /* Report frames the tap transport could not keep up with. Only
+           once a second, since this can go on for as long as the tap runs. */
+        if (audio_tap_running && k_uptime_get_32() - tap_report_time_ms >= 1000) {
+            audio_tap_stats_t tap_stats;
+            audio_tap_stats(&audio_tap, &tap_stats);
+            if (tap_stats.dropped_count != reported_tap_dropped_count) {
+                printk("audio tap dropped %u of %u frames (%u audio frames), max depth %u of %u, %u bytes sent\n",
+                       tap_stats.dropped_count, tap_stats.pushed_count + tap_stats.dropped_count,
+                       tap_stats.dropped_frame_count, tap_stats.max_depth,
+                       (unsigned int)audio_tap.slot_count, tap_stats.sent_byte_count);
+                reported_tap_dropped_count = tap_stats.dropped_count;
+            }
+            tap_report_time_ms = k_uptime_get_32();
+        }
+
+        /* The demo app should not allocate once it has been created */
+        uint32_t reported_locked_allocation_count = allocator_stats.locked_allocation_count;
+        demo_app_allocator_stats(&allocator_stats);
+        if (allocator_stats.locked_allocation_count != reported_locked_allocation_count) {
+            printk("demo app allocated memory while running!\n");
+            print_allocator_stats(&allocator_stats);
+        }
+
+        app_event_t events[APP_EVENT_BATCH_SIZE];
+        uint32_t event_count;
+        while ((event_count = event_queue_pop(&demo_app.from_app, events, APP_EVENT_BATCH_SIZE)) > 0)
         {
-            switch (command)
+            for (uint32_t i = 0; i < event_count; i++)
             {
-            case Led0On:
-                set_led_state(0, 1);
-                break;
-            case Led0Off:
-                set_led_state(0, 0);
-                break;
-            case Led1On:
-                set_led_state(1, 1);
-                break;
-            case Led1Off:
-                set_led_state(1, 0);
-                break;
-            case Led2On:
-                set_led_state(2, 1);
-                break;
-            case Led2Off:
-                set_led_state(2, 0);
-                break;
-            case Led3On:
-                set_led_state(3, 1);
-                break;
-            case Led3Off:
-                set_led_state(3, 0);
-                break;
-            default:
-                break;
+                app_event_t *event = &events[i];
+                switch (event->message)
+                {
+                case Led0On:
+                    set_led_state(0, 1);
+                    break;
+                case Led0Off:
+                    set_led_state(0, 0);
+                    break;
+                case Led1On:
+                    set_led_state(1, 1);
+                    break;
+                case Led1Off:
+                    set_led_state(1, 0);
+                    break;
+                case Led2On:
+                    set_led_state(2, 1);
+                    break;
+                case Led2Off:
+                    set_led_state(2, 0);
+                    break;
+                case Led3On:
+                    set_led_state(3, 1);
+                    break;
+                case Led3Off:
+                    set_led_state(3, 0);
+                    break;
+                case PitchDetected:
+                    printk("%u: pitch %d Hz\n", (unsigned int)event->timestamp, (int)event->value);
+                    break;
+                case NoveltyDetected:
+                    printk("%u: novelty %d/1000\n", (unsigned int)event->timestamp, (int)(1000 * event->value));
+                    break;
+                case FilterModeChanged:
+                    printk("%u: filter mode %d\n", (unsigned int)event->timestamp, (int)event->value);
+                    break;
+                case DelayEstimated:
+                    printk("%u: echo delay %d samples\n", (unsigned int)event->timestamp, (int)event->value);
+                    break;
+                case AdaptationSkipped:
+                    printk("%u: filter adaptation skipped in %d/1000 blocks\n", (unsigned int)event->timestamp, (int)(1000 * event->value));
+                    break;
+                default:
+                    break;
+                }
             }
         }
-        k_msleep(poll_interval_ms);
+
+        /* Sleep until more events arrive, waking up now and then to check the stats */
+        k_sem_take(&app_event_semaphore, K_MSEC(stats_poll_interval_ms));
     }
 }
@@ -0,0 +1,112 @@
+#include "param_store.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#define PARAM_STORE_FRESH 0x4
+#define PARAM_STORE_INDEX_MASK 0x3
+
+void param_store_init(param_store_t* store)
+{
+    memset(store->sets, 0, sizeof(store->sets));
+    /* Set 0 is published, 1 is the shadow and 2 the active one */
+    atomic_set(&store->published, 0);
+    store->shadow = 1;
+    store->active = 2;
+    memset(&store->master, 0, sizeof(store->master));
+    store->params = NULL;
+    k_mutex_init(&store->mutex);
+}
+
+static uint32_t param_count(const demo_app_vtable_t* owner)
+{
+    if (owner == NULL
+        || owner->size < offsetof(demo_app_vtable_t, set_params) + sizeof(owner->set_params)
+        || owner->param_count > DEMO_MAX_PARAMS) {
+        return 0;
+    }
+    return owner->param_count;
+}
+
+/* Copies the master values to the shadow set and publishes it. The
+   reader never touches the shadow set, so it can be written without
+   further synchronization. */
+static void publish(param_store_t* store)
+{
+    store->master.generation++;
+    store->sets[store->shadow] = store->master;
+    atomic_val_t previous = atomic_set(&store->published, store->shadow | PARAM_STORE_FRESH);
+    store->shadow = previous & PARAM_STORE_INDEX_MASK;
+}
+
+void param_store_reset(param_store_t* store, const demo_app_vtable_t* owner)
+{
+    k_mutex_lock(&store->mutex, K_FOREVER);
+    uint32_t count = param_count(owner);
+    store->master.owner = owner;
+    store->master.count = count;
+    store->params = count ? owner->params : NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        store->master.values[i] = store->params[i].default_value;
+    }
+    publish(store);
+    k_mutex_unlock(&store->mutex);
+}
+
+static float clamp(const demo_param_info_t* param, float value)
+{
+    /* Also maps NaN to min, like the apps do */
+    if (!(value >= param->min)) {
+        return param->min;
+    }
+    return value > param->max ? param->max : value;
+}
+
+int param_store_set(param_store_t* store, uint32_t index, float value)
+{
+    k_mutex_lock(&store->mutex, K_FOREVER);
+    if (index >= store->master.count) {
+        k_mutex_unlock(&store->mutex);
+        return -EINVAL;
+    }
+    store->master.values[index] = clamp(&store->params[index], value);
+    publish(store);
+    k_mutex_unlock(&store->mutex);
+    return 0;
+}
+
+const demo_param_info_t* param_store_get(param_store_t* store, uint32_t index, float* value)
+{
+    k_mutex_lock(&store->mutex, K_FOREVER);
+    const demo_param_info_t* param = NULL;
+    if (index < store->master.count) {
+        *value = store->master.values[index];
+        param = &store->params[index];
+    }
+    k_mutex_unlock(&store->mutex);
+    return param;
+}
+
+int param_store_find(param_store_t* store, const char* name)
+{
+    k_mutex_lock(&store->mutex, K_FOREVER);
+    int index = -1;
+    for (uint32_t i = 0; i < store->master.count; i++) {
+        if (strcmp(store->params[i].name, name) == 0) {
+            index = (int)i;
+            break;
+        }
+    }
+    k_mutex_unlock(&store->mutex);
+    return index;
+}
+
+const param_set_t* param_store_take(param_store_t* store)
+{
+    if (atomic_get(&store->published) & PARAM_STORE_FRESH) {
+        atomic_val_t previous = atomic_set(&store->published, store->active);
+        store->active = previous & PARAM_STORE_INDEX_MASK;
+    }
+    return &store->sets[store->active];
+}
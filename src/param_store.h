@@ -0,0 +1,69 @@
+#ifndef PARAM_STORE_H
+#define PARAM_STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/zephyr.h>
+#include <microdsp_demos/microdsp_demos.h>
+
+/* Values of the tunable parameters of the running demo app, see
+   demo_param_info_t, handed from control threads, e.g the shell, to the
+   thread running the app without either of them waiting for the other.
+
+   The store is a triple buffer. Writers fill the shadow set and publish
+   it by swapping its index with the published one, the thread running
+   the app swaps the published set with its active one at the start of a
+   block, if a new one was published since. Each side only ever touches
+   the sets it owns, so the app never sees a half written set, and gets
+   the latest one after at most a block. There is a single reader: only
+   one thread runs an app at a time, see demo_switch.h. */
+
+#define PARAM_STORE_SET_COUNT 3
+
+typedef struct {
+    /* The vtable of the app the values are for, NULL for none */
+    const demo_app_vtable_t* owner;
+    /* Incremented on every publish, so apps can skip sets they applied */
+    uint32_t generation;
+    uint32_t count;
+    float values[DEMO_MAX_PARAMS];
+} param_set_t;
+
+typedef struct {
+    param_set_t sets[PARAM_STORE_SET_COUNT];
+    /* Index of the last published set, with PARAM_STORE_FRESH set until
+       the reader took it */
+    atomic_t published;
+    /* Owned by the writers */
+    uint32_t shadow;
+    param_set_t master;
+    const demo_param_info_t* params;
+    /* Owned by the reader */
+    uint32_t active;
+    /* Serializes writers */
+    struct k_mutex mutex;
+} param_store_t;
+
+void param_store_init(param_store_t* store);
+
+/* Control threads. Publishes the default values of the parameters of
+   owner. Call before creating its app, so that values set for an earlier
+   app of the same demo are never applied to the new one. */
+void param_store_reset(param_store_t* store, const demo_app_vtable_t* owner);
+
+/* Control threads. Sets a parameter, clamped to its range, and publishes
+   all values. Returns 0, or -EINVAL if there is no such parameter. */
+int param_store_set(param_store_t* store, uint32_t index, float value);
+
+/* Control threads. Returns the description of a parameter and stores its
+   value, or returns NULL if there is no such parameter. */
+const demo_param_info_t* param_store_get(param_store_t* store, uint32_t index, float* value);
+
+/* Index of the parameter called name, -1 if there is none */
+int param_store_find(param_store_t* store, const char* name);
+
+/* The thread running the app. Returns the latest published set, which
+   stays valid until the next call. */
+const param_set_t* param_store_take(param_store_t* store);
+
+#endif
@@ -0,0 +1,136 @@
+#include "pcm_convert.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__ARM_FP) && (__ARM_FP & 4)
+/* Cores with a single precision FPU (Cortex-M4F, M33F) can convert between
+   float and fixed point in a single VCVT instruction. Converting to fixed
+   point rounds towards zero and saturates, so no explicit clamping is
+   needed, whether clamp is set or not. The results are bit identical to
+   the reference conversions in pcm_convert.h. */
+static inline float sample_to_float(int32_t sample)
+{
+    float result;
+    __asm__ ("vmov %0, %1\n\t"
+             "vcvt.f32.s32 %0, %0, #23"
+             : "=t"(result) : "r"(sample));
+    return result;
+}
+
+static inline int32_t sample_from_float(float sample, bool clamp)
+{
+    int32_t q31;
+    __asm__ ("vcvt.s32.f32 %1, %1, #31\n\t"
+             "vmov %0, %1"
+             : "=r"(q31), "+t"(sample));
+    return q31 >> 8;
+}
+
+/* Every block takes the loops without clamping */
+static inline bool in_range(const float* samples, unsigned int frame_count)
+{
+    return true;
+}
+#else
+static inline float sample_to_float(int32_t sample)
+{
+    return pcm_sample_to_float(sample);
+}
+
+/* Same result as pcm_sample_from_float. Samples in (-1, 1) need no
+   clamping. Otherwise, clamping uses selects instead of branches, and to
+   the largest float below 1, which gives the same Q23 value as saturating
+   at INT32_MAX. The selects take about two thirds of the time of the block
+   loops below, so they are only used for blocks that need them. */
+static inline int32_t sample_from_float(float sample, bool clamp)
+{
+    if (clamp) {
+        float clamped = sample > -1.0f ? sample : -1.0f;
+        clamped = clamped < 0.99999994f ? clamped : 0.99999994f;
+        sample = sample == sample ? clamped : 0.0f;
+    }
+    return (int32_t)(sample * 2147483648.0f) >> 8;
+}
+
+/* True if all samples are in (-1, 1). The magnitude bits of a float order
+   like an integer, with infinities and NaN above 1.0f, so a sample is in
+   range exactly if its magnitude minus the bits of 1.0f is negative. */
+static inline bool in_range(const float* samples, unsigned int frame_count)
+{
+    int32_t all_negative = -1;
+    #pragma GCC unroll 4
+    for (size_t i = 0; i < frame_count; i++) {
+        int32_t bits;
+        memcpy(&bits, &samples[i], sizeof(bits));
+        all_negative &= (bits & INT32_MAX) - 0x3f800000;
+    }
+    return all_negative < 0;
+}
+#endif
+
+/* The loops are unrolled for the in-order Cortex-M pipeline. */
+
+static void deinterleave_channel(const int32_t* pcm, unsigned int frame_count, float* channel)
+{
+    #pragma GCC unroll 4
+    for (size_t i = 0; i < frame_count; i++) {
+        channel[i] = sample_to_float(pcm[2 * i]);
+    }
+}
+
+void pcm_deinterleave_to_float(const int32_t* pcm, unsigned int frame_count, float* left, float* right)
+{
+    if (left && right) {
+        #pragma GCC unroll 4
+        for (size_t i = 0; i < frame_count; i++) {
+            left[i] = sample_to_float(pcm[2 * i]);
+            right[i] = sample_to_float(pcm[2 * i + 1]);
+        }
+    } else if (left) {
+        deinterleave_channel(pcm, frame_count, left);
+    } else if (right) {
+        deinterleave_channel(pcm + 1, frame_count, right);
+    }
+}
+
+/* Called with a constant clamp, so that each call gets its own loop */
+static inline void interleave_stereo(int32_t* pcm, unsigned int frame_count, const float* left, const float* right, bool clamp)
+{
+    #pragma GCC unroll 4
+    for (size_t i = 0; i < frame_count; i++) {
+        pcm[2 * i] = sample_from_float(left[i], clamp);
+        pcm[2 * i + 1] = sample_from_float(right[i], clamp);
+    }
+}
+
+static inline void interleave_mono(int32_t* pcm, unsigned int frame_count, const float* mono, bool clamp)
+{
+    #pragma GCC unroll 4
+    for (size_t i = 0; i < frame_count; i++) {
+        int32_t sample = sample_from_float(mono[i], clamp);
+        pcm[2 * i] = sample;
+        pcm[2 * i + 1] = sample;
+    }
+}
+
+void pcm_interleave_from_float(int32_t* pcm, unsigned int frame_count, const float* left, const float* right)
+{
+    if (left && right) {
+        if (in_range(left, frame_count) && in_range(right, frame_count)) {
+            interleave_stereo(pcm, frame_count, left, right, false);
+        } else {
+            interleave_stereo(pcm, frame_count, left, right, true);
+        }
+    } else if (left || right) {
+        const float* mono = left ? left : right;
+        if (in_range(mono, frame_count)) {
+            interleave_mono(pcm, frame_count, mono, false);
+        } else {
+            interleave_mono(pcm, frame_count, mono, true);
+        }
+    } else {
+        memset(pcm, 0, 2 * frame_count * sizeof(int32_t));
+    }
+}
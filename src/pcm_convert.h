@@ -0,0 +1,47 @@
+#ifndef PCM_CONVERT_H
+#define PCM_CONVERT_H
+
+#include <stdint.h>
+
+/* Block conversion between the interleaved stereo PCM words used by
+   the I2S DMA buffers and planar float buffers. PCM samples are 24 bit,
+   sign extended to 32 bit words, i.e Q23. Float samples are in [-1, 1). */
+
+#define PCM_FULL_SCALE 8388608.0f /* 2^23 */
+
+/* Reference conversion of a single PCM sample to float. Exact, since
+   every 24 bit integer is representable as a float. */
+static inline float pcm_sample_to_float(int32_t sample)
+{
+    return (float)sample * (1.0f / PCM_FULL_SCALE);
+}
+
+/* Reference conversion of a single float sample to PCM. Values outside
+   [-1, 1) saturate and NaN maps to 0. The value is truncated towards zero
+   to Q31 and then shifted down to Q23, matching the saturating fixed point
+   VCVT instruction used on Arm cores with an FPU. */
+static inline int32_t pcm_sample_from_float(float sample)
+{
+    int32_t q31;
+    if (sample >= 1.0f) {
+        q31 = INT32_MAX;
+    } else if (sample > -1.0f) {
+        q31 = (int32_t)(sample * 2147483648.0f);
+    } else if (sample <= -1.0f) {
+        q31 = INT32_MIN;
+    } else {
+        q31 = 0;
+    }
+    return q31 >> 8;
+}
+
+/* Converts frame_count interleaved stereo PCM frames to planar float.
+   left and/or right may be NULL, in which case that channel is skipped. */
+void pcm_deinterleave_to_float(const int32_t* pcm, unsigned int frame_count, float* left, float* right);
+
+/* Converts planar float to frame_count interleaved stereo PCM frames,
+   with saturation. If one of left and right is NULL, the other channel
+   is written to both PCM channels. If both are NULL, silence is written. */
+void pcm_interleave_from_float(int32_t* pcm, unsigned int frame_count, const float* left, const float* right);
+
+#endif
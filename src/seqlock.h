@@ -0,0 +1,49 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdbool.h>
+#include <string.h>
+#include <zephyr/zephyr.h>
+
+/* Sequence lock for stats that are updated by one thread and copied by
+   others without blocking the writer. The sequence is incremented before
+   and after each update, i.e it is odd while an update is in progress.
+   Readers retry if it changed during their copy.
+
+   There is a single core, so a copy only sees a change if the writer
+   preempted the reader. Readers must not have a higher priority than the
+   writer, or they could preempt it halfway through an update and spin
+   until it gets to run again. */
+typedef struct {
+    atomic_t sequence;
+} seqlock_t;
+
+#define SEQLOCK_INIT { ATOMIC_INIT(0) }
+
+static inline void seqlock_write_begin(seqlock_t* lock)
+{
+    atomic_inc(&lock->sequence);
+}
+
+static inline void seqlock_write_end(seqlock_t* lock)
+{
+    atomic_inc(&lock->sequence);
+}
+
+/* Copies size bytes of the data guarded by lock from data to result */
+static inline void seqlock_read(seqlock_t* lock, void* result, const void* data, size_t size)
+{
+    while (true) {
+        atomic_val_t sequence = atomic_get(&lock->sequence);
+        if ((sequence & 1) == 0) {
+            memcpy(result, data, size);
+            if (atomic_get(&lock->sequence) == sequence) {
+                return;
+            }
+        }
+        /* The writer preempted the copy. Try again. */
+        k_yield();
+    }
+}
+
+#endif